@@ -1918,7 +1918,7 @@ class IfcImporter:
                 mesh.from_pydata(vertices, edges, [])
 
             mesh["ios_materials"] = [int(m.name.split("-")[2]) for m in geometry.materials]
-            mesh["ios_material_ids"] = geometry.material_ids
+            mesh["ios_material_ids"] = geometry.material_ids.tolist()
             return mesh
         except:
             self.ifc_import_settings.logger.error("Could not create mesh for %s", element)
@@ -34,6 +34,7 @@
 #include "../serializers/WavefrontObjSerializer.h"
 #include "../serializers/XmlSerializer.h"
 #include "../serializers/SvgSerializer.h"
+#include "../serializers/serialization_pipeline.h"
 
 #include "../ifcgeom_schema_agnostic/IfcGeomFilter.h"
 #include "../ifcgeom_schema_agnostic/IfcGeomIterator.h"
@@ -53,6 +54,7 @@
 #include <fstream>
 #include <sstream>
 #include <set>
+#include <atomic>
 #include <time.h>
 
 #if USE_VLD
@@ -66,6 +68,8 @@
 
 #include <random>
 #include <thread>
+#include <chrono>
+#include <iomanip>
 
 #if defined(_MSC_VER) && defined(_UNICODE)
 typedef std::wstring path_t;
@@ -148,8 +152,9 @@ bool file_exists(const std::string& filename) {
 
 static std::basic_stringstream<path_t::value_type> log_stream;
 void write_log(bool);
-void fix_quantities(IfcParse::IfcFile&, bool, bool, bool);
+void fix_quantities(IfcParse::IfcFile&, bool, bool, bool, int);
 std::string format_duration(time_t start, time_t end);
+void extend_bounds(const IfcGeom::TriangulationElement*, gp_XYZ&, gp_XYZ&);
 
 /// @todo make the filters non-global
 IfcGeom::entity_filter entity_filter; // Entity filter is used always by default.
@@ -202,6 +207,7 @@ int main(int argc, char** argv) {
 #endif
 
 	double deflection_tolerance, angular_tolerance, force_space_transparency;
+	std::vector<double> lod_deflection_tolerances;
 	inclusion_filter include_filter;
 	inclusion_traverse_filter include_traverse_filter;
 	exclusion_filter exclude_filter;
@@ -222,6 +228,8 @@ int main(int argc, char** argv) {
 		("quiet,q", "less status and progress output")
 #ifdef WITH_HDF5
 		("cache", "cache geometry creation. Use --cache-file to specify cache file path.")
+		("cache-by-content", "key the geometry cache on the content of representations, placements and "
+			"openings rather than on GlobalId, so that the cache can be reused for other revisions of a model.")
 #endif
 		("stderr-progress", "output progress to stderr stream")
 		("yes,y", "answer 'yes' automatically to possible confirmation queries (e.g. overwriting an existing output file)")
@@ -247,12 +255,23 @@ int main(int argc, char** argv) {
 			"based on an interpretation of the geometry when exporting IFC");
 
 	int num_threads;
+	double element_timeout, element_memory_limit;
 	std::string offset_str, rotation_str;
     
 	po::options_description geom_options("Geometry options");
 	geom_options.add_options()
 		("threads,j", po::value<int>(&num_threads)->default_value(1),
-			"Number of parallel processing threads for geometry interpretation.")
+			"Number of parallel processing threads for geometry interpretation, "
+			"SVG drawings and --calculate-quantities.")
+		("element-timeout", po::value<double>(&element_timeout)->default_value(0.),
+			"Aborts the conversion of an element after the specified number of seconds. "
+			"The element is logged and skipped, unless --budget-fallback is specified.")
+		("element-memory-limit", po::value<double>(&element_memory_limit)->default_value(0.),
+			"Aborts the conversion of an element when the memory in use grows by more than "
+			"the specified number of megabytes. Approximate when using multiple threads.")
+		("budget-fallback",
+			"Retries elements that exceed --element-timeout or --element-memory-limit "
+			"without subtracting openings.")
 		("plan",
 			"Specifies whether to include curves in the output result. Typically "
 			"these are representations of type Plan or Axis. Excluded by default.")
@@ -283,7 +302,9 @@ int main(int argc, char** argv) {
             "Centers the elements by applying the center point of all placements as an offset."
             "Can take several minutes on large models.")
 		("center-model-geometry",
-            "Centers the elements by applying the center point of all mesh vertices as an offset.")
+            "Centers the elements by applying the center point of all mesh vertices as an offset. "
+            "For DAE and glTF output without --use-world-coords the bounds are computed while writing "
+            "and the offset is applied to the node placements, otherwise the geometry is converted twice.")
         ("model-offset", po::value<std::string>(&offset_str),
             "Applies an arbitrary offset of form 'x;y;z' to all placements.")
 		("model-rotation", po::value<std::string>(&rotation_str),
@@ -307,6 +328,10 @@ int main(int argc, char** argv) {
 			"such as clippings by means of IfcBooleanResult and subtypes")
 		("no-2d-boolean",
 			"Do not attempt to process boolean subtractions in 2D.")
+		("mesh-boolean",
+			"Perform boolean subtractions on triangulated operands (experimental). The "
+			"result is approximate and consists of planar faces only. Operands that do "
+			"not triangulate into closed meshes are processed as usual.")
 		("enable-layerset-slicing",
 			"Specifies whether to enable the slicing of products according "
 			"to their associated IfcMaterialLayerSet.")
@@ -348,6 +373,17 @@ int main(int argc, char** argv) {
 			"Overrides transparency of spaces in geometry output.")
 		("angular-tolerance", po::value<double>(&angular_tolerance)->default_value(0.5),
 			"Sets the angular tolerance of the mesher in radians 0.5 by default if not specified.")
+		("lod-deflection-tolerance", po::value<std::vector<double>>(&lod_deflection_tolerances)->multitoken(),
+			"Additionally triangulates every element at the specified, coarser, deflection "
+			"tolerances, from the same BRep. Written as MSFT_lod levels of detail by the glTF "
+			"serializer, ignored by other serializers.")
+		("relative-deflection",
+			"Interprets --deflection-tolerance and --lod-deflection-tolerance as fractions "
+			"of the bounding box diagonal of every element.")
+		("triangulate-planar-faces",
+			"Triangulates elements of which all faces are planar and bounded by straight "
+			"edges, such as extrusions of polygonal profiles, by ear clipping the faces "
+			"instead of by the mesher of Open Cascade.")
 		("generate-uvs",
 			"Generates UVs (texture coordinates) by using simple box projection. Requires normals. "
 			"Not guaranteed to work properly if used with --weld-vertices.")
@@ -415,6 +451,10 @@ int main(int argc, char** argv) {
 			"Always enable hidden line rendering instead of only on elevations")
 		("svg-without-storeys", "Don't emit drawings for building storeys")
 		("svg-no-css", "Don't emit CSS style declarations")
+		("svg-mesh-section",
+			"Cuts elements by slicing their triangulation, which is much faster than "
+			"the exact section for large floor plans. The triangulation is controlled "
+			"by --deflection-tolerance and --angular-tolerance")
 		("door-arcs", "Draw door openings arcs for IfcDoor elements")
 		("section-height", po::value<double>(&section_height),
 		    "Specifies the cut section height for SVG 2D geometry.")
@@ -436,10 +476,18 @@ int main(int argc, char** argv) {
 		("use-element-hierarchy",
 			"Order the elements using their IfcBuildingStorey parent. "
 			"Applicable for DAE output.")
+		("dae-streaming",
+			"Writes the geometry of DAE output as elements are processed, so that "
+			"memory usage does not depend on the size of the model.")
 		("site-local-placement",
 			"Place elements locally in the IfcSite coordinate system, instead of placing "
 			"them in the IFC global coords. Applicable for OBJ, DAE, and STP output.")
 		("y-up", "Change the 'up' axis to positive Y, default is Z UP, Applicable for OBJ output.")
+		("gltf-quantize", "Store positions and normals as integers using the KHR_mesh_quantization "
+			"extension. Reduces file size at a precision of 1/65534th of the element dimensions. "
+			"Applicable for GLB output.")
+		("gltf-meshopt", "Compress vertex and index data using the EXT_meshopt_compression extension. "
+			"Best combined with --gltf-quantize. Applicable for GLB output.")
 		("building-local-placement",
 			"Similar to --site-local-placement, but placing elements in locally in the parent IfcBuilding coord system")
         ("precision", po::value<short>(&precision)->default_value(SerializerSettings::DEFAULT_PRECISION),
@@ -739,7 +787,7 @@ int main(int argc, char** argv) {
 				std::ofstream fs(output_filename.c_str());
 				if (fs.is_open()) {
 					if (vmap.count("calculate-quantities")) {
-						fix_quantities(*ifc_file, no_progress, quiet, stderr_progress);
+						fix_quantities(*ifc_file, no_progress, quiet, stderr_progress, num_threads);
 					}
 					fs << *ifc_file;
 					exit_code = EXIT_SUCCESS;
@@ -820,16 +868,26 @@ int main(int argc, char** argv) {
 	settings.set(IfcGeom::IteratorSettings::NO_WIRE_INTERSECTION_TOLERANCE, no_wire_intersection_tolerance);
 	settings.set(IfcGeom::IteratorSettings::STRICT_TOLERANCE, strict_tolerance);
 	settings.set(IfcGeom::IteratorSettings::BOOLEAN_ATTEMPT_2D, !vmap.count("no-2d-boolean"));	
+	settings.set(IfcGeom::IteratorSettings::MESH_BOOLEAN, vmap.count("mesh-boolean") != 0);
+	settings.set(IfcGeom::IteratorSettings::CACHE_BY_CONTENT, vmap.count("cache-by-content") != 0);
 
     settings.set(SerializerSettings::USE_ELEMENT_NAMES, use_element_names);
     settings.set(SerializerSettings::USE_ELEMENT_GUIDS, use_element_guids);
 	settings.set(SerializerSettings::USE_Y_UP, use_y_up);
+	settings.set(SerializerSettings::GLTF_QUANTIZE, vmap.count("gltf-quantize") != 0);
+	settings.set(SerializerSettings::GLTF_MESHOPT_COMPRESSION, vmap.count("gltf-meshopt") != 0);
 	settings.set(SerializerSettings::USE_ELEMENT_STEPIDS, use_element_stepids);
 	settings.set(SerializerSettings::USE_MATERIAL_NAMES, use_material_names);
 	settings.set(SerializerSettings::USE_ELEMENT_TYPES, use_element_types);
 	settings.set(SerializerSettings::USE_ELEMENT_HIERARCHY, use_element_hierarchy);
     settings.set_deflection_tolerance(deflection_tolerance);
 	settings.set_angular_tolerance(angular_tolerance);
+	settings.set_lod_deflection_tolerances(lod_deflection_tolerances);
+	settings.set(IfcGeom::IteratorSettings::RELATIVE_DEFLECTION, vmap.count("relative-deflection") != 0);
+	settings.set(IfcGeom::IteratorSettings::TRIANGULATE_PLANAR_FACES, vmap.count("triangulate-planar-faces") != 0);
+	settings.set_element_timeout(element_timeout);
+	settings.set_element_memory_limit((size_t) (element_memory_limit * 1024. * 1024.));
+	settings.set(IfcGeom::IteratorSettings::BUDGET_FALLBACK, vmap.count("budget-fallback") != 0);
 	settings.precision = precision;
 
 	if (vmap.count("force-space-transparency")) {
@@ -845,6 +903,9 @@ int main(int argc, char** argv) {
 #ifdef WITH_OPENCOLLADA
 	} else if (output_extension == DAE) {
 		serializer = boost::make_shared<ColladaSerializer>(IfcUtil::path::to_utf8(output_temp_filename), settings);
+		if (vmap.count("dae-streaming")) {
+			static_cast<ColladaSerializer*>(serializer.get())->setStreaming(true);
+		}
 #endif
 #ifdef WITH_GLTF
 	} else if (output_extension == GLB) {
@@ -941,6 +1002,15 @@ int main(int argc, char** argv) {
 		Logger::Notice(msg.str());
 	}
 	
+	// When the serializer can apply the offset after the fact, the exact bounds are
+	// accumulated in the conversion loop below instead of converting the model twice.
+	const bool defer_offset = is_tesselated && center_model_geometry && serializer->supportsDeferredOffset();
+	gp_XYZ bounds_min, bounds_max;
+	for (int i = 1; i < 4; ++i) {
+		bounds_min.SetCoord(i, std::numeric_limits<double>::infinity());
+		bounds_max.SetCoord(i, -std::numeric_limits<double>::infinity());
+	}
+
     if (is_tesselated && (center_model || center_model_geometry || model_offset)) {
 		std::array<double, 3> &offset = settings.offset;
 		if (center_model || center_model_geometry) {
@@ -948,7 +1018,10 @@ int main(int argc, char** argv) {
 				Logger::Error("Cannot use --center-model or --center-model-geometry together with --{site,building}-local-placement");
 				return EXIT_FAILURE;
 			}
-
+		}
+		if (defer_offset) {
+			Logger::Notice("Computing bounds during conversion, the model offset is applied to the node placements");
+		} else if (center_model || center_model_geometry) {
 			IfcGeom::Iterator tmp_context_iterator(settings, ifc_file, filter_funcs, num_threads);
 			
 			time_t start, end;
@@ -985,16 +1058,18 @@ int main(int argc, char** argv) {
             }
         }
 
-        std::stringstream msg;
-        msg << std::setprecision (std::numeric_limits< double >::max_digits10) << "Using model offset (" << offset[0] << "," << offset[1] << "," << offset[2] << ")";
-        Logger::Notice(msg.str());
+        if (!defer_offset) {
+            std::stringstream msg;
+            msg << std::setprecision (std::numeric_limits< double >::max_digits10) << "Using model offset (" << offset[0] << "," << offset[1] << "," << offset[2] << ")";
+            Logger::Notice(msg.str());
+        }
     }
 
 	IfcGeom::Iterator context_iterator(settings, ifc_file, filter_funcs, num_threads);
 
 #ifdef WITH_HDF5
 	std::unique_ptr<HdfSerializer> cache;
-	if (vmap.count("cache-file") || vmap.count("cache")) {
+	if (vmap.count("cache-file") || vmap.count("cache") || vmap.count("cache-by-content")) {
 		if (!vmap.count("cache-file")) {
 			cache_file = input_filename + CACHE + HDF;
 		}
@@ -1074,6 +1149,8 @@ int main(int argc, char** argv) {
 		static_cast<SvgSerializer*>(serializer.get())->setAlwaysProject(vmap.count("svg-project") > 0);
 		static_cast<SvgSerializer*>(serializer.get())->setWithoutStoreys(vmap.count("svg-without-storeys") > 0);
 		static_cast<SvgSerializer*>(serializer.get())->setNoCSS(vmap.count("svg-no-css") > 0);
+		static_cast<SvgSerializer*>(serializer.get())->setMeshSection(vmap.count("svg-mesh-section") > 0);
+		static_cast<SvgSerializer*>(serializer.get())->setNumThreads(num_threads);
 		if (relative_center_x && relative_center_y) {
 			static_cast<SvgSerializer*>(serializer.get())->setDrawingCenter(*relative_center_x, *relative_center_y);
 		}
@@ -1097,6 +1174,14 @@ int main(int argc, char** argv) {
 
 	serializer->writeHeader();
 
+	// The elements of a multithreaded iterator remain valid until it is destroyed, so
+	// that formatting the output can be done by a pool of threads and this thread only
+	// hands out the elements.
+	std::unique_ptr<serialization_pipeline> pipeline;
+	if (is_tesselated && num_threads != 1 && serializer->supportsEncoding()) {
+		pipeline.reset(new serialization_pipeline(*serializer, num_threads));
+	}
+
 	int old_progress = quiet ? 0 : -1;
 
 	if (!quiet) {
@@ -1121,7 +1206,19 @@ int main(int argc, char** argv) {
 
 		if (is_tesselated)
 		{
-			serializer->write(static_cast<const IfcGeom::TriangulationElement*>(geom_object));
+			if (pipeline) {
+				try {
+					pipeline->push(static_cast<const IfcGeom::TriangulationElement*>(geom_object));
+				} catch (const std::exception&) {
+					// Reported when finishing the pipeline below
+					break;
+				}
+			} else {
+				serializer->write(static_cast<const IfcGeom::TriangulationElement*>(geom_object));
+			}
+			if (defer_offset) {
+				extend_bounds(static_cast<const IfcGeom::TriangulationElement*>(geom_object), bounds_min, bounds_max);
+			}
 		}
 		else
 		{
@@ -1166,6 +1263,32 @@ int main(int argc, char** argv) {
 			" objects)                                ");
 	}
 
+	if (pipeline) {
+		bool written = true;
+		try {
+			pipeline->finish();
+		} catch (const std::exception& e) {
+			Logger::Error(e);
+			written = false;
+		}
+		pipeline.reset();
+		if (!written) {
+			serializer.reset();
+			IfcUtil::path::delete_file(IfcUtil::path::to_utf8(output_temp_filename));
+			write_log(!quiet);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (defer_offset) {
+		const gp_XYZ center = (bounds_min + bounds_max) * 0.5;
+		const std::array<double, 3> offset = { { -center.X(), -center.Y(), -center.Z() } };
+		std::stringstream msg;
+		msg << std::setprecision(std::numeric_limits< double >::max_digits10) << "Using model offset (" << offset[0] << "," << offset[1] << "," << offset[2] << ")";
+		Logger::Notice(msg.str());
+		serializer->setDeferredOffset(offset);
+	}
+
     serializer->finalize();
     // Make sure the dtor is explicitly run here (e.g. output files are closed before renaming them).
     serializer.reset();
@@ -1220,6 +1343,23 @@ std::string format_duration(time_t start, time_t end)
     return ss.str();
 }
 
+/// Extends the bounds with the vertices of the element in the coordinate system of
+/// the output, i.e. with the (unit converted) element transformation applied.
+void extend_bounds(const IfcGeom::TriangulationElement* o, gp_XYZ& lower, gp_XYZ& upper) {
+	const std::vector<double>& m = o->transformation().matrix().data();
+	const std::vector<double>& verts = o->geometry().verts();
+	for (std::vector<double>::const_iterator it = verts.begin(); it != verts.end();) {
+		const double x = *(it++);
+		const double y = *(it++);
+		const double z = *(it++);
+		for (int i = 0; i < 3; ++i) {
+			const double v = m[i] * x + m[3 + i] * y + m[6 + i] * z + m[9 + i];
+			lower.SetCoord(i + 1, std::min(lower.Coord(i + 1), v));
+			upper.SetCoord(i + 1, std::max(upper.Coord(i + 1), v));
+		}
+	}
+}
+
 void write_log(bool header) {
 	path_t log = log_stream.str();
 	if (!log.empty()) {
@@ -1239,6 +1379,7 @@ bool init_input_file(const std::string& filename, IfcParse::IfcFile*& ifc_file,
     if (no_progress) { Logger::SetOutput(NULL, &log_stream); }
 
     time(&start);
+    auto parse_start = std::chrono::steady_clock::now();
 
 #ifdef WITH_IFCXML
 	if (boost::ends_with(boost::to_lower_copy(filename), ".ifcxml")) {
@@ -1260,9 +1401,18 @@ bool init_input_file(const std::string& filename, IfcParse::IfcFile*& ifc_file,
         return false;
     }
     time(&end);
+    std::chrono::duration<double> parse_duration = std::chrono::steady_clock::now() - parse_start;
+
+    // Throughput in MB/s, to compare the parsing of SPF and ifcXML files
+    std::ifstream input_stream(IfcUtil::path::from_utf8(filename).c_str(), std::ios::binary | std::ios::ate);
+    const double megabytes = (double) input_stream.tellg() / (1024. * 1024.);
+    std::stringstream throughput;
+    if (megabytes > 0. && parse_duration.count() > 0.) {
+        throughput << " (" << std::fixed << std::setprecision(1) << megabytes / parse_duration.count() << " MB/s)";
+    }
 
     if (no_progress) { Logger::SetOutput(&cout_, &log_stream); }
-    else {  Logger::Status("Parsing input file took " + format_duration(start, end)); }
+    else {  Logger::Status("Parsing input file took " + format_duration(start, end) + throughput.str()); }
 
     return true;
 
@@ -1483,8 +1633,49 @@ namespace latebound_access {
 	}
 }
 
-void fix_quantities(IfcParse::IfcFile& f, bool no_progress, bool quiet, bool stderr_progress) {
+namespace {
+	/// Quantities of the elements that share a representation. These are calculated
+	/// concurrently and only afterwards added to the file, in a single pass.
+	struct element_quantities {
+		IfcGeom::BRepElement* element;
+		std::vector<IfcUtil::IfcBaseClass*> products;
+		boost::optional<double> surface_area, volume, footprint_area;
+		// Item id and surface genus for every part of the representation
+		std::vector<std::pair<int, int>> surface_genera;
+	};
+
+	void calculate_quantities(element_quantities& q) {
+		try {
+			double a, b, c;
+			if (q.element->geometry().calculate_surface_area(a)) {
+				q.surface_area = a;
+			}
+			if (q.element->geometry().calculate_volume(a)) {
+				q.volume = a;
+			}
+			if (q.element->calculate_projected_surface_area(a, b, c)) {
+				q.footprint_area = c;
+			}
+			for (auto& part : q.element->geometry()) {
+				q.surface_genera.push_back({ part.ItemId(), IfcGeom::Kernel::surface_genus(part.Shape()) });
+			}
+		} catch (const std::exception& e) {
+			Logger::Error(e);
+		} catch (...) {
+			Logger::Error("Failed to calculate quantities");
+		}
+	}
+}
+
+void fix_quantities(IfcParse::IfcFile& f, bool no_progress, bool quiet, bool stderr_progress, int num_threads) {
+	if (num_threads <= 0) {
+		num_threads = std::thread::hardware_concurrency();
+	}
+
 	{
+		// Deletions are batched so that the inverse references are updated only once
+		f.batch();
+
 		auto delete_reversed = [&f](const aggregate_of_instance::ptr& insts) {
 			if (!insts) {
 				return;
@@ -1529,6 +1720,8 @@ void fix_quantities(IfcParse::IfcFile& f, bool no_progress, bool quiet, bool std
 		for (auto& rel : relationships) {
 			f.removeEntity(rel);
 		}
+
+		f.unbatch();
 	}
 
 	IfcGeom::IteratorSettings settings;
@@ -1538,7 +1731,7 @@ void fix_quantities(IfcParse::IfcFile& f, bool no_progress, bool quiet, bool std
 	settings.set(IfcGeom::IteratorSettings::CONVERT_BACK_UNITS, true);
 	settings.set(IfcGeom::IteratorSettings::DISABLE_TRIANGULATION, true);
 
-	IfcGeom::Iterator context_iterator(settings, &f);
+	IfcGeom::Iterator context_iterator(settings, &f, num_threads);
 
 	if (!context_iterator.initialize()) {
 		return;
@@ -1547,31 +1740,11 @@ void fix_quantities(IfcParse::IfcFile& f, bool no_progress, bool quiet, bool std
 	size_t num_created = 0;
 	int old_progress = quiet ? 0 : -1;
 
-	auto person = latebound_access::create(f, "IfcPerson");
-	latebound_access::set(person, "FamilyName", std::string("IfcOpenShell"));
-	latebound_access::set(person, "GivenName", std::string("IfcOpenShell"));
-	
-	auto org = latebound_access::create(f, "IfcOrganization");
-	latebound_access::set(org, "Name", std::string("IfcOpenShell"));
-	
-	auto pando = latebound_access::create(f, "IfcPersonAndOrganization");
-	latebound_access::set(pando, "ThePerson", person);
-	latebound_access::set(pando, "TheOrganization", org);
-	
-	auto application = latebound_access::create(f, "IfcApplication");
-	latebound_access::set(application, "ApplicationDeveloper", org);
-	latebound_access::set(application, "Version", std::string(IFCOPENSHELL_VERSION));
-	latebound_access::set(application, "ApplicationFullName", std::string("IfcConvert"));
-	latebound_access::set(application, "ApplicationIdentifier", std::string("IfcConvert" IFCOPENSHELL_VERSION));
-	
-	auto ownerhist = latebound_access::create(f, "IfcOwnerHistory");
-	latebound_access::set(ownerhist, "OwningUser", pando);
-	latebound_access::set(ownerhist, "OwningApplication", application);
-	latebound_access::set(ownerhist, "ChangeAction", std::string("MODIFIED"));
-	latebound_access::set(ownerhist, "CreationDate", (int)time(0));
-
-	IfcUtil::IfcBaseClass* quantity = nullptr;
-	aggregate_of_instance::ptr objects;
+	// Elements are grouped by their shared representation. The elements remain
+	// owned by the iterator, which keeps them alive until it is destroyed when
+	// running multithreaded. With a single thread, quantities are calculated
+	// right away as the element is freed when advancing the iterator.
+	std::vector<element_quantities> groups;
 	boost::shared_ptr<IfcGeom::Representation::BRep> previous_geometry_pointer;
 
 	for (;; ++num_created) {
@@ -1585,68 +1758,19 @@ void fix_quantities(IfcParse::IfcFile& f, bool no_progress, bool quiet, bool std
 		}
 
 		if (geom_object && geom_object->geometry_pointer() == previous_geometry_pointer) {
-			objects->push(geom_object->product());
+			groups.back().products.push_back(geom_object->product());
 		} else {
-			if (quantity) {
-				auto rel = latebound_access::create(f, "IfcRelDefinesByProperties");
-				latebound_access::set(rel, "OwnerHistory", ownerhist);
-				latebound_access::set(rel, "RelatedObjects", objects);
-				latebound_access::set(rel, "RelatingPropertyDefinition", quantity);
-			}
-
 			if (!geom_object) {
 				break;
 			}
 
-			aggregate_of_instance::ptr quantities(new aggregate_of_instance);
-
-			double a, b, c;
-			if (geom_object->geometry().calculate_surface_area(a)) {
-				auto quantity_area = latebound_access::create(f, "IfcQuantityArea");
-				latebound_access::set(quantity_area, "Name", std::string("Total Surface Area"));
-				latebound_access::set(quantity_area, "AreaValue", a);
-				quantities->push(quantity_area);
-			}
-			
-			if (geom_object->geometry().calculate_volume(a)) {
-				auto quantity_volume = latebound_access::create(f, "IfcQuantityVolume");
-				latebound_access::set(quantity_volume, "Name", std::string("Volume"));
-				latebound_access::set(quantity_volume, "VolumeValue", a);
-				quantities->push(quantity_volume);
-			}
-
-			if (geom_object->calculate_projected_surface_area(a, b, c)) {
-				auto quantity_area = latebound_access::create(f, "IfcQuantityArea");
-				latebound_access::set(quantity_area, "Name", std::string("Footprint Area"));
-				latebound_access::set(quantity_area, "AreaValue", c);
-				quantities->push(quantity_area);
-			}
-
-			auto quantity_complex = latebound_access::create(f, "IfcPhysicalComplexQuantity");
-			latebound_access::set(quantity_complex, "Name", std::string("Shape Validation Properties"));
-			quantities->push(quantity_complex);
-
-			aggregate_of_instance::ptr quantities_2(new aggregate_of_instance);
-
-			for (auto& part : geom_object->geometry()) {				
-				auto quantity_count = latebound_access::create(f, "IfcQuantityCount");
-				latebound_access::set(quantity_count, "Name", std::string("Surface Genus"));
-				latebound_access::set(quantity_count, "Description", '#' + boost::lexical_cast<std::string>(part.ItemId()));
-				latebound_access::set(quantity_count, "CountValue", IfcGeom::Kernel::surface_genus(part.Shape()));
-
-				quantities_2->push(quantity_count);				
-			}
-
-			latebound_access::set(quantity_complex, "HasQuantities", quantities_2);
+			groups.emplace_back();
+			groups.back().element = geom_object;
+			groups.back().products.push_back(geom_object->product());
 
-			if (quantities->size()) {
-				quantity = latebound_access::create(f, "IfcElementQuantity");
-				latebound_access::set(quantity, "OwnerHistory", ownerhist);
-				latebound_access::set(quantity, "Quantities", quantities);
+			if (num_threads == 1) {
+				calculate_quantities(groups.back());
 			}
-
-			objects.reset(new aggregate_of_instance);
-			objects->push(geom_object->product());
 		}
 
 		previous_geometry_pointer = geom_object->geometry_pointer();
@@ -1670,6 +1794,108 @@ void fix_quantities(IfcParse::IfcFile& f, bool no_progress, bool quiet, bool std
 		}
 	}
 
+	if (num_threads != 1) {
+		std::atomic<size_t> next_group(0);
+		auto calculate = [&groups, &next_group]() {
+			size_t i;
+			while ((i = next_group++) < groups.size()) {
+				calculate_quantities(groups[i]);
+			}
+		};
+		std::vector<std::thread> threads;
+		for (int i = 0; i < num_threads; ++i) {
+			threads.emplace_back(calculate);
+		}
+		for (auto& t : threads) {
+			t.join();
+		}
+	}
+
+	// The multithreaded iterator returns elements in the order in which they are
+	// completed, so the groups are ordered to make the output deterministic.
+	std::sort(groups.begin(), groups.end(), [](const element_quantities& a, const element_quantities& b) {
+		return a.products.front()->data().id() < b.products.front()->data().id();
+	});
+
+	auto person = latebound_access::create(f, "IfcPerson");
+	latebound_access::set(person, "FamilyName", std::string("IfcOpenShell"));
+	latebound_access::set(person, "GivenName", std::string("IfcOpenShell"));
+	
+	auto org = latebound_access::create(f, "IfcOrganization");
+	latebound_access::set(org, "Name", std::string("IfcOpenShell"));
+	
+	auto pando = latebound_access::create(f, "IfcPersonAndOrganization");
+	latebound_access::set(pando, "ThePerson", person);
+	latebound_access::set(pando, "TheOrganization", org);
+	
+	auto application = latebound_access::create(f, "IfcApplication");
+	latebound_access::set(application, "ApplicationDeveloper", org);
+	latebound_access::set(application, "Version", std::string(IFCOPENSHELL_VERSION));
+	latebound_access::set(application, "ApplicationFullName", std::string("IfcConvert"));
+	latebound_access::set(application, "ApplicationIdentifier", std::string("IfcConvert" IFCOPENSHELL_VERSION));
+	
+	auto ownerhist = latebound_access::create(f, "IfcOwnerHistory");
+	latebound_access::set(ownerhist, "OwningUser", pando);
+	latebound_access::set(ownerhist, "OwningApplication", application);
+	latebound_access::set(ownerhist, "ChangeAction", std::string("MODIFIED"));
+	latebound_access::set(ownerhist, "CreationDate", (int)time(0));
+
+	for (auto& g : groups) {
+		aggregate_of_instance::ptr quantities(new aggregate_of_instance);
+
+		if (g.surface_area) {
+			auto quantity_area = latebound_access::create(f, "IfcQuantityArea");
+			latebound_access::set(quantity_area, "Name", std::string("Total Surface Area"));
+			latebound_access::set(quantity_area, "AreaValue", *g.surface_area);
+			quantities->push(quantity_area);
+		}
+		
+		if (g.volume) {
+			auto quantity_volume = latebound_access::create(f, "IfcQuantityVolume");
+			latebound_access::set(quantity_volume, "Name", std::string("Volume"));
+			latebound_access::set(quantity_volume, "VolumeValue", *g.volume);
+			quantities->push(quantity_volume);
+		}
+
+		if (g.footprint_area) {
+			auto quantity_area = latebound_access::create(f, "IfcQuantityArea");
+			latebound_access::set(quantity_area, "Name", std::string("Footprint Area"));
+			latebound_access::set(quantity_area, "AreaValue", *g.footprint_area);
+			quantities->push(quantity_area);
+		}
+
+		auto quantity_complex = latebound_access::create(f, "IfcPhysicalComplexQuantity");
+		latebound_access::set(quantity_complex, "Name", std::string("Shape Validation Properties"));
+		quantities->push(quantity_complex);
+
+		aggregate_of_instance::ptr quantities_2(new aggregate_of_instance);
+
+		for (auto& genus : g.surface_genera) {
+			auto quantity_count = latebound_access::create(f, "IfcQuantityCount");
+			latebound_access::set(quantity_count, "Name", std::string("Surface Genus"));
+			latebound_access::set(quantity_count, "Description", '#' + boost::lexical_cast<std::string>(genus.first));
+			latebound_access::set(quantity_count, "CountValue", genus.second);
+
+			quantities_2->push(quantity_count);
+		}
+
+		latebound_access::set(quantity_complex, "HasQuantities", quantities_2);
+
+		auto quantity = latebound_access::create(f, "IfcElementQuantity");
+		latebound_access::set(quantity, "OwnerHistory", ownerhist);
+		latebound_access::set(quantity, "Quantities", quantities);
+
+		aggregate_of_instance::ptr objects(new aggregate_of_instance);
+		for (auto& p : g.products) {
+			objects->push(p);
+		}
+
+		auto rel = latebound_access::create(f, "IfcRelDefinesByProperties");
+		latebound_access::set(rel, "OwnerHistory", ownerhist);
+		latebound_access::set(rel, "RelatedObjects", objects);
+		latebound_access::set(rel, "RelatingPropertyDefinition", quantity);
+	}
+
 	if (!no_progress && quiet) {
 		for (; old_progress < 100; ++old_progress) {
 			std::cout << ".";
@@ -1235,6 +1235,9 @@ void IfcGeom::Kernel::setValue(GeomValue var, double value) {
 	case GV_BOOLEAN_ATTEMPT_2D:
 		boolean_attempt_2d = value;
 		break;
+	case GV_MESH_BOOLEAN:
+		mesh_boolean = value;
+		break;
 	default:
 		throw std::runtime_error("Invalid setting");
 	}
@@ -1274,6 +1277,8 @@ double IfcGeom::Kernel::getValue(GeomValue var) const {
 		return boolean_debug_setting;
 	case GV_BOOLEAN_ATTEMPT_2D:
 		return boolean_attempt_2d;
+	case GV_MESH_BOOLEAN:
+		return mesh_boolean;
 	}
 	throw std::runtime_error("Invalid setting");
 }
@@ -3477,6 +3482,10 @@ bool IfcGeom::Kernel::boolean_operation(const TopoDS_Shape& a_input, const TopTo
 	const bool do_attempt_2d_boolean = getValue(GV_BOOLEAN_ATTEMPT_2D) > 0.;
 	const bool debug = getValue(GV_DEBUG_BOOLEAN) > 0.;
 
+	if (budget_.exceeded()) {
+		return false;
+	}
+
 	std::string debug_identifier;
 	if (debug) {
 		std::stringstream ss;
@@ -3485,6 +3494,20 @@ bool IfcGeom::Kernel::boolean_operation(const TopoDS_Shape& a_input, const TopTo
 		Logger::Notice("Boolean debug identifier: " + debug_identifier);
 	}
 
+	// Only on the initial attempt, retries with increased fuzziness and the
+	// operations on 2d faces are left to the BRep algorithms.
+	const bool do_attempt_mesh_boolean = op == BOPAlgo_CUT && fuzziness < 0. && getValue(GV_MESH_BOOLEAN) > 0.;
+
+	if (do_attempt_mesh_boolean) {
+		PERF("boolean subtraction: mesh based");
+
+		if (util::boolean_subtraction_using_mesh(a_input, b_input, result, getValue(GV_DEFLECTION_TOLERANCE), getValue(GV_PRECISION))) {
+			return true;
+		}
+
+		Logger::Notice("Mesh based subtraction failed, resorting to BRep boolean operation");
+	}
+
 	if (fuzziness < 0.) {
 		fuzziness = getValue(GV_PRECISION) / 10.;
 	}
@@ -3735,7 +3758,20 @@ bool IfcGeom::Kernel::boolean_operation(const TopoDS_Shape& a_input, const TopTo
 	{
 		PERF("boolean operation: build");
 
-		builder->Build();
+		if (budget_.running()) {
+			// Interrupts the operation when the conversion budget of the element is exceeded
+			Handle(Message_ProgressIndicator) progress = budget_.progress_indicator();
+#if OCC_VERSION_HEX >= 0x70500
+			builder->Build(Message_ProgressIndicator::Start(progress));
+#else
+#if OCC_VERSION_HEX >= 0x70200
+			builder->SetProgressIndicator(progress);
+#endif
+			builder->Build();
+#endif
+		} else {
+			builder->Build();
+		}
 	}
 	if (builder->IsDone()) {
 		if (builder->DSFiller()->HasWarning(STANDARD_TYPE(BOPAlgo_AlertAcquiredSelfIntersection))) {
@@ -4022,6 +4058,10 @@ void IfcGeom::Kernel::set_conversion_placement_rel_to_instance(const IfcUtil::If
 	placement_rel_to_instance_ = instance;
 }
 
+void IfcGeom::Kernel::set_placement_table(const std::shared_ptr<const placement_table>& table) {
+	placement_table_ = table;
+}
+
 
 namespace {
 
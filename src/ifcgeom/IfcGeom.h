@@ -52,6 +52,7 @@
 #include "../ifcgeom_schema_agnostic/IfcRepresentationShapeItem.h"
 #include "../ifcgeom_schema_agnostic/IfcGeomShapeType.h"
 #include "../ifcgeom_schema_agnostic/Kernel.h"
+#include "../ifcgeom_schema_agnostic/conversion_budget.h"
 #include "../ifcgeom_schema_agnostic/ifc_geom_api.h"
 
 // Define this in case you want to conserve memory usage at all cost. This has been
@@ -165,12 +166,17 @@ private:
 	double precision_factor;
 	double boolean_debug_setting;
 	double boolean_attempt_2d;
+	double mesh_boolean;
 
 	size_t operation_counter_ = 0;
 
 	// For stopping PlacementRelTo recursion in convert(const IfcSchema::IfcObjectPlacement* l, gp_Trsf& trsf)
 	const IfcParse::declaration* placement_rel_to_type_;
 	const IfcUtil::IfcBaseEntity* placement_rel_to_instance_;
+	// Precomputed placements, shared by the kernels of the iterator
+	std::shared_ptr<const placement_table> placement_table_;
+	// Budget of the element that is being converted, not copied along with the kernel
+	conversion_budget budget_;
 
 	faceset_helper<>* faceset_helper_;
 	double disable_boolean_result;
@@ -203,6 +209,7 @@ public:
 		, precision_factor(10.)
 		, boolean_debug_setting(false)
 		, boolean_attempt_2d(true)
+		, mesh_boolean(-1.)
 
 		, placement_rel_to_type_(nullptr)
 		, placement_rel_to_instance_(nullptr)
@@ -224,8 +231,10 @@ public:
 		, precision_factor(other.precision_factor)
 		, boolean_debug_setting(other.boolean_debug_setting)
 		, boolean_attempt_2d(other.boolean_attempt_2d)
+		, mesh_boolean(other.mesh_boolean)
 		, placement_rel_to_type_(other.placement_rel_to_type_)
 		, placement_rel_to_instance_(other.placement_rel_to_instance_)
+		, placement_table_(other.placement_table_)
 		// @nb faceset_helper_ always initialized to 0
 		, faceset_helper_(nullptr)
 		, disable_boolean_result(other.disable_boolean_result)
@@ -248,8 +257,10 @@ public:
 		precision_factor = other.precision_factor;
 		boolean_debug_setting = other.boolean_debug_setting;
 		boolean_attempt_2d = other.boolean_attempt_2d;
+		mesh_boolean = other.mesh_boolean;
 		placement_rel_to_type_ = other.placement_rel_to_type_;
 		placement_rel_to_instance_ = other.placement_rel_to_instance_;
+		placement_table_ = other.placement_table_;
 		disable_boolean_result = other.disable_boolean_result;
 		offset = other.offset;
 		rotation = other.rotation;
@@ -441,6 +452,9 @@ public:
 
 	void set_conversion_placement_rel_to_type(const IfcParse::declaration* type);
 	void set_conversion_placement_rel_to_instance(const IfcUtil::IfcBaseEntity* instance);
+	void set_placement_table(const std::shared_ptr<const placement_table>& table);
+
+	conversion_budget& budget() { return budget_; }
 
 #include "mapping_kernel_header.i"
 
@@ -463,6 +477,8 @@ public:
 		return items;
 	}
 
+	virtual std::shared_ptr<const placement_table> build_placement_table(IfcParse::IfcFile* file, int num_threads);
+
 	virtual bool convert_placement(IfcUtil::IfcBaseClass* item, gp_Trsf& trsf) {
 		if (item->as<IfcSchema::IfcObjectPlacement>()) {
 			try {
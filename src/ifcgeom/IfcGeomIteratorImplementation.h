@@ -88,6 +88,7 @@
 #include "../ifcgeom_schema_agnostic/IfcRepresentationShapeItem.h"
 #include "../ifcgeom_schema_agnostic/IfcGeomFilter.h"
 #include "../ifcgeom_schema_agnostic/IteratorImplementation.h"
+#include "../ifcgeom_schema_agnostic/content_hash.h"
 
 #include <atomic>
 
@@ -127,6 +128,11 @@ namespace IfcGeom {
 
 		std::mutex element_ready_mutex_;
 		bool task_result_ptr_initialized = false;
+
+		// Digests of representations and materials, which are shared by many
+		// products, see content_key_()
+		std::mutex content_digests_mutex_;
+		std::map<const IfcUtil::IfcBaseClass*, std::string> content_digests_;
 		size_t async_elements_returned_ = 0;
 		
 		MAKE_TYPE_NAME(IteratorImplementation_)(const MAKE_TYPE_NAME(IteratorImplementation_)&); // N/I
@@ -243,6 +249,10 @@ namespace IfcGeom {
 				total = representations->size();
 
 				if (num_threads_ != 1) {
+					// Resolve all placements once upfront rather than separately in
+					// the cache of every kernel in the pool, which share the table.
+					kernel.set_placement_table(kernel.build_placement_table(ifc_file, num_threads_));
+
 					collect();
 
 					init_future_ = std::async(std::launch::async, [this]() { process_concurrently(); });
@@ -727,8 +737,8 @@ namespace IfcGeom {
 			}
 		}
 
-		std::mutex caching_mutex_;
-
+		// Called concurrently from the conversion threads, the cache is responsible
+		// for its own synchronization.
 		template <typename Fn>
 		Element* decorate_with_cache_(GeometrySerializer::read_type rt, const std::string& product_guid, const std::string& representation_id, Fn f) {
 			
@@ -737,8 +747,6 @@ namespace IfcGeom {
 
 #ifdef WITH_HDF5
 			if (cache_) {
-				std::lock_guard<std::mutex> lk(caching_mutex_);
-
 				auto from_cache = cache_->read(*ifc_file, product_guid, representation_id, rt);
 				if (from_cache) {
 					read_from_cache = true;
@@ -752,8 +760,6 @@ namespace IfcGeom {
 
 #ifdef WITH_HDF5
 			if (cache_ && !read_from_cache && element) {
-				std::lock_guard<std::mutex> lk(caching_mutex_);
-
 				if (rt == GeometrySerializer::READ_TRIANGULATION) {
 					cache_->write((IfcGeom::TriangulationElement*) element);
 				} else {
@@ -765,6 +771,257 @@ namespace IfcGeom {
 			return element;
 		}
 
+		// Digest of inst computed by fn, memoized by instance
+		template <typename Fn>
+		std::string content_digest_(const IfcUtil::IfcBaseClass* inst, Fn fn) {
+			{
+				std::lock_guard<std::mutex> lk(content_digests_mutex_);
+				auto it = content_digests_.find(inst);
+				if (it != content_digests_.end()) {
+					return it->second;
+				}
+			}
+			const std::string digest = fn();
+			std::lock_guard<std::mutex> lk(content_digests_mutex_);
+			content_digests_.insert({ inst, digest });
+			return digest;
+		}
+
+		// Digest of everything the geometry of product for representation depends on, see
+		// IteratorSettings::CACHE_BY_CONTENT. The placement is only included when it is
+		// baked into the geometry, i.e. when openings are subtracted or world coordinates
+		// are requested, otherwise it is applied on the element after reading from cache.
+		// The digests of the representation and materials are only computed once, as
+		// they involve traversing the instance graph also when the key is found in cache.
+		std::string content_key_(IfcGeom::MAKE_TYPE_NAME(Kernel)& k, const IfcGeom::IteratorSettings& s, IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product) {
+			IfcGeom::content_hash h;
+
+			h.add(s.get_raw() & ((1ULL << IteratorSettings::NUM_SETTINGS) - 1));
+			h.add(s.deflection_tolerance());
+			h.add(s.angular_tolerance());
+			for (auto& d : s.lod_deflection_tolerances()) {
+				h.add(d);
+			}
+			h.add(s.force_space_transparency());
+			for (auto& v : s.offset) {
+				h.add(v);
+			}
+			for (auto& v : s.rotation) {
+				h.add(v);
+			}
+			h.add(k.getValue(IfcGeom::Kernel::GV_LENGTH_UNIT));
+			h.add(k.getValue(IfcGeom::Kernel::GV_PRECISION));
+			h.add(product->declaration().name());
+
+			h.add(content_digest_(representation, [this, representation]() {
+				IfcGeom::content_hash rh;
+				rh.add(representation);
+				// Styles refer to the items they apply to, hence not reached by the above
+				aggregate_of_instance::ptr instances = ifc_file->traverse(representation);
+				for (auto& inst : *instances) {
+					if (inst->declaration().is(IfcSchema::IfcRepresentationItem::Class())) {
+						IfcSchema::IfcStyledItem::list::ptr styles = inst->as<IfcSchema::IfcRepresentationItem>()->StyledByItem();
+						for (auto& style : *styles) {
+							rh.add(style);
+						}
+					}
+				}
+				return rh.hex();
+			}));
+
+			IfcSchema::IfcRelAssociatesMaterial::list::ptr materials = product->HasAssociations()->as<IfcSchema::IfcRelAssociatesMaterial>();
+			for (auto& rel : *materials) {
+				IfcUtil::IfcBaseClass* material = rel->RelatingMaterial()->as<IfcUtil::IfcBaseClass>();
+				h.add(content_digest_(material, [this, material]() {
+					IfcGeom::content_hash mh;
+					mh.add(material);
+					aggregate_of_instance::ptr material_instances = ifc_file->traverse(material);
+					for (auto& inst : *material_instances) {
+						if (inst->declaration().is(IfcSchema::IfcMaterial::Class())) {
+							IfcSchema::IfcMaterialDefinitionRepresentation::list::ptr defs = inst->as<IfcSchema::IfcMaterial>()->HasRepresentation();
+							for (auto& def : *defs) {
+								mh.add(def);
+							}
+						}
+					}
+					return mh.hex();
+				}));
+			}
+
+			if (s.get(IteratorSettings::APPLY_LAYERSETS)) {
+				// Layers are folded using the other representations of the product
+				h.add(product->Representation());
+			}
+
+			IfcSchema::IfcRelVoidsElement::list::ptr openings;
+			if (!s.get(IteratorSettings::DISABLE_OPENING_SUBTRACTIONS)) {
+				openings = k.find_openings(product);
+			}
+			if (openings && openings->size()) {
+				h.add(product->ObjectPlacement());
+				for (auto& rel : *openings) {
+					auto opening = rel->RelatedOpeningElement();
+					h.add(opening->ObjectPlacement());
+					h.add(opening->Representation());
+				}
+			} else if (s.get(IteratorSettings::USE_WORLD_COORDS)) {
+				h.add(product->ObjectPlacement());
+			}
+
+			return h.hex();
+		}
+
+		template <typename Fn>
+		BRepElement* decorate_brep_with_cache_(IfcGeom::MAKE_TYPE_NAME(Kernel)& k, const IfcGeom::IteratorSettings& s, IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product, Fn f) {
+#ifdef WITH_HDF5
+			if (cache_ && s.get(IteratorSettings::CACHE_BY_CONTENT)) {
+				const std::string key = content_key_(k, s, representation, product);
+
+				BRepElement* from_cache = (BRepElement*) cache_->read(*ifc_file, key, key, GeometrySerializer::READ_BREP);
+
+				if (from_cache) {
+					// The cache entry may have been created for a different product, possibly in a
+					// different revision of the model, so the attributes are taken from the product.
+					BRepElement* attributes = k.create_brep_for_processed_representation(s, representation, product, from_cache);
+					const gp_Trsf trsf = s.get(IteratorSettings::USE_WORLD_COORDS) ? gp_Trsf() : attributes->transformation().data();
+					BRepElement* element = new BRepElement(
+						attributes->id(), attributes->parent_id(), attributes->name(), attributes->type(), attributes->guid(),
+						attributes->context(), trsf, from_cache->geometry_pointer(), attributes->product());
+					delete attributes;
+					delete from_cache;
+					return element;
+				}
+
+				BRepElement* element = f();
+				if (!element) {
+					return element;
+				}
+
+				// The geometry is identified by the key, so that triangulations are cached by content as well.
+				boost::shared_ptr<IfcGeom::Representation::BRep> geometry(new IfcGeom::Representation::BRep(
+					element->geometry().settings(), key, element->geometry().shapes()));
+				BRepElement* keyed = new BRepElement(
+					element->id(), element->parent_id(), element->name(), element->type(), element->guid(),
+					element->context(), element->transformation().data(), geometry, element->product());
+				delete element;
+
+				cache_->write_by_key(key, keyed);
+
+				return keyed;
+			}
+#endif
+			return (BRepElement*) decorate_with_cache_(GeometrySerializer::READ_BREP, product->GlobalId(), std::to_string(representation->data().id()), f);
+		}
+
+		// Whether elem was converted without openings by the BUDGET_FALLBACK retry, see
+		// create_brep_within_budget_(). Its geometry does not match the settings s and is
+		// not written to the cache, neither by guid nor by content.
+		static bool is_budget_fallback_(const IfcGeom::IteratorSettings& s, const BRepElement* elem) {
+			return !s.get(IteratorSettings::DISABLE_OPENING_SUBTRACTIONS) &&
+				elem->geometry().settings().get(IteratorSettings::DISABLE_OPENING_SUBTRACTIONS);
+		}
+
+		template <typename Fn>
+		TriangulationElement* decorate_triangulation_with_cache_(const IfcGeom::IteratorSettings& s, BRepElement* elem, Fn f) {
+			// Levels of detail are not stored in the cache
+			if (!s.lod_deflection_tolerances().empty() || is_budget_fallback_(s, elem)) {
+				return f();
+			}
+#ifdef WITH_HDF5
+			if (cache_ && s.get(IteratorSettings::CACHE_BY_CONTENT)) {
+				// See decorate_brep_with_cache_(), the geometry id is the content key
+				const std::string& key = elem->geometry().id();
+
+				TriangulationElement* from_cache = (TriangulationElement*) cache_->read(*ifc_file, key, key, GeometrySerializer::READ_TRIANGULATION);
+
+				if (from_cache) {
+					TriangulationElement* element = new TriangulationElement(*elem, from_cache->geometry_pointer());
+					delete from_cache;
+					return element;
+				}
+
+				TriangulationElement* element = f();
+				if (element) {
+					cache_->write_by_key(key, element);
+				}
+				return element;
+			}
+#endif
+			// the part before the hyphen is the representation id
+			auto gid2 = elem->geometry().id();
+			auto hyphen = gid2.find("-");
+			if (hyphen != std::string::npos) {
+				gid2 = gid2.substr(0, hyphen);
+			}
+
+			return (TriangulationElement*) decorate_with_cache_(GeometrySerializer::READ_TRIANGULATION, elem->guid(), gid2, f);
+		}
+
+		// Creates the element by means of f within the conversion budget of the element, see
+		// IteratorSettings::element_timeout(). Aborted elements are logged and, depending on
+		// IteratorSettings::BUDGET_FALLBACK, retried without subtracting openings.
+		template <typename Fn>
+		BRepElement* create_brep_within_budget_(IfcGeom::MAKE_TYPE_NAME(Kernel)& k, const IfcGeom::IteratorSettings& s, IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product, Fn f) {
+			if (s.element_timeout() <= 0. && s.element_memory_limit() == 0) {
+				return decorate_brep_with_cache_(k, s, representation, product, [&s, &f]() {
+					return f(s);
+				});
+			}
+
+			conversion_budget::resource exceeded = conversion_budget::NONE;
+
+			// Runs f under a fresh budget, aborted elements return nullptr
+			auto within_budget = [&k, &f, &exceeded](const IfcGeom::IteratorSettings& settings) {
+				BRepElement* elem;
+				k.budget().start(settings.element_timeout(), settings.element_memory_limit());
+				try {
+					elem = f(settings);
+				} catch (...) {
+					k.budget().stop();
+					throw;
+				}
+				exceeded = k.budget().exceeded_resource();
+				k.budget().stop();
+				if (exceeded != conversion_budget::NONE) {
+					delete elem;
+					elem = nullptr;
+				}
+				return elem;
+			};
+
+			auto log_exceeded = [&exceeded, product](const std::string& what) {
+				Logger::Error(std::string("Conversion of ") + product->GlobalId() + what + " aborted, exceeded its " +
+					(exceeded == conversion_budget::TIME ? "time" : "memory") + " budget", product);
+			};
+
+			// Aborted elements are not written to the cache
+			BRepElement* element = decorate_brep_with_cache_(k, s, representation, product, [&s, &within_budget]() {
+				return within_budget(s);
+			});
+
+			if (exceeded == conversion_budget::NONE) {
+				return element;
+			}
+
+			log_exceeded("");
+
+			if (s.get(IteratorSettings::BUDGET_FALLBACK) && !s.get(IteratorSettings::DISABLE_OPENING_SUBTRACTIONS)) {
+				Logger::Notice("Retrying conversion without openings", product);
+				IteratorSettings without_openings(s);
+				without_openings.set(IteratorSettings::DISABLE_OPENING_SUBTRACTIONS, true);
+				// Not cached, the cache is keyed on the element and would otherwise
+				// return the geometry without openings for the requested settings.
+				// See is_budget_fallback_() for the triangulation.
+				element = within_budget(without_openings);
+				if (exceeded == conversion_budget::NONE) {
+					return element;
+				}
+				log_exceeded(" without openings");
+			}
+
+			return nullptr;
+		}
+
 		BRepElement* create_shape_model_for_next_entity() {
 			for (;;) {
 				auto rp = get_next_task();
@@ -776,11 +1033,11 @@ namespace IfcGeom {
 
 				Logger::SetProduct(product);
 
-				BRepElement* element = (BRepElement*)decorate_with_cache_(GeometrySerializer::READ_BREP, product->GlobalId(), std::to_string(representation->data().id()), [this, product, representation]() {
+				BRepElement* element = create_brep_within_budget_(kernel, settings, representation, product, [this, product, representation](const IfcGeom::IteratorSettings& s) {
 					if (ifcproduct_iterator == ifcproducts->begin() || !geometry_reuse_ok_for_current_representation_) {
-						return kernel.create_brep_for_representation_and_product(settings, representation, product);
+						return kernel.create_brep_for_representation_and_product(s, representation, product);
 					} else {
-						return kernel.create_brep_for_processed_representation(settings, representation, product, current_shape_model);
+						return kernel.create_brep_for_processed_representation(s, representation, product, current_shape_model);
 					}
 				});
 
@@ -813,9 +1070,9 @@ namespace IfcGeom {
 			IfcSchema::IfcRepresentation *representation = rep->representation;
 			IfcSchema::IfcProduct *product = *rep->products->begin();
 
-			IfcGeom::BRepElement* brep = static_cast<IfcGeom::BRepElement*>(decorate_with_cache_(GeometrySerializer::READ_BREP, product->GlobalId(), std::to_string(representation->data().id()), [kernel, settings, product, representation]() {
-				return kernel->create_brep_for_representation_and_product(settings, representation, product);
-			}));
+			IfcGeom::BRepElement* brep = create_brep_within_budget_(*kernel, settings, representation, product, [kernel, product, representation](const IfcGeom::IteratorSettings& s) {
+				return kernel->create_brep_for_representation_and_product(s, representation, product);
+			});
 
 			if (!brep) {
 				return;
@@ -831,9 +1088,9 @@ namespace IfcGeom {
 
 			for (auto it = rep->products->begin() + 1; it != rep->products->end(); ++it) {
 				auto product2 = *it;
-				IfcGeom::BRepElement* brep2 = static_cast<IfcGeom::BRepElement*>(decorate_with_cache_(GeometrySerializer::READ_BREP, product2->GlobalId(), std::to_string(representation->data().id()), [kernel, settings, product2, representation, brep]() {
+				IfcGeom::BRepElement* brep2 = decorate_brep_with_cache_(*kernel, settings, representation, product2, [kernel, settings, product2, representation, brep]() {
 					return kernel->create_brep_for_processed_representation(settings, representation, product2, brep);
-				}));
+				});
 				if (brep2) {
 					auto elem2 = process_based_on_settings(settings, brep2, dynamic_cast<IfcGeom::TriangulationElement*>(elem));
 					if (elem2) {
@@ -857,14 +1114,7 @@ namespace IfcGeom {
 					return nullptr;
 				}
 			} else if (!settings.get(IfcGeom::IteratorSettings::DISABLE_TRIANGULATION)) {
-				// the part before the hyphen is the representation id
-				auto gid2 = elem->geometry().id();
-				auto hyphen = gid2.find("-");
-				if (hyphen != std::string::npos) {
-					gid2 = gid2.substr(0, hyphen);
-				}
-
-				return decorate_with_cache_(GeometrySerializer::READ_TRIANGULATION, elem->guid(), gid2, [elem, previous]() {
+				return decorate_triangulation_with_cache_(settings, elem, [elem, previous]() {
 					try {
 						if (!previous) {
 							return new TriangulationElement(*elem);
@@ -1100,14 +1350,7 @@ namespace IfcGeom {
                         Logger::Message(Logger::LOG_ERROR, "Getting a serialized element from model failed.");
 					}
 				} else if (!settings.get(IteratorSettings::DISABLE_TRIANGULATION)) {
-					// the part before the hyphen is the representation id
-					auto gid2 = next_shape_model->geometry().id();
-					auto hyphen = gid2.find("-");
-					if (hyphen != std::string::npos) {
-						gid2 = gid2.substr(0, hyphen);
-					}
-
-					next_triangulation = (TriangulationElement*)decorate_with_cache_(GeometrySerializer::READ_TRIANGULATION, next_shape_model->guid(), gid2, [this, next_shape_model]() {
+					next_triangulation = decorate_triangulation_with_cache_(settings, next_shape_model, [this, next_shape_model]() {
 						try {
 							if (ifcproduct_iterator == ifcproducts->begin() || !geometry_reuse_ok_for_current_representation_) {
 								return new TriangulationElement(*next_shape_model);
@@ -1181,6 +1424,17 @@ namespace IfcGeom {
 				: -1.0
 			);
 
+			kernel.setValue(IfcGeom::Kernel::GV_MESH_BOOLEAN,
+				settings.get(IteratorSettings::MESH_BOOLEAN)
+				? +1.0
+				: -1.0
+			);
+
+			if (settings.get(IteratorSettings::MESH_BOOLEAN)) {
+				// Operands of mesh based booleans are triangulated at the output tolerance
+				kernel.setValue(IfcGeom::Kernel::GV_DEFLECTION_TOLERANCE, settings.deflection_tolerance());
+			}
+
 			if (settings.get(IteratorSettings::BUILDING_LOCAL_PLACEMENT)) {
 				if (settings.get(IteratorSettings::SITE_LOCAL_PLACEMENT)) {
 					Logger::Message(Logger::LOG_WARNING, "building-local-placement takes precedence over site-local-placement");
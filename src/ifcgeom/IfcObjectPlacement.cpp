@@ -20,6 +20,10 @@
 #include <gp_Trsf.hxx>
 #include "../ifcgeom/IfcGeom.h"
 
+#include <future>
+#include <unordered_map>
+#include <unordered_set>
+
 #define Kernel MAKE_TYPE_NAME(Kernel)
 
 bool IfcGeom::Kernel::convert(const IfcSchema::IfcObjectPlacement* l, gp_Trsf& trsf) {
@@ -28,6 +32,14 @@ bool IfcGeom::Kernel::convert(const IfcSchema::IfcObjectPlacement* l, gp_Trsf& t
 		Logger::Message(Logger::LOG_ERROR, "Unsupported IfcObjectPlacement:", l);
 		return false; 		
 	}
+	if (placement_table_ && placement_table_->rel_to_type() == placement_rel_to_type_ && !placement_rel_to_instance_) {
+		const gp_Trsf* resolved = placement_table_->find(l->data().id());
+		if (resolved) {
+			trsf.PreMultiply(*resolved);
+			trsf.PreMultiply(offset_and_rotation);
+			return true;
+		}
+	}
 	IfcSchema::IfcLocalPlacement* current = (IfcSchema::IfcLocalPlacement*)l;
 	for (;;) {
 
@@ -73,3 +85,139 @@ bool IfcGeom::Kernel::convert(const IfcSchema::IfcObjectPlacement* l, gp_Trsf& t
 	CACHE(IfcObjectPlacement,l,trsf)
 	return true;
 }
+
+std::shared_ptr<const IfcGeom::placement_table> IfcGeom::Kernel::build_placement_table(IfcParse::IfcFile* file, int num_threads) {
+	IfcSchema::IfcLocalPlacement::list::ptr placements = file->instances_by_type<IfcSchema::IfcLocalPlacement>();
+
+	// Resolution stops at the placements of the products of placement_rel_to_type_,
+	// which is equivalent to the PlacesObject() check in convert() above.
+	std::unordered_set<const IfcUtil::IfcBaseClass*> stop_at;
+	aggregate_of_instance::ptr products;
+	if (placement_rel_to_type_ && (products = file->instances_by_type(placement_rel_to_type_))) {
+		for (auto it = products->begin(); it != products->end(); ++it) {
+			IfcSchema::IfcProduct* product = (*it)->as<IfcSchema::IfcProduct>();
+			if (product && product->ObjectPlacement()) {
+				stop_at.insert(product->ObjectPlacement());
+			}
+		}
+	}
+
+	std::vector<IfcSchema::IfcLocalPlacement*> local(placements->begin(), placements->end());
+	std::unordered_map<const IfcUtil::IfcBaseClass*, size_t> index_of;
+	index_of.reserve(local.size());
+	for (size_t i = 0; i < local.size(); ++i) {
+		index_of[local[i]] = i;
+	}
+
+	static const size_t npos = (size_t) -1;
+
+	std::vector<size_t> parent(local.size(), npos);
+	for (size_t i = 0; i < local.size(); ++i) {
+		IfcSchema::IfcObjectPlacement* rel_to = local[i]->PlacementRelTo();
+		if (rel_to && stop_at.find(rel_to) == stop_at.end()) {
+			auto it = index_of.find(rel_to);
+			if (it != index_of.end()) {
+				parent[i] = it->second;
+			}
+		}
+	}
+
+	// Depth of every placement in the hierarchy, computed without recursion as
+	// the chains can be long. Cyclic references are broken at the point where
+	// the cycle is detected.
+	std::vector<int> depth(local.size(), -1);
+	std::vector<size_t> chain;
+	for (size_t i = 0; i < local.size(); ++i) {
+		size_t current = i;
+		while (current != npos && depth[current] < 0) {
+			depth[current] = -2;
+			chain.push_back(current);
+			current = parent[current];
+			if (current != npos && depth[current] == -2) {
+				Logger::Error("Cyclic placement hierarchy", local[current]);
+				parent[chain.back()] = npos;
+				current = npos;
+			}
+		}
+		int d = current == npos ? -1 : depth[current];
+		for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+			depth[*it] = ++d;
+		}
+		chain.clear();
+	}
+
+	std::vector<std::vector<size_t>> levels;
+	for (size_t i = 0; i < local.size(); ++i) {
+		if ((size_t) depth[i] >= levels.size()) {
+			levels.resize(depth[i] + 1);
+		}
+		levels[depth[i]].push_back(i);
+	}
+
+	auto table = std::make_shared<placement_table>(placement_rel_to_type_, file->getMaxId());
+	std::vector<size_t> entry(local.size());
+	for (auto& level : levels) {
+		for (auto& i : level) {
+			entry[i] = table->add(local[i]->data().id());
+		}
+	}
+
+	// Every thread converts the relative placements with its own kernel, as the
+	// caches of the kernel are not synchronized.
+	if (num_threads < 1) {
+		num_threads = 1;
+	}
+	std::vector<Kernel> kernels(num_threads, *this);
+	for (auto& k : kernels) {
+		k.placement_table_.reset();
+	}
+
+	auto resolve = [&](Kernel& k, const std::vector<size_t>& level, size_t begin, size_t end) {
+		for (size_t j = begin; j < end; ++j) {
+			const size_t i = level[j];
+			if (parent[i] != npos && !table->resolved(entry[parent[i]])) {
+				continue;
+			}
+			gp_Trsf trsf;
+			try {
+				IfcSchema::IfcAxis2Placement* relplacement = local[i]->RelativePlacement();
+				if (relplacement->as<IfcSchema::IfcAxis2Placement3D>()) {
+					k.convert(relplacement->as<IfcSchema::IfcAxis2Placement3D>(), trsf);
+				}
+			} catch (std::exception& e) {
+				Logger::Error(e, local[i]);
+				continue;
+			} catch (...) {
+				Logger::Error("Failed processing placement", local[i]);
+				continue;
+			}
+			if (parent[i] != npos) {
+				trsf.PreMultiply(table->at(entry[parent[i]]));
+			}
+			table->set(entry[i], trsf);
+		}
+	};
+
+	// Placements on the same level only depend on the levels above, which
+	// have been completed, so a level is divided over the threads.
+	static const size_t min_per_thread = 256;
+	for (auto& level : levels) {
+		size_t n = std::min<size_t>(num_threads, level.size() / min_per_thread);
+		if (n < 2) {
+			resolve(kernels.front(), level, 0, level.size());
+			continue;
+		}
+		std::vector<std::future<void>> futures;
+		futures.reserve(n);
+		for (size_t t = 0; t < n; ++t) {
+			const size_t begin = level.size() * t / n;
+			const size_t end = level.size() * (t + 1) / n;
+			futures.push_back(std::async(std::launch::async, resolve, std::ref(kernels[t]), std::cref(level), begin, end));
+		}
+		for (auto& f : futures) {
+			f.get();
+		}
+	}
+
+	return table;
+}
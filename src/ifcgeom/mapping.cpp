@@ -56,6 +56,11 @@ bool IfcGeom::Kernel::convert_shape(const IfcBaseInterface* l, TopoDS_Shape& r)
 	bool processed = false;
 	bool ignored = false;
 
+	// Once the budget of the element is exceeded nothing is converted anymore
+	if (budget_.exceeded()) {
+		return false;
+	}
+
 #ifndef NO_CACHE
 	std::map<int,TopoDS_Shape>::const_iterator it = cache.Shape.find(id);
 	if ( it != cache.Shape.end() ) { r = it->second; return true; }
@@ -91,6 +96,12 @@ bool IfcGeom::Kernel::convert_shape(const IfcBaseInterface* l, TopoDS_Shape& r)
 		}
 	}
 
+	if (processed && success && budget_.exceeded()) {
+		// Possibly the result of an interrupted boolean operation, not to be cached
+		Logger::Message(Logger::LOG_ERROR, "Conversion budget exceeded for:", l);
+		return false;
+	}
+
 	if ( processed && success ) { 
 		const double precision = getValue(GV_PRECISION);
 		apply_tolerance(r, precision);
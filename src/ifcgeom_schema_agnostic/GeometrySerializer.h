@@ -23,6 +23,9 @@
 #include "../ifcgeom_schema_agnostic/Serializer.h"
 #include "../ifcgeom_schema_agnostic/IfcGeomElement.h"
 
+#include <array>
+#include <string>
+
 class SerializerSettings : public IfcGeom::IteratorSettings
 {
 public:
@@ -30,27 +33,33 @@ public:
     {
         /// Use entity names instead of unique IDs for naming elements.
         /// Applicable for OBJ, DAE, and SVG output.
-        USE_ELEMENT_NAMES = 1U << (IfcGeom::IteratorSettings::NUM_SETTINGS + 1U),
+        USE_ELEMENT_NAMES = 1ULL << (IfcGeom::IteratorSettings::NUM_SETTINGS + 1ULL),
         /// Use entity GUIDs instead of unique IDs for naming elements.
         /// Applicable for OBJ, DAE, and SVG output.
-        USE_ELEMENT_GUIDS = 1U << (IfcGeom::IteratorSettings::NUM_SETTINGS + 2U),
+        USE_ELEMENT_GUIDS = 1ULL << (IfcGeom::IteratorSettings::NUM_SETTINGS + 2ULL),
         /// Use material names instead of unique IDs for naming materials.
         /// Applicable for OBJ and DAE output.
-        USE_MATERIAL_NAMES = 1U << (IfcGeom::IteratorSettings::NUM_SETTINGS + 3U),
+        USE_MATERIAL_NAMES = 1ULL << (IfcGeom::IteratorSettings::NUM_SETTINGS + 3ULL),
 		/// Use element types instead of unique IDs for naming elements.
 		/// Applicable for DAE output.
-		USE_ELEMENT_TYPES = 1U << (IfcGeom::IteratorSettings::NUM_SETTINGS + 4U),
+		USE_ELEMENT_TYPES = 1ULL << (IfcGeom::IteratorSettings::NUM_SETTINGS + 4ULL),
 		/// Order the elements using their IfcBuildingStorey parent
 		/// Applicable for DAE output
-		USE_ELEMENT_HIERARCHY = 1U << (IfcGeom::IteratorSettings::NUM_SETTINGS + 5U),
+		USE_ELEMENT_HIERARCHY = 1ULL << (IfcGeom::IteratorSettings::NUM_SETTINGS + 5ULL),
         /// Use step ids for naming elements.
 		/// Applicable for OBJ, DAE, and SVG output.
-		USE_ELEMENT_STEPIDS = 1U << (IfcGeom::IteratorSettings::NUM_SETTINGS + 6U),
+		USE_ELEMENT_STEPIDS = 1ULL << (IfcGeom::IteratorSettings::NUM_SETTINGS + 6ULL),
 		/// Use Y UP .
 		/// Applicable for OBJ output.
 		USE_Y_UP = 1ULL << (IfcGeom::IteratorSettings::NUM_SETTINGS + 7ULL),
+		/// Store positions as 16-bit and normals as 8-bit integers (KHR_mesh_quantization).
+		/// Applicable for glTF output.
+		GLTF_QUANTIZE = 1ULL << (IfcGeom::IteratorSettings::NUM_SETTINGS + 8ULL),
+		/// Compress vertex and index data (EXT_meshopt_compression).
+		/// Applicable for glTF output.
+		GLTF_MESHOPT_COMPRESSION = 1ULL << (IfcGeom::IteratorSettings::NUM_SETTINGS + 9ULL),
 		/// Number of different setting flags.
-        NUM_SETTINGS = 7
+        NUM_SETTINGS = 9
     };
 
     SerializerSettings()
@@ -99,6 +108,16 @@ public:
 	}
 };
 
+/// Output of a serializer for a single element, see GeometrySerializer::encode()
+struct encoded_chunk {
+	/// Position of the element in the output assigned by reserve(), e.g. the
+	/// number of vertices written before the element.
+	size_t offset;
+	std::string data;
+
+	encoded_chunk() : offset(0) {}
+};
+
 class GeometrySerializer : public Serializer {
 public:
 	enum read_type { READ_BREP, READ_TRIANGULATION };
@@ -110,7 +129,36 @@ public:
 	virtual void write(const IfcGeom::TriangulationElement* o) = 0;
 	virtual void write(const IfcGeom::BRepElement* o) = 0;
 	virtual void setUnitNameAndMagnitude(const std::string& name, float magnitude) = 0;
+	/// When used as a geometry cache for the iterator, read() and the write functions
+	/// are called concurrently from multiple threads.
 	virtual IfcGeom::Element* read(IfcParse::IfcFile& f, const std::string& guid, const std::string& representation_id, read_type rt = READ_BREP) = 0;
+	/// Content addressed storage: the geometry is stored under key instead of under the
+	/// GlobalId of the element. Read back using read(f, key, key, rt).
+	virtual void write_by_key(const std::string& key, const IfcGeom::TriangulationElement* o) = 0;
+	virtual void write_by_key(const std::string& key, const IfcGeom::BRepElement* o) = 0;
+	/// Whether an offset that is only known after all elements have been written can
+	/// still be applied to the output, e.g. because it is assembled in finalize().
+	virtual bool supportsDeferredOffset() const { return false; }
+	/// Translates the entire model, to be called after the last write() and before finalize().
+	virtual void setDeferredOffset(const std::array<double, 3>& /*offset*/) {
+		throw std::runtime_error("Not supported");
+	}
+
+	/// Whether write() of triangulated elements is split into reserve(), encode()
+	/// and append() so that elements can be formatted concurrently, see
+	/// serialization_pipeline.
+	virtual bool supportsEncoding() const { return false; }
+	/// Called in the order of the elements before encode(), records in the chunk
+	/// the state of the output that the encoding depends on.
+	virtual void reserve(const IfcGeom::TriangulationElement* /*o*/, encoded_chunk& /*chunk*/) {}
+	/// Formats the element into the chunk, can be called concurrently for different elements.
+	virtual void encode(const IfcGeom::TriangulationElement* /*o*/, encoded_chunk& /*chunk*/) {
+		throw std::runtime_error("Not supported");
+	}
+	/// Writes an encoded chunk to the output, called in the order of the elements.
+	virtual void append(const IfcGeom::TriangulationElement* /*o*/, const encoded_chunk& /*chunk*/) {
+		throw std::runtime_error("Not supported");
+	}
 
     const SerializerSettings& settings() const { return settings_; }
     SerializerSettings& settings() { return settings_; }
@@ -135,6 +183,14 @@ public:
 	virtual IfcGeom::Element* read(IfcParse::IfcFile&, const std::string&, const std::string&, read_type = READ_BREP) {
 		throw std::runtime_error("Not supported");
 	};
+
+	virtual void write_by_key(const std::string&, const IfcGeom::TriangulationElement*) {
+		throw std::runtime_error("Not supported");
+	}
+
+	virtual void write_by_key(const std::string&, const IfcGeom::BRepElement*) {
+		throw std::runtime_error("Not supported");
+	}
 };
 
 #endif
@@ -10,3 +10,15 @@ void IfcGeom::IteratorSettings::set_deflection_tolerance(double value)
 		deflection_tolerance_ = 1e-3;
 	}
 }
+
+void IfcGeom::IteratorSettings::set_lod_deflection_tolerances(const std::vector<double>& value)
+{
+	lod_deflection_tolerances_.clear();
+	for (double d : value) {
+		if (d <= 1e-6) {
+			Logger::Message(Logger::LOG_WARNING, "Level of detail deflection tolerance cannot be set to <= 1e-6; ignoring");
+		} else {
+			lod_deflection_tolerances_.push_back(d);
+		}
+	}
+}
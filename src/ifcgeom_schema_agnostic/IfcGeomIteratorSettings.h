@@ -27,6 +27,7 @@
 
 #include <set>
 #include <array>
+#include <vector>
 
 namespace IfcGeom
 {
@@ -117,14 +118,34 @@ namespace IfcGeom
 			DEBUG_BOOLEAN = 1 << 23,
 			/// Try to perform boolean subtractions in 2d. Defaults to true.
 			BOOLEAN_ATTEMPT_2D = 1 << 24,
+			/// Subtract openings and other boolean operands on triangulated representations
+			/// of the operands (experimental). The result is approximate, the BRep operation
+			/// is used when the operands do not triangulate into closed meshes.
+			MESH_BOOLEAN = 1 << 25,
+			/// Key the geometry cache on a digest of the representation, the relevant settings
+			/// and, when they affect the geometry, placement and openings, rather than on the
+			/// GlobalId. Cache entries are then reused across revisions and renumbered models.
+			CACHE_BY_CONTENT = 1 << 26,
+			/// Interpret the deflection tolerances used for triangulation, including the ones
+			/// of the levels of detail, as fractions of the bounding box diagonal of the element.
+			RELATIVE_DEFLECTION = 1 << 27,
+			/// Retry elements that exceed their conversion budget without subtracting openings,
+			/// see element_timeout() and element_memory_limit(). Otherwise these elements are skipped.
+			BUDGET_FALLBACK = 1 << 28,
+			/// Triangulate shapes of which all faces are planar and bounded by straight edges,
+			/// such as extrusions of polygonal profiles, by ear clipping the faces rather than
+			/// by BRepMesh. Other shapes are meshed by BRepMesh regardless.
+			TRIANGULATE_PLANAR_FACES = 1 << 29,
 			/// Number of different setting flags.
-			NUM_SETTINGS = 25,
+			NUM_SETTINGS = 30,
         };
 
         IteratorSettings()
             : settings_(WELD_VERTICES | BOOLEAN_ATTEMPT_2D) // OR options that default to true here
             , deflection_tolerance_(1.e-3)
 			, angular_tolerance_(0.5)
+			, element_timeout_(0.)
+			, element_memory_limit_(0)
         {
         }
 
@@ -133,6 +154,13 @@ namespace IfcGeom
 		double angular_tolerance() const { return angular_tolerance_; }
 		double force_space_transparency() const { return force_space_transparency_; }
 		std::set<int> context_ids() const { return context_ids_; }
+		/// Deflection tolerances of additional, coarser, levels of detail that are triangulated
+		/// from the same BRep. None by default.
+		const std::vector<double>& lod_deflection_tolerances() const { return lod_deflection_tolerances_; }
+		/// Wall-clock time in seconds after which the conversion of an element is aborted, zero for no limit.
+		double element_timeout() const { return element_timeout_; }
+		/// Growth of resident memory in bytes after which the conversion of an element is aborted, zero for no limit.
+		size_t element_memory_limit() const { return element_memory_limit_; }
 
 		/// @todo Using deflection tolerance of 1e-6 or smaller hangs the conversion, research more in-depth.
 		/// This bug can be reproduced e.g. with the Duplex model that can be found from http://www.nibs.org/?page=bsa_commonbimfiles#project1
@@ -142,6 +170,16 @@ namespace IfcGeom
 			angular_tolerance_ = value;
 		}
 
+		void set_lod_deflection_tolerances(const std::vector<double>& value);
+
+		void set_element_timeout(double value) {
+			element_timeout_ = value;
+		}
+
+		void set_element_memory_limit(size_t value) {
+			element_memory_limit_ = value;
+		}
+
 		void force_space_transparency(double value) {
 			force_space_transparency_ = value;
 		}
@@ -181,6 +219,9 @@ namespace IfcGeom
 		uint64_t settings_;
         double deflection_tolerance_, angular_tolerance_, force_space_transparency_;
 		std::set<int> context_ids_;
+		std::vector<double> lod_deflection_tolerances_;
+		double element_timeout_;
+		size_t element_memory_limit_;
     };
 
     class IFC_GEOM_API ElementSettings : public IteratorSettings
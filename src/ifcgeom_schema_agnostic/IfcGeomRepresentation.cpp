@@ -27,8 +27,14 @@
 #include <BRepGProp.hxx>
 #include <GProp_GProps.hxx>
 
+#include <BRepTools_WireExplorer.hxx>
+#include <Poly_Array1OfTriangle.hxx>
+#include <Bnd_Box.hxx>
+#include <BRepBndLib.hxx>
+
 #include "../ifcparse/IfcLogger.h"
 #include "../ifcgeom_schema_agnostic/Kernel.h"
+#include "../ifcgeom_schema_agnostic/mesh_utils.h"
 
 IfcGeom::Representation::Serialization::Serialization(const BRep& brep)
 	: Representation(brep.settings())
@@ -256,11 +262,159 @@ bool IfcGeom::Representation::BRep::calculate_projected_surface_area(const gp_Ax
 	}
 }
 
+namespace {
+	// The length of the bounding box diagonal of the items, after applying their
+	// placement, used as the size of the element for relative deflection tolerances.
+	double element_size(const IfcGeom::Representation::BRep& shape_model) {
+		Bnd_Box total;
+		for (auto& item : shape_model) {
+			Bnd_Box box;
+			BRepBndLib::Add(item.Shape(), box);
+			if (box.IsVoid()) {
+				continue;
+			}
+			double xyz[6];
+			box.Get(xyz[0], xyz[1], xyz[2], xyz[3], xyz[4], xyz[5]);
+			for (int i = 0; i < 8; ++i) {
+				gp_XYZ corner(xyz[(i & 1) ? 3 : 0], xyz[(i & 2) ? 4 : 1], xyz[(i & 4) ? 5 : 2]);
+				item.Placement().Transforms(corner);
+				total.Add(gp_Pnt(corner));
+			}
+		}
+		if (total.IsVoid()) {
+			return 1.;
+		}
+		return std::sqrt(total.SquareExtent());
+	}
+
+	// Assigns a triangulation to the faces of polyhedral shapes, such as the extrusions
+	// of polygonal profiles, by ear clipping the wires in the parameter space of the
+	// face plane. This is exact regardless of the deflection and faster than BRepMesh,
+	// see IteratorSettings::TRIANGULATE_PLANAR_FACES. Returns false, leaving the shape untouched, when a face is not
+	// planar or has curved edges, in which case the shape is meshed by BRepMesh.
+	bool triangulate_planar_faces(const TopoDS_Shape& s) {
+		std::vector<std::pair<TopoDS_Face, Handle(Poly_Triangulation)>> triangulations;
+
+		for (TopExp_Explorer exp(s, TopAbs_FACE); exp.More(); exp.Next()) {
+			// The triangulation is stored in the coordinate system of the face without its location
+			TopoDS_Face face = TopoDS::Face(exp.Current());
+			face.Location(TopLoc_Location());
+
+			Handle(Geom_Plane) plane = Handle(Geom_Plane)::DownCast(BRep_Tool::Surface(face));
+			if (plane.IsNull()) {
+				return false;
+			}
+
+			const gp_XYZ& origin = plane->Position().Location().XYZ();
+			const gp_XYZ& u = plane->Position().XDirection().XYZ();
+			const gp_XYZ& v = plane->Position().YDirection().XYZ();
+
+			const TopoDS_Wire outer = BRepTools::OuterWire(face);
+			if (outer.IsNull()) {
+				return false;
+			}
+			std::vector<TopoDS_Wire> wires = { outer };
+			for (TopExp_Explorer wexp(face, TopAbs_WIRE); wexp.More(); wexp.Next()) {
+				if (!wexp.Current().IsSame(outer)) {
+					wires.push_back(TopoDS::Wire(wexp.Current()));
+				}
+			}
+
+			std::vector<std::vector<IfcGeom::util::mesh::point2>> loops;
+			std::vector<gp_Pnt> points;
+			for (auto& w : wires) {
+				loops.emplace_back();
+				for (BRepTools_WireExplorer wexp(w, face); wexp.More(); wexp.Next()) {
+					if (BRepAdaptor_Curve(wexp.Current()).GetType() != GeomAbs_Line) {
+						return false;
+					}
+					const gp_Pnt p = BRep_Tool::Pnt(wexp.CurrentVertex());
+					loops.back().push_back({ (p.XYZ() - origin).Dot(u), (p.XYZ() - origin).Dot(v) });
+					points.push_back(p);
+				}
+			}
+
+			std::vector<std::array<int, 3>> triangles;
+			if (!IfcGeom::util::mesh::triangulate_polygon(loops, triangles) || triangles.empty()) {
+				return false;
+			}
+
+			TColgp_Array1OfPnt nodes(1, (int) points.size());
+			TColgp_Array1OfPnt2d uv_nodes(1, (int) points.size());
+			int i = 1;
+			for (auto& l : loops) {
+				for (auto& uv : l) {
+					nodes(i) = points[i - 1];
+					uv_nodes(i) = gp_Pnt2d(uv[0], uv[1]);
+					++i;
+				}
+			}
+
+			// Triangles are counter-clockwise in parameter space, like the ones created by BRepMesh
+			Poly_Array1OfTriangle tris(1, (int) triangles.size());
+			i = 1;
+			for (auto& t : triangles) {
+				tris(i++) = Poly_Triangle(t[0] + 1, t[1] + 1, t[2] + 1);
+			}
+
+			Handle(Poly_Triangulation) tri = new Poly_Triangulation(nodes, uv_nodes, tris);
+			triangulations.push_back(std::make_pair(face, tri));
+		}
+
+		if (triangulations.empty()) {
+			return false;
+		}
+
+		BRep_Builder builder;
+		for (auto& p : triangulations) {
+			builder.UpdateFace(p.first, p.second);
+		}
+
+		return true;
+	}
+}
+
 IfcGeom::Representation::Triangulation::Triangulation(const BRep& shape_model)
 	: Representation(shape_model.settings())
 	, id_(shape_model.id())
 	, weld_offset_(0)
 {
+	const bool relative = settings().get(IteratorSettings::RELATIVE_DEFLECTION);
+	const double size = relative ? element_size(shape_model) : 1.;
+
+	// Relative tolerances are clamped, as very small deflections hang BRepMesh.
+	auto absolute = [relative, size](double d) {
+		return relative ? (std::max)(d * size, 1.e-5) : d;
+	};
+
+	if (triangulate(shape_model, absolute(settings().deflection_tolerance()))) {
+		// The triangulation does not depend on the deflection, coarser levels would be identical
+		return;
+	}
+
+	// Every level of detail is meshed anew, as triangulate() removes the
+	// triangulations from the shapes once they are converted. Levels that
+	// are not coarser than the previous one are omitted.
+	size_t num_indices = _faces.size();
+	for (double d : settings().lod_deflection_tolerances()) {
+		std::shared_ptr<Triangulation> lod(new Triangulation(shape_model, id_ + "-lod" + std::to_string(lods_.size() + 1)));
+		lod->triangulate(shape_model, absolute(d));
+		if (lod->faces().size() < num_indices) {
+			num_indices = lod->faces().size();
+			lods_.push_back(lod);
+		}
+	}
+}
+
+IfcGeom::Representation::Triangulation::Triangulation(const BRep& shape_model, const std::string& id)
+	: Representation(shape_model.settings())
+	, id_(id)
+	, weld_offset_(0)
+{}
+
+bool IfcGeom::Representation::Triangulation::triangulate(const BRep& shape_model, double deflection_tolerance) {
+	bool exact = true;
+
 	for (IfcGeom::IfcRepresentationShapeItems::const_iterator iit = shape_model.begin(); iit != shape_model.end(); ++iit) {
 
 		// Don't weld vertices that belong to different items to prevent non-manifold situations.
@@ -293,9 +447,12 @@ IfcGeom::Representation::Triangulation::Triangulation(const BRep& shape_model)
 		const TopoDS_Shape& s = iit->Shape();
 		const gp_GTrsf& trsf = iit->Placement();
 
-		// Triangulate the shape
+		// Triangulate the shape, polyhedral shapes are optionally triangulated directly
 		try {
-			BRepMesh_IncrementalMesh(s, settings().deflection_tolerance(), false, settings().angular_tolerance());
+			if (!(settings().get(IteratorSettings::TRIANGULATE_PLANAR_FACES) && triangulate_planar_faces(s))) {
+				exact = false;
+				BRepMesh_IncrementalMesh(s, deflection_tolerance, false, settings().angular_tolerance());
+			}
 		} catch (...) {
 			Logger::Message(Logger::LOG_ERROR, "Failed to triangulate shape");
 			continue;
@@ -412,7 +569,7 @@ IfcGeom::Representation::Triangulation::Triangulation(const BRep& shape_model)
 			// belong to any face.
 			for (TopExp_Explorer texp(s, TopAbs_EDGE); texp.More(); texp.Next()) {
 				BRepAdaptor_Curve crv(TopoDS::Edge(texp.Current()));
-				GCPnts_QuasiUniformDeflection tessellater(crv, settings().deflection_tolerance());
+				GCPnts_QuasiUniformDeflection tessellater(crv, deflection_tolerance);
 				int n = tessellater.NbPoints();
 				int previous = -1;
 
@@ -471,6 +628,8 @@ IfcGeom::Representation::Triangulation::Triangulation(const BRep& shape_model)
 
 		BRepTools::Clean(s);
 	}
+
+	return exact;
 }
 
 /// Generates UVs for a single mesh using box projection.
@@ -128,6 +128,8 @@ namespace IfcGeom {
 			// @todo this can be improved
 			std::vector<std::shared_ptr<IfcGeom::SurfaceStyle>> styles_;
 
+			std::vector<std::shared_ptr<Triangulation>> lods_;
+
 		public:
 			const std::string& id() const { return id_; }
 			const std::vector<double>& verts() const { return _verts; }
@@ -137,6 +139,9 @@ namespace IfcGeom {
             const std::vector<double>& uvs() const { return uvs_; }
 			const std::vector<int>& material_ids() const { return _material_ids; }
 			const std::vector<Material>& materials() const { return _materials; }
+			/// Coarser levels of detail, in the order of IteratorSettings::lod_deflection_tolerances().
+			/// Levels with no fewer triangles than the previous level are omitted.
+			const std::vector<std::shared_ptr<Triangulation>>& lods() const { return lods_; }
 
 			Triangulation(const BRep& shape_model);
 			
@@ -172,6 +177,12 @@ namespace IfcGeom {
 			static std::vector<double> box_project_uvs(const std::vector<double> &vertices, const std::vector<double> &normals);
 
 		private:
+			Triangulation(const BRep& shape_model, const std::string& id);
+
+			/// Appends the triangulations of the items in shape_model at the specified deflection.
+			/// Returns true when all items are triangulated exactly, i.e. regardless of the deflection.
+			bool triangulate(const BRep& shape_model, double deflection_tolerance);
+
 			/// Welds vertices that belong to different faces
 			int addVertex(int material_index, const gp_XYZ& p);
 			void addEdge(int n1, int n2, std::map<std::pair<int, int>, int>& edgecount, std::vector<std::pair<int, int> >& edges_temp);
@@ -26,6 +26,8 @@
 #include "../ifcgeom_schema_agnostic/IfcGeomIterator.h"
 #include "../ifcgeom_schema_agnostic/IfcGeomMaterial.h"
 #include "../ifcgeom_schema_agnostic/Kernel.h"
+#include "../ifcgeom_schema_agnostic/mesh_utils.h"
+#include "../ifcgeom_schema_agnostic/boolean_utils.h"
 
 #include <NCollection_UBTree.hxx>
 #include <BRepBndLib.hxx>
@@ -38,6 +40,18 @@
 #include <TopTools_DataMapOfShapeInteger.hxx>
 #include <BRepBuilderAPI_MakeEdge.hxx>
 #include <BRepExtrema_ExtPF.hxx>
+#include <Standard_Version.hxx>
+#include <Standard_Failure.hxx>
+#include <BRepMesh_IncrementalMesh.hxx>
+#include <Poly_Triangulation.hxx>
+
+#include <set>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <cstring>
+#include <algorithm>
+#include <functional>
 
 namespace IfcGeom {
 
@@ -51,6 +65,17 @@ namespace IfcGeom {
 		double dot_product;
 	};
 
+	/// The closest hits of a batch of rays in flat arrays, with one value (three for
+	/// positions and normals) per ray. Rays that do not hit anything have a null
+	/// instance, style index -1, an infinite distance and NaN position and normal.
+	struct ray_batch_result {
+		std::vector<IfcUtil::IfcBaseEntity*> instances;
+		std::vector<int> style_indices;
+		std::vector<double> positions;
+		std::vector<double> normals;
+		std::vector<double> distances;
+	};
+
 	namespace {
 
 		// Approximates the distance `other` protrudes into `volume` by finding the
@@ -98,43 +123,105 @@ namespace IfcGeom {
 	}
 
 	namespace impl {
+
 		template <typename T>
 		class tree {
 
-			bool test(const TopoDS_Shape& A, const TopoDS_Shape& B, bool completely_within, double extend) const {
+			struct test_result {
+				bool hit;
+				double distance;
+				double protrusion_distance;
+			};
+
+			// Does not modify the tree or the operands, so that it can be called
+			// concurrently from clash_all().
+			static test_result evaluate(const TopoDS_Shape& A, const TopoDS_Shape& B, bool completely_within, double extend) {
 				if (extend > 0.) {
 					BRepExtrema_DistShapeShape dss(A, B);
 					if (dss.Perform() && dss.NbSolution() >= 1) {
 						if (dss.Value() <= extend) {
-							distances_.push_back(dss.Value());
-							protrusion_distances_.push_back(max_distance_inside(B, A));
-						}						
-						return dss.Value() <= extend;
+							return { true, dss.Value(), max_distance_inside(B, A) };
+						}
 					}
 				} else {
 					if (IfcGeom::Kernel::count(A, TopAbs_SHELL) == 0 ||
 						IfcGeom::Kernel::count(B, TopAbs_SHELL) == 0)
 					{
-						return false;
+						return { false, 0., 0. };
 					}
 
 					if (completely_within) {
-						BRepAlgoAPI_Cut cut(B, A);
-						if (cut.IsDone()) {
+						BRepAlgoAPI_Cut cut;
+						if (boolean_op(cut, B, A)) {
 							if (IfcGeom::Kernel::count(cut.Shape(), TopAbs_SHELL) == 0) {
-								return true;
+								return { true, 0., 0. };
 							}
 						}
 					} else {
-						BRepAlgoAPI_Common common(A, B);
-						if (common.IsDone()) {
+						BRepAlgoAPI_Common common;
+						if (boolean_op(common, A, B)) {
 							if (IfcGeom::Kernel::count(common.Shape(), TopAbs_SHELL) > 0) {
-								return true;
+								return { true, 0., 0. };
 							}
 						}
 					}
 				}
-				return false;
+				return { false, 0., 0. };
+			}
+
+			template <typename Op>
+			static bool boolean_op(Op& op, const TopoDS_Shape& a, const TopoDS_Shape& b) {
+				TopTools_ListOfShape arguments, tools;
+				arguments.Append(a);
+				tools.Append(b);
+				op.SetArguments(arguments);
+				op.SetTools(tools);
+#if OCC_VERSION_HEX >= 0x70000
+				// The operands are shared between the threads of clash_all()
+				op.SetNonDestructive(true);
+#endif
+				op.Build();
+				return op.IsDone();
+			}
+
+			const util::mesh::point_in_mesh* find_mesh(const T& t) const {
+				typename mesh_map_t::const_iterator it = meshes_.find(t);
+				if (it == meshes_.end()) {
+					return nullptr;
+				}
+				return it->second->classifier.get();
+			}
+
+			// Uses the triangulations of a and b when available, distances are not
+			// computed on the triangulations.
+			test_result evaluate(const T& a, const T& b, const TopoDS_Shape& A, const TopoDS_Shape& B, bool completely_within, double extend) const {
+				if (extend <= 0.) {
+					const util::mesh::point_in_mesh* ma = find_mesh(a);
+					const util::mesh::point_in_mesh* mb = find_mesh(b);
+					if (ma && mb) {
+						const bool hit = completely_within
+							? util::mesh::within(*ma, *mb, mesh_tolerance_)
+							: util::mesh::intersects(*ma, *mb, mesh_tolerance_);
+						return { hit, 0., -1. };
+					}
+				}
+				return evaluate(A, B, completely_within, extend);
+			}
+
+			bool test(const TopoDS_Shape& A, const TopoDS_Shape& B, bool completely_within, double extend) const {
+				return record(evaluate(A, B, completely_within, extend), extend);
+			}
+
+			bool test(const T& a, const T& b, const TopoDS_Shape& A, const TopoDS_Shape& B, bool completely_within, double extend) const {
+				return record(evaluate(a, b, A, B, completely_within, extend), extend);
+			}
+
+			bool record(const test_result& r, double extend) const {
+				if (r.hit && extend > 0.) {
+					distances_.push_back(r.distance);
+					protrusion_distances_.push_back(r.protrusion_distance);
+				}
+				return r.hit;
 			}
 
 		protected:
@@ -154,6 +241,30 @@ namespace IfcGeom {
 				BRepBndLib::AddClose(s, b);
 				add(t, b);
 				shapes_[t] = s;
+
+				if (mesh_deflection_ > 0.) {
+					std::shared_ptr<element_mesh> m(new element_mesh);
+					if (util::triangulate_closed(s, mesh_deflection_, Precision::Confusion(), m->mesh)) {
+						m->classifier.reset(new util::mesh::point_in_mesh(m->mesh));
+						meshes_[t] = m;
+					}
+				}
+			}
+
+			/// Experimental: tests for intersection and containment on triangulations of
+			/// the elements rather than using Boolean operations. The results are
+			/// approximate and their agreement with the Boolean operations has not yet
+			/// been established on real models. Needs to be enabled before elements are
+			/// added. Elements that do not triangulate into closed meshes are tested on
+			/// their BRep. Surfaces that penetrate each other by less than tolerance are
+			/// considered touching.
+			void enable_mesh_narrow_phase(double deflection, double tolerance = 1.e-5) {
+				mesh_deflection_ = deflection;
+				mesh_tolerance_ = tolerance;
+			}
+
+			bool mesh_narrow_phase() const {
+				return mesh_deflection_ > 0.;
 			}
 
 			std::vector<T> select_box(const T& t, bool completely_within = false, double extend=-1.e-5) const {
@@ -228,7 +339,7 @@ namespace IfcGeom {
 				for (it = ts.begin(); it != ts.end(); ++it) {
 					const TopoDS_Shape& B = shapes_.find(*it)->second;
 
-					if (test(A, B, completely_within, extend)) {
+					if (test(t, *it, A, B, completely_within, extend)) {
 						ts_filtered.push_back(*it);
 					}
 				}
@@ -315,6 +426,156 @@ namespace IfcGeom {
 				return ts_filtered;
 			}
 
+			enum clash_type {
+				// Pairs of which the volumes intersect
+				CLASH_INTERSECTION,
+				// Pairs (a, b) where b is completely within a
+				CLASH_CONTAINMENT,
+				// Pairs that are less than tolerance apart
+				CLASH_CLEARANCE
+			};
+
+			struct clash {
+				T a, b;
+				double distance;
+				double protrusion_distance;
+			};
+
+			// Tests all elements in a against all elements in b. The candidate pairs are
+			// found using bounding volume hierarchies over both sets, which are then
+			// tested in parallel using num_threads threads. Unlike select(), this does
+			// not modify the tree, the distances are stored in the results. For the
+			// symmetric clash types every pair is only reported once, also when a and b
+			// overlap. Tolerance is applied to the bounding boxes in the broad phase and
+			// is the maximum distance for CLASH_CLEARANCE.
+			std::vector<clash> clash_all(const std::vector<T>& a, const std::vector<T>& b, clash_type type, double tolerance, int num_threads) const {
+				std::vector<const TopoDS_Shape*> shapes_a, shapes_b;
+				std::vector<T> elements_a, elements_b;
+				std::vector<util::mesh::box3> boxes_a, boxes_b;
+
+				auto gather = [this](const std::vector<T>& ts, std::vector<T>& elements, std::vector<const TopoDS_Shape*>& shapes, std::vector<util::mesh::box3>& boxes) {
+					for (auto& t : ts) {
+						typename map_t::const_iterator it = shapes_.find(t);
+						if (it == shapes_.end()) {
+							continue;
+						}
+						Bnd_Box bb;
+						BRepBndLib::AddClose(it->second, bb);
+						if (bb.IsVoid()) {
+							continue;
+						}
+						elements.push_back(t);
+						shapes.push_back(&it->second);
+						double x1, y1, z1, x2, y2, z2;
+						bb.Get(x1, y1, z1, x2, y2, z2);
+						boxes.emplace_back();
+						boxes.back().add(util::mesh::point3{ x1, y1, z1 });
+						boxes.back().add(util::mesh::point3{ x2, y2, z2 });
+					}
+				};
+
+				gather(a, elements_a, shapes_a, boxes_a);
+				gather(b, elements_b, shapes_b, boxes_b);
+
+				// The tolerance is applied to one of the sets only
+				for (auto& box : boxes_a) {
+					box.enlarge(tolerance);
+				}
+
+				const bool symmetric = type != CLASH_CONTAINMENT;
+				std::set<T> set_a, set_b;
+				if (symmetric) {
+					set_a.insert(elements_a.begin(), elements_a.end());
+					set_b.insert(elements_b.begin(), elements_b.end());
+				}
+
+				// Broad phase
+				std::vector<std::pair<size_t, size_t>> candidates;
+				{
+					util::mesh::bvh tree_a(boxes_a), tree_b(boxes_b);
+					util::mesh::overlapping_pairs(tree_a, tree_b, [&](int i, int j) {
+						const T& x = elements_a[i];
+						const T& y = elements_b[j];
+						if (x == y) {
+							return;
+						}
+						// The pair is also encountered in reverse order
+						if (symmetric && set_a.find(y) != set_a.end() && set_b.find(x) != set_b.end() && !std::less<T>()(x, y)) {
+							return;
+						}
+						candidates.push_back({ i, j });
+					});
+				}
+
+				// Narrow phase, every thread takes the next candidate from a shared
+				// counter and writes into its own buffer. The results are ordered by
+				// candidate afterwards to be independent of the scheduling.
+				typedef std::vector<std::pair<size_t, clash>> buffer_t;
+
+				if (num_threads < 1) {
+					num_threads = 1;
+				}
+				if ((size_t) num_threads > candidates.size()) {
+					num_threads = (int) (std::max)(candidates.size(), (size_t) 1);
+				}
+
+				std::vector<buffer_t> buffers(num_threads);
+				std::atomic<size_t> next(0);
+
+				auto work = [&](buffer_t& buffer) {
+					for (size_t c = next++; c < candidates.size(); c = next++) {
+						const T& x = elements_a[candidates[c].first];
+						const T& y = elements_b[candidates[c].second];
+						const TopoDS_Shape& A = *shapes_a[candidates[c].first];
+						const TopoDS_Shape& B = *shapes_b[candidates[c].second];
+						try {
+							test_result r = evaluate(x, y, A, B, type == CLASH_CONTAINMENT, type == CLASH_CLEARANCE ? tolerance : -1.);
+							if (r.hit) {
+								// Not approximated on the triangulations, where it is left at -1
+								if (type == CLASH_INTERSECTION && !(find_mesh(x) && find_mesh(y))) {
+									r.protrusion_distance = max_distance_inside(B, A);
+								}
+								buffer.push_back({ c, { x, y, r.distance, r.protrusion_distance } });
+							}
+						} catch (const Standard_Failure& e) {
+							if (e.GetMessageString() && strlen(e.GetMessageString())) {
+								Logger::Error(e.GetMessageString());
+							} else {
+								Logger::Error("Unknown error in clash test");
+							}
+						} catch (const std::exception& e) {
+							Logger::Error(e);
+						} catch (...) {
+							Logger::Error("Unknown error in clash test");
+						}
+					}
+				};
+
+				std::vector<std::thread> threads;
+				for (int i = 1; i < num_threads; ++i) {
+					threads.emplace_back(work, std::ref(buffers[i]));
+				}
+				work(buffers[0]);
+				for (auto& t : threads) {
+					t.join();
+				}
+
+				buffer_t merged;
+				for (auto& buffer : buffers) {
+					merged.insert(merged.end(), buffer.begin(), buffer.end());
+				}
+				std::sort(merged.begin(), merged.end(), [](const std::pair<size_t, clash>& x, const std::pair<size_t, clash>& y) {
+					return x.first < y.first;
+				});
+
+				std::vector<clash> results;
+				results.reserve(merged.size());
+				for (auto& m : merged) {
+					results.push_back(m.second);
+				}
+				return results;
+			}
+
 		protected:
 			typedef NCollection_UBTree<T, Bnd_Box> tree_t;
 			typedef std::map<T, TopoDS_Shape> map_t;
@@ -324,6 +585,16 @@ namespace IfcGeom {
 			
 			bool enable_face_styles_ = false;
 
+			struct element_mesh {
+				util::mesh::triangle_mesh mesh;
+				std::unique_ptr<util::mesh::point_in_mesh> classifier;
+			};
+			typedef std::map<T, std::shared_ptr<element_mesh>> mesh_map_t;
+
+			mesh_map_t meshes_;
+			double mesh_deflection_ = -1.;
+			double mesh_tolerance_ = 1.e-5;
+
 			class selector : public tree_t::Selector
 			{
 			public:
@@ -366,17 +637,21 @@ namespace IfcGeom {
 			add_file(f, settings);
 		}
 
+		tree(IfcParse::IfcFile& f, const IfcGeom::IteratorSettings& settings, int num_threads) {
+			add_file(f, settings, num_threads);
+		}
+
 		tree(IfcGeom::Iterator& it) {
 			add_file(it);
 		}		
 
-		void add_file(IfcParse::IfcFile& f, const IfcGeom::IteratorSettings& settings) {
+		void add_file(IfcParse::IfcFile& f, const IfcGeom::IteratorSettings& settings, int num_threads = 1) {
 			IfcGeom::IteratorSettings settings_ = settings;
 			settings_.set(IfcGeom::IteratorSettings::DISABLE_TRIANGULATION, true);
 			settings_.set(IfcGeom::IteratorSettings::USE_WORLD_COORDS, true);
 			settings_.set(IfcGeom::IteratorSettings::SEW_SHELLS, true);
 
-			IfcGeom::Iterator it(settings_, &f);
+			IfcGeom::Iterator it(settings_, &f, num_threads);
 
 			add_file(it);
 		}
@@ -396,6 +671,10 @@ namespace IfcGeom {
 			auto compound = elem->geometry().as_compound();
 			compound.Move(elem->transformation().data());
 			add(elem->product(), compound);
+			{
+				std::lock_guard<std::mutex> lk(ray_scene_mutex_);
+				ray_scene_.reset();
+			}
 			auto git = elem->geometry().begin();
 
 			if (enable_face_styles_) {
@@ -483,6 +762,103 @@ namespace IfcGeom {
 			return result;
 		}
 
+		/// Triangulates all elements into a single mesh with a bounding volume hierarchy
+		/// over its triangles for select_rays(). Called by select_rays() when the mesh
+		/// has not been built yet, adding elements afterwards invalidates it.
+		void build_ray_scene(double deflection = 1.e-3) {
+			std::lock_guard<std::mutex> lk(ray_scene_mutex_);
+			build_ray_scene_(deflection);
+		}
+
+		/// Casts n rays from origins[3 * i] in directions[3 * i] and returns for every ray
+		/// the closest hit within max_distance. The rays are distributed over num_threads
+		/// threads, consecutive rays are traced together and should preferably be coherent.
+		/// The normal is the unit normal of the triangle hit, pointing outwards of the
+		/// face, the style index refers to styles() when face styles are enabled.
+		/// Concurrent calls are safe, the scene is built once by the first of them.
+		ray_batch_result select_rays(const double* origins, const double* directions, size_t n, double max_distance = 1000., int num_threads = 1) {
+			std::shared_ptr<const ray_scene> scene_ptr;
+			{
+				std::lock_guard<std::mutex> lk(ray_scene_mutex_);
+				if (!ray_scene_) {
+					build_ray_scene_(1.e-3);
+				}
+				// Kept alive for the duration of the call if elements are added concurrently
+				scene_ptr = ray_scene_;
+			}
+			const ray_scene& scene = *scene_ptr;
+			const util::mesh::triangle_mesh& mesh = scene.mesh;
+
+			ray_batch_result result;
+			result.instances.resize(n);
+			result.style_indices.resize(n);
+			result.positions.resize(3 * n);
+			result.normals.resize(3 * n);
+			result.distances.resize(n);
+
+			std::vector<int> hits(n);
+
+			// Rays are handed out in chunks of a number of packets
+			const size_t chunk = 64 * util::mesh::ray_caster::packet_size;
+			std::atomic<size_t> next(0);
+
+			auto work = [&]() {
+				for (size_t begin = next.fetch_add(chunk); begin < n; begin = next.fetch_add(chunk)) {
+					const size_t end = (std::min)(begin + chunk, n);
+					scene.caster->cast(origins, directions, begin, end, max_distance, hits.data(), result.distances.data());
+
+					for (size_t i = begin; i < end; ++i) {
+						double* position = result.positions.data() + 3 * i;
+						double* normal = result.normals.data() + 3 * i;
+						const int t = hits[i];
+						if (t == -1) {
+							result.instances[i] = nullptr;
+							result.style_indices[i] = -1;
+							std::fill(position, position + 3, std::numeric_limits<double>::quiet_NaN());
+							std::fill(normal, normal + 3, std::numeric_limits<double>::quiet_NaN());
+							continue;
+						}
+						result.instances[i] = scene.instances[t];
+						result.style_indices[i] = scene.style_indices[t];
+
+						const double* o = origins + 3 * i;
+						const double* d = directions + 3 * i;
+						const double len = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+						for (int j = 0; j < 3; ++j) {
+							position[j] = o[j] + d[j] / len * result.distances[i];
+						}
+
+						util::mesh::point3 nm = mesh.triangle_normal(t);
+						const double nm_len = std::sqrt(util::mesh::dot(nm, nm));
+						for (int j = 0; j < 3; ++j) {
+							normal[j] = nm[j] / nm_len;
+						}
+					}
+				}
+			};
+
+			if (num_threads < 1) {
+				num_threads = 1;
+			}
+			std::vector<std::thread> threads;
+			for (int i = 1; i < num_threads; ++i) {
+				threads.emplace_back(work);
+			}
+			work();
+			for (auto& t : threads) {
+				t.join();
+			}
+
+			return result;
+		}
+
+		ray_batch_result select_rays(const std::vector<double>& origins, const std::vector<double>& directions, double max_distance = 1000., int num_threads = 1) {
+			if (origins.size() != directions.size() || origins.size() % 3) {
+				throw IfcParse::IfcException("Expected an equal number of origins and directions as xyz triplets");
+			}
+			return select_rays(origins.data(), directions.data(), origins.size() / 3, max_distance, num_threads);
+		}
+
 		bool enable_face_styles() const {
 			return enable_face_styles_;
 		}
@@ -500,6 +876,70 @@ namespace IfcGeom {
 
 		face_style_map_t face_styles_;
 		std::vector<IfcGeom::Material> styles_;
+
+		struct ray_scene {
+			util::mesh::triangle_mesh mesh;
+			// Per triangle
+			std::vector<IfcUtil::IfcBaseEntity*> instances;
+			std::vector<int> style_indices;
+			std::unique_ptr<util::mesh::ray_caster> caster;
+		};
+
+		std::shared_ptr<ray_scene> ray_scene_;
+		std::mutex ray_scene_mutex_;
+
+		// Requires ray_scene_mutex_ to be held
+		void build_ray_scene_(double deflection) {
+			std::shared_ptr<ray_scene> scene(new ray_scene);
+			auto& vertices = scene->mesh.vertices;
+			auto& triangles = scene->mesh.triangles;
+
+			for (auto& p : shapes_) {
+				try {
+					BRepMesh_IncrementalMesh(p.second, deflection, false, 0.5);
+				} catch (...) {
+					Logger::Error("Failed to triangulate shape", p.first);
+					continue;
+				}
+
+				TopExp_Explorer exp(p.second, TopAbs_FACE);
+				for (; exp.More(); exp.Next()) {
+					const TopoDS_Face& face = TopoDS::Face(exp.Current());
+					TopLoc_Location loc;
+					Handle(Poly_Triangulation) tri = BRep_Tool::Triangulation(face, loc);
+					if (tri.IsNull()) {
+						continue;
+					}
+
+					int style_index = -1;
+					if (enable_face_styles_ && face_styles_.IsBound(face)) {
+						style_index = face_styles_.Find(face);
+					}
+
+					const int offset = (int) vertices.size() - 1;
+					for (int i = 1; i <= tri->NbNodes(); ++i) {
+						const gp_XYZ xyz = tri->Node(i).Transformed(loc).XYZ();
+						vertices.push_back({ xyz.X(), xyz.Y(), xyz.Z() });
+					}
+
+					const Poly_Array1OfTriangle& tris = tri->Triangles();
+					for (int i = 1; i <= tris.Length(); ++i) {
+						int n1, n2, n3;
+						if (face.Orientation() == TopAbs_REVERSED) {
+							tris(i).Get(n3, n2, n1);
+						} else {
+							tris(i).Get(n1, n2, n3);
+						}
+						triangles.push_back({ offset + n1, offset + n2, offset + n3 });
+						scene->instances.push_back(p.first);
+						scene->style_indices.push_back(style_index);
+					}
+				}
+			}
+
+			scene->caster.reset(new util::mesh::ray_caster(scene->mesh));
+			ray_scene_ = scene;
+		}
 	};
 
 }
@@ -4,6 +4,7 @@
 #include "../ifcparse/IfcFile.h"
 #include "../ifcgeom_schema_agnostic/IfcGeomIteratorSettings.h"
 #include "../ifcgeom_schema_agnostic/IfcRepresentationShapeItem.h"
+#include "../ifcgeom_schema_agnostic/placement_table.h"
 
 #include <boost/preprocessor/stringize.hpp>
 #include <boost/preprocessor/seq/size.hpp>
@@ -94,7 +95,8 @@ namespace IfcGeom {
 			GV_PRECISION_FACTOR,
 			GV_NO_WIRE_INTERSECTION_TOLERANCE,
 			GV_DEBUG_BOOLEAN,
-			GV_BOOLEAN_ATTEMPT_2D
+			GV_BOOLEAN_ATTEMPT_2D,
+			GV_MESH_BOOLEAN
 		};
 
 		IFC_PARSE_API Kernel(IfcParse::IfcFile* file_);
@@ -124,6 +126,12 @@ namespace IfcGeom {
 			return implementation_->convert_placement(item, trsf);
 		}
 
+		// Resolves all IfcLocalPlacements in the file into a table, levels of the
+		// placement hierarchy are processed using num_threads threads.
+		virtual std::shared_ptr<const placement_table> build_placement_table(IfcParse::IfcFile* file, int num_threads) {
+			return implementation_->build_placement_table(file, num_threads);
+		}
+
 		IFC_PARSE_API static int count(const TopoDS_Shape&, TopAbs_ShapeEnum, bool unique = false);
 		IFC_PARSE_API static int surface_genus(const TopoDS_Shape&);
 
@@ -1,6 +1,7 @@
 #include "boolean_utils.h"
 
 #include "../ifcgeom_schema_agnostic/IfcGeomTree.h"
+#include "../ifcgeom_schema_agnostic/mesh_utils.h"
 
 #include <BRepBuilderAPI_Copy.hxx>
 #include <TopExp_Explorer.hxx>
@@ -16,8 +17,18 @@
 #include <GeomAPI_ExtremaCurveCurve.hxx>
 #include <ShapeAnalysis_Surface.hxx>
 #include <BRepBuilderAPI_MakeFace.hxx>
+#include <BRepBuilderAPI_MakeEdge.hxx>
+#include <BRepBuilderAPI_MakeVertex.hxx>
+#include <BRepMesh_IncrementalMesh.hxx>
+#include <Poly_Triangulation.hxx>
+#include <TopoDS_Shell.hxx>
+#include <TopoDS_Solid.hxx>
+#include <TopoDS_Wire.hxx>
+#include <BRep_Builder.hxx>
+#include <gp_Pln.hxx>
 #include <Standard_Version.hxx>
 
+#include <map>
 #include <vector>
 
 void IfcGeom::util::copy_operand(const TopTools_ListOfShape & l, TopTools_ListOfShape & r) {
@@ -763,6 +774,144 @@ bool IfcGeom::util::boolean_subtraction_2d_using_builder(const TopoDS_Shape & a_
 	return true;
 }
 
+bool IfcGeom::util::triangulate_closed(const TopoDS_Shape& s, double deflection, double eps, IfcGeom::util::mesh::triangle_mesh& m) {
+	// The copy is triangulated, because triangulations are stored on the TShapes,
+	// which s may share with other shapes (e.g mapped items, or the shapes stored
+	// in IfcGeom::tree). BRepMesh would reuse them when these are triangulated
+	// later on with a different deflection.
+	TopoDS_Shape copy;
+	try {
+		copy = BRepBuilderAPI_Copy(s);
+		BRepMesh_IncrementalMesh(copy, deflection, false, 0.5);
+	} catch (...) {
+		return false;
+	}
+
+	// Face triangulations do not share nodes, they are merged by position so
+	// that the closedness of the mesh can be established.
+	IfcGeom::util::mesh::vertex_welder welder(m.vertices, eps);
+
+	TopExp_Explorer exp(copy, TopAbs_FACE);
+	for (; exp.More(); exp.Next()) {
+		const TopoDS_Face& face = TopoDS::Face(exp.Current());
+		TopLoc_Location loc;
+		Handle(Poly_Triangulation) tri = BRep_Tool::Triangulation(face, loc);
+		if (tri.IsNull()) {
+			return false;
+		}
+
+		std::vector<int> indices;
+		indices.reserve(tri->NbNodes());
+		for (int i = 1; i <= tri->NbNodes(); ++i) {
+			const gp_XYZ p = tri->Node(i).Transformed(loc).XYZ();
+			indices.push_back(welder.add(IfcGeom::util::mesh::point3{ p.X(), p.Y(), p.Z() }));
+		}
+
+		const Poly_Array1OfTriangle& triangles = tri->Triangles();
+		for (int i = 1; i <= triangles.Length(); ++i) {
+			int n1, n2, n3;
+			if (face.Orientation() == TopAbs_REVERSED) {
+				triangles(i).Get(n3, n2, n1);
+			} else {
+				triangles(i).Get(n1, n2, n3);
+			}
+			std::array<int, 3> t = { indices[n1 - 1], indices[n2 - 1], indices[n3 - 1] };
+			if (t[0] != t[1] && t[1] != t[2] && t[0] != t[2]) {
+				m.triangles.push_back(t);
+			}
+		}
+	}
+
+	return m.is_closed();
+}
+
+namespace {
+	bool polygon_mesh_to_shape(const IfcGeom::util::mesh::polygon_mesh& m, TopoDS_Shape& result) {
+		std::vector<TopoDS_Vertex> vertices;
+		vertices.reserve(m.vertices.size());
+		for (auto& p : m.vertices) {
+			vertices.push_back(BRepBuilderAPI_MakeVertex(gp_Pnt(p[0], p[1], p[2])));
+		}
+
+		// Edges are shared between adjacent faces so that a valid shell is formed
+		std::map<std::pair<int, int>, TopoDS_Edge> edges;
+
+		BRep_Builder B;
+		TopoDS_Shell shell;
+		B.MakeShell(shell);
+
+		for (auto& poly : m.polygons) {
+			gp_XYZ normal, center;
+			for (size_t i = 0; i < poly.size(); ++i) {
+				const auto& a = m.vertices[poly[i]];
+				const auto& b = m.vertices[poly[(i + 1) % poly.size()]];
+				normal += gp_XYZ(
+					(a[1] - b[1]) * (a[2] + b[2]),
+					(a[2] - b[2]) * (a[0] + b[0]),
+					(a[0] - b[0]) * (a[1] + b[1]));
+				center += gp_XYZ(a[0], a[1], a[2]);
+			}
+			if (normal.Modulus() < gp::Resolution()) {
+				continue;
+			}
+			center /= (double) poly.size();
+
+			TopoDS_Wire wire;
+			B.MakeWire(wire);
+			for (size_t i = 0; i < poly.size(); ++i) {
+				const int u = poly[i];
+				const int v = poly[(i + 1) % poly.size()];
+				const auto key = std::make_pair((std::min)(u, v), (std::max)(u, v));
+				auto it = edges.find(key);
+				if (it == edges.end()) {
+					BRepBuilderAPI_MakeEdge me(vertices[key.first], vertices[key.second]);
+					if (!me.IsDone()) {
+						return false;
+					}
+					it = edges.insert(std::make_pair(key, me.Edge())).first;
+				}
+				B.Add(wire, u == key.first ? it->second : TopoDS::Edge(it->second.Reversed()));
+			}
+
+			BRepBuilderAPI_MakeFace mf(gp_Pln(gp_Pnt(center), gp_Dir(normal)), wire, true);
+			if (!mf.IsDone()) {
+				return false;
+			}
+			B.Add(shell, mf.Face());
+		}
+
+		TopoDS_Solid solid;
+		B.MakeSolid(solid);
+		B.Add(solid, shell);
+		result = solid;
+
+		return true;
+	}
+}
+
+bool IfcGeom::util::boolean_subtraction_using_mesh(const TopoDS_Shape& a_input, const TopTools_ListOfShape& b_input, TopoDS_Shape& result, double deflection, double eps) {
+	IfcGeom::util::mesh::triangle_mesh a;
+	if (!triangulate_closed(a_input, deflection, eps, a)) {
+		return false;
+	}
+
+	std::vector<IfcGeom::util::mesh::triangle_mesh> bs;
+	TopTools_ListIteratorOfListOfShape it(b_input);
+	for (; it.More(); it.Next()) {
+		bs.emplace_back();
+		if (!triangulate_closed(it.Value(), deflection, eps, bs.back())) {
+			return false;
+		}
+	}
+
+	IfcGeom::util::mesh::polygon_mesh r;
+	if (!IfcGeom::util::mesh::subtract(a, bs, r, eps)) {
+		return false;
+	}
+
+	return polygon_mesh_to_shape(r, result);
+}
+
 void IfcGeom::util::points_on_planar_face_generator::reset() {
 	i = j = (int)inset_;
 }
@@ -29,6 +29,8 @@
 #include <BRepTools.hxx>
 #include <TopTools_IndexedMapOfShape.hxx>
 
+#include "../ifcgeom_schema_agnostic/mesh_utils.h"
+
 namespace IfcGeom {
 	namespace util {
 
@@ -84,6 +86,17 @@ namespace IfcGeom {
 
 		bool boolean_subtraction_2d_using_builder(const TopoDS_Shape& a_input, const TopTools_ListOfShape& b_input, TopoDS_Shape& result, double eps);
 
+		// Triangulates the operands with the given deflection and subtracts them using
+		// the mesh based algorithm in mesh_utils.h. Returns false when one of the
+		// operands does not triangulate into a closed mesh or the result is empty, in
+		// which case the caller is expected to resort to the BRep boolean operation.
+		bool boolean_subtraction_using_mesh(const TopoDS_Shape& a_input, const TopTools_ListOfShape& b_input, TopoDS_Shape& result, double deflection, double eps);
+
+		// Triangulates a copy of s with the given deflection into m, with the nodes of
+		// adjacent faces merged within eps. No triangulations are stored on s. Returns
+		// whether the resulting mesh is closed.
+		bool triangulate_closed(const TopoDS_Shape& s, double deflection, double eps, IfcGeom::util::mesh::triangle_mesh& m);
+
 	}
 }
 
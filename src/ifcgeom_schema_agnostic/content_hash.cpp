@@ -0,0 +1,230 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#include "content_hash.h"
+
+#include "../ifcparse/Argument.h"
+#include "../ifcparse/IfcEntityInstanceData.h"
+#include "../ifcparse/aggregate_of_instance.h"
+#include "../ifcparse/IfcSchema.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <locale>
+#include <sstream>
+
+namespace {
+	uint32_t rotate_left(uint32_t v, int n) {
+		return (v << n) | (v >> (32 - n));
+	}
+}
+
+IfcGeom::sha1::sha1()
+	: block_size_(0)
+	, length_(0)
+{
+	state_[0] = 0x67452301;
+	state_[1] = 0xEFCDAB89;
+	state_[2] = 0x98BADCFE;
+	state_[3] = 0x10325476;
+	state_[4] = 0xC3D2E1F0;
+}
+
+void IfcGeom::sha1::process_block_() {
+	uint32_t w[80];
+	for (int i = 0; i < 16; ++i) {
+		w[i] = (uint32_t) block_[i * 4] << 24 | (uint32_t) block_[i * 4 + 1] << 16 |
+			(uint32_t) block_[i * 4 + 2] << 8 | (uint32_t) block_[i * 4 + 3];
+	}
+	for (int i = 16; i < 80; ++i) {
+		w[i] = rotate_left(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+	}
+
+	uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3], e = state_[4];
+	for (int i = 0; i < 80; ++i) {
+		uint32_t f, k;
+		if (i < 20) {
+			f = (b & c) | (~b & d);
+			k = 0x5A827999;
+		} else if (i < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ED9EBA1;
+		} else if (i < 60) {
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8F1BBCDC;
+		} else {
+			f = b ^ c ^ d;
+			k = 0xCA62C1D6;
+		}
+		const uint32_t t = rotate_left(a, 5) + f + e + k + w[i];
+		e = d;
+		d = c;
+		c = rotate_left(b, 30);
+		b = a;
+		a = t;
+	}
+
+	state_[0] += a;
+	state_[1] += b;
+	state_[2] += c;
+	state_[3] += d;
+	state_[4] += e;
+	block_size_ = 0;
+}
+
+void IfcGeom::sha1::process_bytes(const void* data, size_t length) {
+	const unsigned char* bytes = (const unsigned char*) data;
+	length_ += length;
+	while (length) {
+		const size_t n = std::min(length, sizeof(block_) - block_size_);
+		memcpy(block_ + block_size_, bytes, n);
+		block_size_ += n;
+		bytes += n;
+		length -= n;
+		if (block_size_ == sizeof(block_)) {
+			process_block_();
+		}
+	}
+}
+
+void IfcGeom::sha1::get_digest(unsigned char (&digest)[20]) const {
+	// Padding finalizes the state, so this is done on a copy
+	sha1 s = *this;
+	const uint64_t bits = length_ * 8;
+	const unsigned char one = 0x80, zero = 0x00;
+	s.process_bytes(&one, 1);
+	while (s.block_size_ != 56) {
+		s.process_bytes(&zero, 1);
+	}
+	unsigned char length[8];
+	for (int i = 0; i < 8; ++i) {
+		length[i] = (unsigned char) (bits >> ((7 - i) * 8));
+	}
+	s.process_bytes(length, 8);
+	for (int i = 0; i < 20; ++i) {
+		digest[i] = (unsigned char) (s.state_[i / 4] >> ((3 - i % 4) * 8));
+	}
+}
+
+void IfcGeom::content_hash::update_(const void* data, size_t length) {
+	sha_.process_bytes(data, length);
+}
+
+void IfcGeom::content_hash::add(const std::string& s) {
+	add((uint64_t) s.size());
+	update_(s.data(), s.size());
+}
+
+void IfcGeom::content_hash::add(uint64_t v) {
+	unsigned char bytes[8];
+	for (int i = 0; i < 8; ++i) {
+		bytes[i] = (unsigned char) (v >> (i * 8));
+	}
+	update_(bytes, 8);
+}
+
+void IfcGeom::content_hash::add(double v) {
+	std::ostringstream oss;
+	oss.imbue(std::locale::classic());
+	oss << std::setprecision(17) << v;
+	add(oss.str());
+}
+
+void IfcGeom::content_hash::add_argument_(const Argument* arg) {
+	if (arg == nullptr) {
+		add(std::string("$"));
+		return;
+	}
+
+	const IfcUtil::ArgumentType ty = arg->type();
+	add((uint64_t) ty);
+
+	switch (ty) {
+	case IfcUtil::Argument_ENTITY_INSTANCE: {
+		IfcUtil::IfcBaseClass* inst = *arg;
+		add(inst);
+		break;
+	}
+	case IfcUtil::Argument_AGGREGATE_OF_ENTITY_INSTANCE: {
+		aggregate_of_instance::ptr insts = *arg;
+		add((uint64_t) insts->size());
+		for (auto& inst : *insts) {
+			add(inst);
+		}
+		break;
+	}
+	case IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_ENTITY_INSTANCE: {
+		aggregate_of_aggregate_of_instance::ptr insts = *arg;
+		add((uint64_t) insts->size());
+		for (auto it = insts->begin(); it != insts->end(); ++it) {
+			add((uint64_t) it->size());
+			for (auto& inst : *it) {
+				add(inst);
+			}
+		}
+		break;
+	}
+	default:
+		// All other arguments do not refer to instances and their
+		// serialization is independent of instance names.
+		add(arg->toString());
+	}
+}
+
+void IfcGeom::content_hash::add(const IfcUtil::IfcBaseClass* instance) {
+	if (instance == nullptr) {
+		add(std::string("$"));
+		return;
+	}
+
+	// Simple types wrapped in a select, e.g. IfcLengthMeasure(1.), have no identity
+	const bool has_identity = instance->data().id() != 0;
+
+	if (has_identity) {
+		auto it = visited_.find(instance);
+		if (it != visited_.end()) {
+			add(std::string("#"));
+			add((uint64_t) it->second);
+			return;
+		}
+		const size_t index = visited_.size();
+		visited_.insert({ instance, index });
+	}
+
+	add(instance->declaration().name());
+
+	const IfcEntityInstanceData& data = instance->data();
+	const size_t n = data.getArgumentCount();
+	add((uint64_t) n);
+	for (size_t i = 0; i < n; ++i) {
+		add_argument_(data.getArgument(i));
+	}
+}
+
+std::string IfcGeom::content_hash::hex() const {
+	unsigned char digest[20];
+	sha_.get_digest(digest);
+	std::ostringstream oss;
+	oss << std::hex << std::setfill('0');
+	for (int i = 0; i < 20; ++i) {
+		oss << std::setw(2) << (unsigned int) digest[i];
+	}
+	return oss.str();
+}
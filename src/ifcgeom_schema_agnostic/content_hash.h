@@ -0,0 +1,79 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include "ifc_geom_api.h"
+
+#include "../ifcparse/IfcBaseClass.h"
+
+#include <map>
+#include <string>
+#include <cstdint>
+
+namespace IfcGeom {
+
+	/// SHA-1 (FIPS 180-4), used for content keys rather than for security.
+	/// Implemented here as Boost only provides it as an undocumented detail.
+	class IFC_GEOM_API sha1 {
+	private:
+		uint32_t state_[5];
+		unsigned char block_[64];
+		size_t block_size_;
+		uint64_t length_;
+
+		void process_block_();
+
+	public:
+		sha1();
+
+		void process_bytes(const void* data, size_t length);
+
+		/// Writes the 20 byte digest, the state is left as is, so that more bytes can be added
+		void get_digest(unsigned char (&digest)[20]) const;
+	};
+
+	/// Computes a digest over instance graphs that does not depend on the names
+	/// (STEP ids) of the instances. Instances are serialized depth first, every
+	/// instance that was already visited is replaced by the order in which it
+	/// was first encountered. This makes the digest suitable as a key for geometry
+	/// that remains valid across revisions and renumbering of a model.
+	class IFC_GEOM_API content_hash {
+	private:
+		sha1 sha_;
+		std::map<const IfcUtil::IfcBaseClass*, size_t> visited_;
+
+		void update_(const void* data, size_t length);
+		void add_argument_(const Argument* arg);
+
+	public:
+		/// Adds the instance and all instances it (directly or indirectly) refers to
+		void add(const IfcUtil::IfcBaseClass* instance);
+		void add(const std::string& s);
+		void add(uint64_t v);
+		void add(double v);
+
+		/// 40 character hexadecimal representation of the SHA-1 digest
+		std::string hex() const;
+	};
+
+}
+
+#endif
@@ -0,0 +1,138 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#include "conversion_budget.h"
+
+#include <Standard_Version.hxx>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#include <fstream>
+#endif
+
+namespace {
+	// Reading the resident memory involves a system call, the memory is therefore
+	// checked at most once per interval.
+	const std::chrono::milliseconds memory_check_interval(50);
+
+	class budget_progress_indicator : public Message_ProgressIndicator {
+	private:
+		const IfcGeom::conversion_budget& budget_;
+
+	public:
+		budget_progress_indicator(const IfcGeom::conversion_budget& budget)
+			: budget_(budget)
+		{}
+
+#if OCC_VERSION_HEX >= 0x70500
+		void Show(const Message_ProgressScope&, const Standard_Boolean) {}
+#else
+		Standard_Boolean Show(const Standard_Boolean) { return Standard_True; }
+#endif
+
+		Standard_Boolean UserBreak() {
+			return budget_.exceeded();
+		}
+	};
+}
+
+IfcGeom::conversion_budget::conversion_budget()
+	: running_(false)
+	, memory_limit_(0)
+	, memory_start_(0)
+	, exceeded_(NONE)
+	, next_memory_check_(0)
+{}
+
+void IfcGeom::conversion_budget::start(double seconds, size_t bytes) {
+	running_ = seconds > 0. || bytes > 0;
+	deadline_ = seconds > 0.
+		? clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds))
+		: clock::time_point::max();
+	memory_limit_ = bytes;
+	memory_start_ = bytes ? resident_memory() : 0;
+	exceeded_ = NONE;
+	next_memory_check_ = 0;
+}
+
+void IfcGeom::conversion_budget::stop() {
+	running_ = false;
+	exceeded_ = NONE;
+}
+
+IfcGeom::conversion_budget::resource IfcGeom::conversion_budget::exceeded_resource() const {
+	if (!running_) {
+		return NONE;
+	}
+
+	int exceeded = exceeded_;
+	if (exceeded != NONE) {
+		return (resource) exceeded;
+	}
+
+	const clock::time_point now = clock::now();
+	if (now > deadline_) {
+		exceeded = TIME;
+	} else if (memory_limit_) {
+		int64_t next = next_memory_check_;
+		const int64_t ticks = now.time_since_epoch().count();
+		if (ticks >= next && next_memory_check_.compare_exchange_strong(next, (now + memory_check_interval).time_since_epoch().count())) {
+			const size_t memory = resident_memory();
+			if (memory > memory_start_ && memory - memory_start_ > memory_limit_) {
+				exceeded = MEMORY;
+			}
+		}
+	}
+
+	if (exceeded != NONE) {
+		exceeded_ = exceeded;
+	}
+	return (resource) exceeded;
+}
+
+Handle(Message_ProgressIndicator) IfcGeom::conversion_budget::progress_indicator() const {
+	return new budget_progress_indicator(*this);
+}
+
+size_t IfcGeom::resident_memory() {
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return counters.WorkingSetSize;
+	}
+#elif defined(__APPLE__)
+	mach_task_basic_info info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t) &info, &count) == KERN_SUCCESS) {
+		return info.resident_size;
+	}
+#elif defined(__linux__)
+	std::ifstream statm("/proc/self/statm");
+	size_t size, resident;
+	if (statm >> size >> resident) {
+		return resident * (size_t) sysconf(_SC_PAGESIZE);
+	}
+#endif
+	return 0;
+}
@@ -0,0 +1,77 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#ifndef CONVERSION_BUDGET_H
+#define CONVERSION_BUDGET_H
+
+#include "ifc_geom_api.h"
+
+#include <Message_ProgressIndicator.hxx>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace IfcGeom {
+
+	/// Wall-clock and memory budget for the conversion of a single element, see
+	/// IteratorSettings::element_timeout() and IteratorSettings::element_memory_limit().
+	/// The kernel checks the budget before converting representation items, and
+	/// boolean operations are interrupted by means of an OCCT progress indicator.
+	/// Once exceeded, the budget remains exceeded until it is stopped. Memory is
+	/// measured as the growth of the resident memory of the process, which is
+	/// approximate when several elements are converted concurrently.
+	class IFC_GEOM_API conversion_budget {
+	public:
+		enum resource { NONE, TIME, MEMORY };
+
+	private:
+		typedef std::chrono::steady_clock clock;
+
+		bool running_;
+		clock::time_point deadline_;
+		size_t memory_limit_, memory_start_;
+		// Accessed by the threads of the boolean operations as well
+		mutable std::atomic<int> exceeded_;
+		mutable std::atomic<int64_t> next_memory_check_;
+
+		conversion_budget(const conversion_budget&);
+		conversion_budget& operator=(const conversion_budget&);
+
+	public:
+		conversion_budget();
+
+		/// Starts the budget, a value of zero leaves that resource unlimited
+		void start(double seconds, size_t bytes);
+		void stop();
+
+		bool running() const { return running_; }
+		bool exceeded() const { return exceeded_resource() != NONE; }
+		resource exceeded_resource() const;
+
+		/// A progress indicator that requests a user break when the budget is exceeded
+		Handle(Message_ProgressIndicator) progress_indicator() const;
+	};
+
+	/// The resident memory of the process in bytes, or zero when not available
+	IFC_GEOM_API size_t resident_memory();
+
+}
+
+#endif
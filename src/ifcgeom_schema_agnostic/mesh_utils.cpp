@@ -0,0 +1,1281 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#include "mesh_utils.h"
+
+#include <cmath>
+#include <functional>
+#include <map>
+#include <memory>
+#include <utility>
+
+using namespace IfcGeom::util::mesh;
+
+namespace {
+	// Shewchuk's static error bound for orient3d, epsilon being 2^-53
+	const double o3d_epsilon = std::ldexp(1., -53);
+	const double o3d_errbound = (7.0 + 56.0 * o3d_epsilon) * o3d_epsilon;
+
+	double norm(const point3& p) {
+		return std::sqrt(dot(p, p));
+	}
+
+	point3 centroid(const std::vector<point3>& ps) {
+		point3 c = { 0., 0., 0. };
+		for (auto& p : ps) {
+			c = c + p;
+		}
+		return c * (1. / ps.size());
+	}
+
+	box3 polygon_bounds(const std::vector<point3>& ps) {
+		box3 b;
+		for (auto& p : ps) {
+			b.add(p);
+		}
+		return b;
+	}
+
+	// Newell's method, length is twice the polygon area
+	point3 newell_normal(const std::vector<point3>& ps) {
+		point3 n = { 0., 0., 0. };
+		for (size_t i = 0; i < ps.size(); ++i) {
+			const point3& a = ps[i];
+			const point3& b = ps[(i + 1) % ps.size()];
+			n[0] += (a[1] - b[1]) * (a[2] + b[2]);
+			n[1] += (a[2] - b[2]) * (a[0] + b[0]);
+			n[2] += (a[0] - b[0]) * (a[1] + b[1]);
+		}
+		return n;
+	}
+
+	enum { COPLANAR = 0, FRONT = 1, BACK = 2, SPANNING = 3 };
+
+	// Splits a convex polygon by the plane n.x = w. Polygons within eps of the
+	// plane are returned unmodified in front.
+	void split_polygon(const std::vector<point3>& poly, const point3& n, double w, double eps, std::vector<point3>& front, std::vector<point3>& back) {
+		int polygon_type = 0;
+		std::vector<int> types(poly.size());
+		std::vector<double> ts(poly.size());
+		for (size_t i = 0; i < poly.size(); ++i) {
+			ts[i] = dot(n, poly[i]) - w;
+			types[i] = ts[i] < -eps ? BACK : ts[i] > eps ? FRONT : COPLANAR;
+			polygon_type |= types[i];
+		}
+		if (polygon_type != SPANNING) {
+			(polygon_type == BACK ? back : front) = poly;
+			return;
+		}
+		for (size_t i = 0; i < poly.size(); ++i) {
+			const size_t j = (i + 1) % poly.size();
+			const int ti = types[i], tj = types[j];
+			const point3& vi = poly[i];
+			const point3& vj = poly[j];
+			if (ti != BACK) front.push_back(vi);
+			if (ti != FRONT) back.push_back(vi);
+			if ((ti | tj) == SPANNING) {
+				const double t = ts[i] / (ts[i] - ts[j]);
+				const point3 v = vi + (vj - vi) * t;
+				front.push_back(v);
+				back.push_back(v);
+			}
+		}
+	}
+
+	// Interval of the line with unit direction d, in the plane of the convex
+	// polygon poly, covered by poly where it meets the plane n.x = w. Returns
+	// false when poly does not reach the plane or lies in it.
+	bool plane_interval(const std::vector<point3>& poly, const point3& n, double w, const point3& d, double eps, double& t0, double& t1) {
+		t0 = +std::numeric_limits<double>::infinity();
+		t1 = -std::numeric_limits<double>::infinity();
+		bool on_plane = true;
+		auto add = [&](const point3& p) {
+			const double t = dot(p, d);
+			t0 = (std::min)(t0, t);
+			t1 = (std::max)(t1, t);
+		};
+		for (size_t i = 0; i < poly.size(); ++i) {
+			const point3& vi = poly[i];
+			const point3& vj = poly[(i + 1) % poly.size()];
+			const double si = dot(n, vi) - w;
+			const double sj = dot(n, vj) - w;
+			if (std::fabs(si) <= eps) {
+				add(vi);
+			} else {
+				on_plane = false;
+				if (std::fabs(sj) > eps && (si < 0.) != (sj < 0.)) {
+					add(vi + (vj - vi) * (si / (si - sj)));
+				}
+			}
+		}
+		return !on_plane && t0 <= t1;
+	}
+
+	// A split fragment of one of the operand triangles. The normal is the
+	// normalized normal of the original triangle.
+	struct fragment {
+		std::vector<point3> points;
+		point3 normal;
+	};
+
+	// Distance of p to the plane through a with unit normal n
+	double plane_distance(const point3& p, const point3& a, const point3& n) {
+		return std::fabs(dot(p - a, n));
+	}
+
+	// Whether an edge of triangle t crosses triangle u by more than tolerance
+	bool edges_cross(const std::array<point3, 3>& t, const std::array<point3, 3>& u, double tolerance) {
+		point3 n = cross(u[1] - u[0], u[2] - u[0]);
+		const double len = norm(n);
+		if (len == 0.) {
+			return false;
+		}
+		n = n * (1. / len);
+		for (int i = 0; i < 3; ++i) {
+			const point3& p = t[i];
+			const point3& q = t[(i + 1) % 3];
+			if (segment_triangle(p, q, u[0], u[1], u[2]) != SEGMENT_CROSSES) {
+				continue;
+			}
+			if (plane_distance(p, u[0], n) > tolerance && plane_distance(q, u[0], n) > tolerance) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::array<point3, 3> triangle_points(const triangle_mesh& m, int i) {
+		const auto& t = m.triangles[i];
+		return std::array<point3, 3>{ m.vertices[t[0]], m.vertices[t[1]], m.vertices[t[2]] };
+	}
+
+	// Classifies the vertices of b against a, until one is found for which the
+	// classification equals stop_at. Vertices are moved by offset along their
+	// inward normal first, i.e. into the volume of b also where b is concave, so
+	// that vertices on coinciding surfaces are classified consistently. Returns
+	// whether a vertex classified as stop_at was found.
+	bool any_vertex(const point_in_mesh& a, const point_in_mesh& b, double offset, bool stop_at) {
+		const auto& vertices = b.mesh().vertices;
+		const auto& normals = b.vertex_normals();
+		for (size_t i = 0; i < vertices.size(); ++i) {
+			if (dot(normals[i], normals[i]) == 0.) {
+				continue;
+			}
+			if (a.inside(vertices[i] - normals[i] * offset) == stop_at) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	double classification_offset(const point_in_mesh& b, double tolerance) {
+		return (std::max)(tolerance, b.bounds().diagonal() * 1.e-6);
+	}
+
+	std::vector<box3> triangle_boxes(const triangle_mesh& m) {
+		std::vector<box3> boxes;
+		boxes.reserve(m.triangles.size());
+		for (size_t i = 0; i < m.triangles.size(); ++i) {
+			boxes.push_back(m.triangle_bounds(i));
+		}
+		return boxes;
+	}
+
+	// Splits all triangles of m along their intersections with the triangles of
+	// others. A fragment is only split by the plane of another triangle when the
+	// segment along which the two triangles intersect passes through it, so that
+	// triangles are not cut by planes of triangles they merely share a bounding
+	// box with.
+	void split_mesh(const triangle_mesh& m, const std::vector<const point_in_mesh*>& others, double eps, std::vector<fragment>& result) {
+		std::vector<std::vector<point3>> current, next;
+		std::vector<point3> front, back;
+
+		for (size_t i = 0; i < m.triangles.size(); ++i) {
+			point3 n = m.triangle_normal(i);
+			const double len = norm(n);
+			if (len < eps * eps) {
+				continue;
+			}
+			n = n * (1. / len);
+
+			box3 tri_box = m.triangle_bounds(i);
+			tri_box.enlarge(eps);
+
+			const std::vector<point3> triangle{
+				m.vertices[m.triangles[i][0]],
+				m.vertices[m.triangles[i][1]],
+				m.vertices[m.triangles[i][2]]
+			};
+			const double wi = dot(n, triangle[0]);
+
+			current.clear();
+			current.push_back(triangle);
+
+			for (auto& other : others) {
+				if (!other->bounds().overlaps(tri_box)) {
+					continue;
+				}
+				const triangle_mesh& om = other->mesh();
+				other->tree().select_box(tri_box, [&](int j) {
+					point3 on = om.triangle_normal(j);
+					const double olen = norm(on);
+					if (olen < eps * eps) {
+						return;
+					}
+					on = on * (1. / olen);
+					const double w = dot(on, om.vertices[om.triangles[j][0]]);
+
+					// The line along which the planes of the two triangles meet. Parallel
+					// and coplanar triangles are not split, the fragments are resolved by
+					// classification.
+					point3 d = cross(n, on);
+					const double dlen = norm(d);
+					if (dlen < eps * eps) {
+						return;
+					}
+					d = d * (1. / dlen);
+
+					const std::vector<point3> other_triangle{
+						om.vertices[om.triangles[j][0]],
+						om.vertices[om.triangles[j][1]],
+						om.vertices[om.triangles[j][2]]
+					};
+					double a0, a1, b0, b1;
+					if (!plane_interval(triangle, on, w, d, eps, a0, a1) ||
+						!plane_interval(other_triangle, n, wi, d, eps, b0, b1))
+					{
+						return;
+					}
+					// The intersection segment of the two triangles
+					const double s0 = (std::max)(a0, b0);
+					const double s1 = (std::min)(a1, b1);
+					if (s1 - s0 < eps) {
+						return;
+					}
+
+					box3 obox = om.triangle_bounds(j);
+					obox.enlarge(eps);
+
+					next.clear();
+					for (auto& poly : current) {
+						double p0, p1;
+						if (!polygon_bounds(poly).overlaps(obox) ||
+							!plane_interval(poly, on, w, d, eps, p0, p1) ||
+							(std::min)(p1, s1) - (std::max)(p0, s0) < eps)
+						{
+							next.push_back(poly);
+							continue;
+						}
+						front.clear();
+						back.clear();
+						split_polygon(poly, on, w, eps, front, back);
+						if (front.size() >= 3) next.push_back(front);
+						if (back.size() >= 3) next.push_back(back);
+					}
+					current.swap(next);
+				});
+			}
+
+			for (auto& poly : current) {
+				result.push_back(fragment{ poly, n });
+			}
+		}
+	}
+
+	// Inserts the points that lie on the interior of polygon edges, so that
+	// adjacent polygons share their vertices.
+	void remove_t_junctions(polygon_mesh& m, double eps) {
+		std::vector<box3> boxes;
+		boxes.reserve(m.vertices.size());
+		for (auto& p : m.vertices) {
+			box3 b;
+			b.add(p);
+			b.enlarge(eps);
+			boxes.push_back(b);
+		}
+		bvh tree(boxes);
+
+		std::vector<std::pair<double, int>> on_edge;
+		for (auto& poly : m.polygons) {
+			std::vector<int> updated;
+			for (size_t i = 0; i < poly.size(); ++i) {
+				const int u = poly[i];
+				const int v = poly[(i + 1) % poly.size()];
+				updated.push_back(u);
+
+				const point3& a = m.vertices[u];
+				const point3& b = m.vertices[v];
+				const point3 d = b - a;
+				const double l2 = dot(d, d);
+				if (l2 == 0.) {
+					continue;
+				}
+
+				box3 edge_box;
+				edge_box.add(a);
+				edge_box.add(b);
+				edge_box.enlarge(eps);
+
+				on_edge.clear();
+				tree.select_box(edge_box, [&](int k) {
+					if (k == u || k == v) {
+						return;
+					}
+					const point3& p = m.vertices[k];
+					const double t = dot(p - a, d) / l2;
+					if (t <= 0. || t >= 1.) {
+						return;
+					}
+					const point3 q = a + d * t;
+					if (norm(p - q) < eps) {
+						on_edge.push_back(std::make_pair(t, k));
+					}
+				});
+
+				std::sort(on_edge.begin(), on_edge.end());
+				for (auto& pr : on_edge) {
+					updated.push_back(pr.second);
+				}
+			}
+			poly.swap(updated);
+		}
+	}
+}
+
+double IfcGeom::util::mesh::box3::diagonal() const {
+	if (empty()) {
+		return 0.;
+	}
+	return norm(upper - lower);
+}
+
+box3 IfcGeom::util::mesh::triangle_mesh::bounds() const {
+	box3 b;
+	for (auto& p : vertices) {
+		b.add(p);
+	}
+	return b;
+}
+
+box3 IfcGeom::util::mesh::triangle_mesh::triangle_bounds(size_t i) const {
+	box3 b;
+	for (int j = 0; j < 3; ++j) {
+		b.add(vertices[triangles[i][j]]);
+	}
+	return b;
+}
+
+point3 IfcGeom::util::mesh::triangle_mesh::triangle_normal(size_t i) const {
+	const point3& a = vertices[triangles[i][0]];
+	const point3& b = vertices[triangles[i][1]];
+	const point3& c = vertices[triangles[i][2]];
+	return cross(b - a, c - a);
+}
+
+bool IfcGeom::util::mesh::triangle_mesh::is_closed() const {
+	if (triangles.empty()) {
+		return false;
+	}
+	// For every directed edge count its occurrences, a closed consistently
+	// oriented mesh has every directed edge exactly once with its opposite.
+	std::map<std::pair<int, int>, int> edges;
+	for (auto& t : triangles) {
+		for (int i = 0; i < 3; ++i) {
+			edges[std::make_pair(t[i], t[(i + 1) % 3])] ++;
+		}
+	}
+	for (auto& e : edges) {
+		if (e.second != 1) {
+			return false;
+		}
+		auto it = edges.find(std::make_pair(e.first.second, e.first.first));
+		if (it == edges.end() || it->second != 1) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int IfcGeom::util::mesh::vertex_welder::add(const point3& p) {
+	std::array<long long, 3> key;
+	for (int i = 0; i < 3; ++i) {
+		key[i] = (long long) std::floor(p[i] / eps_);
+	}
+	for (int dx = -1; dx <= 1; ++dx) {
+		for (int dy = -1; dy <= 1; ++dy) {
+			for (int dz = -1; dz <= 1; ++dz) {
+				auto it = grid_.find(std::array<long long, 3>{ key[0] + dx, key[1] + dy, key[2] + dz });
+				if (it == grid_.end()) {
+					continue;
+				}
+				for (int i : it->second) {
+					if (norm(points_[i] - p) <= eps_) {
+						return i;
+					}
+				}
+			}
+		}
+	}
+	const int i = (int) points_.size();
+	points_.push_back(p);
+	grid_[key].push_back(i);
+	return i;
+}
+
+int IfcGeom::util::mesh::orient3d(const point3& a, const point3& b, const point3& c, const point3& d) {
+	const double adx = a[0] - d[0], bdx = b[0] - d[0], cdx = c[0] - d[0];
+	const double ady = a[1] - d[1], bdy = b[1] - d[1], cdy = c[1] - d[1];
+	const double adz = a[2] - d[2], bdz = b[2] - d[2], cdz = c[2] - d[2];
+
+	const double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+	const double cdxady = cdx * ady, adxcdy = adx * cdy;
+	const double adxbdy = adx * bdy, bdxady = bdx * ady;
+
+	const double det =
+		adz * (bdxcdy - cdxbdy) +
+		bdz * (cdxady - adxcdy) +
+		cdz * (adxbdy - bdxady);
+
+	const double permanent =
+		(std::fabs(bdxcdy) + std::fabs(cdxbdy)) * std::fabs(adz) +
+		(std::fabs(cdxady) + std::fabs(adxcdy)) * std::fabs(bdz) +
+		(std::fabs(adxbdy) + std::fabs(bdxady)) * std::fabs(cdz);
+
+	const double errbound = o3d_errbound * permanent;
+	if (det > errbound) {
+		return 1;
+	} else if (-det > errbound) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+
+void IfcGeom::util::mesh::bvh::build(const std::vector<box3>& boxes) {
+	nodes_.clear();
+	items_.clear();
+	boxes_ = boxes;
+	if (boxes_.empty()) {
+		return;
+	}
+	std::vector<point3> centers;
+	centers.reserve(boxes_.size());
+	items_.reserve(boxes_.size());
+	for (size_t i = 0; i < boxes_.size(); ++i) {
+		centers.push_back(boxes_[i].center());
+		items_.push_back((int) i);
+	}
+	nodes_.reserve(2 * boxes_.size());
+	build_(0, (int) items_.size(), centers);
+}
+
+int IfcGeom::util::mesh::bvh::build_(int begin, int end, std::vector<point3>& centers) {
+	const int ni = (int) nodes_.size();
+	nodes_.emplace_back();
+
+	box3 b, cb;
+	for (int i = begin; i < end; ++i) {
+		b.add(boxes_[items_[i]]);
+		cb.add(centers[items_[i]]);
+	}
+	nodes_[ni].box = b;
+
+	if (end - begin <= 4) {
+		nodes_[ni].first = begin;
+		nodes_[ni].count = end - begin;
+		return ni;
+	}
+
+	// Median split along the longest axis of the box of centers
+	int axis = 0;
+	for (int i = 1; i < 3; ++i) {
+		if (cb.upper[i] - cb.lower[i] > cb.upper[axis] - cb.lower[axis]) {
+			axis = i;
+		}
+	}
+	const int mid = (begin + end) / 2;
+	std::nth_element(items_.begin() + begin, items_.begin() + mid, items_.begin() + end, [&centers, axis](int x, int y) {
+		return centers[x][axis] < centers[y][axis];
+	});
+
+	build_(begin, mid, centers);
+	const int right = build_(mid, end, centers);
+	nodes_[ni].first = right;
+	nodes_[ni].count = 0;
+	return ni;
+}
+
+bool IfcGeom::util::mesh::bvh::slab_test(const box3& b, const point3& origin, const point3& inv, double tmax) {
+	// NaNs, resulting from an origin on a slab boundary with a zero direction
+	// component, are ignored by the order of the min/max arguments.
+	double tmin = 0.;
+	for (int i = 0; i < 3; ++i) {
+		const double t1 = (b.lower[i] - origin[i]) * inv[i];
+		const double t2 = (b.upper[i] - origin[i]) * inv[i];
+		tmin = (std::max)(tmin, (std::min)(t1, t2));
+		tmax = (std::min)(tmax, (std::max)(t1, t2));
+	}
+	return tmin <= tmax;
+}
+
+segment_triangle_result IfcGeom::util::mesh::segment_triangle(const point3& p, const point3& q, const point3& a, const point3& b, const point3& c) {
+	const int s1 = orient3d(a, b, c, p);
+	const int s2 = orient3d(a, b, c, q);
+	if (s1 == 0 || s2 == 0) {
+		return SEGMENT_DEGENERATE;
+	}
+	if (s1 == s2) {
+		return SEGMENT_MISSES;
+	}
+	const int e[3] = {
+		orient3d(p, q, a, b),
+		orient3d(p, q, b, c),
+		orient3d(p, q, c, a)
+	};
+	bool pos = false, neg = false, zero = false;
+	for (int i = 0; i < 3; ++i) {
+		pos = pos || e[i] > 0;
+		neg = neg || e[i] < 0;
+		zero = zero || e[i] == 0;
+	}
+	if (pos && neg) {
+		return SEGMENT_MISSES;
+	}
+	if (zero) {
+		return SEGMENT_DEGENERATE;
+	}
+	return SEGMENT_CROSSES;
+}
+
+IfcGeom::util::mesh::point_in_mesh::point_in_mesh(const triangle_mesh& m)
+	: mesh_(m)
+	, bounds_(m.bounds())
+{
+	// Boxes are slightly enlarged so that flat boxes of axis-aligned triangles
+	// are not missed due to rounding in the slab test.
+	const double d = (std::max)(bounds_.diagonal() * 1.e-9, 1.e-12);
+	std::vector<box3> boxes = triangle_boxes(m);
+	for (auto& b : boxes) {
+		b.enlarge(d);
+	}
+	tree_.build(boxes);
+	length_ = 2. * bounds_.diagonal() + 1.;
+
+	vertex_normals_.assign(m.vertices.size(), point3{ 0., 0., 0. });
+	for (size_t i = 0; i < m.triangles.size(); ++i) {
+		point3 n = m.triangle_normal(i);
+		const double len = norm(n);
+		if (len == 0.) {
+			continue;
+		}
+		n = n * (1. / len);
+		const auto& t = m.triangles[i];
+		for (int k = 0; k < 3; ++k) {
+			const point3 u = m.vertices[t[(k + 1) % 3]] - m.vertices[t[k]];
+			const point3 v = m.vertices[t[(k + 2) % 3]] - m.vertices[t[k]];
+			const double angle = std::atan2(norm(cross(u, v)), dot(u, v));
+			vertex_normals_[t[k]] = vertex_normals_[t[k]] + n * angle;
+		}
+	}
+	for (auto& n : vertex_normals_) {
+		const double len = norm(n);
+		if (len > 0.) {
+			n = n * (1. / len);
+		}
+	}
+}
+
+bool IfcGeom::util::mesh::point_in_mesh::inside(const point3& p) const {
+	if (!bounds_.contains(p)) {
+		return false;
+	}
+
+	// Fixed directions, deliberately not aligned with any of the axes or
+	// diagonals that are prevalent in building geometry.
+	static const point3 directions[] = {
+		{ 0.5366453451, 0.6280614512, 0.5635765811 },
+		{ -0.7147284139, 0.3211839183, 0.6213564612 },
+		{ 0.2513947231, -0.8739182731, 0.4159283746 },
+		{ -0.3846513294, -0.4519726383, -0.8049617326 },
+		{ 0.8815209373, -0.1329172833, -0.4530926617 },
+		{ -0.1133519283, 0.9282736154, -0.3543819265 }
+	};
+
+	for (auto& d0 : directions) {
+		const point3 d = d0 * (1. / norm(d0));
+		const point3 q = p + d * length_;
+		int crossings = 0;
+		bool degenerate = false;
+		tree_.select_segment(p, d, length_, [&](int i) {
+			if (!degenerate) {
+				const auto& t = mesh_.triangles[i];
+				const segment_triangle_result r = segment_triangle(p, q, mesh_.vertices[t[0]], mesh_.vertices[t[1]], mesh_.vertices[t[2]]);
+				if (r == SEGMENT_CROSSES) {
+					++crossings;
+				} else if (r == SEGMENT_DEGENERATE) {
+					degenerate = true;
+				}
+			}
+			return length_;
+		});
+		if (!degenerate) {
+			return (crossings % 2) == 1;
+		}
+	}
+
+	// All rays degenerate, the point lies on the surface
+	return false;
+}
+
+namespace {
+	// The rays of a packet in structure of arrays layout, lanes that are not in
+	// use have a negative tmax so that they never hit anything.
+	struct ray_packet {
+		enum { N = ray_caster::packet_size };
+		double o[3][N];
+		double d[3][N];
+		double inv[3][N];
+		double tmax[N];
+		int hit[N];
+
+		bool hits(const box3& b) const {
+			bool any = false;
+			for (int l = 0; l < N; ++l) {
+				double tmin = 0.;
+				double tmax_l = tmax[l];
+				for (int i = 0; i < 3; ++i) {
+					const double t1 = (b.lower[i] - o[i][l]) * inv[i][l];
+					const double t2 = (b.upper[i] - o[i][l]) * inv[i][l];
+					tmin = (std::max)(tmin, (std::min)(t1, t2));
+					tmax_l = (std::min)(tmax_l, (std::max)(t1, t2));
+				}
+				any |= tmin <= tmax_l;
+			}
+			return any;
+		}
+
+		// Moeller-Trumbore, rays parallel to the triangle result in NaNs that fail
+		// the comparisons and are thereby rejected.
+		void intersect(const point3& a, const point3& b, const point3& c, int index) {
+			const point3 e1 = b - a;
+			const point3 e2 = c - a;
+			for (int l = 0; l < N; ++l) {
+				const double px = d[1][l] * e2[2] - d[2][l] * e2[1];
+				const double py = d[2][l] * e2[0] - d[0][l] * e2[2];
+				const double pz = d[0][l] * e2[1] - d[1][l] * e2[0];
+				const double inv_det = 1. / (e1[0] * px + e1[1] * py + e1[2] * pz);
+				const double sx = o[0][l] - a[0];
+				const double sy = o[1][l] - a[1];
+				const double sz = o[2][l] - a[2];
+				const double u = (sx * px + sy * py + sz * pz) * inv_det;
+				const double qx = sy * e1[2] - sz * e1[1];
+				const double qy = sz * e1[0] - sx * e1[2];
+				const double qz = sx * e1[1] - sy * e1[0];
+				const double v = (d[0][l] * qx + d[1][l] * qy + d[2][l] * qz) * inv_det;
+				const double t = (e2[0] * qx + e2[1] * qy + e2[2] * qz) * inv_det;
+				const bool accept = u >= 0. && v >= 0. && u + v <= 1. && t > 0. && t < tmax[l];
+				tmax[l] = accept ? t : tmax[l];
+				hit[l] = accept ? index : hit[l];
+			}
+		}
+	};
+}
+
+IfcGeom::util::mesh::ray_caster::ray_caster(const triangle_mesh& m)
+	: mesh_(m)
+{
+	const double d = (std::max)(m.bounds().diagonal() * 1.e-9, 1.e-12);
+	std::vector<box3> boxes = triangle_boxes(m);
+	for (auto& b : boxes) {
+		b.enlarge(d);
+	}
+	tree_.build(boxes);
+}
+
+void IfcGeom::util::mesh::ray_caster::cast(const double* origins, const double* directions, size_t begin, size_t end, double max_distance, int* triangles, double* distances) const {
+	const auto& nodes = tree_.nodes();
+	const auto& items = tree_.items();
+
+	ray_packet packet;
+
+	for (size_t first = begin; first < end; first += packet_size) {
+		const size_t count = (std::min)((size_t) packet_size, end - first);
+
+		for (int l = 0; l < packet_size; ++l) {
+			const size_t r = first + (std::min)((size_t) l, count - 1);
+			const point3 o = { origins[3 * r], origins[3 * r + 1], origins[3 * r + 2] };
+			point3 d = { directions[3 * r], directions[3 * r + 1], directions[3 * r + 2] };
+			const double len = norm(d);
+			if (len > 0.) {
+				d = d * (1. / len);
+			}
+			for (int i = 0; i < 3; ++i) {
+				packet.o[i][l] = o[i];
+				packet.d[i][l] = d[i];
+				packet.inv[i][l] = 1. / d[i];
+			}
+			packet.tmax[l] = ((size_t) l < count && len > 0.) ? max_distance : -1.;
+			packet.hit[l] = -1;
+		}
+
+		if (!nodes.empty()) {
+			int stack[64];
+			int n = 0;
+			stack[n++] = 0;
+			while (n) {
+				const int ni = stack[--n];
+				const bvh::node& nd = nodes[ni];
+				if (!packet.hits(nd.box)) {
+					continue;
+				}
+				if (nd.count) {
+					for (int i = nd.first; i < nd.first + nd.count; ++i) {
+						const int ti = items[i];
+						const auto& t = mesh_.triangles[ti];
+						packet.intersect(mesh_.vertices[t[0]], mesh_.vertices[t[1]], mesh_.vertices[t[2]], ti);
+					}
+				} else {
+					// Visit the child closest to the origin of the first ray first,
+					// so that tmax is narrowed early on.
+					const point3 cl = nodes[ni + 1].box.center();
+					const point3 cr = nodes[nd.first].box.center();
+					int axis = 0;
+					for (int i = 1; i < 3; ++i) {
+						if (std::fabs(cr[i] - cl[i]) > std::fabs(cr[axis] - cl[axis])) {
+							axis = i;
+						}
+					}
+					const bool left_first = (packet.d[axis][0] >= 0.) == (cl[axis] <= cr[axis]);
+					stack[n++] = left_first ? nd.first : ni + 1;
+					stack[n++] = left_first ? ni + 1 : nd.first;
+				}
+			}
+		}
+
+		for (size_t l = 0; l < count; ++l) {
+			triangles[first + l] = packet.hit[l];
+			distances[first + l] = packet.hit[l] == -1 ? std::numeric_limits<double>::infinity() : packet.tmax[l];
+		}
+	}
+}
+
+bool IfcGeom::util::mesh::subtract(const triangle_mesh& a, const std::vector<triangle_mesh>& bs, polygon_mesh& result, double eps) {
+	result.vertices.clear();
+	result.polygons.clear();
+
+	if (!a.is_closed()) {
+		return false;
+	}
+	for (auto& b : bs) {
+		if (!b.is_closed()) {
+			return false;
+		}
+	}
+
+	const box3 a_bounds = a.bounds();
+	point_in_mesh a_classifier(a);
+	std::vector<std::unique_ptr<point_in_mesh>> b_classifiers;
+	// Subtraction operands not overlapping with a are ignored
+	std::vector<size_t> b_indices;
+	for (size_t i = 0; i < bs.size(); ++i) {
+		box3 bb = bs[i].bounds();
+		bb.enlarge(eps);
+		if (bb.overlaps(a_bounds)) {
+			b_indices.push_back(i);
+			b_classifiers.emplace_back(new point_in_mesh(bs[i]));
+		}
+	}
+
+	vertex_welder welder(result.vertices, eps);
+	const double offset = 2. * eps;
+
+	auto emit = [&](const std::vector<point3>& points, bool reversed) {
+		std::vector<int> poly;
+		for (size_t i = 0; i < points.size(); ++i) {
+			const int v = welder.add(points[reversed ? points.size() - 1 - i : i]);
+			if (poly.empty() || poly.back() != v) {
+				poly.push_back(v);
+			}
+		}
+		while (poly.size() > 1 && poly.front() == poly.back()) {
+			poly.pop_back();
+		}
+		if (poly.size() < 3) {
+			return;
+		}
+		std::vector<point3> welded;
+		for (int v : poly) {
+			welded.push_back(result.vertices[v]);
+		}
+		if (norm(newell_normal(welded)) < eps * eps) {
+			return;
+		}
+		result.polygons.push_back(poly);
+	};
+
+	std::vector<fragment> fragments;
+	std::vector<const point_in_mesh*> others;
+
+	// Fragments of a are retained when not inside any of the subtraction operands
+	for (auto& bc : b_classifiers) {
+		others.push_back(bc.get());
+	}
+	split_mesh(a, others, eps, fragments);
+	for (auto& f : fragments) {
+		const point3 below = centroid(f.points) - f.normal * offset;
+		bool retain = true;
+		for (auto& bc : b_classifiers) {
+			if (bc->inside(below)) {
+				retain = false;
+				break;
+			}
+		}
+		if (retain) {
+			emit(f.points, false);
+		}
+	}
+
+	// Fragments of the subtraction operands are retained, reversed, when inside a
+	// and not inside any of the other operands. Coinciding faces of the operands
+	// are only retained for the operand with the lowest index.
+	for (size_t i = 0; i < b_classifiers.size(); ++i) {
+		others.clear();
+		others.push_back(&a_classifier);
+		for (size_t j = 0; j < b_classifiers.size(); ++j) {
+			if (i != j) {
+				others.push_back(b_classifiers[j].get());
+			}
+		}
+		fragments.clear();
+		split_mesh(bs[b_indices[i]], others, eps, fragments);
+		for (auto& f : fragments) {
+			const point3 c = centroid(f.points);
+			const point3 above = c + f.normal * offset;
+			const point3 below = c - f.normal * offset;
+			if (!a_classifier.inside(above) || !a_classifier.inside(below)) {
+				continue;
+			}
+			bool retain = true;
+			for (size_t j = 0; j < b_classifiers.size() && retain; ++j) {
+				if (i == j) {
+					continue;
+				}
+				if (b_classifiers[j]->inside(above) || (j < i && b_classifiers[j]->inside(below))) {
+					retain = false;
+				}
+			}
+			if (retain) {
+				emit(f.points, true);
+			}
+		}
+	}
+
+	if (result.polygons.empty()) {
+		return false;
+	}
+
+	remove_t_junctions(result, eps);
+	return true;
+}
+
+bool IfcGeom::util::mesh::surfaces_cross(const point_in_mesh& a, const point_in_mesh& b, double tolerance) {
+	bool crossing = false;
+	overlapping_pairs(a.tree(), b.tree(), [&](int i, int j) {
+		if (crossing) {
+			return;
+		}
+		const auto ta = triangle_points(a.mesh(), i);
+		const auto tb = triangle_points(b.mesh(), j);
+		crossing = edges_cross(ta, tb, tolerance) || edges_cross(tb, ta, tolerance);
+	});
+	return crossing;
+}
+
+bool IfcGeom::util::mesh::within(const point_in_mesh& a, const point_in_mesh& b, double tolerance) {
+	if (b.mesh().vertices.empty() || !a.bounds().overlaps(b.bounds()) || surfaces_cross(a, b, tolerance)) {
+		return false;
+	}
+	return !any_vertex(a, b, classification_offset(b, tolerance), false);
+}
+
+bool IfcGeom::util::mesh::intersects(const point_in_mesh& a, const point_in_mesh& b, double tolerance) {
+	if (!a.bounds().overlaps(b.bounds())) {
+		return false;
+	}
+	// Crossings that pass exactly through an edge or vertex are not detected by
+	// surfaces_cross(), which are therefore complemented by classifying vertices.
+	return surfaces_cross(a, b, tolerance) ||
+		any_vertex(a, b, classification_offset(b, tolerance), true) ||
+		any_vertex(b, a, classification_offset(a, tolerance), true);
+}
+
+std::vector<std::vector<point3>> IfcGeom::util::mesh::slice(const triangle_mesh& m, const point3& origin, const point3& normal) {
+	std::vector<double> distances;
+	distances.reserve(m.vertices.size());
+	for (auto& v : m.vertices) {
+		distances.push_back(dot(v - origin, normal));
+	}
+
+	// Vertices on the plane are counted as above the plane, so that an edge is
+	// crossed when its vertices are on different sides. A point on the plane is
+	// identified by the pair of vertex indices of the edge it lies on, or by the
+	// index twice when it coincides with a vertex.
+	typedef std::pair<int, int> point_key;
+	std::map<point_key, point3> points;
+
+	auto intersect = [&](int a, int b) {
+		if (a > b) {
+			std::swap(a, b);
+		}
+		const double da = distances[a], db = distances[b];
+		point_key k;
+		point3 p;
+		if (da == 0.) {
+			k = { a, a };
+			p = m.vertices[a];
+		} else if (db == 0.) {
+			k = { b, b };
+			p = m.vertices[b];
+		} else {
+			k = { a, b };
+			p = m.vertices[a] + (m.vertices[b] - m.vertices[a]) * (da / (da - db));
+		}
+		points.insert({ k, p });
+		return k;
+	};
+
+	std::vector<std::array<point_key, 2>> segments;
+	std::map<point_key, std::vector<size_t>> incident;
+
+	for (auto& t : m.triangles) {
+		bool above[3];
+		for (int i = 0; i < 3; ++i) {
+			above[i] = distances[t[i]] >= 0.;
+		}
+		if (above[0] == above[1] && above[1] == above[2]) {
+			continue;
+		}
+		// The vertex on its own side of the plane
+		int i = 0;
+		while (above[i] == above[(i + 1) % 3] || above[i] == above[(i + 2) % 3]) {
+			++i;
+		}
+		std::array<point_key, 2> s = { intersect(t[i], t[(i + 1) % 3]), intersect(t[i], t[(i + 2) % 3]) };
+		if (s[0] == s[1]) {
+			continue;
+		}
+		incident[s[0]].push_back(segments.size());
+		incident[s[1]].push_back(segments.size());
+		segments.push_back(s);
+	}
+
+	std::vector<std::vector<point3>> polylines;
+	std::vector<bool> used(segments.size(), false);
+
+	for (size_t i = 0; i < segments.size(); ++i) {
+		if (used[i]) {
+			continue;
+		}
+		used[i] = true;
+
+		std::vector<point_key> chain = { segments[i][0], segments[i][1] };
+
+		// Extend at the end, and when the chain does not close, also at the start
+		for (int pass = 0; pass < 2; ++pass) {
+			for (;;) {
+				const point_key end = chain.back();
+				size_t next = segments.size();
+				for (auto j : incident[end]) {
+					if (!used[j]) {
+						next = j;
+						break;
+					}
+				}
+				if (next == segments.size()) {
+					break;
+				}
+				used[next] = true;
+				chain.push_back(segments[next][0] == end ? segments[next][1] : segments[next][0]);
+			}
+			if (chain.front() == chain.back()) {
+				break;
+			}
+			std::reverse(chain.begin(), chain.end());
+		}
+
+		polylines.emplace_back();
+		polylines.back().reserve(chain.size());
+		for (auto& k : chain) {
+			polylines.back().push_back(points[k]);
+		}
+	}
+
+	return polylines;
+}
+
+namespace {
+	// Twice the signed area of triangle abc, positive when counter-clockwise
+	double orient2d(const point2& a, const point2& b, const point2& c) {
+		return (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+	}
+
+	bool same_point(const point2& a, const point2& b) {
+		return a[0] == b[0] && a[1] == b[1];
+	}
+
+	// Whether the segments ab and cd cross at a point in the interior of both
+	bool segments_cross(const point2& a, const point2& b, const point2& c, const point2& d) {
+		const double d1 = orient2d(a, b, c), d2 = orient2d(a, b, d);
+		const double d3 = orient2d(c, d, a), d4 = orient2d(c, d, b);
+		return ((d1 > 0. && d2 < 0.) || (d1 < 0. && d2 > 0.)) &&
+			((d3 > 0. && d4 < 0.) || (d3 < 0. && d4 > 0.));
+	}
+
+	// Whether p lies in the interior of segment ab
+	bool on_segment(const point2& a, const point2& b, const point2& p) {
+		return orient2d(a, b, p) == 0. && !same_point(a, p) && !same_point(b, p) &&
+			(std::min)(a[0], b[0]) <= p[0] && p[0] <= (std::max)(a[0], b[0]) &&
+			(std::min)(a[1], b[1]) <= p[1] && p[1] <= (std::max)(a[1], b[1]);
+	}
+
+	// A vertex in the doubly linked ring of the polygon that remains to be
+	// clipped. The vertices at which holes are bridged occur twice.
+	struct ring_vertex {
+		int index;
+		point2 p;
+		int prev, next;
+	};
+
+	typedef std::vector<ring_vertex> ring;
+
+	// Twice the signed area of the loop
+	double loop_area(const std::vector<point2>& loop) {
+		double area = 0.;
+		for (size_t i = 0; i < loop.size(); ++i) {
+			const point2& a = loop[i];
+			const point2& b = loop[(i + 1) % loop.size()];
+			area += a[0] * b[1] - b[0] * a[1];
+		}
+		return area;
+	}
+
+	// Links the loop into a ring with the requested orientation, returns its first vertex
+	int link_loop(ring& r, const std::vector<point2>& loop, int offset, bool counter_clockwise) {
+		const int n = (int) loop.size();
+		const int first = (int) r.size();
+		const bool reverse = (loop_area(loop) > 0.) != counter_clockwise;
+		for (int i = 0; i < n; ++i) {
+			const int j = reverse ? n - 1 - i : i;
+			r.push_back({ offset + j, loop[j], first + (i + n - 1) % n, first + (i + 1) % n });
+		}
+		return first;
+	}
+
+	// Whether b lies strictly within the interior angle of the ring at vertex a
+	bool locally_inside(const ring& r, int a, const point2& b) {
+		const point2& p = r[r[a].prev].p;
+		const point2& q = r[a].p;
+		const point2& n = r[r[a].next].p;
+		if (orient2d(p, q, n) >= 0.) {
+			return orient2d(q, n, b) > 0. && orient2d(q, b, p) > 0.;
+		} else {
+			return orient2d(q, p, b) < 0. || orient2d(q, b, n) < 0.;
+		}
+	}
+
+	// Whether the segment between ring vertices a and b can be inserted as a bridge,
+	// the edges of the holes that are not yet bridged are part of the ring as well.
+	bool is_visible(const ring& r, int a, int b) {
+		const point2& pa = r[a].p;
+		const point2& pb = r[b].p;
+		if (!locally_inside(r, a, pb) || !locally_inside(r, b, pa)) {
+			return false;
+		}
+		for (auto& v : r) {
+			if (segments_cross(pa, pb, v.p, r[v.next].p) || on_segment(pa, pb, v.p)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Splices the hole ring at m into the ring at v as v, m, ..., m', v', v.next
+	void bridge(ring& r, int v, int m) {
+		const ring_vertex vc = r[v], mc = r[m];
+		const int v2 = (int) r.size();
+		r.push_back(vc);
+		const int m2 = (int) r.size();
+		r.push_back(mc);
+		r[v].next = m;
+		r[m].prev = v;
+		r[mc.prev].next = m2;
+		r[m2].prev = mc.prev;
+		r[m2].next = v2;
+		r[v2].prev = m2;
+		r[v2].next = vc.next;
+		r[vc.next].prev = v2;
+	}
+
+	// Whether the vertex e is convex and no reflex vertex lies in the triangle it
+	// spans with its neighbours. Vertices that coincide with the triangle corners
+	// are the duplicates introduced by the bridges and are disregarded.
+	bool is_ear(const ring& r, int e) {
+		const point2& a = r[r[e].prev].p;
+		const point2& b = r[e].p;
+		const point2& c = r[r[e].next].p;
+		if (orient2d(a, b, c) <= 0.) {
+			return false;
+		}
+		for (int i = r[r[e].next].next; i != r[e].prev; i = r[i].next) {
+			const point2& p = r[i].p;
+			if (same_point(p, a) || same_point(p, b) || same_point(p, c)) {
+				continue;
+			}
+			if (orient2d(a, b, p) >= 0. && orient2d(b, c, p) >= 0. && orient2d(c, a, p) >= 0. &&
+				orient2d(r[r[i].prev].p, p, r[r[i].next].p) <= 0.)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Removes collinear vertices and zero-width spikes from the ring
+	int remove_collinear(ring& r, int start, int& n) {
+		bool removed = true;
+		while (removed && n > 3) {
+			removed = false;
+			int i = start;
+			for (int k = n; k > 0 && n > 3; --k) {
+				const int p = r[i].prev, q = r[i].next;
+				if (orient2d(r[p].p, r[i].p, r[q].p) == 0.) {
+					r[p].next = q;
+					r[q].prev = p;
+					--n;
+					removed = true;
+					start = q;
+				}
+				i = q;
+			}
+		}
+		return start;
+	}
+}
+
+bool IfcGeom::util::mesh::triangulate_polygon(const std::vector<std::vector<point2>>& loops, std::vector<std::array<int, 3>>& triangles) {
+	if (loops.empty() || loops.front().size() < 3) {
+		return false;
+	}
+
+	ring r;
+	int offset = 0;
+	const int start = link_loop(r, loops.front(), offset, true);
+	offset += (int) loops.front().size();
+
+	// Holes are linked clockwise and bridged in the order of their rightmost
+	// vertex, from right to left, so that a visible vertex always exists.
+	std::vector<std::pair<double, int>> holes;
+	for (size_t i = 1; i < loops.size(); ++i) {
+		if (loops[i].size() < 3) {
+			return false;
+		}
+		int first = link_loop(r, loops[i], offset, false);
+		offset += (int) loops[i].size();
+		int rightmost = first;
+		for (int j = first + 1; j < (int) r.size(); ++j) {
+			if (r[j].p[0] > r[rightmost].p[0]) {
+				rightmost = j;
+			}
+		}
+		holes.push_back({ r[rightmost].p[0], rightmost });
+	}
+	std::sort(holes.begin(), holes.end(), std::greater<std::pair<double, int>>());
+
+	for (auto& h : holes) {
+		const int m = h.second;
+		std::vector<std::pair<double, int>> candidates;
+		int i = start;
+		do {
+			const point2 d = { r[i].p[0] - r[m].p[0], r[i].p[1] - r[m].p[1] };
+			candidates.push_back({ d[0] * d[0] + d[1] * d[1], i });
+			i = r[i].next;
+		} while (i != start);
+		std::sort(candidates.begin(), candidates.end());
+		auto it = std::find_if(candidates.begin(), candidates.end(), [&r, m](const std::pair<double, int>& c) {
+			return is_visible(r, c.second, m);
+		});
+		if (it == candidates.end()) {
+			return false;
+		}
+		bridge(r, it->second, m);
+	}
+
+	int n = 0;
+	int i = start;
+	do {
+		++n;
+		i = r[i].next;
+	} while (i != start);
+
+	const size_t first_triangle = triangles.size();
+	triangles.reserve(first_triangle + n - 2);
+
+	bool filtered = false;
+	int ear = start, stop = start;
+	while (n > 3) {
+		const int prev = r[ear].prev, next = r[ear].next;
+		if (is_ear(r, ear)) {
+			triangles.push_back({ r[prev].index, r[ear].index, r[next].index });
+			r[prev].next = next;
+			r[next].prev = prev;
+			--n;
+			ear = stop = next;
+		} else if ((ear = next) == stop) {
+			// Degenerate vertices left by the bridges can prevent ears from being found
+			if (filtered) {
+				return false;
+			}
+			filtered = true;
+			ear = stop = remove_collinear(r, ear, n);
+		}
+	}
+
+	const int prev = r[ear].prev, next = r[ear].next;
+	if (orient2d(r[prev].p, r[ear].p, r[next].p) > 0.) {
+		triangles.push_back({ r[prev].index, r[ear].index, r[next].index });
+	}
+
+	// Loops that touch or overlap can result in overlapping ears, which is detected
+	// by comparing the area of the triangles to the area of the polygon.
+	double polygon_area = std::fabs(loop_area(loops.front()));
+	const double tolerance = polygon_area * 1.e-6;
+	for (size_t j = 1; j < loops.size(); ++j) {
+		polygon_area -= std::fabs(loop_area(loops[j]));
+	}
+	std::vector<point2> points;
+	for (auto& l : loops) {
+		points.insert(points.end(), l.begin(), l.end());
+	}
+	double triangle_area = 0.;
+	for (auto it = triangles.begin() + first_triangle; it != triangles.end(); ++it) {
+		triangle_area += orient2d(points[(*it)[0]], points[(*it)[1]], points[(*it)[2]]);
+	}
+
+	return std::fabs(triangle_area - polygon_area) <= tolerance;
+}
@@ -0,0 +1,394 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+/********************************************************************************
+ *                                                                              *
+ * Open Cascade independent utilities on triangle meshes: a flat bounding       *
+ * volume hierarchy, certified orientation predicates, ray parity point         *
+ * classification, a polygon-splitting mesh subtraction and ear clipping of     *
+ * planar polygons with holes. These are used as an approximate, but            *
+ * considerably faster, alternative to the BRep algorithms when an exact result *
+ * is not required (e.g. for visualization).                                    *
+ *                                                                              *
+ ********************************************************************************/
+
+#ifndef MESH_UTILS_H
+#define MESH_UTILS_H
+
+#include "ifc_geom_api.h"
+
+#include <array>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
+
+namespace IfcGeom {
+	namespace util {
+		namespace mesh {
+
+			typedef std::array<double, 3> point3;
+
+			inline point3 operator+(const point3& a, const point3& b) { return point3{ a[0] + b[0], a[1] + b[1], a[2] + b[2] }; }
+			inline point3 operator-(const point3& a, const point3& b) { return point3{ a[0] - b[0], a[1] - b[1], a[2] - b[2] }; }
+			inline point3 operator*(const point3& a, double d) { return point3{ a[0] * d, a[1] * d, a[2] * d }; }
+			inline double dot(const point3& a, const point3& b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+			inline point3 cross(const point3& a, const point3& b) {
+				return point3{ a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+			}
+
+			struct IFC_GEOM_API box3 {
+				point3 lower, upper;
+
+				box3() {
+					lower.fill(+std::numeric_limits<double>::infinity());
+					upper.fill(-std::numeric_limits<double>::infinity());
+				}
+
+				bool empty() const { return lower[0] > upper[0]; }
+
+				void add(const point3& p) {
+					for (int i = 0; i < 3; ++i) {
+						lower[i] = (std::min)(lower[i], p[i]);
+						upper[i] = (std::max)(upper[i], p[i]);
+					}
+				}
+
+				void add(const box3& b) {
+					add(b.lower);
+					add(b.upper);
+				}
+
+				void enlarge(double d) {
+					for (int i = 0; i < 3; ++i) {
+						lower[i] -= d;
+						upper[i] += d;
+					}
+				}
+
+				bool overlaps(const box3& b) const {
+					for (int i = 0; i < 3; ++i) {
+						if (lower[i] > b.upper[i] || b.lower[i] > upper[i]) {
+							return false;
+						}
+					}
+					return true;
+				}
+
+				bool contains(const point3& p) const {
+					for (int i = 0; i < 3; ++i) {
+						if (p[i] < lower[i] || p[i] > upper[i]) {
+							return false;
+						}
+					}
+					return true;
+				}
+
+				point3 center() const { return (lower + upper) * 0.5; }
+
+				double diagonal() const;
+			};
+
+			/// A triangle soup with consistent (outward, counter-clockwise) orientation
+			struct IFC_GEOM_API triangle_mesh {
+				std::vector<point3> vertices;
+				std::vector<std::array<int, 3>> triangles;
+
+				box3 bounds() const;
+				box3 triangle_bounds(size_t i) const;
+				/// Unnormalized triangle normal, length is twice the triangle area
+				point3 triangle_normal(size_t i) const;
+				/// True when every undirected edge is used by exactly two triangles
+				bool is_closed() const;
+			};
+
+			/// Planar polygons sharing a vertex pool, used as the output of the boolean
+			/// operation in order to not needlessly triangulate split fragments.
+			struct IFC_GEOM_API polygon_mesh {
+				std::vector<point3> vertices;
+				std::vector<std::vector<int>> polygons;
+			};
+
+			/// Merges points within eps by hashing them on a uniform grid of cell size eps.
+			class IFC_GEOM_API vertex_welder {
+			private:
+				struct cell_hash {
+					size_t operator()(const std::array<long long, 3>& k) const {
+						return (size_t)(k[0] * 73856093LL ^ k[1] * 19349663LL ^ k[2] * 83492791LL);
+					}
+				};
+
+				std::vector<point3>& points_;
+				double eps_;
+				std::unordered_map<std::array<long long, 3>, std::vector<int>, cell_hash> grid_;
+
+			public:
+				vertex_welder(std::vector<point3>& points, double eps)
+					: points_(points)
+					, eps_(eps)
+				{}
+
+				/// Returns the index of a previously added point within eps or appends p
+				int add(const point3& p);
+			};
+
+			/// Returns the sign of the determinant of (a-d, b-d, c-d), i.e. positive
+			/// when d lies below the plane through a, b, c (with the counter-clockwise
+			/// normal pointing up). The evaluation is guarded by a static floating point
+			/// error bound: a non-zero result is guaranteed to be correct, zero is returned
+			/// when the sign cannot be certified, which callers treat as degenerate.
+			IFC_GEOM_API int orient3d(const point3& a, const point3& b, const point3& c, const point3& d);
+
+			/// A flat bounding volume hierarchy over a set of boxes, nodes are laid out
+			/// depth-first so that the left child immediately follows its parent.
+			class IFC_GEOM_API bvh {
+			public:
+				struct node {
+					box3 box;
+					// for leaves the range in the item index array, for internal nodes
+					// count is zero and first is the index of the right child.
+					int first, count;
+				};
+
+			private:
+				std::vector<node> nodes_;
+				std::vector<int> items_;
+				std::vector<box3> boxes_;
+
+				int build_(int begin, int end, std::vector<point3>& centers);
+
+			public:
+				bvh() {}
+				explicit bvh(const std::vector<box3>& boxes) { build(boxes); }
+
+				void build(const std::vector<box3>& boxes);
+
+				bool empty() const { return nodes_.empty(); }
+				const box3& bounds() const { return nodes_.front().box; }
+				const std::vector<node>& nodes() const { return nodes_; }
+				const std::vector<int>& items() const { return items_; }
+				const box3& box(int i) const { return boxes_[i]; }
+
+				/// Invokes fn(i) for every item i for which the box overlaps b
+				template <typename Fn>
+				void select_box(const box3& b, Fn fn) const {
+					if (nodes_.empty()) {
+						return;
+					}
+					int stack[64];
+					int n = 0;
+					stack[n++] = 0;
+					while (n) {
+						const int ni = stack[--n];
+						const node& nd = nodes_[ni];
+						if (!nd.box.overlaps(b)) {
+							continue;
+						}
+						if (nd.count) {
+							for (int i = nd.first; i < nd.first + nd.count; ++i) {
+								if (boxes_[items_[i]].overlaps(b)) {
+									fn(items_[i]);
+								}
+							}
+						} else {
+							stack[n++] = nd.first;
+							stack[n++] = ni + 1;
+						}
+					}
+				}
+
+				/// Invokes fn(i) for every item i for which the box is intersected by the
+				/// segment origin + t * direction, t in [0, tmax]. When fn returns a value
+				/// smaller than tmax, the search is narrowed accordingly (closest hit queries).
+				template <typename Fn>
+				void select_segment(const point3& origin, const point3& direction, double tmax, Fn fn) const {
+					if (nodes_.empty()) {
+						return;
+					}
+					point3 inv;
+					for (int i = 0; i < 3; ++i) {
+						inv[i] = 1. / direction[i];
+					}
+					int stack[64];
+					int n = 0;
+					stack[n++] = 0;
+					while (n) {
+						const int ni = stack[--n];
+						const node& nd = nodes_[ni];
+						if (!slab_test(nd.box, origin, inv, tmax)) {
+							continue;
+						}
+						if (nd.count) {
+							for (int i = nd.first; i < nd.first + nd.count; ++i) {
+								if (slab_test(boxes_[items_[i]], origin, inv, tmax)) {
+									tmax = (std::min)(tmax, (double) fn(items_[i]));
+								}
+							}
+						} else {
+							stack[n++] = nd.first;
+							stack[n++] = ni + 1;
+						}
+					}
+				}
+
+				static bool slab_test(const box3& b, const point3& origin, const point3& inv, double tmax);
+			};
+
+			/// Invokes fn(i, j) for every item i in a of which the box overlaps with the
+			/// box of item j in b. Both hierarchies are descended simultaneously, so that
+			/// subtrees that are apart are rejected as a whole.
+			template <typename Fn>
+			void overlapping_pairs(const bvh& a, const bvh& b, Fn fn) {
+				if (a.empty() || b.empty()) {
+					return;
+				}
+				std::vector<std::pair<int, int>> stack{ { 0, 0 } };
+				while (!stack.empty()) {
+					const auto p = stack.back();
+					stack.pop_back();
+					const bvh::node& na = a.nodes()[p.first];
+					const bvh::node& nb = b.nodes()[p.second];
+					if (!na.box.overlaps(nb.box)) {
+						continue;
+					}
+					if (na.count && nb.count) {
+						for (int i = na.first; i < na.first + na.count; ++i) {
+							const int ia = a.items()[i];
+							for (int j = nb.first; j < nb.first + nb.count; ++j) {
+								const int ib = b.items()[j];
+								if (a.box(ia).overlaps(b.box(ib))) {
+									fn(ia, ib);
+								}
+							}
+						}
+					} else if (nb.count || (!na.count && na.box.diagonal() >= nb.box.diagonal())) {
+						// Descend into the larger of the two subtrees
+						stack.push_back({ p.first + 1, p.second });
+						stack.push_back({ na.first, p.second });
+					} else {
+						stack.push_back({ p.first, p.second + 1 });
+						stack.push_back({ p.first, nb.first });
+					}
+				}
+			}
+
+			enum segment_triangle_result {
+				SEGMENT_MISSES,
+				SEGMENT_CROSSES,
+				// Segment passes through an edge or vertex, or its end points lie
+				// in the plane of the triangle, or the outcome could not be certified.
+				SEGMENT_DEGENERATE
+			};
+
+			/// Classifies segment p-q against triangle abc using only orient3d()
+			IFC_GEOM_API segment_triangle_result segment_triangle(const point3& p, const point3& q, const point3& a, const point3& b, const point3& c);
+
+			/// Classifies points against a closed triangle mesh by counting the parity of
+			/// ray crossings. Degenerate rays are discarded and retried in another direction.
+			class IFC_GEOM_API point_in_mesh {
+			private:
+				const triangle_mesh& mesh_;
+				box3 bounds_;
+				bvh tree_;
+				double length_;
+				std::vector<point3> vertex_normals_;
+
+			public:
+				explicit point_in_mesh(const triangle_mesh& m);
+
+				const triangle_mesh& mesh() const { return mesh_; }
+				const box3& bounds() const { return bounds_; }
+				const bvh& tree() const { return tree_; }
+
+				/// Outward unit normals of the vertices, averaged over the incident triangles
+				/// weighted by their angle at the vertex. Zero for isolated vertices.
+				const std::vector<point3>& vertex_normals() const { return vertex_normals_; }
+
+				/// Returns whether p is inside the mesh, the classification of a point that
+				/// lies (within floating point precision) on the surface is arbitrary.
+				bool inside(const point3& p) const;
+			};
+
+			/// Returns whether the surfaces of the closed meshes classified by a and b cross.
+			/// An edge that penetrates the other surface by less than tolerance at either
+			/// side is considered to be touching it. Coplanar triangles do not cross.
+			IFC_GEOM_API bool surfaces_cross(const point_in_mesh& a, const point_in_mesh& b, double tolerance);
+
+			/// Returns whether the closed mesh classified by b is completely within a,
+			/// coinciding surfaces are allowed.
+			IFC_GEOM_API bool within(const point_in_mesh& a, const point_in_mesh& b, double tolerance);
+
+			/// Returns whether the volumes of the closed meshes classified by a and b
+			/// intersect, i.e. their surfaces cross or one is contained in the other.
+			IFC_GEOM_API bool intersects(const point_in_mesh& a, const point_in_mesh& b, double tolerance);
+
+			/// Finds the closest triangle hit by each of a batch of rays. Consecutive rays are
+			/// traced in packets of packet_size that traverse the hierarchy together, a node
+			/// is visited when any of the rays in the packet hits it. The loops over the rays
+			/// in a packet are branch-free so that they are vectorized by the compiler. This
+			/// pays off when consecutive rays are coherent, e.g. rays from a common origin
+			/// ordered by direction, or parallel rays from neighbouring origins.
+			class IFC_GEOM_API ray_caster {
+			private:
+				const triangle_mesh& mesh_;
+				bvh tree_;
+
+			public:
+				enum { packet_size = 8 };
+
+				explicit ray_caster(const triangle_mesh& m);
+
+				const triangle_mesh& mesh() const { return mesh_; }
+
+				/// Casts the rays [begin, end) from origins[3 * i] in directions[3 * i], which
+				/// need not be normalized. Stores the index of the closest triangle within
+				/// max_distance in triangles[i], or -1 when there is none, and the distance
+				/// to it in distances[i]. Can be called concurrently for distinct ranges.
+				void cast(const double* origins, const double* directions, size_t begin, size_t end, double max_distance, int* triangles, double* distances) const;
+			};
+
+			/// Subtracts the closed meshes bs from the closed mesh a. The triangles of every
+			/// operand are split by the supporting planes of the triangles of the other operands
+			/// they overlap with, after which each fragment is classified by offsetting its
+			/// centroid by eps along its normal. Points are merged within eps and T-junctions
+			/// are eliminated so that the result is watertight when the input was.
+			IFC_GEOM_API bool subtract(const triangle_mesh& a, const std::vector<triangle_mesh>& bs, polygon_mesh& result, double eps);
+
+			/// Intersects the triangles of m with the plane through origin with the given normal.
+			/// The segments are joined into polylines on the topology of the mesh, i.e. a point
+			/// is identified by the edge or vertex it lies on, so that no tolerance is involved
+			/// and a closed mesh results in closed polylines, which repeat their first point at
+			/// the end. Triangles that lie in the plane do not contribute segments.
+			IFC_GEOM_API std::vector<std::vector<point3>> slice(const triangle_mesh& m, const point3& origin, const point3& normal);
+
+			typedef std::array<double, 2> point2;
+
+			/// Triangulates a planar polygon with holes by ear clipping. loops[0] is the
+			/// outer boundary and the others are holes, the orientation of the loops is
+			/// irrelevant. Holes are first joined to the boundary by bridge edges to the
+			/// closest visible vertex. The counter-clockwise triangles index into the
+			/// concatenation of the loops. Returns false when no ear could be found, i.e.
+			/// when the loops self-intersect or overlap.
+			IFC_GEOM_API bool triangulate_polygon(const std::vector<std::vector<point2>>& loops, std::vector<std::array<int, 3>>& triangles);
+
+		}
+	}
+}
+
+#endif
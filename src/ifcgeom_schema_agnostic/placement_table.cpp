@@ -0,0 +1,60 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#include "placement_table.h"
+
+IfcGeom::placement_table::placement_table(const IfcParse::declaration* rel_to_type, unsigned int max_id)
+	: rel_to_type_(rel_to_type)
+	, entry_by_id_((size_t) max_id + 1, -1)
+{}
+
+size_t IfcGeom::placement_table::add(int id) {
+	const size_t index = ids_.size();
+	if (id >= 0 && (size_t) id < entry_by_id_.size()) {
+		entry_by_id_[id] = (int32_t) index;
+	}
+	ids_.push_back(id);
+	transforms_.emplace_back();
+	resolved_.push_back(0);
+	static const double identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+	matrices_.insert(matrices_.end(), identity, identity + 16);
+	return index;
+}
+
+void IfcGeom::placement_table::set(size_t index, const gp_Trsf& trsf) {
+	transforms_[index] = trsf;
+	double* m = matrices_.data() + index * 16;
+	for (int i = 1; i < 4; ++i) {
+		for (int j = 1; j < 5; ++j) {
+			*m++ = trsf.Value(i, j);
+		}
+	}
+	resolved_[index] = 1;
+}
+
+const gp_Trsf* IfcGeom::placement_table::find(int id) const {
+	if (id < 0 || (size_t) id >= entry_by_id_.size()) {
+		return nullptr;
+	}
+	const int32_t index = entry_by_id_[id];
+	if (index == -1 || !resolved_[index]) {
+		return nullptr;
+	}
+	return &transforms_[index];
+}
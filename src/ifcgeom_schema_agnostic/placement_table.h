@@ -0,0 +1,80 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#ifndef PLACEMENT_TABLE_H
+#define PLACEMENT_TABLE_H
+
+#include "ifc_geom_api.h"
+
+#include "../ifcparse/IfcSchema.h"
+
+#include <gp_Trsf.hxx>
+
+#include <vector>
+#include <cstdint>
+
+namespace IfcGeom {
+
+	/// The resolved absolute transformations of all IfcLocalPlacements in a file.
+	/// Entries are stored in topological order, i.e. a placement always comes after
+	/// the placement it is relative to. The table is filled once by the kernel
+	/// and from then on only read, concurrently, by the kernels of the iterator.
+	class IFC_GEOM_API placement_table {
+	private:
+		const IfcParse::declaration* rel_to_type_;
+		// Instance id to entry, -1 for instances that are not in the table
+		std::vector<int32_t> entry_by_id_;
+		std::vector<int> ids_;
+		std::vector<gp_Trsf> transforms_;
+		// 16 values per entry, row major, translation in meters
+		std::vector<double> matrices_;
+		std::vector<uint8_t> resolved_;
+
+	public:
+		/// rel_to_type is the type at which the resolution of PlacementRelTo
+		/// has stopped, nullptr if placements were resolved up to the root.
+		placement_table(const IfcParse::declaration* rel_to_type, unsigned int max_id);
+
+		/// Appends an entry for the placement with the given instance id and returns its index
+		size_t add(int id);
+
+		/// Stores the transformation of an entry, can be called concurrently for distinct entries
+		void set(size_t index, const gp_Trsf& trsf);
+
+		/// Returns the transformation of an entry, only valid after it has been set
+		const gp_Trsf& at(size_t index) const { return transforms_[index]; }
+		bool resolved(size_t index) const { return resolved_[index] != 0; }
+
+		/// Returns the transformation of the placement with the given instance id,
+		/// or nullptr when the placement was not resolved.
+		const gp_Trsf* find(int id) const;
+
+		const IfcParse::declaration* rel_to_type() const { return rel_to_type_; }
+		size_t size() const { return ids_.size(); }
+
+		/// Instance ids of the entries, in the order of matrices()
+		const std::vector<int>& ids() const { return ids_; }
+
+		/// Flat array of 4x4 row major matrices, identity for unresolved entries
+		const std::vector<double>& matrices() const { return matrices_; }
+	};
+
+}
+
+#endif
@@ -19,11 +19,14 @@
 #include <ShapeExtend_WireData.hxx>
 #include <Standard_Version.hxx>
 #include <GeomAPI_ExtremaCurveCurve.hxx>
+#include <Geom_Line.hxx>
 
 #include <boost/range/irange.hpp>
 #include <boost/range/algorithm_ext/push_back.hpp>
 
 #include <map>
+#include <limits>
+#include <algorithm>
 
 bool IfcGeom::util::approximate_plane_through_wire(const TopoDS_Wire& wire, gp_Pln& plane, double eps_) {
 	// Newell's Method is used for the normal calculation
@@ -342,6 +345,88 @@ namespace {
 	};
 }
 
+bool IfcGeom::util::segments_intersect(const line_segment& a, const line_segment& b, double eps) {
+	const gp_Dir& d1 = a.line.Direction();
+	const gp_Dir& d2 = b.line.Direction();
+	if (d1.IsParallel(d2, Precision::Angular())) {
+		return false;
+	}
+
+	const gp_XYZ w = a.line.Location().XYZ() - b.line.Location().XYZ();
+	const double c = d1.Dot(d2);
+	const double d = d1.XYZ().Dot(w);
+	const double e = d2.XYZ().Dot(w);
+	const double denom = 1. - c * c;
+	const double U1 = (c * e - d) / denom;
+	const double U2 = (e - c * d) / denom;
+
+	const gp_XYZ p1 = a.line.Location().XYZ() + d1.XYZ() * U1;
+	const gp_XYZ p2 = b.line.Location().XYZ() + d2.XYZ() * U2;
+	if ((p1 - p2).Modulus() >= eps) {
+		return false;
+	}
+
+	return a.u1 - eps < U1 && U1 < a.u2 + eps && b.u1 - eps < U2 && U2 < b.u2 + eps;
+}
+
+// The segments are swept in the order of their lower bound along the axis of largest
+// extent, so that only segments of which the intervals overlap are compared.
+std::vector<std::vector<int>> IfcGeom::util::segment_intersections(const std::vector<line_segment>& segments, double eps) {
+	const int n = (int) segments.size();
+
+	// segments_intersect() accepts closest points up to eps beyond the ends of either
+	// segment and up to eps apart, so intervals up to 3 eps apart need to overlap.
+	const double padding = 1.5 * eps;
+
+	std::vector<std::pair<double, double>> intervals[3];
+	double extent[3];
+	for (int k = 0; k < 3; ++k) {
+		double lower = std::numeric_limits<double>::infinity();
+		double upper = -lower;
+		for (auto& s : segments) {
+			const double a = s.line.Location().Coord(k + 1) + s.line.Direction().Coord(k + 1) * s.u1;
+			const double b = s.line.Location().Coord(k + 1) + s.line.Direction().Coord(k + 1) * s.u2;
+			intervals[k].push_back({ (std::min)(a, b) - padding, (std::max)(a, b) + padding });
+			lower = (std::min)(lower, (std::min)(a, b));
+			upper = (std::max)(upper, (std::max)(a, b));
+		}
+		extent[k] = upper - lower;
+	}
+	const auto& interval = intervals[std::max_element(extent, extent + 3) - extent];
+
+	std::vector<int> order(n);
+	for (int i = 0; i < n; ++i) {
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&interval](int a, int b) {
+		return interval[a].first < interval[b].first;
+	});
+
+	std::vector<std::vector<int>> result(n);
+	std::vector<int> active;
+	for (int a : order) {
+		active.erase(std::remove_if(active.begin(), active.end(), [&interval, a](int b) {
+			return interval[b].second < interval[a].first;
+		}), active.end());
+		for (int b : active) {
+			const int i = (std::max)(a, b), j = (std::min)(a, b);
+			if (i - j <= 1 || (i == n - 1 && j == 0)) {
+				continue;
+			}
+			if (segments_intersect(segments[i], segments[j], eps)) {
+				result[i].push_back(j);
+			}
+		}
+		active.push_back(a);
+	}
+
+	for (auto& js : result) {
+		std::sort(js.begin(), js.end());
+	}
+
+	return result;
+}
+
 bool IfcGeom::util::wire_intersections(const TopoDS_Wire& wire, TopTools_ListOfShape& wires, double eps, double eps_real) {
 	if (!wire.Closed()) {
 		wires.Append(wire);
@@ -361,12 +446,21 @@ bool IfcGeom::util::wire_intersections(const TopoDS_Wire& wire, TopTools_ListOfS
 	BRepTools_WireExplorer exp(wire);
 	IfcGeom::impl::tree<int> tree;
 
-	int edge_idx = 0;
+	// Wires of only linear edges are checked by a sweep over the segments, so that
+	// Extrema only needs to be evaluated to construct the intersection points.
+	std::vector<line_segment> segments;
+	bool linear = true;
+
 	for (; exp.More(); exp.Next()) {
 		wd->Add(exp.Current());
-		if (n > 64) {
-			// tfk: indices in tree are 0-based vd 1-based in wiredata
-			tree.add(edge_idx++, exp.Current());
+		if (linear) {
+			double u1, u2;
+			Handle(Geom_Curve) crv = BRep_Tool::Curve(exp.Current(), u1, u2);
+			if (!crv.IsNull() && crv->DynamicType() == STANDARD_TYPE(Geom_Line)) {
+				segments.push_back({ Handle(Geom_Line)::DownCast(crv)->Lin(), (std::min)(u1, u2), (std::max)(u1, u2) });
+			} else {
+				linear = false;
+			}
 		}
 	}
 
@@ -379,6 +473,16 @@ bool IfcGeom::util::wire_intersections(const TopoDS_Wire& wire, TopTools_ListOfS
 		throw geometry_exception("Invalid loop");
 	}
 
+	std::vector<std::vector<int>> linear_intersections;
+	if (linear) {
+		linear_intersections = segment_intersections(segments, eps);
+	} else if (n > 64) {
+		for (int edge_idx = 0; edge_idx < n; ++edge_idx) {
+			// tfk: indices in tree are 0-based vd 1-based in wiredata
+			tree.add(edge_idx, wd->Edge(edge_idx + 1));
+		}
+	}
+
 	bool intersected = false;
 
 	// tfk: Extrema on infinite curves proved to be more robust.
@@ -389,7 +493,9 @@ bool IfcGeom::util::wire_intersections(const TopoDS_Wire& wire, TopTools_ListOfS
 	for (int i = 2; i < n; ++i) {
 
 		std::vector<int> js;
-		if (n > 64) {
+		if (linear) {
+			js = linear_intersections[i];
+		} else if (n > 64) {
 			Bnd_Box b;
 			BRepBndLib::Add(wd->Edge(i + 1), b);
 			b.Enlarge(eps);
@@ -401,7 +507,7 @@ bool IfcGeom::util::wire_intersections(const TopoDS_Wire& wire, TopTools_ListOfS
 		for (std::vector<int>::const_iterator it = js.begin(); it != js.end(); ++it) {
 			int j = *it;
 
-			if (n > 64) {
+			if (n > 64 && !linear) {
 				if (j > i) {
 					continue;
 				}
@@ -1,3 +1,7 @@
+#ifndef WIRE_UTILS_H
+#define WIRE_UTILS_H
+
+#include <gp_Lin.hxx>
 #include <gp_Pln.hxx>
 #include <TopoDS_Wire.hxx>
 #include <TopTools_ListOfShape.hxx>
@@ -23,6 +27,22 @@ namespace IfcGeom {
 		// eps_real: tolerance used to construct new edge geometry around intersection points, cannot be zero
 		bool wire_intersections(const TopoDS_Wire& wire, TopTools_ListOfShape& wires, double eps, double eps_real);
 
+		/// A linear edge as the parameter range on its line
+		struct line_segment {
+			gp_Lin line;
+			double u1, u2;
+		};
+
+		/// Evaluates the criterion that wire_intersections() applies to the extrema of the
+		/// unbounded curves directly on the closest points of the two lines.
+		bool segments_intersect(const line_segment& a, const line_segment& b, double eps);
+
+		/// Returns for every segment i of a closed polygon the non-consecutive segments j < i
+		/// for which segments_intersect() holds, without comparing all pairs of segments.
+		std::vector<std::vector<int>> segment_intersections(const std::vector<line_segment>& segments, double eps);
+
 		void select_largest(const TopTools_ListOfShape& shapes, TopoDS_Shape& largest);
 	}
 }
+
+#endif
@@ -54,6 +54,18 @@
 #include <Geom_Plane.hxx>
 
 #include <memory>
+#include <chrono>
+#include <map>
+#include <list>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
 
 template <typename T>
 union data_field {
@@ -149,13 +161,16 @@ public:
 		read_content(s);
 	}
 
-	void write(std::ostream& s) {
+	// Messages that are sent in batches are only flushed at the end of the batch
+	void write(std::ostream& s, bool flush = true) {
 		std::cout.rdbuf(stdout_orig);
 		swrite(s, iden);
 		std::ostringstream oss;
 		write_content(oss);
 		swrite(s, oss.str());
-		s.flush();
+		if (flush) {
+			s.flush();
+		}
 		std::cout.rdbuf(stdout_redir);
 	}
 
@@ -173,6 +188,16 @@ const int32_t GET_LOG   = BYE       + 1;
 const int32_t LOG       = GET_LOG   + 1;
 const int32_t DEFLECTION = LOG        + 1;
 const int32_t SETTING    = DEFLECTION + 1;
+// Protocol version 1
+const int32_t NUM_THREADS = SETTING     + 1;
+const int32_t STREAM      = NUM_THREADS + 1;
+// Protocol version 2
+const int32_t GET_STATS   = STREAM      + 1;
+const int32_t STATS       = GET_STATS   + 1;
+const int32_t REQUEST     = STATS       + 1;
+const int32_t ABORTED     = REQUEST     + 1;
+
+const int32_t PROTOCOL_VERSION = 2;
 
 class Hello : public Command {
 private:
@@ -186,7 +211,7 @@ protected:
 	}
 public:
 	const std::string& string() { return str; }
-	Hello() : Command(HELLO), str("IfcOpenShell-" IFCOPENSHELL_VERSION "-0") {}
+	Hello() : Command(HELLO), str("IfcOpenShell-" IFCOPENSHELL_VERSION "-" + std::to_string(PROTOCOL_VERSION)) {}
 };
 
 class More : public Command {
@@ -205,17 +230,20 @@ public:
 
 class IfcModel : public Command {
 private:
-	std::string str;
+	IfcParse::IfcFile* file_;
 protected:
 	void read_content(std::istream& s) {
-		str = sread<std::string>(s);
-	}
-	void write_content(std::ostream& s) {
-		swrite(s, str);
+		// The file is parsed from a buffer that is read into directly from the
+		// stream and of which ownership is transferred to the file, so that the
+		// model, which can be large, is not copied.
+		int32_t len = sread<int32_t>(s);
+		file_ = new IfcParse::IfcFile(s, len);
+		while (len++ % 4) s.get();
 	}
+	void write_content(std::ostream& /*s*/) {}
 public:
-	const std::string& string() { return str; }
-	IfcModel() : Command(IFC_MODEL) {};
+	IfcParse::IfcFile* file() { return file_; }
+	IfcModel() : Command(IFC_MODEL), file_(0) {};
 };
 
 class Get : public Command {
@@ -449,6 +477,97 @@ public:
 	uint32_t value() const { return value_; }
 };
 
+class NumThreads : public Command {
+private:
+	int32_t num_threads_;
+protected:
+	void read_content(std::istream& s) {
+		num_threads_ = sread<int32_t>(s);
+	}
+	void write_content(std::ostream& s) {
+		swrite(s, num_threads_);
+	}
+public:
+	NumThreads(int32_t n = 1) : Command(NUM_THREADS), num_threads_(n) {};
+	int32_t num_threads() const { return num_threads_; }
+};
+
+// Grants the server credits to send this number of Entity messages without
+// waiting for the client. The entities are sent as a single batch, after which
+// pending messages from the client are processed. Clients keep the pipeline
+// filled by granting new credits before the previous batch has been consumed.
+class Stream : public Command {
+private:
+	int32_t credits_;
+protected:
+	void read_content(std::istream& s) {
+		credits_ = sread<int32_t>(s);
+	}
+	void write_content(std::ostream& s) {
+		swrite(s, credits_);
+	}
+public:
+	Stream(int32_t n = 0) : Command(STREAM), credits_(n) {};
+	int32_t credits() const { return credits_; }
+};
+
+class GetStats : public Command {
+protected:
+	void read_content(std::istream& /*s*/) {}
+	void write_content(std::ostream& /*s*/) {}
+public:
+	GetStats() : Command(GET_STATS) {};
+};
+
+// Timings in seconds of the processing of a model
+struct model_stats {
+	// Sequence number of the model within the lifetime of the process
+	int model;
+	double read, initialize, iterate, total;
+	int elements;
+	bool done;
+
+	model_stats(int m = 0)
+		: model(m), read(0.), initialize(0.), iterate(0.), total(0.), elements(0), done(false)
+	{}
+};
+
+class Stats : public Command {
+private:
+	model_stats stats_;
+protected:
+	void read_content(std::istream& /*s*/) {}
+	void write_content(std::ostream& s) {
+		std::string json = "{" +
+			format_json(std::string("model")) + ":" + format_json(stats_.model) + "," +
+			format_json(std::string("read")) + ":" + format_json(stats_.read) + "," +
+			format_json(std::string("initialize")) + ":" + format_json(stats_.initialize) + "," +
+			format_json(std::string("iterate")) + ":" + format_json(stats_.iterate) + "," +
+			format_json(std::string("total")) + ":" + format_json(stats_.total) + "," +
+			format_json(std::string("elements")) + ":" + format_json(stats_.elements) + "," +
+			format_json(std::string("done")) + ":" + (stats_.done ? "true" : "false") + "}";
+		swrite(s, json);
+	}
+public:
+	Stats(const model_stats& stats) : Command(STATS), stats_(stats) {};
+};
+
+// Sent by the supervisor when the worker for a request has exited unexpectedly,
+// the status is the exit code or the negated signal number.
+class Aborted : public Command {
+private:
+	int32_t status_;
+protected:
+	void read_content(std::istream& s) {
+		status_ = sread<int32_t>(s);
+	}
+	void write_content(std::ostream& s) {
+		swrite(s, status_);
+	}
+public:
+	Aborted(int32_t status = 0) : Command(ABORTED), status_(status) {};
+};
+
 static const std::string TOTAL_SURFACE_AREA = "TOTAL_SURFACE_AREA";
 static const std::string TOTAL_SHAPE_VOLUME = "TOTAL_SHAPE_VOLUME";
 static const std::string SURFACE_AREA_ALONG_X = "SURFACE_AREA_ALONG_X";
@@ -540,7 +659,25 @@ public:
 	}
 };
 
-int main () {
+void write_entity(IfcGeom::Iterator* iterator, bool emit_quantities, bool flush) {
+	const IfcGeom::TriangulationElement* geom = static_cast<const IfcGeom::TriangulationElement*>(iterator->get());
+	std::unique_ptr<EntityExtension> eext;
+	if (emit_quantities) {
+		eext.reset(new QuantityWriter_v1(iterator->get_native()));
+	} else {
+		eext.reset(new QuantityWriter_v0(iterator->get_native()));
+	}
+	Entity(geom, eext.get()).write(std::cout, flush);
+}
+
+typedef std::chrono::steady_clock::time_point time_point;
+
+double seconds_since(const time_point& t0) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// Processes models received on stdin one after the other until Bye is received
+int serve() {
 	// Redirect stdout to this stream, so that involuntary 
 	// writes to stdout do not interfere with our protocol.
 	std::ostringstream oss;
@@ -557,24 +694,61 @@ int main () {
 	std::cin.setf(std::ios_base::binary);
 #endif
 
+	// Settings apply to the next model only
 	double deflection = 1.e-3;
+	int num_threads = 1;
+	std::vector< std::pair<uint32_t, uint32_t> > setting_pairs;
+
 	bool has_more = false;
 
 	IfcGeom::Iterator* iterator = 0;
 	IfcParse::IfcFile* file = 0;
-	std::vector< std::pair<uint32_t, uint32_t> > setting_pairs;
+
+	model_stats stats;
+	time_point model_start;
+
+	// Releases the current model, also when it has not been processed completely
+	// because a new model has been received.
+	auto close_model = [&]() {
+		if (iterator || file) {
+			delete iterator;
+			delete file;
+			iterator = 0;
+			file = 0;
+			stats.total = seconds_since(model_start);
+		}
+		has_more = false;
+	};
+
+	// Advances the iterator, the time spent in the iterator is attributed to iteration
+	auto next = [&]() {
+		time_point t0 = std::chrono::steady_clock::now();
+		has_more = iterator->next() != 0;
+		stats.iterate += seconds_since(t0);
+		if (!has_more) {
+			stats.done = true;
+			close_model();
+		}
+	};
 
 	Hello().write(std::cout);
 
 	int exit_code = 0;
 	for (;;) {
 		const int32_t msg_type = sread<int32_t>(std::cin);
+		if (!std::cin.good()) {
+			exit_code = 1;
+			break;
+		}
 		switch (msg_type) {
 		case IFC_MODEL: {
+			close_model();
+			Logger::ClearLog();
+			stats = model_stats(stats.model + 1);
+			model_start = std::chrono::steady_clock::now();
+
 			IfcModel m; m.read(std::cin);
-			std::string::size_type len = m.string().size();
-			char* data = new char[len];
-			memcpy(data, m.string().c_str(), len);
+			stats.read = seconds_since(model_start);
 
 			IfcGeom::IteratorSettings settings;
             settings.set(IfcGeom::IteratorSettings::USE_WORLD_COORDS, false);
@@ -582,6 +756,7 @@ int main () {
             settings.set(IfcGeom::IteratorSettings::CONVERT_BACK_UNITS, true);
             // settings.set(IfcGeom::IteratorSettings::INCLUDE_CURVES, true);
 
+			emit_quantities = false;
 			std::vector< std::pair<uint32_t, uint32_t> >::const_iterator it = setting_pairs.begin();
 			for (; it != setting_pairs.end(); ++it) {
 				settings.set(it->first, it->second != 0);
@@ -594,9 +769,20 @@ int main () {
 
 			settings.set_deflection_tolerance(deflection);
 
-			file = new IfcParse::IfcFile(data, (int)len);
-			iterator = new IfcGeom::Iterator(settings, file);
+			file = m.file();
+			iterator = new IfcGeom::Iterator(settings, file, num_threads);
+
+			deflection = 1.e-3;
+			num_threads = 1;
+			setting_pairs.clear();
+
+			time_point t0 = std::chrono::steady_clock::now();
 			has_more = iterator->initialize();
+			stats.initialize = seconds_since(t0);
+			if (!has_more) {
+				stats.done = true;
+				close_model();
+			}
 
 			More(has_more).write(std::cout);
 			continue;
@@ -607,25 +793,40 @@ int main () {
 				exit_code = 1;
 				break;
 			}
-			const IfcGeom::TriangulationElement* geom = static_cast<const IfcGeom::TriangulationElement*>(iterator->get());
-			std::unique_ptr<EntityExtension> eext;
-			if (emit_quantities) {
-				eext.reset(new QuantityWriter_v1(iterator->get_native()));
+			write_entity(iterator, emit_quantities, true);
+			stats.elements += 1;
+			continue;
+		}
+		case STREAM: {
+			Stream st; st.read(std::cin);
+			if (!has_more) {
+				// Credits granted by the client before it received the end of
+				// the stream, to which there is nothing left to respond.
+				continue;
+			}
+			// Every entity is followed by advancing the iterator, the end of the
+			// stream is signalled by More(false), credits left at that point are void.
+			for (int32_t credits = st.credits(); credits > 0 && has_more; --credits) {
+				write_entity(iterator, emit_quantities, false);
+				stats.elements += 1;
+				next();
+			}
+			if (has_more) {
+				std::cout.rdbuf(stdout_orig);
+				std::cout.flush();
+				std::cout.rdbuf(stdout_redir);
 			} else {
-				eext.reset(new QuantityWriter_v0(iterator->get_native()));
+				More(false).write(std::cout);
 			}
-			Entity(geom, eext.get()).write(std::cout);
 			continue;
 		}
 		case NEXT: {
 			Next n; n.read(std::cin);
-			has_more = iterator->next() != 0;
 			if (!has_more) {
-				delete file;
-				delete iterator;
-				file = 0;
-				iterator = 0;
+				exit_code = 1;
+				break;
 			}
+			next();
 			More(has_more).write(std::cout);
 			continue;
 		}
@@ -634,7 +835,16 @@ int main () {
 			WriteLog(Logger::GetLog()).write(std::cout);
 			continue;
 		}
+		case GET_STATS: {
+			GetStats gs; gs.read(std::cin);
+			if (!stats.done && iterator) {
+				stats.total = seconds_since(model_start);
+			}
+			Stats(stats).write(std::cout);
+			continue;
+		}
 		case BYE: {
+			close_model();
 			Bye().write(std::cout);
 			exit_code = 0;
 			break;
@@ -659,6 +869,16 @@ int main () {
 				break;
 			}
 		}
+		case NUM_THREADS: {
+			NumThreads n; n.read(std::cin);
+			if (!iterator && n.num_threads() > 0) {
+				num_threads = n.num_threads();
+				continue;
+			} else {
+				exit_code = 1;
+				break;
+			}
+		}
 		default:
 			exit_code = 1; 
 			break;
@@ -668,3 +888,340 @@ int main () {
 	std::cout.rdbuf(stdout_orig);
 	return exit_code;
 }
+
+#ifndef _WIN32
+
+namespace {
+
+	const size_t HEADER_SIZE = 2 * sizeof(int32_t);
+
+	int32_t read_int32(const char* data) {
+		int32_t v;
+		memcpy(&v, data, sizeof(int32_t));
+		return v;
+	}
+
+	// A byte queue that is consumed from the front. Consumed bytes are only
+	// discarded once they outnumber the pending ones, so that partial reads
+	// and writes do not move the remainder of the queue every time.
+	class byte_queue {
+	private:
+		std::string data_;
+		size_t offset_;
+	public:
+		byte_queue() : offset_(0) {}
+
+		const char* data() const { return data_.data() + offset_; }
+		size_t size() const { return data_.size() - offset_; }
+		bool empty() const { return offset_ == data_.size(); }
+
+		void append(const char* data, size_t size) { data_.append(data, size); }
+
+		void consume(size_t size) {
+			offset_ += size;
+			if (offset_ == data_.size()) {
+				data_.clear();
+				offset_ = 0;
+			} else if (offset_ > data_.size() - offset_) {
+				data_.erase(0, offset_);
+				offset_ = 0;
+			}
+		}
+
+		void clear() {
+			data_.clear();
+			offset_ = 0;
+		}
+	};
+
+	// Returns the size of the first complete message, i.e. type, length and
+	// padded content, at the front of the queue or zero when it is incomplete.
+	size_t next_message(const byte_queue& queue) {
+		if (queue.size() < HEADER_SIZE) {
+			return 0;
+		}
+		int32_t len = read_int32(queue.data() + sizeof(int32_t));
+		while (len % 4) ++len;
+		const size_t size = HEADER_SIZE + len;
+		return queue.size() < size ? 0 : size;
+	}
+
+	bool write_all(int fd, const char* data, size_t size) {
+		size_t written = 0;
+		while (written < size) {
+			ssize_t n = write(fd, data + written, size - written);
+			if (n < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return false;
+			}
+			written += n;
+		}
+		return true;
+	}
+
+	// Appends a message wrapped into a Request message for the given request id
+	void append_envelope(byte_queue& queue, int32_t request_id, const char* message, size_t size) {
+		const int32_t header[3] = { REQUEST, (int32_t) (sizeof(int32_t) + size), request_id };
+		queue.append((const char*) header, sizeof(header));
+		queue.append(message, size);
+	}
+
+	void append_message(byte_queue& queue, Command&& command) {
+		std::ostringstream oss;
+		command.write(oss);
+		const std::string message = oss.str();
+		queue.append(message.data(), message.size());
+	}
+
+	// Puts a file descriptor in non-blocking mode for the lifetime of the object
+	class nonblocking {
+	private:
+		int fd_, flags_;
+	public:
+		explicit nonblocking(int fd) : fd_(fd), flags_(fcntl(fd, F_GETFL)) {
+			fcntl(fd_, F_SETFL, flags_ | O_NONBLOCK);
+		}
+		~nonblocking() { restore(); }
+		void restore() { fcntl(fd_, F_SETFL, flags_); }
+	};
+
+	// Output of the workers is not read while this many bytes are pending for the
+	// client, a client that does not read its input then stalls the workers, but
+	// not the forwarding of its own messages to them.
+	const size_t MAX_PENDING_OUTPUT = 1 << 26;
+
+	struct worker {
+		int32_t request_id;
+		pid_t pid;
+		// The write end of the stdin and the read end of the stdout of the worker
+		int in, out;
+		byte_queue to_worker, from_worker;
+		// A worker that has been sent Bye is retired: it is left to drain its
+		// output and exit, subsequent requests with its id start a new worker.
+		bool hello_received, bye_sent, exited;
+	};
+
+	// Forks a worker process that serves the models for a single request id
+	worker* spawn(std::list<worker>& workers, int32_t request_id) {
+		int in[2], out[2];
+		if (pipe(in) != 0) {
+			return nullptr;
+		}
+		if (pipe(out) != 0) {
+			close(in[0]); close(in[1]);
+			return nullptr;
+		}
+		pid_t pid = fork();
+		if (pid < 0) {
+			close(in[0]); close(in[1]); close(out[0]); close(out[1]);
+			return nullptr;
+		}
+		if (pid == 0) {
+			// Pipes of the other workers need to be closed in the child for those
+			// workers to observe the end of their input when the supervisor exits.
+			for (auto& w : workers) {
+				close(w.in);
+				close(w.out);
+			}
+			dup2(in[0], STDIN_FILENO);
+			dup2(out[1], STDOUT_FILENO);
+			close(in[0]); close(in[1]); close(out[0]); close(out[1]);
+			signal(SIGPIPE, SIG_DFL);
+			_exit(serve());
+		}
+		close(in[0]);
+		close(out[1]);
+		fcntl(in[1], F_SETFL, fcntl(in[1], F_GETFL) | O_NONBLOCK);
+		workers.push_back(worker());
+		worker& w = workers.back();
+		w.request_id = request_id;
+		w.pid = pid;
+		w.in = in[1];
+		w.out = out[0];
+		w.hello_received = w.bye_sent = w.exited = false;
+		return &w;
+	}
+
+	void stop(worker& w) {
+		kill(w.pid, SIGTERM);
+		close(w.in);
+		close(w.out);
+		int status;
+		waitpid(w.pid, &status, 0);
+	}
+}
+
+// Routes the messages of multiple concurrent requests, wrapped in Request messages,
+// to a worker process per request id. A worker processes any number of models for
+// its request id, until it receives Bye. A worker that crashes is reported to the
+// client with an Aborted message, a subsequent request with the same id starts a
+// new worker, other requests are not affected.
+int supervise() {
+	signal(SIGPIPE, SIG_IGN);
+
+	// Messages are written to string streams, std::cout is left untouched for the workers
+	stdout_orig = stdout_redir = std::cout.rdbuf();
+
+	// Messages for the client are queued and written when stdout is ready, so that
+	// neither a client that is slow to read, nor one that is blocked writing a large
+	// message to stdin, stalls the other requests.
+	nonblocking stdout_nonblocking(STDOUT_FILENO);
+	byte_queue to_client;
+	append_message(to_client, Hello());
+
+	// Workers that have not been sent Bye, by request id
+	std::map<int32_t, worker*> active;
+	std::list<worker> workers;
+	byte_queue from_client;
+	char buffer[1 << 16];
+
+	for (;;) {
+		std::vector<pollfd> fds;
+		std::vector<worker*> fd_workers;
+		fds.push_back({ STDIN_FILENO, POLLIN, 0 });
+		// Negative descriptors are ignored by poll()
+		fds.push_back({ to_client.empty() ? -1 : STDOUT_FILENO, POLLOUT, 0 });
+		for (auto& w : workers) {
+			if (to_client.size() < MAX_PENDING_OUTPUT) {
+				fds.push_back({ w.out, POLLIN, 0 });
+				fd_workers.push_back(&w);
+			}
+			if (!w.to_worker.empty()) {
+				fds.push_back({ w.in, POLLOUT, 0 });
+				fd_workers.push_back(&w);
+			}
+		}
+
+		if (poll(fds.data(), fds.size(), -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return 1;
+		}
+
+		if (fds[1].revents) {
+			ssize_t n = write(STDOUT_FILENO, to_client.data(), to_client.size());
+			if (n > 0) {
+				to_client.consume(n);
+			} else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+				// The client has closed its input
+				return 1;
+			}
+		}
+
+		for (size_t i = 2; i < fds.size(); ++i) {
+			worker& w = *fd_workers[i - 2];
+			if (!fds[i].revents || w.exited) {
+				continue;
+			}
+
+			if (fds[i].events == POLLOUT) {
+				ssize_t n = write(w.in, w.to_worker.data(), w.to_worker.size());
+				if (n > 0) {
+					w.to_worker.consume(n);
+				} else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+					// The worker has exited, which is handled when its output is closed
+					w.to_worker.clear();
+				}
+				continue;
+			}
+
+			ssize_t n = read(w.out, buffer, sizeof(buffer));
+			if (n < 0 && errno == EINTR) {
+				continue;
+			}
+			if (n <= 0) {
+				int status = 0;
+				close(w.in);
+				close(w.out);
+				waitpid(w.pid, &status, 0);
+				if (!w.bye_sent) {
+					active.erase(w.request_id);
+					const int32_t code = WIFSIGNALED(status) ? -WTERMSIG(status) : WEXITSTATUS(status);
+					std::ostringstream aborted;
+					Aborted(code).write(aborted);
+					const std::string message = aborted.str();
+					append_envelope(to_client, w.request_id, message.data(), message.size());
+				}
+				w.exited = true;
+				continue;
+			}
+
+			w.from_worker.append(buffer, n);
+			while (size_t size = next_message(w.from_worker)) {
+				if (!w.hello_received) {
+					// The client has already received the Hello of the supervisor
+					w.hello_received = true;
+				} else {
+					append_envelope(to_client, w.request_id, w.from_worker.data(), size);
+				}
+				w.from_worker.consume(size);
+			}
+		}
+
+		workers.remove_if([](const worker& w) { return w.exited; });
+
+		if (fds[0].revents) {
+			ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+			if (n < 0 && errno == EINTR) {
+				continue;
+			}
+			bool bye = n <= 0;
+			if (n > 0) {
+				from_client.append(buffer, n);
+			}
+			while (!bye) {
+				const size_t size = next_message(from_client);
+				if (size == 0) {
+					break;
+				}
+				const char* message = from_client.data();
+				const int32_t type = read_int32(message);
+				if (type == BYE) {
+					bye = true;
+				} else if (type == REQUEST && size >= HEADER_SIZE + sizeof(int32_t) + HEADER_SIZE) {
+					const int32_t request_id = read_int32(message + HEADER_SIZE);
+					const char* inner = message + HEADER_SIZE + sizeof(int32_t);
+					worker* w = active[request_id];
+					if (w == nullptr && (w = active[request_id] = spawn(workers, request_id)) == nullptr) {
+						return 1;
+					}
+					w->to_worker.append(inner, size - HEADER_SIZE - sizeof(int32_t));
+					if (read_int32(inner) == BYE) {
+						w->bye_sent = true;
+						active.erase(request_id);
+					}
+				} else {
+					return 1;
+				}
+				from_client.consume(size);
+			}
+			if (bye) {
+				for (auto& w : workers) {
+					stop(w);
+				}
+				// The remaining output and the Bye are written in blocking mode
+				append_message(to_client, Bye());
+				stdout_nonblocking.restore();
+				write_all(STDOUT_FILENO, to_client.data(), to_client.size());
+				return n <= 0 ? 1 : 0;
+			}
+		}
+	}
+}
+
+#endif
+
+int main(int argc, char** argv) {
+	if (argc == 2 && std::string(argv[1]) == "--supervise") {
+#ifdef _WIN32
+		std::cerr << "--supervise is not supported on Windows" << std::endl;
+		return 1;
+#else
+		return supervise();
+#endif
+	}
+	return serve();
+}
@@ -0,0 +1,229 @@
+# IfcOpenShell - IFC toolkit and geometry engine
+# Copyright (C) 2021 Thomas Krijnen <thomas@aecgeeks.com>
+#
+# This file is part of IfcOpenShell.
+#
+# IfcOpenShell is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# IfcOpenShell is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with IfcOpenShell.  If not, see <http://www.gnu.org/licenses/>.
+
+"""A minimal stand-in client for IfcGeomServer, for testing the protocol
+without a BIMserver deployment.
+
+    python client.py IfcGeomServer model.ifc [model.ifc ...] [--threads N]
+        [--credits N] [--supervise]
+
+Without --supervise the models are processed one after the other by a single
+server process. With --supervise the server is started as a supervisor and
+every model is sent concurrently under its own request id. For every model
+the number of elements received and the timings reported by the server are
+printed as a JSON object.
+"""
+
+import sys
+import json
+import struct
+import argparse
+import threading
+import subprocess
+import collections
+
+HELLO = 0xFF00
+IFC_MODEL = HELLO + 1
+GET = IFC_MODEL + 1
+ENTITY = GET + 1
+MORE = ENTITY + 1
+NEXT = MORE + 1
+BYE = NEXT + 1
+GET_LOG = BYE + 1
+LOG = GET_LOG + 1
+DEFLECTION = LOG + 1
+SETTING = DEFLECTION + 1
+NUM_THREADS = SETTING + 1
+STREAM = NUM_THREADS + 1
+GET_STATS = STREAM + 1
+STATS = GET_STATS + 1
+REQUEST = STATS + 1
+ABORTED = REQUEST + 1
+
+
+def pad(data):
+    return data + b"\0" * (-len(data) % 4)
+
+
+def message(type, content=b""):
+    return struct.pack("<ii", type, len(content)) + pad(content)
+
+
+def string(data):
+    return struct.pack("<i", len(data)) + pad(data)
+
+
+def envelope(request_id, msg):
+    return message(REQUEST, struct.pack("<i", request_id) + msg)
+
+
+def read_message(stream):
+    header = stream.read(8)
+    if len(header) < 8:
+        raise EOFError()
+    type, length = struct.unpack("<ii", header)
+    content = stream.read(length + (-length % 4))
+    return type, content[:length]
+
+
+def read_string(content):
+    (length,) = struct.unpack_from("<i", content)
+    return content[4 : 4 + length]
+
+
+class connection:
+    """Sends the messages for a single model, directly or wrapped in Request
+    messages, and receives its replies from a queue."""
+
+    def __init__(self, server, lock, request_id=None):
+        self.server = server
+        self.lock = lock
+        self.request_id = request_id
+        self.queue = collections.deque()
+        self.condition = threading.Condition()
+
+    def send(self, msg):
+        if self.request_id is not None:
+            msg = envelope(self.request_id, msg)
+        with self.lock:
+            self.server.stdin.write(msg)
+            self.server.stdin.flush()
+
+    def put(self, type, content):
+        with self.condition:
+            self.queue.append((type, content))
+            self.condition.notify()
+
+    def receive(self, expected):
+        with self.condition:
+            while not self.queue:
+                self.condition.wait()
+            type, content = self.queue.popleft()
+        if type == ABORTED:
+            raise RuntimeError("Worker aborted with status %d" % struct.unpack("<i", content))
+        if type != expected:
+            raise RuntimeError("Expected message 0x%x, received 0x%x" % (expected, type))
+        return content
+
+    def process(self, path, num_threads, credits):
+        if num_threads != 1:
+            self.send(message(NUM_THREADS, struct.pack("<i", num_threads)))
+        with open(path, "rb") as f:
+            self.send(message(IFC_MODEL, string(f.read())))
+
+        elements = 0
+        (more,) = struct.unpack("<i", self.receive(MORE))
+        if more:
+            # Keep twice the batch size in flight, so that the server does not
+            # need to wait for new credits.
+            self.send(message(STREAM, struct.pack("<i", 2 * credits)))
+            in_flight = 2 * credits
+            while True:
+                with self.condition:
+                    while not self.queue:
+                        self.condition.wait()
+                    type, _ = self.queue[0]
+                if type == MORE:
+                    self.receive(MORE)
+                    break
+                self.receive(ENTITY)
+                elements += 1
+                in_flight -= 1
+                if in_flight == credits:
+                    self.send(message(STREAM, struct.pack("<i", credits)))
+                    in_flight += credits
+
+        self.send(message(GET_STATS))
+        stats = json.loads(read_string(self.receive(STATS)))
+        stats["path"] = path
+        stats["elements_received"] = elements
+        return stats
+
+
+def reader(server, connections, supervised):
+    try:
+        while True:
+            type, content = read_message(server.stdout)
+            if supervised and type == REQUEST:
+                (request_id,) = struct.unpack_from("<i", content)
+                type, length = struct.unpack_from("<ii", content, 4)
+                connections[request_id].put(type, content[12 : 12 + length])
+            elif type == BYE:
+                break
+            elif not supervised:
+                connections[None].put(type, content)
+    except EOFError:
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("server")
+    parser.add_argument("models", nargs="+")
+    parser.add_argument("--threads", type=int, default=1)
+    parser.add_argument("--credits", type=int, default=32)
+    parser.add_argument("--supervise", action="store_true")
+    args = parser.parse_args()
+
+    command = [args.server] + (["--supervise"] if args.supervise else [])
+    server = subprocess.Popen(command, stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+
+    type, content = read_message(server.stdout)
+    assert type == HELLO
+    print(read_string(content).decode(), file=sys.stderr)
+
+    lock = threading.Lock()
+    if args.supervise:
+        connections = {i: connection(server, lock, i) for i in range(len(args.models))}
+    else:
+        connections = {None: connection(server, lock)}
+
+    thread = threading.Thread(target=reader, args=(server, connections, args.supervise))
+    thread.start()
+
+    results = [None] * len(args.models)
+
+    def process(i, conn):
+        try:
+            results[i] = conn.process(args.models[i], args.threads, args.credits)
+        except RuntimeError as e:
+            results[i] = {"path": args.models[i], "error": str(e)}
+
+    if args.supervise:
+        threads = [threading.Thread(target=process, args=(i, connections[i])) for i in range(len(args.models))]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+    else:
+        for i in range(len(args.models)):
+            process(i, connections[None])
+
+    server.stdin.write(message(BYE))
+    server.stdin.flush()
+    thread.join()
+    server.wait()
+
+    for r in results:
+        print(json.dumps(r))
+
+    return 0 if all("error" not in r for r in results) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
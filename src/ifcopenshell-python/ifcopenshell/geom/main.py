@@ -23,7 +23,9 @@ from __future__ import print_function
 
 import os
 import sys
+import array
 import operator
+import itertools
 
 from .. import ifcopenshell_wrapper
 from ..file import file
@@ -124,16 +126,25 @@ class iterator(ifcopenshell_wrapper.Iterator):
 
 
 class tree(ifcopenshell_wrapper.tree):
-    def __init__(self, file=None, settings=None):
+    def __init__(self, file=None, settings=None, num_threads=1, mesh_deflection=None, mesh_tolerance=1.0e-5):
+        if mesh_deflection is not None:
+            # Needs to be enabled before the elements are added
+            ifcopenshell_wrapper.tree.__init__(self)
+            self.enable_mesh_narrow_phase(mesh_deflection, mesh_tolerance)
+            if file is not None:
+                self.add_file(file, settings or ifcopenshell_wrapper.IteratorSettings(), num_threads)
+            return
         args = [self]
         if file is not None:
             args.append(file.wrapped_data)
             if settings is not None:
                 args.append(settings)
+                if num_threads != 1:
+                    args.append(num_threads)
         ifcopenshell_wrapper.tree.__init__(*args)
 
-    def add_file(self, file, settings):
-        ifcopenshell_wrapper.tree.add_file(self, file.wrapped_data, settings)
+    def add_file(self, file, settings, num_threads=1):
+        ifcopenshell_wrapper.tree.add_file(self, file.wrapped_data, settings, num_threads)
 
     def add_iterator(self, iterator):
         ifcopenshell_wrapper.tree.add_file(self, iterator)
@@ -177,6 +188,55 @@ class tree(ifcopenshell_wrapper.tree):
             args.append(kwargs.get("extend", -1.0e-5))
         return [entity_instance(e) for e in ifcopenshell_wrapper.tree.select_box(*args)]
 
+    def select_rays(self, origins, directions, max_distance=1000.0, num_threads=1):
+        """Casts a batch of rays and returns the closest hit of every ray.
+
+        Origins and directions are sequences of xyz triplets or float64 arrays
+        of shape (n, 3). Consecutive rays are traced together, so ordering the
+        rays coherently improves performance. The elements are triangulated on
+        first use, use build_ray_scene(deflection) to control the deflection.
+
+        Returns a tuple of memoryviews (instance ids, style indices, positions,
+        normals, distances), positions and normals are of shape (n, 3). Rays
+        that do not hit anything have instance id 0, style index -1 and an
+        infinite distance. Style indices refer to styles() when face styles
+        are enabled.
+        """
+
+        def as_buffer(v):
+            try:
+                memoryview(v)
+                return v
+            except TypeError:
+                return array.array("d", itertools.chain.from_iterable(v))
+
+        ids, styles, positions, normals, distances = ifcopenshell_wrapper.tree.select_rays_(
+            self, as_buffer(origins), as_buffer(directions), max_distance, num_threads
+        )
+        if len(ids):
+            positions = positions.cast("B").cast("d", (len(ids), 3))
+            normals = normals.cast("B").cast("d", (len(ids), 3))
+        return ids, styles, positions, normals, distances
+
+    CLASH_TYPES = {"intersection": 0, "containment": 1, "clearance": 2}
+
+    def clash_all(self, a, b=None, mode="intersection", tolerance=-1.0e-5, num_threads=1):
+        """Tests all elements in a against all elements in b, or against the
+        other elements in a when b is not specified.
+
+        Returns a list of (a, b, distance, protrusion_distance) tuples. For
+        mode "containment" b is completely within a, for mode "clearance" the
+        elements are less than tolerance apart.
+        """
+        a = [e.wrapped_data for e in a]
+        b = a if b is None else [e.wrapped_data for e in b]
+        return [
+            (entity_instance(x), entity_instance(y), distance, protrusion)
+            for x, y, distance, protrusion in ifcopenshell_wrapper.tree.clash_all_(
+                self, a, b, tree.CLASH_TYPES[mode], tolerance, num_threads
+            )
+        ]
+
 
 def create_shape(settings, inst, repr=None):
     """
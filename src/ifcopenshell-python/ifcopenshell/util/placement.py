@@ -17,6 +17,8 @@
 # along with IfcOpenShell.  If not, see <http://www.gnu.org/licenses/>.
 
 import numpy as np
+import ifcopenshell.ifcopenshell_wrapper
+import ifcopenshell.util.unit
 
 
 def a2p(o, z, x):
@@ -44,6 +46,22 @@ def get_local_placement(plc):
     return np.dot(parent, get_axis2placement(plc.RelativePlacement))
 
 
+def get_local_placements(ifc_file, num_threads=1):
+    """Resolves the absolute matrices of all IfcLocalPlacements in the file at once.
+
+    Returns a dictionary of instance id to 4x4 matrix. Like get_local_placement(),
+    translations are expressed in the project length unit.
+    """
+    ids, matrices = ifcopenshell.ifcopenshell_wrapper.resolve_placements(ifc_file.wrapped_data, num_threads)
+    matrices = np.frombuffer(matrices, dtype=np.float64).reshape(-1, 4, 4)
+    # The geometry kernel resolves the placements in meters
+    unit_scale = ifcopenshell.util.unit.calculate_unit_scale(ifc_file) if ifc_file.by_type("IfcUnitAssignment") else 1.0
+    if unit_scale != 1.0:
+        matrices = matrices.copy()
+        matrices[:, :3, 3] /= unit_scale
+    return dict(zip(np.frombuffer(ids, dtype=np.int32).tolist(), matrices))
+
+
 def get_storey_elevation(storey):
     if storey.ObjectPlacement:
         matrix = get_local_placement(storey.ObjectPlacement)
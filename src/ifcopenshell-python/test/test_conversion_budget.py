@@ -0,0 +1,193 @@
+# IfcOpenShell - IFC toolkit and geometry engine
+# Copyright (C) 2021 Thomas Krijnen <thomas@aecgeeks.com>
+#
+# This file is part of IfcOpenShell.
+#
+# IfcOpenShell is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# IfcOpenShell is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with IfcOpenShell.  If not, see <http://www.gnu.org/licenses/>.
+
+# Elements that exceed their conversion budget are aborted. A budget that is
+# too small for any conversion results in no elements, a generous budget does
+# not affect the result. With BUDGET_FALLBACK aborted elements are retried
+# without openings, under a fresh budget, and not written to the cache.
+
+import time
+import pytest
+import ifcopenshell
+import ifcopenshell.geom
+import ifcopenshell.guid
+import ifcopenshell.template
+
+O = 0.0, 0.0, 0.0
+X = 1.0, 0.0, 0.0
+Z = 0.0, 0.0, 1.0
+
+
+def create_ifcaxis2placement(f, point=O, dir1=Z, dir2=X):
+    return f.createIfcAxis2Placement3D(
+        f.createIfcCartesianPoint(point), f.createIfcDirection(dir1), f.createIfcDirection(dir2)
+    )
+
+
+def create_file(num_openings=1):
+    f = ifcopenshell.template.create()
+
+    owner_history = f.by_type("IfcOwnerHistory")[0]
+    context = f.by_type("IfcGeometricRepresentationContext")[0]
+
+    def extrusion(profile, height, point=O):
+        solid = f.createIfcExtrudedAreaSolid(
+            profile, create_ifcaxis2placement(f, point), f.createIfcDirection(Z), height
+        )
+        return f.createIfcProductDefinitionShape(
+            None, None, [f.createIfcShapeRepresentation(context, "Body", "SweptSolid", [solid])]
+        )
+
+    def rectangle(width, depth):
+        return f.createIfcRectangleProfileDef("AREA", None, None, width, depth)
+
+    wall = f.createIfcWall(
+        ifcopenshell.guid.new(),
+        owner_history,
+        None,
+        None,
+        None,
+        f.createIfcLocalPlacement(None, create_ifcaxis2placement(f)),
+        extrusion(rectangle(5.0, 0.2), 3.0),
+        None,
+    )
+
+    def add_opening(body):
+        opening = f.createIfcOpeningElement(
+            ifcopenshell.guid.new(),
+            owner_history,
+            None,
+            None,
+            None,
+            f.createIfcLocalPlacement(wall.ObjectPlacement, create_ifcaxis2placement(f)),
+            body,
+            None,
+        )
+        f.createIfcRelVoidsElement(ifcopenshell.guid.new(), owner_history, None, None, wall, opening)
+
+    add_opening(extrusion(rectangle(1.0, 1.0), 2.0, (0.0, 0.0, -0.5)))
+    # Additional openings, spread along the wall, to make the subtraction expensive
+    for i in range(1, num_openings):
+        x = -2.4 + 4.8 * i / num_openings
+        circle = f.createIfcCircleProfileDef("AREA", None, None, 0.01)
+        add_opening(extrusion(circle, 1.0, (x, 0.0, 0.2 + 2.0 * (i % 2))))
+
+    return f
+
+
+def convert(f, settings, cache=None):
+    return [(shape.guid, len(shape.geometry.faces)) for shape in ifcopenshell.geom.iterate(settings, f, cache=cache)]
+
+
+def timed_convert(f, settings):
+    t0 = time.perf_counter()
+    elements = convert(f, settings)
+    return elements, time.perf_counter() - t0
+
+
+def without_openings():
+    settings = ifcopenshell.geom.settings()
+    settings.set(settings.DISABLE_OPENING_SUBTRACTIONS, True)
+    return settings
+
+
+class TestConversionBudget:
+    def test_exceeded(self):
+        f = create_file()
+        assert len(convert(f, ifcopenshell.geom.settings())) == 1
+        ifcopenshell.get_log()
+
+        settings = ifcopenshell.geom.settings()
+        settings.set_element_timeout(1.0e-9)
+        assert convert(f, settings) == []
+        log = ifcopenshell.get_log()
+        assert "aborted, exceeded its time budget" in log
+        assert "without openings" not in log
+
+    def test_generous(self):
+        f = create_file()
+        expected = convert(f, ifcopenshell.geom.settings())
+        assert len(expected) == 1
+        # The opening is subtracted
+        assert expected[0][1] > convert(f, without_openings())[0][1]
+
+        settings = ifcopenshell.geom.settings()
+        settings.set_element_timeout(600.0)
+        settings.set_element_memory_limit(1 << 30)
+        assert convert(f, settings) == expected
+
+    def test_fallback_has_a_budget_of_its_own(self):
+        f = create_file()
+        ifcopenshell.get_log()
+
+        settings = ifcopenshell.geom.settings()
+        settings.set(settings.BUDGET_FALLBACK, True)
+        settings.set_element_timeout(1.0e-9)
+        assert convert(f, settings) == []
+        log = ifcopenshell.get_log()
+        assert "aborted, exceeded its time budget" in log
+        assert "without openings aborted, exceeded its time budget" in log
+
+    def calibrate(self, f):
+        """The conversion of f without openings, with openings and a timeout that
+        is only exceeded by the conversion with openings"""
+        expected, t_without = timed_convert(f, without_openings())
+        with_openings, t_with = timed_convert(f, ifcopenshell.geom.settings())
+        assert len(expected) == 1
+        assert with_openings[0][1] > expected[0][1]
+        # The budget only measures the conversion itself, which without openings
+        # takes less than the iteration as a whole and with openings more than the
+        # iteration minus the conversion without openings.
+        timeout = 10.0 * t_without
+        if t_with - t_without < 2.0 * timeout:
+            pytest.skip("Subtracting the openings is not sufficiently slower than converting the wall")
+        return expected, with_openings, timeout
+
+    def test_fallback_without_openings(self):
+        f = create_file(num_openings=200)
+        expected, _, timeout = self.calibrate(f)
+
+        settings = ifcopenshell.geom.settings()
+        settings.set_element_timeout(timeout)
+        assert convert(f, settings) == []
+
+        settings.set(settings.BUDGET_FALLBACK, True)
+        assert convert(f, settings) == expected
+
+    @pytest.mark.skipif(not hasattr(ifcopenshell.geom.serializers, "hdf5"), reason="Built without HDF5 support")
+    @pytest.mark.parametrize("cache_by_content", [False, True])
+    def test_fallback_is_not_cached(self, tmp_path, cache_by_content):
+        f = create_file(num_openings=200)
+        expected, with_openings, timeout = self.calibrate(f)
+        cache = str(tmp_path / "cache.h5")
+
+        settings = ifcopenshell.geom.settings()
+        settings.set(settings.CACHE_BY_CONTENT, cache_by_content)
+        settings.set(settings.BUDGET_FALLBACK, True)
+        settings.set_element_timeout(timeout)
+        assert convert(f, settings, cache) == expected
+
+        # Without a budget the openings are subtracted, rather than the geometry
+        # of the fallback being read from the cache
+        settings.set_element_timeout(0.0)
+        assert convert(f, settings, cache) == with_openings
+        assert convert(f, settings, cache) == with_openings
+
+
+if __name__ == "__main__":
+    pytest.main(["-x", __file__])
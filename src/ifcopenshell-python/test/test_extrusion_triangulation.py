@@ -0,0 +1,158 @@
+# IfcOpenShell - IFC toolkit and geometry engine
+# Copyright (C) 2021 Thomas Krijnen <thomas@aecgeeks.com>
+#
+# This file is part of IfcOpenShell.
+#
+# IfcOpenShell is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# IfcOpenShell is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with IfcOpenShell.  If not, see <http://www.gnu.org/licenses/>.
+
+# With TRIANGULATE_PLANAR_FACES, extrusions of polygonal profiles are triangulated
+# directly by ear clipping the faces instead of by BRepMesh. The volume and area of
+# the triangulation are compared to the ones calculated on the BRep.
+
+import collections
+import math
+import pytest
+import ifcopenshell
+import ifcopenshell.geom
+import ifcopenshell.guid
+import ifcopenshell.template
+
+O = 0.0, 0.0, 0.0
+X = 1.0, 0.0, 0.0
+Z = 0.0, 0.0, 1.0
+
+
+def create_ifcaxis2placement(f, point=O, dir1=Z, dir2=X):
+    return f.createIfcAxis2Placement3D(
+        f.createIfcCartesianPoint(point), f.createIfcDirection(dir1), f.createIfcDirection(dir2)
+    )
+
+
+def create_ifcpolyline(f, point_list):
+    return f.createIfcPolyLine([f.createIfcCartesianPoint(p) for p in point_list + point_list[:1]])
+
+
+def profiles(f):
+    yield f.createIfcRectangleProfileDef("AREA", None, None, 0.3, 4.0)
+    yield f.createIfcIShapeProfileDef("AREA", None, None, 0.2, 0.4, 0.01, 0.02)
+    yield f.createIfcLShapeProfileDef("AREA", None, None, 0.1, 0.15, 0.01)
+    yield f.createIfcArbitraryClosedProfileDef(
+        "AREA", None, create_ifcpolyline(f, [(0.0, 0.0), (3.0, 0.0), (3.0, 1.0), (2.0, 2.0), (1.0, 1.0), (0.0, 2.0)])
+    )
+    yield f.createIfcArbitraryProfileDefWithVoids(
+        "AREA",
+        None,
+        create_ifcpolyline(f, [(0.0, 0.0), (4.0, 0.0), (4.0, 3.0), (0.0, 3.0)]),
+        [
+            create_ifcpolyline(f, [(1.0, 1.0), (2.0, 1.0), (2.0, 2.0), (1.0, 2.0)]),
+            create_ifcpolyline(f, [(2.5, 1.0), (3.5, 1.0), (3.0, 2.0)]),
+        ],
+    )
+
+
+def create_proxy(f, profile, point=O, extrude_dir=Z, depth=3.0):
+    solid = f.createIfcExtrudedAreaSolid(
+        profile, create_ifcaxis2placement(f, point), f.createIfcDirection(extrude_dir), depth
+    )
+    context = f.by_type("IfcGeometricRepresentationContext")[0]
+    body_representation = f.createIfcShapeRepresentation(context, "Body", "SweptSolid", [solid])
+    f.createIfcBuildingElementProxy(
+        ifcopenshell.guid.new(),
+        f.by_type("IfcOwnerHistory")[0],
+        profile.is_a(),
+        None,
+        None,
+        f.createIfcLocalPlacement(None, create_ifcaxis2placement(f)),
+        f.createIfcProductDefinitionShape(None, None, [body_representation]),
+        None,
+    )
+
+
+def create_file():
+    f = ifcopenshell.template.create()
+    for i, profile in enumerate(profiles(f)):
+        for extrude_dir in (Z, (0.0, 0.6, 0.8)):
+            create_proxy(f, profile, (i * 5.0, 0.0, 0.0), extrude_dir)
+    return f
+
+
+def mesh_volume_and_area(geometry):
+    vs = geometry.verts
+    fs = geometry.faces
+    volume = area = 0.0
+    for i in range(0, len(fs), 3):
+        a, b, c = (vs[j * 3 : j * 3 + 3] for j in fs[i : i + 3])
+        ab = [q - p for p, q in zip(a, b)]
+        ac = [q - p for p, q in zip(a, c)]
+        n = ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0]
+        volume += sum(p * q for p, q in zip(a, n)) / 6.0
+        area += sum(x * x for x in n) ** 0.5 / 2.0
+    return volume, area
+
+
+def cap_vertex_valence(geometry, z=0.0):
+    """The largest number of triangles in the plane at height z that share a vertex"""
+    vs = geometry.verts
+    fs = geometry.faces
+    valence = collections.Counter()
+    for i in range(0, len(fs), 3):
+        corners = [tuple(round(c, 9) for c in vs[j * 3 : j * 3 + 3]) for j in fs[i : i + 3]]
+        if all(abs(c[2] - z) < 1.0e-9 for c in corners):
+            valence.update(corners)
+    return max(valence.values())
+
+
+def settings(triangulate_planar_faces):
+    s = ifcopenshell.geom.settings()
+    s.set(s.TRIANGULATE_PLANAR_FACES, triangulate_planar_faces)
+    return s
+
+
+class TestExtrusionTriangulation:
+    @pytest.mark.parametrize("triangulate_planar_faces", [False, True])
+    def test_volume_and_area(self, triangulate_planar_faces):
+        f = create_file()
+
+        brep_settings = ifcopenshell.geom.settings()
+        brep_settings.set(brep_settings.DISABLE_TRIANGULATION, True)
+        expected = {elem.guid: (elem.volume, elem.surface_area) for elem in ifcopenshell.geom.iterate(brep_settings, f)}
+
+        results = {
+            elem.guid: mesh_volume_and_area(elem.geometry)
+            for elem in ifcopenshell.geom.iterate(settings(triangulate_planar_faces), f)
+        }
+
+        assert len(results) == len(f.by_type("IfcBuildingElementProxy"))
+        assert results.keys() == expected.keys()
+
+        for guid, (volume, area) in results.items():
+            assert volume == pytest.approx(expected[guid][0], rel=1.0e-6)
+            assert area == pytest.approx(expected[guid][1], rel=1.0e-6)
+
+    def test_convex_faces_are_ear_clipped_into_a_fan(self):
+        # Ear clipping a convex polygon cuts off consecutive ears, which results in a fan
+        # around a single vertex.
+        n = 12
+        f = ifcopenshell.template.create()
+        ellipse = [(2.0 * math.cos(2 * math.pi * i / n), 0.2 * math.sin(2 * math.pi * i / n)) for i in range(n)]
+        profile = f.createIfcArbitraryClosedProfileDef("AREA", None, create_ifcpolyline(f, ellipse))
+        create_proxy(f, profile, depth=1.0)
+
+        (ear_clipped,) = ifcopenshell.geom.iterate(settings(True), f)
+
+        assert cap_vertex_valence(ear_clipped.geometry) == n - 2
+
+
+if __name__ == "__main__":
+    pytest.main(["-x", __file__])
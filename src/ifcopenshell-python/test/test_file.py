@@ -20,6 +20,7 @@ import pytest
 import test.bootstrap
 import ifcopenshell
 import ifcopenshell.api
+import ifcopenshell.guid
 import ifcopenshell.util.element
 
 
@@ -179,6 +180,15 @@ class TestFile(test.bootstrap.IFC4):
         assert self.file.by_guid(1) == element
         assert self.file.by_guid("id") == element
 
+    def test_validating_guids(self):
+        valid = self.file.createIfcWall(ifcopenshell.guid.new())
+        self.file.createIfcWall("id")
+        self.file.createIfcWall("4" + valid.GlobalId[1:])
+        self.file.createIfcWall(valid.GlobalId[:-1] + "-")
+        assert sorted(self.file.invalid_guids()) == sorted(
+            ["id", "4" + valid.GlobalId[1:], valid.GlobalId[:-1] + "-"]
+        )
+
     def test_adding_an_element(self):
         g = ifcopenshell.file()
         element = g.createIfcWall()
@@ -261,6 +271,23 @@ class TestFile(test.bootstrap.IFC4):
         self.file.unbatch()
         assert len(list(self.file)) == 0
 
+    def test_batched_removing_elements_that_reference_each_other(self):
+        wall = self.file.createIfcWall(GlobalId="global_id")
+        quantities = [self.file.createIfcQuantityLength(Name=str(i), LengthValue=i) for i in range(1000)]
+        qto = self.file.createIfcElementQuantity(GlobalId="qto", Name="Qto", Quantities=quantities)
+        rel = self.file.createIfcRelDefinesByProperties(
+            GlobalId="rel", RelatedObjects=[wall], RelatingPropertyDefinition=qto
+        )
+        kept = self.file.createIfcElementQuantity(GlobalId="kept", Name="Kept", Quantities=quantities[:1])
+        self.file.batch()
+        for inst in [rel, qto] + quantities[1:]:
+            self.file.remove(inst)
+        self.file.unbatch()
+        assert set(self.file) == {wall, kept, quantities[0]}
+        assert kept.Quantities == (quantities[0],)
+        assert self.file.get_inverse(wall) == set()
+        assert self.file.get_inverse(quantities[0]) == {kept}
+
     def test_creating_ifc_data_from_a_string(self):
         element = self.file.createIfcWall()
         g = ifcopenshell.file.from_string(self.file.wrapped_data.to_string())
@@ -0,0 +1,118 @@
+# IfcOpenShell - IFC toolkit and geometry engine
+# Copyright (C) 2021 Thomas Krijnen <thomas@aecgeeks.com>
+#
+# This file is part of IfcOpenShell.
+#
+# IfcOpenShell is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# IfcOpenShell is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with IfcOpenShell.  If not, see <http://www.gnu.org/licenses/>.
+
+# Triangulation arrays are exposed as read-only memoryviews that remain valid
+# after the objects they were obtained from are freed.
+
+import gc
+import json
+
+import pytest
+import ifcopenshell
+import ifcopenshell.geom
+import ifcopenshell.guid
+import ifcopenshell.template
+
+attributes = "verts", "normals", "faces", "edges", "material_ids"
+
+
+def create_wall(f, representation=None):
+    if representation is None:
+        context = f.by_type("IfcGeometricRepresentationContext")[0]
+        solid = f.createIfcExtrudedAreaSolid(
+            f.createIfcRectangleProfileDef("AREA", None, None, 5.0, 0.2),
+            f.createIfcAxis2Placement3D(f.createIfcCartesianPoint((0.0, 0.0, 0.0))),
+            f.createIfcDirection((0.0, 0.0, 1.0)),
+            3.0,
+        )
+        representation = f.createIfcProductDefinitionShape(
+            None, None, [f.createIfcShapeRepresentation(context, "Body", "SweptSolid", [solid])]
+        )
+    return f.createIfcWall(
+        ifcopenshell.guid.new(),
+        f.by_type("IfcOwnerHistory")[0],
+        ObjectPlacement=f.createIfcLocalPlacement(
+            None, f.createIfcAxis2Placement3D(f.createIfcCartesianPoint((0.0, 0.0, 0.0)))
+        ),
+        Representation=representation,
+    )
+
+
+def create_file():
+    f = ifcopenshell.template.create()
+    create_wall(f)
+    return f
+
+
+def snapshot(geometry):
+    return {attr: list(getattr(geometry, attr)) for attr in attributes}
+
+
+class TestGeometryBuffers:
+    def test_memoryviews(self):
+        f = create_file()
+        shape = ifcopenshell.geom.create_shape(ifcopenshell.geom.settings(), f.by_type("IfcWall")[0])
+        for attr in attributes:
+            view = getattr(shape.geometry, attr)
+            assert isinstance(view, memoryview)
+            assert view.readonly
+        assert shape.geometry.verts.format == "d"
+        assert shape.geometry.faces.format == "i"
+        assert len(shape.geometry.faces) % 3 == 0
+
+    def test_conversion(self):
+        # Memoryviews do not support concatenation or JSON serialization, an
+        # explicit conversion is needed
+        f = create_file()
+        geometry = ifcopenshell.geom.create_shape(ifcopenshell.geom.settings(), f.by_type("IfcWall")[0]).geometry
+        with pytest.raises(TypeError):
+            geometry.verts + (0.0,)
+        with pytest.raises(TypeError):
+            json.dumps(geometry.faces)
+        assert tuple(geometry.verts) + (0.0,) == tuple(geometry.verts.tolist()) + (0.0,)
+        assert json.loads(json.dumps(list(geometry.faces))) == geometry.faces.tolist()
+
+    def test_outlives_shape(self):
+        f = create_file()
+        shape = ifcopenshell.geom.create_shape(ifcopenshell.geom.settings(), f.by_type("IfcWall")[0])
+        expected = snapshot(shape.geometry)
+        views = {attr: getattr(shape.geometry, attr) for attr in attributes}
+        del shape
+        gc.collect()
+        assert {attr: list(view) for attr, view in views.items()} == expected
+
+    def test_outlives_iterator(self):
+        f = create_file()
+        create_wall(f, f.by_type("IfcWall")[0].Representation)
+        it = ifcopenshell.geom.iterator(ifcopenshell.geom.settings(), f)
+        assert it.initialize()
+        views, expected = [], []
+        while True:
+            geometry = it.get().geometry
+            views.append({attr: getattr(geometry, attr) for attr in attributes})
+            expected.append(snapshot(geometry))
+            if not it.next():
+                break
+        del it
+        gc.collect()
+        assert len(views) == 2
+        assert [{attr: list(view) for attr, view in v.items()} for v in views] == expected
+
+
+if __name__ == "__main__":
+    pytest.main(["-x", __file__])
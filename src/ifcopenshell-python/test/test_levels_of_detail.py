@@ -0,0 +1,110 @@
+# IfcOpenShell - IFC toolkit and geometry engine
+# Copyright (C) 2021 Thomas Krijnen <thomas@aecgeeks.com>
+#
+# This file is part of IfcOpenShell.
+#
+# IfcOpenShell is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# IfcOpenShell is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with IfcOpenShell.  If not, see <http://www.gnu.org/licenses/>.
+
+# Levels of detail are written by the glTF serializer as MSFT_lod nodes. Only
+# levels that are coarser than the previous level are written, so that shapes
+# that triangulate identically at every deflection have no levels of detail.
+
+import json
+import struct
+import pytest
+import ifcopenshell
+import ifcopenshell.geom
+import ifcopenshell.guid
+import ifcopenshell.template
+
+
+def create_file():
+    f = ifcopenshell.template.create()
+    context = f.by_type("IfcGeometricRepresentationContext")[0]
+    origin = f.createIfcAxis2Placement3D(f.createIfcCartesianPoint((0.0, 0.0, 0.0)))
+    profiles = {
+        "cylinder": f.createIfcCircleProfileDef("AREA", None, None, 1.0),
+        "box": f.createIfcRectangleProfileDef("AREA", None, None, 1.0, 2.0),
+    }
+    for name, profile in profiles.items():
+        solid = f.createIfcExtrudedAreaSolid(profile, origin, f.createIfcDirection((0.0, 0.0, 1.0)), 2.0)
+        f.createIfcColumn(
+            ifcopenshell.guid.new(),
+            f.by_type("IfcOwnerHistory")[0],
+            name,
+            ObjectPlacement=f.createIfcLocalPlacement(None, origin),
+            Representation=f.createIfcProductDefinitionShape(
+                None, None, [f.createIfcShapeRepresentation(context, "Body", "SweptSolid", [solid])]
+            ),
+        )
+    return f
+
+
+def read_glb(path):
+    with open(path, "rb") as glb:
+        data = glb.read()
+    length, chunk_type = struct.unpack_from("<II", data, 12)
+    assert chunk_type == 0x4E4F534A
+    return json.loads(data[20 : 20 + length])
+
+
+def num_triangles(gltf, node):
+    mesh = gltf["meshes"][node["mesh"]]
+    return sum(gltf["accessors"][p["indices"]]["count"] for p in mesh["primitives"]) // 3
+
+
+def serialize(f, path, lod_deflection_tolerances, triangulate_planar_faces=False):
+    settings = ifcopenshell.geom.settings()
+    settings.set(settings.USE_ELEMENT_NAMES, True)
+    settings.set(settings.TRIANGULATE_PLANAR_FACES, triangulate_planar_faces)
+    settings.set_lod_deflection_tolerances(lod_deflection_tolerances)
+    # The number of segments of the cylinder is then determined by the deflection
+    settings.set_angular_tolerance(2.0)
+    serializer = ifcopenshell.geom.serializers.gltf(str(path), settings)
+    serializer.writeHeader()
+    for elem in ifcopenshell.geom.iterate(settings, f):
+        serializer.write(elem)
+    serializer.finalize()
+    gltf = read_glb(path)
+    scene = gltf["scenes"][gltf["scene"]]["nodes"]
+    return {
+        gltf["nodes"][i]["name"]: [
+            num_triangles(gltf, gltf["nodes"][j])
+            for j in [i] + gltf["nodes"][i].get("extensions", {}).get("MSFT_lod", {}).get("ids", [])
+        ]
+        for i in scene
+    }
+
+
+@pytest.mark.skipif(not hasattr(ifcopenshell.geom.serializers, "gltf"), reason="Built without glTF support")
+class TestLevelsOfDetail:
+    def test_levels_get_coarser(self, tmp_path):
+        levels = serialize(create_file(), tmp_path / "lods.glb", [0.01, 0.05, 0.2])
+        assert len(levels["cylinder"]) == 4
+        assert all(a > b for a, b in zip(levels["cylinder"], levels["cylinder"][1:]))
+
+    def test_levels_that_are_not_coarser_are_omitted(self, tmp_path):
+        levels = serialize(create_file(), tmp_path / "lods.glb", [0.05, 0.05, 0.01])
+        assert len(levels["cylinder"]) == 2
+        assert levels["box"] == [12]
+
+    @pytest.mark.parametrize("triangulate_planar_faces", [False, True])
+    def test_shapes_with_planar_faces_have_no_levels(self, tmp_path, triangulate_planar_faces):
+        levels = serialize(create_file(), tmp_path / "lods.glb", [0.01, 0.05], triangulate_planar_faces)
+        assert levels["box"] == [12]
+        assert len(levels["cylinder"]) == 3
+
+
+if __name__ == "__main__":
+    pytest.main(["-x", __file__])
@@ -0,0 +1,113 @@
+# IfcOpenShell - IFC toolkit and geometry engine
+# Copyright (C) 2021 Thomas Krijnen <thomas@aecgeeks.com>
+#
+# This file is part of IfcOpenShell.
+#
+# IfcOpenShell is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# IfcOpenShell is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with IfcOpenShell.  If not, see <http://www.gnu.org/licenses/>.
+
+# Openings subtracted on triangulated operands (MESH_BOOLEAN) result in the
+# same volume as the regular BRep boolean and in a closed triangulation.
+
+import collections
+
+import pytest
+import ifcopenshell
+import ifcopenshell.geom
+import ifcopenshell.guid
+import ifcopenshell.template
+
+# Openings as (width, depth, height, position) in wall coordinates: passing
+# through, partially through, overlapping each other and touching the wall top.
+openings = [
+    (1.0, 1.0, 2.0, (-1.5, 0.0, -0.5)),
+    (0.6, 0.1, 0.6, (0.0, 0.05, 1.0)),
+    (0.8, 1.0, 0.8, (1.2, 0.0, 0.5)),
+    (0.8, 1.0, 0.8, (1.6, 0.0, 0.9)),
+    (0.5, 1.0, 1.0, (-0.5, 0.0, 2.0)),
+]
+
+
+def create_file():
+    f = ifcopenshell.template.create()
+    owner_history = f.by_type("IfcOwnerHistory")[0]
+    context = f.by_type("IfcGeometricRepresentationContext")[0]
+
+    # A box of width x depth x height, extruded along Z from point
+    def create_box(ifc_class, width, depth, height, point=(0.0, 0.0, 0.0), relative_to=None):
+        solid = f.createIfcExtrudedAreaSolid(
+            f.createIfcRectangleProfileDef("AREA", None, None, width, depth),
+            f.createIfcAxis2Placement3D(f.createIfcCartesianPoint(point)),
+            f.createIfcDirection((0.0, 0.0, 1.0)),
+            height,
+        )
+        return f.create_entity(
+            ifc_class,
+            ifcopenshell.guid.new(),
+            owner_history,
+            ObjectPlacement=f.createIfcLocalPlacement(
+                relative_to, f.createIfcAxis2Placement3D(f.createIfcCartesianPoint((0.0, 0.0, 0.0)))
+            ),
+            Representation=f.createIfcProductDefinitionShape(
+                None, None, [f.createIfcShapeRepresentation(context, "Body", "SweptSolid", [solid])]
+            ),
+        )
+
+    wall = create_box("IfcWall", 5.0, 0.2, 3.0)
+    for width, depth, height, point in openings:
+        opening = create_box("IfcOpeningElement", width, depth, height, point, wall.ObjectPlacement)
+        f.createIfcRelVoidsElement(ifcopenshell.guid.new(), owner_history, None, None, wall, opening)
+    return f
+
+
+def volume(geometry):
+    # Sum of the signed volumes of the tetrahedra spanned by the origin and the triangles
+    vs = geometry.verts
+    fs = geometry.faces
+    v = 0.0
+    for i in range(0, len(fs), 3):
+        (ax, ay, az), (bx, by, bz), (cx, cy, cz) = (vs[j * 3 : j * 3 + 3] for j in fs[i : i + 3])
+        v += ax * (by * cz - bz * cy) - ay * (bx * cz - bz * cx) + az * (bx * cy - by * cx)
+    return v / 6.0
+
+
+def is_closed(geometry):
+    vs = geometry.verts
+    fs = geometry.faces
+    # Vertices are compared by position, triangulations are not necessarily welded
+    key = lambda i: tuple(round(x, 6) for x in vs[i * 3 : i * 3 + 3])
+    edges = collections.Counter()
+    for i in range(0, len(fs), 3):
+        tri = [key(j) for j in fs[i : i + 3]]
+        for a, b in zip(tri, tri[1:] + tri[:1]):
+            edges[a, b] += 1
+    return all(edges[b, a] == n for (a, b), n in edges.items())
+
+
+def convert(f, mesh_boolean):
+    settings = ifcopenshell.geom.settings()
+    settings.set(settings.MESH_BOOLEAN, mesh_boolean)
+    return [elem.geometry for elem in ifcopenshell.geom.iterate(settings, f, include=f.by_type("IfcWall"))]
+
+
+class TestMeshBoolean:
+    def test_volume(self):
+        f = create_file()
+        (expected,) = convert(f, False)
+        (result,) = convert(f, True)
+        assert volume(result) == pytest.approx(volume(expected), rel=1.0e-6)
+        assert is_closed(result)
+
+
+if __name__ == "__main__":
+    pytest.main(["-x", __file__])
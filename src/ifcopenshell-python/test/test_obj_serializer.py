@@ -0,0 +1,109 @@
+# IfcOpenShell - IFC toolkit and geometry engine
+# Copyright (C) 2021 Thomas Krijnen <thomas@aecgeeks.com>
+#
+# This file is part of IfcOpenShell.
+#
+# IfcOpenShell is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# IfcOpenShell is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with IfcOpenShell.  If not, see <http://www.gnu.org/licenses/>.
+
+# Numbers in the OBJ output are formatted like a stream with the serializer
+# precision, i.e. like printf's %.*g, regardless of the C locale.
+
+import locale
+import pytest
+import ifcopenshell
+import ifcopenshell.geom
+import ifcopenshell.guid
+import ifcopenshell.template
+
+COMMA_LOCALES = ["de_DE.UTF-8", "de_DE.utf8", "de_DE", "nl_NL.UTF-8", "fr_FR.UTF-8", "German_Germany.1252"]
+
+
+def create_file():
+    # An extrusion with coordinates that are not exactly representable and of
+    # varying magnitude
+    f = ifcopenshell.template.create()
+    outline = [(0.0, 0.0), (1.0 / 3.0, 0.0), (0.7, 2.0 / 7.0), (0.1, 1e-7), (0.0, 0.0)]
+    profile = f.createIfcArbitraryClosedProfileDef(
+        "AREA", None, f.createIfcPolyline([f.createIfcCartesianPoint(p) for p in outline])
+    )
+    solid = f.createIfcExtrudedAreaSolid(
+        profile,
+        f.createIfcAxis2Placement3D(f.createIfcCartesianPoint((-0.25, 1e5 / 3.0, 0.0))),
+        f.createIfcDirection((0.0, 0.0, 1.0)),
+        123456.789,
+    )
+    context = f.by_type("IfcGeometricRepresentationContext")[0]
+    f.createIfcBuildingElementProxy(
+        ifcopenshell.guid.new(),
+        f.by_type("IfcOwnerHistory")[0],
+        ObjectPlacement=f.createIfcLocalPlacement(
+            None, f.createIfcAxis2Placement3D(f.createIfcCartesianPoint((0.0, 0.0, 0.0)))
+        ),
+        Representation=f.createIfcProductDefinitionShape(
+            None, None, [f.createIfcShapeRepresentation(context, "Body", "SweptSolid", [solid])]
+        ),
+    )
+    return f
+
+
+def serialize(f, precision):
+    settings = ifcopenshell.geom.settings()
+    settings.precision = precision
+    obj = ifcopenshell.geom.serializers.buffer()
+    mtl = ifcopenshell.geom.serializers.buffer()
+    serializer = ifcopenshell.geom.serializers.obj(obj, mtl, settings)
+    serializer.writeHeader()
+    verts = []
+    for elem in ifcopenshell.geom.iterator(settings, f):
+        serializer.write(elem)
+        verts.extend(elem.geometry.verts)
+    serializer.finalize()
+    return obj.get_value(), verts
+
+
+def vertex_lines(obj):
+    return [line for line in obj.split("\n") if line.startswith("v ")]
+
+
+class TestObjSerializer:
+    @pytest.mark.parametrize("precision", [-1, 1, 3, 6, 15, 17])
+    def test_vertices_are_formatted_as_printf(self, precision):
+        obj, verts = serialize(create_file(), precision)
+        p = 6 if precision < 0 else precision
+        expected = ["v %s %s %s" % tuple("%.*g" % (p, c) for c in verts[i : i + 3]) for i in range(0, len(verts), 3)]
+        assert vertex_lines(obj) == expected
+
+    def test_output_does_not_depend_on_the_locale(self):
+        f = create_file()
+        reference, _ = serialize(f, 15)
+        previous = locale.setlocale(locale.LC_NUMERIC)
+        for name in COMMA_LOCALES:
+            try:
+                locale.setlocale(locale.LC_NUMERIC, name)
+                break
+            except locale.Error:
+                pass
+        else:
+            pytest.skip("No locale with a decimal comma is available")
+        try:
+            assert locale.localeconv()["decimal_point"] != "."
+            obj, _ = serialize(f, 15)
+        finally:
+            locale.setlocale(locale.LC_NUMERIC, previous)
+        assert obj == reference
+        assert "," not in "".join(vertex_lines(obj))
+
+
+if __name__ == "__main__":
+    pytest.main(["-x", __file__])
@@ -0,0 +1,305 @@
+# IfcOpenShell - IFC toolkit and geometry engine
+# Copyright (C) 2021 Thomas Krijnen <thomas@aecgeeks.com>
+#
+# This file is part of IfcOpenShell.
+#
+# IfcOpenShell is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# IfcOpenShell is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with IfcOpenShell.  If not, see <http://www.gnu.org/licenses/>.
+
+# Queries on ifcopenshell.geom.tree are compared to brute force evaluations
+# on small models of axis aligned boxes and L shaped extrusions. Rays are
+# compared to slab tests against the boxes.
+
+import random
+import itertools
+import threading
+
+import pytest
+import ifcopenshell
+import ifcopenshell.geom
+import ifcopenshell.guid
+import ifcopenshell.template
+
+
+def create_proxy(f, profile, height, point, name=None):
+    # An element with profile extruded along Z from point, placed at the origin
+    solid = f.createIfcExtrudedAreaSolid(
+        profile,
+        f.createIfcAxis2Placement3D(f.createIfcCartesianPoint(point)),
+        f.createIfcDirection((0.0, 0.0, 1.0)),
+        height,
+    )
+    context = f.by_type("IfcGeometricRepresentationContext")[0]
+    return f.createIfcBuildingElementProxy(
+        ifcopenshell.guid.new(),
+        f.by_type("IfcOwnerHistory")[0],
+        name,
+        ObjectPlacement=f.createIfcLocalPlacement(
+            None, f.createIfcAxis2Placement3D(f.createIfcCartesianPoint((0.0, 0.0, 0.0)))
+        ),
+        Representation=f.createIfcProductDefinitionShape(
+            None, None, [f.createIfcShapeRepresentation(context, "Body", "SweptSolid", [solid])]
+        ),
+    )
+
+
+def create_box(f, lower, upper, name=None):
+    (x0, y0, z0), (x1, y1, z1) = lower, upper
+    profile = f.createIfcRectangleProfileDef("AREA", None, None, x1 - x0, y1 - y0)
+    return create_proxy(f, profile, z1 - z0, ((x0 + x1) / 2.0, (y0 + y1) / 2.0, z0), name)
+
+
+def random_boxes(seed, n=40, extent=10.0):
+    rng = random.Random(seed)
+    boxes = []
+    for i in range(n):
+        lower = tuple(rng.uniform(0.0, extent) for _ in range(3))
+        size = tuple(rng.uniform(0.2, 2.0) for _ in range(3))
+        boxes.append((lower, tuple(p + d for p, d in zip(lower, size))))
+    return boxes
+
+
+def overlap(a, b, eps=0.0):
+    # Whether the interiors of two axis aligned boxes overlap by more than eps
+    return all(min(a[1][k], b[1][k]) - max(a[0][k], b[0][k]) > eps for k in range(3))
+
+
+def distance(a, b):
+    return sum(max(0.0, max(a[0][k], b[0][k]) - min(a[1][k], b[1][k])) ** 2 for k in range(3)) ** 0.5
+
+
+def pairs(clashes):
+    return {frozenset((a.Name, b.Name)) for a, b, *_ in clashes}
+
+
+class TestClashAll:
+    def setup_file(self, boxes):
+        self.file = ifcopenshell.template.create()
+        self.boxes = {str(i): box for i, box in enumerate(boxes)}
+        for name, box in self.boxes.items():
+            create_box(self.file, *box, name=name)
+        self.elements = self.file.by_type("IfcBuildingElementProxy")
+        return ifcopenshell.geom.tree(self.file, ifcopenshell.geom.settings(), num_threads=2)
+
+    def test_intersection(self):
+        tree = self.setup_file([((0, 0, 0), (1, 1, 1)), ((0.5, 0.5, 0.5), (1.5, 1.5, 1.5)), ((5, 5, 5), (6, 6, 6))])
+        clashes = tree.clash_all(self.elements)
+        assert pairs(clashes) == {frozenset(("0", "1"))}
+        # Every pair is reported once
+        assert len(clashes) == 1
+
+    def test_containment(self):
+        tree = self.setup_file([((0, 0, 0), (4, 4, 4)), ((1, 1, 1), (2, 2, 2))])
+        outer, inner = sorted(self.elements, key=lambda e: e.Name)
+        assert [(a.Name, b.Name) for a, b, *_ in tree.clash_all([outer], [inner], "containment")] == [("0", "1")]
+        assert tree.clash_all([inner], [outer], "containment") == []
+
+    def test_clearance(self):
+        tree = self.setup_file([((0, 0, 0), (1, 1, 1)), ((1.05, 0, 0), (2, 1, 1))])
+        clashes = tree.clash_all(self.elements, mode="clearance", tolerance=0.1)
+        assert pairs(clashes) == {frozenset(("0", "1"))}
+        assert clashes[0][2] == pytest.approx(0.05, abs=1.0e-6)
+        assert tree.clash_all(self.elements, mode="clearance", tolerance=0.01) == []
+
+    @pytest.mark.parametrize("seed", range(3))
+    def test_brute_force(self, seed):
+        tree = self.setup_file(random_boxes(seed))
+        names = sorted(self.boxes)
+        expected = {
+            frozenset((a, b))
+            for i, a in enumerate(names)
+            for b in names[i + 1 :]
+            # Boxes that only touch or barely overlap are ambiguous, they are left out
+            if overlap(self.boxes[a], self.boxes[b], 1.0e-3)
+        }
+        ambiguous = {
+            frozenset((a, b))
+            for i, a in enumerate(names)
+            for b in names[i + 1 :]
+            if overlap(self.boxes[a], self.boxes[b], -1.0e-3) and frozenset((a, b)) not in expected
+        }
+
+        single = tree.clash_all(self.elements, num_threads=1)
+        assert pairs(single) - ambiguous == expected
+
+        # The results do not depend on the number of threads
+        multi = tree.clash_all(self.elements, num_threads=4)
+        assert [(a, b, d, p) for a, b, d, p in multi] == [(a, b, d, p) for a, b, d, p in single]
+
+        # The same pairs are found by select() on the individual elements
+        selected = {frozenset((e.Name, o.Name)) for e in self.elements for o in tree.select(e) if o != e}
+        assert pairs(single) == selected
+
+    @pytest.mark.parametrize("seed", range(3))
+    def test_clearance_brute_force(self, seed):
+        tree = self.setup_file(random_boxes(seed))
+        names = sorted(self.boxes)
+        clashes = tree.clash_all(self.elements, mode="clearance", tolerance=0.5, num_threads=4)
+        for a, b, dist, _ in clashes:
+            expected_distance = distance(self.boxes[a.Name], self.boxes[b.Name])
+            if expected_distance > 1.0e-3:
+                assert dist == pytest.approx(expected_distance, abs=1.0e-4)
+        expected = {
+            frozenset((a, b))
+            for i, a in enumerate(names)
+            for b in names[i + 1 :]
+            if 1.0e-3 < distance(self.boxes[a], self.boxes[b]) < 0.5 - 1.0e-3
+        }
+        assert expected <= pairs(clashes)
+
+
+def create_l_shape(f, x, y, z, width, depth, height, name=None):
+    # The union of the boxes (x, y, z)-(x + width, y + 1, z + height) and (x, y + 1, z)-(x + 1, y + depth, z + height)
+    outline = [(0.0, 0.0), (width, 0.0), (width, 1.0), (1.0, 1.0), (1.0, depth), (0.0, depth)]
+    points = [f.createIfcCartesianPoint(p) for p in outline + outline[:1]]
+    profile = f.createIfcArbitraryClosedProfileDef("AREA", None, f.createIfcPolyline(points))
+    return create_proxy(f, profile, height, (x, y, z), name)
+
+
+def union_relations(parts, box):
+    """Whether the interior of box overlaps the union of the parts, and whether
+    box is within it, evaluated exactly on the cells of the coordinate grid"""
+    coords = [
+        sorted({c for b in parts + [box] for c in (b[0][k], b[1][k]) if box[0][k] <= c <= box[1][k]}) for k in range(3)
+    ]
+    inside = [
+        any(all(b[0][k] < c[k] < b[1][k] for k in range(3)) for b in parts)
+        for c in itertools.product(*[[(p + q) / 2.0 for p, q in zip(cs, cs[1:])] for cs in coords])
+    ]
+    return any(inside), all(inside)
+
+
+class TestMeshNarrowPhase:
+    # Concave elements and boxes on an integer grid, with many coinciding faces,
+    # edges and vertices. The mesh and BRep narrow phases are both compared to
+    # the exact result.
+
+    @pytest.mark.parametrize("seed", range(3))
+    def test_concave(self, seed):
+        rng = random.Random(seed)
+        f = ifcopenshell.template.create()
+        shapes, boxes = {}, {}
+        for i in range(15):
+            x, y, z = (float(rng.randint(0, 6)) for _ in range(3))
+            w, d, h = (float(rng.randint(2, 5)) for _ in range(3))
+            shapes["L%d" % i] = [((x, y, z), (x + w, y + 1, z + h)), ((x, y + 1, z), (x + 1, y + d, z + h))]
+            create_l_shape(f, x, y, z, w, d, h, name="L%d" % i)
+        for i in range(15):
+            lower = tuple(float(rng.randint(0, 6)) for _ in range(3))
+            upper = tuple(c + rng.randint(1, 3) for c in lower)
+            boxes["B%d" % i] = (lower, upper)
+            create_box(f, lower, upper, name="B%d" % i)
+
+        elements = {e.Name: e for e in f.by_type("IfcBuildingElementProxy")}
+        ls = [elements[n] for n in shapes]
+        bs = [elements[n] for n in boxes]
+
+        expected_intersection = set()
+        expected_containment = set()
+        for l, parts in shapes.items():
+            for b, box in boxes.items():
+                overlaps, within = union_relations(parts, box)
+                if overlaps:
+                    expected_intersection.add((l, b))
+                if within:
+                    expected_containment.add((l, b))
+
+        settings = ifcopenshell.geom.settings()
+        for t in (ifcopenshell.geom.tree(f, settings), ifcopenshell.geom.tree(f, settings, mesh_deflection=0.001)):
+            intersection = {(a.Name, b.Name) for a, b, *_ in t.clash_all(ls, bs)}
+            assert intersection == expected_intersection
+            containment = {(a.Name, b.Name) for a, b, *_ in t.clash_all(ls, bs, "containment")}
+            assert containment == expected_containment
+
+
+def ray_box(origin, direction, box):
+    # Slab test, returns the distance to the first intersection with the box
+    # surface in front of the origin or None.
+    t0, t1 = 0.0, float("inf")
+    for k in range(3):
+        if direction[k] == 0.0:
+            if not box[0][k] <= origin[k] <= box[1][k]:
+                return None
+            continue
+        a = (box[0][k] - origin[k]) / direction[k]
+        b = (box[1][k] - origin[k]) / direction[k]
+        t0, t1 = max(t0, min(a, b)), min(t1, max(a, b))
+    if t0 > t1:
+        return None
+    return t0 if t0 > 0.0 else t1
+
+
+class TestSelectRays:
+    @pytest.mark.parametrize("seed", range(3))
+    def test_brute_force(self, seed):
+        rng = random.Random(seed)
+        f = ifcopenshell.template.create()
+        boxes = {}
+        for lower, upper in random_boxes(seed, n=20):
+            boxes[create_box(f, lower, upper).id()] = (lower, upper)
+        tree = ifcopenshell.geom.tree(f, ifcopenshell.geom.settings())
+
+        origins, directions = [], []
+        for i in range(500):
+            origins.append(tuple(rng.uniform(-5.0, 15.0) for _ in range(3)))
+            d = [rng.gauss(0.0, 1.0) for _ in range(3)]
+            length = sum(x * x for x in d) ** 0.5
+            directions.append(tuple(x / length for x in d))
+
+        results = [tree.select_rays(origins, directions, 100.0, num_threads=n) for n in (1, 4)]
+        assert [list(v) for v in results[0][0:1] + results[0][4:]] == [
+            list(v) for v in results[1][0:1] + results[1][4:]
+        ]
+
+        ids, _, positions, _, distances = results[0]
+        for i, (origin, direction) in enumerate(zip(origins, directions)):
+            hits = sorted(
+                (d, inst) for inst, box in boxes.items() for d in [ray_box(origin, direction, box)] if d is not None
+            )
+            if not hits:
+                assert ids[i] == 0
+                assert distances[i] == float("inf")
+                continue
+            assert distances[i] == pytest.approx(hits[0][0], abs=1.0e-6)
+            # Hits on coinciding surfaces or at box edges are ambiguous
+            if len(hits) == 1 or hits[1][0] - hits[0][0] > 1.0e-6:
+                assert ids[i] == hits[0][1]
+            assert list(positions[i]) == pytest.approx(
+                [o + d * hits[0][0] for o, d in zip(origin, direction)], abs=1.0e-6
+            )
+
+    def test_concurrent(self):
+        # The ray scene is built on first use, also when the first calls are concurrent
+        f = ifcopenshell.template.create()
+        for lower, upper in random_boxes(0, n=20):
+            create_box(f, lower, upper)
+        tree = ifcopenshell.geom.tree(f, ifcopenshell.geom.settings())
+        origins = [(x * 0.5, -5.0, 1.0) for x in range(20)]
+        directions = [(0.0, 1.0, 0.0)] * len(origins)
+
+        results = [None] * 8
+
+        def run(i):
+            ids, _, _, _, distances = tree.select_rays(origins, directions)
+            results[i] = list(ids), list(distances)
+
+        threads = [threading.Thread(target=run, args=(i,)) for i in range(len(results))]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        assert all(r == results[0] for r in results)
+
+
+if __name__ == "__main__":
+    pytest.main(["-x", __file__])
@@ -16,7 +16,9 @@
 # You should have received a copy of the GNU Lesser General Public License
 # along with IfcOpenShell.  If not, see <http://www.gnu.org/licenses/>.
 
+import pytest
 import ifcopenshell
+import ifcopenshell.api
 import test.bootstrap
 import ifcopenshell.util.placement as subject
 
@@ -41,3 +43,29 @@ class TestGetStoreyElevationIFC4(test.bootstrap.IFC4):
         assert subject.get_storey_elevation(storey) == 0.0
         building = self.file.createIfcBuilding()
         assert subject.get_storey_elevation(building) == 0.0
+
+
+class TestGetLocalPlacementsIFC4(test.bootstrap.IFC4):
+    def test_run(self):
+        parent = self.file.createIfcLocalPlacement()
+        parent.RelativePlacement = self.file.createIfcAxis2Placement3D(
+            self.file.createIfcCartesianPoint((1.0, 0.0, 0.0))
+        )
+        child = self.file.createIfcLocalPlacement()
+        child.PlacementRelTo = parent
+        child.RelativePlacement = self.file.createIfcAxis2Placement3D(
+            self.file.createIfcCartesianPoint((0.0, 2.0, 0.0))
+        )
+        placements = subject.get_local_placements(self.file)
+        assert placements[parent.id()][:3, 3].tolist() == [1.0, 0.0, 0.0]
+        assert placements[child.id()][:3, 3].tolist() == [1.0, 2.0, 0.0]
+
+    def test_run_in_project_units(self):
+        ifcopenshell.api.run("root.create_entity", self.file, ifc_class="IfcProject")
+        ifcopenshell.api.run("unit.assign_unit", self.file, length={"is_metric": True, "raw": "MILLIMETERS"})
+        placement = self.file.createIfcLocalPlacement()
+        placement.RelativePlacement = self.file.createIfcAxis2Placement3D(
+            self.file.createIfcCartesianPoint((1000.0, 0.0, 3000.0))
+        )
+        placements = subject.get_local_placements(self.file)
+        assert placements[placement.id()][:3, 3].tolist() == pytest.approx([1000.0, 0.0, 3000.0])
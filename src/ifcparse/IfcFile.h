@@ -241,6 +241,10 @@ public:
 	/// Returns the entity with the specified GlobalId
 	IfcUtil::IfcBaseClass* instance_by_guid(const std::string& guid);
 
+	/// Returns the GlobalIds in the file that are not well-formed, see
+	/// IfcParse::IfcGlobalId::is_valid(). The GlobalIds are expanded in bulk.
+	std::vector<std::string> invalid_guids() const;
+
 	/// Performs a depth-first traversal, returning all entity instance
 	/// attributes as a flat list. NB: includes the root instance specified
 	/// in the first function argument.
@@ -313,6 +317,9 @@ public:
 
 #ifdef WITH_IFCXML
 IFC_PARSE_API IfcFile* parse_ifcxml(const std::string& filename);
+/// Parses ifcXML from a buffer in memory, for example a file that has been
+/// read or received already. The buffer is not copied.
+IFC_PARSE_API IfcFile* parse_ifcxml(const char* data, size_t length);
 #endif
 
 }
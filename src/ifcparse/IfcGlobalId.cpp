@@ -17,11 +17,11 @@
  *                                                                              *
  ********************************************************************************/
 
-#include <vector>
-#include <algorithm>
+#include <array>
+#include <random>
+#include <cstdint>
 
 #include <boost/uuid/uuid.hpp>
-#include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_io.hpp>
 #include <boost/version.hpp>
 #include <boost/lexical_cast.hpp>
@@ -31,65 +31,92 @@
 #include "../ifcparse/IfcBaseClass.h"
 #include "../ifcparse/IfcLogger.h"
 
-static const char* chars = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz_$";
-
-// Converts an unsigned integer into a base64 string of length l
-std::string base64(unsigned v, int l) {
-	std::string r;
-	r.reserve(l);
-	while ( v ) {
-		r.push_back(chars[v%64]);
-		v /= 64;
+namespace {
+
+	const char chars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz_$";
+
+	// Maps characters to their value in the base64 alphabet above, 0xFF for other characters
+	const std::array<uint8_t, 256>& decode_table() {
+		static const std::array<uint8_t, 256> table = []() {
+			std::array<uint8_t, 256> t;
+			t.fill(0xFF);
+			for (uint8_t i = 0; i < 64; ++i) {
+				t[(unsigned char) chars[i]] = i;
+			}
+			return t;
+		}();
+		return table;
 	}
-	while ( (int)r.size() != l ) r.push_back('0');
-	std::reverse(r.begin(),r.end());
-	return r;
-}
 
-// Converts a base64 string into an unsigned integer
-unsigned from_base64(const std::string& s) {
-	std::string::size_type zeros = s.find_first_not_of('0');
-	unsigned r = 0;
-	if ( zeros != std::string::npos )
-		for ( std::string::const_iterator i = s.begin()+zeros; i != s.end(); ++ i ) {
-			r *= 64;
-			const char* c = strchr(chars,*i);
-			if ( !c ) throw IfcParse::IfcException("Failed to decode GlobalId");
-			r += (unsigned)(c-chars);
+	// Compresses the UUID byte array into a base64 representation. The first byte is
+	// encoded by two characters, the remaining fifteen bytes by groups of four characters
+	// per three bytes.
+	void compress(const unsigned char* v, char* r) {
+		r[0] = chars[v[0] >> 6];
+		r[1] = chars[v[0] & 63];
+		for (int i = 0; i < 5; ++i) {
+			const uint32_t d = ((uint32_t) v[1 + 3 * i] << 16) | ((uint32_t) v[2 + 3 * i] << 8) | v[3 + 3 * i];
+			char* c = r + 2 + 4 * i;
+			c[0] = chars[d >> 18];
+			c[1] = chars[(d >> 12) & 63];
+			c[2] = chars[(d >> 6) & 63];
+			c[3] = chars[d & 63];
 		}
-	return r;
-}
+	}
 
-// Compresses the UUID byte array into a base64 representation
-std::string compress(unsigned char* v) {
-	std::string r;
-	r.reserve(22);
-	r += base64(v[0],2);
-	for ( unsigned i = 1; i < 16; i += 3 ) {
-		r += base64((v[i]<<16) + (v[i+1]<<8) + v[i+2],4);
+	enum expand_status { EXPAND_OK, EXPAND_OVERFLOW, EXPAND_INVALID_CHARACTER };
+
+	// Expands the base64 representation into a UUID byte array. Does not branch on the
+	// contents of s, so that loops over many GlobalIds can be vectorized by the compiler.
+	expand_status expand(const char* s, unsigned char* v, const std::array<uint8_t, 256>& t) {
+		const uint32_t a = t[(unsigned char) s[0]];
+		const uint32_t b = t[(unsigned char) s[1]];
+		uint32_t invalid = a | b;
+		v[0] = (unsigned char) ((a << 6) | b);
+		for (int i = 0; i < 5; ++i) {
+			const char* c = s + 2 + 4 * i;
+			const uint32_t c0 = t[(unsigned char) c[0]];
+			const uint32_t c1 = t[(unsigned char) c[1]];
+			const uint32_t c2 = t[(unsigned char) c[2]];
+			const uint32_t c3 = t[(unsigned char) c[3]];
+			invalid |= c0 | c1 | c2 | c3;
+			const uint32_t d = (c0 << 18) | (c1 << 12) | (c2 << 6) | c3;
+			v[1 + 3 * i] = (unsigned char) (d >> 16);
+			v[2 + 3 * i] = (unsigned char) (d >> 8);
+			v[3 + 3 * i] = (unsigned char) d;
+		}
+		// Valid characters have values below 64, the first character encodes the two
+		// most significant bits of the first byte only.
+		if (invalid & 0xC0) {
+			return EXPAND_INVALID_CHARACTER;
+		}
+		return a > 3 ? EXPAND_OVERFLOW : EXPAND_OK;
 	}
-	return r;
-}
 
-// Expands the base64 representation into a UUID byte array
-void expand(const std::string& s, std::vector<unsigned char>& v) {
-	v.push_back((unsigned char)from_base64(s.substr(0,2)));
-	for( unsigned i = 0; i < 5; ++i ) {
-		unsigned d = from_base64(s.substr(2+4*i,4));
-		for ( unsigned j = 0; j < 3; ++ j ) {
-			v.push_back((d>>(8*(2-j))) % 256);
+	// A random number generator per thread for version 4 UUIDs
+	void generate_uuid(unsigned char* v) {
+		static thread_local std::mt19937_64 engine = []() {
+			std::random_device device;
+			std::seed_seq seed{ device(), device(), device(), device(), device(), device(), device(), device() };
+			return std::mt19937_64(seed);
+		}();
+		const uint64_t hi = engine();
+		const uint64_t lo = engine();
+		for (int i = 0; i < 8; ++i) {
+			v[i] = (unsigned char) (hi >> (56 - 8 * i));
+			v[8 + i] = (unsigned char) (lo >> (56 - 8 * i));
 		}
+		// Version 4, variant RFC 4122
+		v[6] = (v[6] & 0x0F) | 0x40;
+		v[8] = (v[8] & 0x3F) | 0x80;
 	}
-}
 
-// A random number generator for the UUID
-static boost::uuids::basic_random_generator<boost::mt19937> gen;
+}
 
 IfcParse::IfcGlobalId::IfcGlobalId() {
-	uuid_data = gen();
-	std::vector<unsigned char> v(uuid_data.size());
-	std::copy(uuid_data.begin(), uuid_data.end(), v.begin());
-	string_data = compress(&v[0]);
+	generate_uuid(uuid_data.begin());
+	string_data.resize(length);
+	::compress(uuid_data.begin(), &string_data[0]);
 #if BOOST_VERSION < 104400
 	formatted_string = boost::lexical_cast<std::string>(uuid_data);
 #else
@@ -97,11 +124,8 @@ IfcParse::IfcGlobalId::IfcGlobalId() {
 #endif
 
 #ifndef NDEBUG
-	std::vector<unsigned char> test_vector;
-	expand(string_data, test_vector);
 	boost::uuids::uuid test_uuid;
-	std::copy(test_vector.begin(), test_vector.end(), test_uuid.begin());
-	if (uuid_data != test_uuid) {
+	if (::expand(string_data.data(), test_uuid.begin(), decode_table()) != EXPAND_OK || uuid_data != test_uuid) {
 		Logger::Message(Logger::LOG_ERROR, "Internal error generating GlobalId");
 	}
 #endif
@@ -110,21 +134,15 @@ IfcParse::IfcGlobalId::IfcGlobalId() {
 IfcParse::IfcGlobalId::IfcGlobalId(const std::string& s)
 	: string_data(s)
 {
-	std::vector<unsigned char> v;
-	expand(string_data, v);
-	std::copy(v.begin(), v.end(), uuid_data.begin());
+	// GlobalIds that encode more than 128 bits are accepted, the excess bits are discarded
+	if (string_data.size() != length || ::expand(string_data.data(), uuid_data.begin(), decode_table()) == EXPAND_INVALID_CHARACTER) {
+		throw IfcParse::IfcException("Failed to decode GlobalId");
+	}
 #if BOOST_VERSION < 104400
 	formatted_string = boost::lexical_cast<std::string>(uuid_data);
 #else
 	formatted_string = boost::uuids::to_string(uuid_data);
 #endif
-
-#ifndef NDEBUG
-	const std::string test_string = compress(&uuid_data.data[0]);
-	if (string_data != test_string) {
-		Logger::Message(Logger::LOG_ERROR, "Internal error generating GlobalId");
-	}
-#endif
 }
 
 IfcParse::IfcGlobalId::operator const std::string&() const {
@@ -138,3 +156,35 @@ IfcParse::IfcGlobalId::operator const boost::uuids::uuid&() const {
 const std::string& IfcParse::IfcGlobalId::formatted() const {
 	return formatted_string;
 }
+
+void IfcParse::IfcGlobalId::generate(size_t n, char* buffer) {
+	unsigned char v[16];
+	for (size_t i = 0; i < n; ++i) {
+		generate_uuid(v);
+		::compress(v, buffer + i * length);
+	}
+}
+
+void IfcParse::IfcGlobalId::compress(size_t n, const unsigned char* uuids, char* buffer) {
+	for (size_t i = 0; i < n; ++i) {
+		::compress(uuids + i * 16, buffer + i * length);
+	}
+}
+
+size_t IfcParse::IfcGlobalId::expand(size_t n, const char* buffer, unsigned char* uuids, bool* valid) {
+	const std::array<uint8_t, 256>& t = decode_table();
+	size_t num_valid = 0;
+	for (size_t i = 0; i < n; ++i) {
+		const bool v = ::expand(buffer + i * length, uuids + i * 16, t) == EXPAND_OK;
+		if (valid) {
+			valid[i] = v;
+		}
+		num_valid += v;
+	}
+	return num_valid;
+}
+
+bool IfcParse::IfcGlobalId::is_valid(const std::string& s) {
+	unsigned char v[16];
+	return s.size() == length && ::expand(s.data(), v, decode_table()) == EXPAND_OK;
+}
@@ -21,6 +21,7 @@
 #define IFCGLOBALID_H
 
 #include <string>
+#include <cstddef>
 #include <boost/uuid/uuid.hpp>
 
 #include "ifc_parse_api.h"
@@ -28,6 +29,8 @@
 namespace IfcParse {
 
 	/// A helper class for the creation of IFC GlobalIds.
+	/// New GlobalIds are created from a random number generator
+	/// per thread, so that they can be generated concurrently.
 	class IFC_PARSE_API IfcGlobalId {
 	private:
 		std::string string_data, formatted_string;
@@ -39,6 +42,22 @@ namespace IfcParse {
 		operator const std::string&() const;
 		operator const boost::uuids::uuid&() const;
 		const std::string& formatted() const;
+
+		/// Writes n new GlobalIds to buffer, which needs to hold n * length
+		/// characters. GlobalIds are not separated nor null-terminated.
+		static void generate(size_t n, char* buffer);
+
+		/// Compresses n UUIDs of 16 bytes each into n GlobalIds, see generate().
+		static void compress(size_t n, const unsigned char* uuids, char* buffer);
+
+		/// Expands n GlobalIds of length characters each into n UUIDs of 16 bytes.
+		/// The validity of every GlobalId is written to valid, if not null, and
+		/// the number of valid GlobalIds is returned.
+		static size_t expand(size_t n, const char* buffer, unsigned char* uuids, bool* valid = nullptr);
+
+		/// Whether s consists of length characters of the base64 alphabet of
+		/// IFC and does not encode more than 128 bits.
+		static bool is_valid(const std::string& s);
 	};
 
 }
@@ -210,6 +210,11 @@ std::string Logger::GetLog() {
 	return log_stream.str();
 }
 
+void Logger::ClearLog() {
+	log_stream.str("");
+	log_stream.clear();
+}
+
 void Logger::PrintPerformanceStats() {
 	std::vector<std::pair<double, std::string>> items;
 	for (auto& p : performance_statistics) {
@@ -96,6 +96,8 @@ public:
 
 	static void ProgressBar(int progress);
 	static std::string GetLog();
+	/// Discards the messages logged so far, to be used in between tasks of a long running process
+	static void ClearLog();
 	static void PrintPerformanceStats();
 	static void PrintPerformanceStatsOnElement(bool b) { print_perf_stats_on_element = b; }
 };
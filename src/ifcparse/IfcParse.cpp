@@ -23,6 +23,7 @@
 #include "../ifcparse/IfcBaseClass.h"
 #include "../ifcparse/IfcSpfStream.h"
 #include "../ifcparse/IfcFile.h"
+#include "../ifcparse/IfcGlobalId.h"
 #include "../ifcparse/IfcSIPrefix.h"
 #include "../ifcparse/IfcSchema.h"
 #include "../ifcparse/utils.h"
@@ -34,6 +35,7 @@
 #include <set>
 #include <ctime>
 #include <mutex>
+#include <memory>
 #include <string>
 #include <stdio.h>
 #include <stdlib.h>
@@ -2046,7 +2048,7 @@ void IfcFile::process_deletion_() {
 			for (aggregate_of_instance::it iit = references->begin(); iit != references->end(); ++iit) {
 				IfcUtil::IfcBaseEntity* related_instance = (IfcUtil::IfcBaseEntity*) *iit;
 
-				if (std::find(batch_deletion_ids_.begin(), batch_deletion_ids_.end(), related_instance->data().id()) != batch_deletion_ids_.end()) {
+				if (batch_deletion_ids_.get<1>().count(related_instance->data().id())) {
 					continue;
 				}
 
@@ -2273,6 +2275,34 @@ IfcUtil::IfcBaseClass* IfcFile::instance_by_guid(const std::string& guid) {
 	}
 }
 
+std::vector<std::string> IfcFile::invalid_guids() const {
+	std::vector<std::string> invalid;
+	std::vector<const std::string*> guids;
+	guids.reserve(byguid.size());
+	std::string buffer;
+	buffer.reserve(byguid.size() * IfcGlobalId::length);
+	for (const auto& p : byguid) {
+		if (p.first.size() == IfcGlobalId::length) {
+			guids.push_back(&p.first);
+			buffer += p.first;
+		} else {
+			invalid.push_back(p.first);
+		}
+	}
+
+	std::vector<unsigned char> uuids(guids.size() * 16);
+	std::unique_ptr<bool[]> valid(new bool[guids.size()]);
+	if (IfcGlobalId::expand(guids.size(), buffer.data(), uuids.data(), valid.get()) != guids.size()) {
+		for (size_t i = 0; i < guids.size(); ++i) {
+			if (!valid[i]) {
+				invalid.push_back(*guids[i]);
+			}
+		}
+	}
+
+	return invalid;
+}
+
 // FIXME: Test destructor to delete entity and arg allocations
 IfcFile::~IfcFile() {
 	std::set<IfcUtil::IfcBaseClass*> entities_to_delete;
@@ -3,9 +3,13 @@
 #ifdef WITH_IFCXML
 
 #include "IfcFile.h"
+#include "utils.h"
 
 #include <libxml/parser.h>
 
+#include <fstream>
+#include <unordered_map>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/range/adaptor/transformed.hpp>
 #include <boost/range/algorithm/copy.hpp>
@@ -147,12 +151,106 @@ public:
 	}
 };
 
+// Attribute and inverse attribute names of an entity, including those of its
+// supertypes, so that XML names are looked up in a single hash table.
+struct entity_names {
+	std::unordered_map<std::string, int> attributes;
+	std::unordered_map<std::string, const IfcParse::inverse_attribute*> inverses;
+
+	explicit entity_names(const IfcParse::entity* entity) {
+		const int n = (int) entity->attribute_count();
+		for (int i = 0; i < n; ++i) {
+			attributes.emplace(entity->attribute_by_index(i)->name(), i);
+		}
+		for (auto& inv : entity->all_inverse_attributes()) {
+			inverses.emplace(inv->name(), inv);
+		}
+	}
+};
+
 struct ifcxml_parse_state {
 	IfcParse::IfcFile* file;
 	std::vector<stack_node> stack;
-	std::map<std::string, int> idmap;
+	// Instances by their id in the XML file, references to ids not yet
+	// encountered are resolved in a single pass after parsing. Ids that follow
+	// the common convention of a number prefixed with 'i' are stored by number.
+	std::unordered_map<unsigned, IfcUtil::IfcBaseClass*> numeric_ids;
+	std::unordered_map<std::string, IfcUtil::IfcBaseClass*> ids;
 	std::vector<std::pair<IfcWrite::IfcWriteArgument*, std::string> > forward_references;
 	ifcxml_dialect dialect;
+	// Text content of the current element, which libxml2 may report in pieces
+	std::string text;
+	// XML attributes of the element being started
+	std::vector<std::pair<std::string, std::string> > attributes;
+
+	// Tag names are interned to schema declarations as they are encountered
+	std::unordered_map<std::string, const IfcParse::declaration*> declarations;
+	std::unordered_map<const IfcParse::entity*, entity_names> names;
+
+	// Same as schema_definition::declaration_by_name(), which throws on unknown names
+	const IfcParse::declaration* declaration_by_name(const std::string& name) {
+		auto it = declarations.find(name);
+		if (it == declarations.end()) {
+			it = declarations.emplace(name, file->schema()->declaration_by_name(name)).first;
+		}
+		return it->second;
+	}
+
+	const entity_names& names_of(const IfcParse::entity* entity) {
+		auto it = names.find(entity);
+		if (it == names.end()) {
+			it = names.emplace(entity, entity_names(entity)).first;
+		}
+		return it->second;
+	}
+
+	// Same as entity::attribute_index(), -1 for unknown names
+	int attribute_index(const IfcParse::entity* entity, const std::string& name) {
+		const auto& attributes = names_of(entity).attributes;
+		auto it = attributes.find(name);
+		return it == attributes.end() ? -1 : it->second;
+	}
+
+	const IfcParse::inverse_attribute* inverse_attribute(const IfcParse::entity* entity, const std::string& name) {
+		const auto& inverses = names_of(entity).inverses;
+		auto it = inverses.find(name);
+		return it == inverses.end() ? nullptr : it->second;
+	}
+
+	static bool numeric_id(const std::string& id, unsigned& number) {
+		// Leading zeros are not accepted, so that distinct strings map to distinct numbers
+		if (id.size() < 2 || id.size() > 10 || id[0] != 'i' || (id[1] == '0' && id.size() > 2)) {
+			return false;
+		}
+		number = 0;
+		for (size_t i = 1; i < id.size(); ++i) {
+			if (id[i] < '0' || id[i] > '9') {
+				return false;
+			}
+			number = number * 10 + (unsigned) (id[i] - '0');
+		}
+		return true;
+	}
+
+	void add_instance(const std::string& id, IfcUtil::IfcBaseClass* inst) {
+		unsigned number;
+		if (numeric_id(id, number)) {
+			numeric_ids[number] = inst;
+		} else {
+			ids[id] = inst;
+		}
+	}
+
+	IfcUtil::IfcBaseClass* find_instance(const std::string& id) const {
+		unsigned number;
+		if (numeric_id(id, number)) {
+			auto it = numeric_ids.find(number);
+			return it == numeric_ids.end() ? nullptr : it->second;
+		} else {
+			auto it = ids.find(id);
+			return it == ids.end() ? nullptr : it->second;
+		}
+	}
 };
 
 // ifc4 allows for aggregates to be concatenated using whitespace.
@@ -206,12 +304,16 @@ Argument* parse_attribute_value(const IfcParse::parameter_type* ty, const std::s
 	return v;
 }
 
+static void process_text(ifcxml_parse_state* state);
+
 static void end_element(void* user, const xmlChar* tag) {
 	ifcxml_parse_state* state = (ifcxml_parse_state*)user;
 
 	if (state->file == nullptr) {
 		return;
 	}
+
+	process_text(state);
 	
 	if (!state->stack.empty() && state->stack.back().ntype() == stack_node::node_aggregate) {
 		const auto& back = state->stack.back();
@@ -224,9 +326,9 @@ static void end_element(void* user, const xmlChar* tag) {
 		back.inst()->data().attributes()[back.idx()] = li;
 	}
 
-	if (state->dialect == ifcxml_dialect_ifc2x3 && state->stack.back().ntype() == stack_node::node_instance) {
+	if (state->dialect == ifcxml_dialect_ifc2x3 && !state->stack.empty() && state->stack.back().ntype() == stack_node::node_instance) {
 		if (state->stack.back().inst() != nullptr) {
-			state->idmap[state->stack.back().id_in_file()] = state->file->addEntity(state->stack.back().inst())->data().id();
+			state->add_instance(state->stack.back().id_in_file(), state->file->addEntity(state->stack.back().inst()));
 		}
 	}
 
@@ -242,14 +344,37 @@ static void end_element(void* user, const xmlChar* tag) {
 	}	
 }
 
+// Whether the text content of the current element is used
+static bool accepts_text(const ifcxml_parse_state* state) {
+	if (state->stack.empty()) {
+		return false;
+	}
+	const stack_node& back = state->stack.back();
+	return (back.inst() != nullptr && back.inst()->declaration().as_type_declaration()) ||
+		back.ntype() == stack_node::node_header_entry ||
+		back.ntype() == stack_node::node_instance_attribute ||
+		back.ntype() == stack_node::node_aggregate_element;
+}
+
 static void process_characters(void* user, const xmlChar* ch, int len) {
 	ifcxml_parse_state* state = (ifcxml_parse_state*)user;
 
-	if (state->file == nullptr) {
+	if (state->file == nullptr || !accepts_text(state)) {
 		return;
 	}
 
-	std::string txt((char*) ch, len);
+	// Text is processed once the element ends or a child element starts,
+	// because libxml2 reports text in pieces at the boundaries of its buffers.
+	state->text.append((const char*) ch, len);
+}
+
+static void process_text(ifcxml_parse_state* state) {
+	if (state->text.empty()) {
+		return;
+	}
+
+	std::string txt;
+	txt.swap(state->text);
 
 	stack_node::node_type state_type = stack_node::stack_empty;
 	if (!state->stack.empty()) {
@@ -323,7 +448,9 @@ static void start_element(void* user, const xmlChar* tag, const xmlChar** attrs)
 	std::cout << std::string(state->stack.size(), ' ') << "<" << tagname << ">";
 #endif
 
-	std::vector<std::pair<std::string, std::string> > attributes;
+	// Reused to avoid reallocation for every element
+	std::vector<std::pair<std::string, std::string> >& attributes = state->attributes;
+	attributes.clear();
 
 	if (attrs) {
 		std::string attrname;
@@ -380,6 +507,8 @@ static void start_element(void* user, const xmlChar* tag, const xmlChar** attrs)
 		return;
 	}
 
+	process_text(state);
+
 	{
 		// ifcXML id attributes are commonly numeric identifiers prefixed with 'i' (as
 		// XML identifiers need to start with a alphabetic character). This convention
@@ -412,16 +541,16 @@ static void start_element(void* user, const xmlChar* tag, const xmlChar** attrs)
 				if (pair.first == "id" || pair.first == "href" || pair.first == "ref") {
 					id = id_in_file = pair.second;
 					if (pair.first == "href" || pair.first == "ref") {
-						if (state->idmap.find(pair.second) == state->idmap.end()) {
+						IfcUtil::IfcBaseClass* referenced = state->find_instance(pair.second);
+						if (referenced == nullptr) {
 							rv = pair.second;
-							return rv;
 						} else {
-							rv = state->file->instance_by_id(state->idmap[pair.second]);
-							return rv;
+							rv = referenced;
 						}
+						return rv;
 					}
 				} else if (pair.first == "xsi:type") {
-					decl = state->file->schema()->declaration_by_name(pair.second)->as_entity();
+					decl = state->declaration_by_name(pair.second)->as_entity();
 				}
 			}
 
@@ -434,7 +563,7 @@ static void start_element(void* user, const xmlChar* tag, const xmlChar** attrs)
 						continue;
 					}
 
-					auto idx = entity->attribute_index(pair.first);
+					auto idx = state->attribute_index(entity, pair.first);
 					if (idx != -1) {
 						auto attr = entity->attribute_by_index(idx);
 						auto val = parse_attribute_value(attr->type_of_attribute(), pair.second);
@@ -454,7 +583,7 @@ static void start_element(void* user, const xmlChar* tag, const xmlChar** attrs)
 				// subsequent child nodes
 				newinst = state->file->addEntity(newinst);
 				if (id) {
-					state->idmap[*id] = newinst->data().id();
+					state->add_instance(*id, newinst);
 				}
 			}
 
@@ -467,10 +596,11 @@ static void start_element(void* user, const xmlChar* tag, const xmlChar** attrs)
 			state_type = state->stack.back().ntype();
 		}
 
-		const std::string tagname_copy = boost::replace_all_copy(tagname, "-wrapper", "");
+		const std::string tagname_copy = tagname.find("-wrapper") == std::string::npos
+			? tagname : boost::replace_all_copy(tagname, "-wrapper", "");
 
 		if (state_type == stack_node::node_select) {
-			const IfcParse::declaration* decl = state->file->schema()->declaration_by_name(tagname_copy);
+			const IfcParse::declaration* decl = state->declaration_by_name(tagname_copy);
 			Argument* attr;
 			IfcUtil::IfcBaseClass* inst;
 			auto inst_ = create_instance(decl);
@@ -498,7 +628,7 @@ static void start_element(void* user, const xmlChar* tag, const xmlChar** attrs)
 			} else {
 				const IfcParse::declaration* decl = nullptr;
 				try {
-					decl = state->file->schema()->declaration_by_name(tagname_copy);
+					decl = state->declaration_by_name(tagname_copy);
 				} catch (const std::exception& e) {
 					Logger::Error(e);
 				}
@@ -518,24 +648,21 @@ static void start_element(void* user, const xmlChar* tag, const xmlChar** attrs)
 				// We need to push something on the stack. Likely there has been some extra indirection that is not understood.
 				state->stack.push_back(state->stack.back());
 			} else {
-				auto idx = current->attribute_index(tagname);
+				auto idx = state->attribute_index(current, tagname);
 				if (idx == -1) {
-					auto inverses = current->all_inverse_attributes();
-					auto found = std::find_if(inverses.begin(), inverses.end(), [&tagname](const IfcParse::inverse_attribute* attr) {
-						return attr->name() == tagname;
-					});
-					if (found == inverses.end()) {
+					const IfcParse::inverse_attribute* inverse = state->inverse_attribute(current, tagname);
+					if (inverse == nullptr) {
 						Logger::Error("Unknown attribute " + tagname);
 						state->stack.push_back(state->stack.back());
 					} else {
-						if ((*found)->bound1() == 0 && (*found)->bound2() == 1) {
-							auto inst_or_ref = create_instance((*found)->entity_reference());
+						if (inverse->bound1() == 0 && inverse->bound2() == 1) {
+							auto inst_or_ref = create_instance(inverse->entity_reference());
 							IfcUtil::IfcBaseClass* inst;
 							Argument* attr;
 							instance_to_attribute(inst_or_ref, attr, inst);
 							if (inst != nullptr) {
-								int idx = (*found)->entity_reference()->attribute_index(
-									(*found)->attribute_reference()
+								int idx = inverse->entity_reference()->attribute_index(
+									inverse->attribute_reference()
 								);
 								IfcWrite::IfcWriteArgument* attr_inv = new IfcWrite::IfcWriteArgument();
 								attr_inv->set(state->stack.back().inst());
@@ -546,7 +673,7 @@ static void start_element(void* user, const xmlChar* tag, const xmlChar** attrs)
 								state->stack.push_back(state->stack.back());
 							}
 						} else {
-							state->stack.push_back(stack_node::inverse(state->stack.back().inst(), *found));
+							state->stack.push_back(stack_node::inverse(state->stack.back().inst(), inverse));
 						}
 					}
 				} else {
@@ -587,7 +714,7 @@ static void start_element(void* user, const xmlChar* tag, const xmlChar** attrs)
 			} else {
 				const IfcParse::declaration* decl = nullptr;
 				try {
-					decl = state->file->schema()->declaration_by_name(tagname);
+					decl = state->declaration_by_name(tagname);
 				} catch (const std::exception& e) {
 					Logger::Error(e);
 				}
@@ -640,7 +767,15 @@ end:
 }
 
 #ifdef WITH_IFCXML
-IFC_PARSE_API IfcParse::IfcFile* IfcParse::parse_ifcxml(const std::string& filename) {
+
+// The input is passed to the libxml2 push parser in chunks of this size, so that
+// files are read in a few large reads and never need to be held in memory as a whole.
+static const size_t ifcxml_chunk_size = 1 << 20;
+
+// Parses the chunks returned by next_chunk(data, size), which returns false at
+// the end of the input.
+template <typename Fn>
+static IfcParse::IfcFile* parse_ifcxml_chunks(const std::string& name, Fn next_chunk) {
 	ifcxml_parse_state state;
 	state.file = nullptr;
 	state.dialect = ifcxml_dialect_unknown;
@@ -651,14 +786,35 @@ IFC_PARSE_API IfcParse::IfcFile* IfcParse::parse_ifcxml(const std::string& filen
 	handler.endElement = end_element;
 	handler.characters = process_characters;
 
-	xmlSAXUserParseFile(&handler, &state, filename.c_str());
+	xmlParserCtxtPtr ctxt = nullptr;
+	const char* data;
+	size_t size;
+	while (next_chunk(data, size)) {
+		if (ctxt == nullptr) {
+			// The first bytes are passed on creation for libxml2 to detect the encoding
+			const int initial = (int) std::min(size, (size_t) 4);
+			ctxt = xmlCreatePushParserCtxt(&handler, &state, data, initial, name.c_str());
+			if (ctxt == nullptr) {
+				break;
+			}
+			data += initial;
+			size -= initial;
+		}
+		if (xmlParseChunk(ctxt, data, (int) size, 0) != 0) {
+			break;
+		}
+	}
+	if (ctxt) {
+		xmlParseChunk(ctxt, nullptr, 0, 1);
+		xmlFreeParserCtxt(ctxt);
+	}
 
 	for (const auto& pair : state.forward_references) {
-		auto it = state.idmap.find(pair.second);
-		if (it == state.idmap.end()) {
+		IfcUtil::IfcBaseClass* referenced = state.find_instance(pair.second);
+		if (referenced == nullptr) {
 			Logger::Error("Instance with id '" + pair.second + "' not encountered");
 		} else {
-			pair.first->set(state.file->instance_by_id(it->second));
+			pair.first->set(referenced);
 		}
 	}
 
@@ -669,6 +825,30 @@ IFC_PARSE_API IfcParse::IfcFile* IfcParse::parse_ifcxml(const std::string& filen
 
 	return state.file;
 }
+
+IFC_PARSE_API IfcParse::IfcFile* IfcParse::parse_ifcxml(const std::string& filename) {
+	std::ifstream stream(IfcUtil::path::from_utf8(filename).c_str(), std::ios::binary);
+	if (!stream) {
+		return nullptr;
+	}
+	std::vector<char> buffer(ifcxml_chunk_size);
+	return parse_ifcxml_chunks(filename, [&stream, &buffer](const char*& data, size_t& size) {
+		stream.read(buffer.data(), buffer.size());
+		data = buffer.data();
+		size = (size_t) stream.gcount();
+		return size > 0;
+	});
+}
+
+IFC_PARSE_API IfcParse::IfcFile* IfcParse::parse_ifcxml(const char* data, size_t length) {
+	size_t offset = 0;
+	return parse_ifcxml_chunks("", [data, length, &offset](const char*& chunk, size_t& size) {
+		chunk = data + offset;
+		size = std::min(length - offset, ifcxml_chunk_size);
+		offset += size;
+		return size > 0;
+	});
+}
 #endif
 
 #endif // WITH_IFCXML
\ No newline at end of file
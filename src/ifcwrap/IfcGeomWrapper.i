@@ -39,6 +39,41 @@
 }
 
 %ignore IfcGeom::impl::tree::selector;
+%ignore IfcGeom::tree::select_rays;
+%ignore IfcGeom::ray_batch_result;
+
+// Release the global interpreter lock during geometry interpretation, so that
+// other Python threads can run while the iterator or create_shape() is busy.
+%{
+	class release_gil {
+		PyThreadState* state_;
+	public:
+		release_gil() : state_(PyEval_SaveThread()) {}
+		~release_gil() { PyEval_RestoreThread(state_); }
+	};
+%}
+
+%define RELEASE_GIL(function)
+%exception function {
+	try {
+		// The lock is reacquired before the exception handlers run
+		release_gil guard;
+		$action
+	} catch(const IfcParse::IfcAttributeOutOfRangeException& e) {
+		SWIG_exception(SWIG_IndexError, e.what());
+	} catch(const IfcParse::IfcException& e) {
+		SWIG_exception(SWIG_RuntimeError, e.what());
+	} catch(const std::runtime_error& e) {
+		SWIG_exception(SWIG_RuntimeError, e.what());
+	} catch(...) {
+		SWIG_exception(SWIG_RuntimeError, "An unknown error occurred");
+	}
+}
+%enddef
+
+RELEASE_GIL(IfcGeom::Iterator::initialize)
+RELEASE_GIL(IfcGeom::Iterator::next)
+RELEASE_GIL(create_shape)
 
 // Using RTTI return a more specialized type of Element
 // Note that these elements are not to be owned by SWIG/Python as they will be freed automatically upon the next iteration
@@ -134,6 +169,95 @@
 		return IfcGeom_tree_vector_to_list(ps);
 	}
 
+	void enable_mesh_narrow_phase(double deflection, double tolerance = 1.e-5) {
+		$self->enable_mesh_narrow_phase(deflection, tolerance);
+	}
+
+	bool mesh_narrow_phase() const {
+		return $self->mesh_narrow_phase();
+	}
+
+	// Returns a tuple of memoryviews (instance ids, style indices, positions, normals,
+	// distances), instance id is 0 for rays that do not hit anything. Origins and
+	// directions are C-contiguous buffers of doubles, e.g. numpy float64 arrays.
+	PyObject* select_rays_(PyObject* origins, PyObject* directions, double max_distance, int num_threads) {
+		Py_buffer o, d;
+		if (PyObject_GetBuffer(origins, &o, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) {
+			return NULL;
+		}
+		if (PyObject_GetBuffer(directions, &d, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) {
+			PyBuffer_Release(&o);
+			return NULL;
+		}
+
+		auto is_double = [](const Py_buffer& b) {
+			return b.itemsize == sizeof(double) && b.format && b.format[0] && b.format[strlen(b.format) - 1] == 'd';
+		};
+		if (!is_double(o) || !is_double(d) || o.len != d.len || (o.len / sizeof(double)) % 3) {
+			PyBuffer_Release(&o);
+			PyBuffer_Release(&d);
+			PyErr_SetString(PyExc_TypeError, "Expected buffers of doubles with an equal number of origins and directions as xyz triplets");
+			return NULL;
+		}
+
+		const size_t n = o.len / sizeof(double) / 3;
+		std::shared_ptr<IfcGeom::ray_batch_result> r(new IfcGeom::ray_batch_result);
+		std::shared_ptr<std::vector<int>> ids(new std::vector<int>(n, 0));
+		{
+			release_gil guard;
+			*r = $self->select_rays((const double*) o.buf, (const double*) d.buf, n, max_distance, num_threads);
+			for (size_t i = 0; i < n; ++i) {
+				if (r->instances[i]) {
+					(*ids)[i] = r->instances[i]->data().id();
+				}
+			}
+		}
+		PyBuffer_Release(&o);
+		PyBuffer_Release(&d);
+
+		PyObject* owner = pythonize_shared_owner(r);
+		PyObject* ids_owner = pythonize_shared_owner(ids);
+		PyObject* result = PyTuple_New(5);
+		PyTuple_SetItem(result, 0, pythonize_buffer(ids_owner, *ids));
+		PyTuple_SetItem(result, 1, pythonize_buffer(owner, r->style_indices));
+		PyTuple_SetItem(result, 2, pythonize_buffer(owner, r->positions));
+		PyTuple_SetItem(result, 3, pythonize_buffer(owner, r->normals));
+		PyTuple_SetItem(result, 4, pythonize_buffer(owner, r->distances));
+		Py_DECREF(ids_owner);
+		Py_DECREF(owner);
+		return result;
+	}
+
+	// Returns a list of (a, b, distance, protrusion_distance) tuples, type is one
+	// of 0: intersection, 1: containment, 2: clearance.
+	PyObject* clash_all_(aggregate_of_instance::ptr a, aggregate_of_instance::ptr b, int type, double tolerance, int num_threads) const {
+		if (type < 0 || type > 2) {
+			throw IfcParse::IfcException("Invalid clash type");
+		}
+
+		std::vector<IfcUtil::IfcBaseEntity*> va, vb;
+		for (auto& x : *a) {
+			if (x->declaration().is("IfcProduct")) va.push_back((IfcUtil::IfcBaseEntity*)x);
+		}
+		for (auto& x : *b) {
+			if (x->declaration().is("IfcProduct")) vb.push_back((IfcUtil::IfcBaseEntity*)x);
+		}
+
+		std::vector<IfcGeom::tree::clash> clashes;
+		{
+			release_gil guard;
+			clashes = $self->clash_all(va, vb, (IfcGeom::tree::clash_type) type, tolerance, num_threads);
+		}
+
+		PyObject* result = PyList_New(clashes.size());
+		for (size_t i = 0; i < clashes.size(); ++i) {
+			PyList_SetItem(result, i, Py_BuildValue("(NNdd)",
+				pythonize(clashes[i].a), pythonize(clashes[i].b),
+				clashes[i].distance, clashes[i].protrusion_distance));
+		}
+		return result;
+	}
+
 }
 
 // A visitor
@@ -234,24 +358,44 @@ struct ShapeRTTI : public boost::static_visitor<PyObject*>
 %newobject construct_iterator_with_include_exclude_globalid;
 %newobject construct_iterator_with_include_exclude_id;
 
+// The geometry arrays are exposed as read-only memoryviews on the vectors of the
+// triangulation, rather than as tuples of Python numbers. The owner argument is
+// referenced by the memoryviews to keep the vectors alive. Without an owner
+// (None) the memoryviews are created on a copy of the vectors.
+%define buffer_or_copy(name)
+	PyObject* name ## _buffer_(PyObject* owner) const {
+		return owner == Py_None ? pythonize_buffer_copy($self->name()) : pythonize_buffer(owner, $self->name());
+	}
+%enddef
+
 %extend IfcGeom::Representation::Triangulation {
+	buffer_or_copy(verts)
+	buffer_or_copy(normals)
+	buffer_or_copy(faces)
+	buffer_or_copy(edges)
+	buffer_or_copy(material_ids)
+
 	%pythoncode %{
         # Hide the getters with read-only property implementations
         id = property(id)
-        faces = property(faces)
-        edges = property(edges)
-        material_ids = property(material_ids)
         materials = property(materials)
-	%}
-};
 
-// Specialized accessors follow later, for otherwise property definitions
-// would appear before templated getter functions are defined.
-%extend IfcGeom::Representation::Triangulation {
-	%pythoncode %{
-        # Hide the getters with read-only property implementations
-        verts = property(verts)
-        normals = property(normals)
+        def _buffer_owner(self):
+            # Either the element the triangulation was obtained from has set a
+            # reference to it in _owner or the Python object owns the
+            # triangulation (create_shape()). Otherwise, e.g. for triangulations
+            # referenced from other C++ objects, there is no object that keeps
+            # the vectors alive and the buffers are copied.
+            owner = getattr(self, "_owner", None)
+            if owner is None and self.thisown:
+                owner = self
+            return owner
+
+        verts = property(lambda self: self.verts_buffer_(self._buffer_owner()))
+        normals = property(lambda self: self.normals_buffer_(self._buffer_owner()))
+        faces = property(lambda self: self.faces_buffer_(self._buffer_owner()))
+        edges = property(lambda self: self.edges_buffer_(self._buffer_owner()))
+        material_ids = property(lambda self: self.material_ids_buffer_(self._buffer_owner()))
 	%}
 };
 
@@ -287,9 +431,20 @@ struct ShapeRTTI : public boost::static_visitor<PyObject*>
 };
 
 %extend IfcGeom::TriangulationElement {
+	PyObject* geometry_owner_() const {
+		return pythonize_shared_owner($self->geometry_pointer());
+	}
+
 	%pythoncode %{
+        def _get_geometry(self, get=geometry):
+            g = get(self)
+            # Elements returned by the iterator are freed upon the next iteration,
+            # the triangulation is shared so that its buffers remain valid.
+            g._owner = self.geometry_owner_()
+            return g
+
         # Hide the getters with read-only property implementations
-        geometry = property(geometry)
+        geometry = property(_get_geometry)
 	%}
 };
 
@@ -413,6 +568,17 @@ struct ShapeRTTI : public boost::static_visitor<PyObject*>
 			? +1.0
 			: -1.0
 		);
+
+		kernel.setValue(IfcGeom::Kernel::GV_MESH_BOOLEAN,
+			settings.get(IfcGeom::IteratorSettings::MESH_BOOLEAN)
+			? +1.0
+			: -1.0
+		);
+
+		if (settings.get(IfcGeom::IteratorSettings::MESH_BOOLEAN)) {
+			// Operands of mesh based booleans are triangulated at the output tolerance
+			kernel.setValue(IfcGeom::Kernel::GV_DEFLECTION_TOLERANCE, settings.deflection_tolerance());
+		}
 			
 		if (instance->declaration().is(Schema::IfcProduct::Class())) {
 			if (representation) {
@@ -606,6 +772,25 @@ struct ShapeRTTI : public boost::static_visitor<PyObject*>
 	}
 %}
 
+%inline %{
+	// Returns a tuple of memoryviews (instance ids, 4x4 row major matrices) of the
+	// absolute placements of all IfcLocalPlacements in the file, in meters.
+	PyObject* resolve_placements(IfcParse::IfcFile* file, int num_threads = 1) {
+		std::shared_ptr<const IfcGeom::placement_table> table;
+		{
+			release_gil guard;
+			IfcGeom::Kernel kernel(file);
+			table = kernel.build_placement_table(file, num_threads);
+		}
+		PyObject* owner = pythonize_shared_owner(table);
+		PyObject* result = PyTuple_New(2);
+		PyTuple_SetItem(result, 0, pythonize_buffer(owner, table->ids()));
+		PyTuple_SetItem(result, 1, pythonize_buffer(owner, table->matrices()));
+		Py_DECREF(owner);
+		return result;
+	}
+%}
+
 %inline %{
 	IfcUtil::IfcBaseClass* serialise(const std::string& schema_name, const std::string& shape_str, bool advanced=true) {
 		std::stringstream stream(shape_str);
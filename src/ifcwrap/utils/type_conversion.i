@@ -169,6 +169,120 @@
 		return pyobj;
 	}
 
+	// A minimal read-only exporter of the buffer protocol over the contents of
+	// an STL vector. The owner is referenced for as long as the buffer is in use
+	// and is responsible for keeping the vector contents alive.
+	struct vector_buffer {
+		PyObject_HEAD
+		PyObject* owner;
+		void* data;
+		Py_ssize_t count;
+		Py_ssize_t itemsize;
+		char* format;
+	};
+
+	static void vector_buffer_dealloc(PyObject* self) {
+		Py_XDECREF(((vector_buffer*) self)->owner);
+		PyObject_Del(self);
+	}
+
+	static int vector_buffer_getbuffer(PyObject* self, Py_buffer* view, int flags) {
+		vector_buffer* b = (vector_buffer*) self;
+		if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE) {
+			view->obj = NULL;
+			PyErr_SetString(PyExc_BufferError, "Geometry buffers are read-only");
+			return -1;
+		}
+		view->obj = self;
+		Py_INCREF(self);
+		view->buf = b->data;
+		view->len = b->count * b->itemsize;
+		view->readonly = 1;
+		view->itemsize = b->itemsize;
+		view->format = (flags & PyBUF_FORMAT) == PyBUF_FORMAT ? b->format : NULL;
+		view->ndim = 1;
+		view->shape = (flags & PyBUF_ND) == PyBUF_ND ? &b->count : NULL;
+		view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &b->itemsize : NULL;
+		view->suboffsets = NULL;
+		view->internal = NULL;
+		return 0;
+	}
+
+	static PyTypeObject* vector_buffer_type() {
+		static PyBufferProcs procs = { vector_buffer_getbuffer, NULL };
+		static PyTypeObject type = { PyVarObject_HEAD_INIT(NULL, 0) };
+		if (type.tp_name == NULL) {
+			type.tp_name = "ifcopenshell_wrapper.vector_buffer";
+			type.tp_basicsize = sizeof(vector_buffer);
+			type.tp_dealloc = vector_buffer_dealloc;
+			type.tp_as_buffer = &procs;
+			type.tp_flags = Py_TPFLAGS_DEFAULT;
+			type.tp_doc = "Read-only view on geometry data";
+			if (PyType_Ready(&type) < 0) {
+				type.tp_name = NULL;
+				return NULL;
+			}
+		}
+		return &type;
+	}
+
+	template <typename T> char* buffer_format();
+	template <> char* buffer_format<double>() { static char f[] = "d"; return f; }
+	template <> char* buffer_format<int>() { static char f[] = "i"; return f; }
+
+	// Returns a memoryview on v without copying its contents, owner is kept alive
+	// by the memoryview.
+	template <typename T>
+	PyObject* pythonize_buffer(PyObject* owner, const std::vector<T>& v) {
+		PyTypeObject* type = vector_buffer_type();
+		if (type == NULL) {
+			return NULL;
+		}
+		vector_buffer* b = PyObject_New(vector_buffer, type);
+		if (b == NULL) {
+			return NULL;
+		}
+		Py_INCREF(owner);
+		b->owner = owner;
+		// An empty vector might not have storage, but memoryviews require a valid pointer
+		static T empty;
+		b->data = (void*) (v.empty() ? &empty : v.data());
+		b->count = (Py_ssize_t) v.size();
+		b->itemsize = (Py_ssize_t) sizeof(T);
+		b->format = buffer_format<T>();
+		PyObject* view = PyMemoryView_FromObject((PyObject*) b);
+		Py_DECREF(b);
+		return view;
+	}
+
+	template <typename T>
+	void delete_capsule_contents(PyObject* capsule) {
+		delete static_cast<T*>(PyCapsule_GetPointer(capsule, PyCapsule_GetName(capsule)));
+	}
+
+	// Returns a memoryview on a copy of v, for when there is no object that
+	// keeps v alive for the lifetime of the memoryview.
+	template <typename T>
+	PyObject* pythonize_buffer_copy(const std::vector<T>& v) {
+		std::vector<T>* copy = new std::vector<T>(v);
+		PyObject* owner = PyCapsule_New(copy, "ifcopenshell_wrapper.buffer_copy", delete_capsule_contents< std::vector<T> >);
+		PyObject* view = pythonize_buffer(owner, *copy);
+		Py_DECREF(owner);
+		return view;
+	}
+
+	// Wraps a copy of the shared pointer in a Python object, to be used as the owner
+	// of buffers that point into the shared object.
+	template <typename T>
+	PyObject* pythonize_shared_owner(const boost::shared_ptr<T>& p) {
+		return PyCapsule_New(new boost::shared_ptr<T>(p), "ifcopenshell_wrapper.shared_owner", delete_capsule_contents< boost::shared_ptr<T> >);
+	}
+
+	template <typename T>
+	PyObject* pythonize_shared_owner(const std::shared_ptr<T>& p) {
+		return PyCapsule_New(new std::shared_ptr<T>(p), "ifcopenshell_wrapper.shared_owner", delete_capsule_contents< std::shared_ptr<T> >);
+	}
+
 	PyObject* pythonize(const aggregate_of_aggregate_of_instance::ptr& t) {
 		unsigned int i = 0;
 		PyObject* pyobj = PyTuple_New(t->size());
@@ -212,6 +212,7 @@ void ColladaSerializer::ColladaExporter::ColladaScene::add(
 		{ (double)posmatrix[2], (double)posmatrix[5], (double)posmatrix[8], (double)posmatrix[11] },
 		{ 0, 0, 0, 1 }
 	};
+	applyDeferredOffset(matrix_array);
 
 	delete relative_trsf;
 
@@ -258,6 +259,7 @@ void ColladaSerializer::ColladaExporter::ColladaScene::addParent(const IfcGeom::
 		{ (double)parentMatrix[2], (double)parentMatrix[5], (double)parentMatrix[8], (double)parentMatrix[11] },
 		{ 0, 0, 0, 1 }
 	};
+	applyDeferredOffset(matrix_array);
 
     std::string name = serializer->object_id(&parent);
 	collada_id(name);
@@ -295,6 +297,17 @@ void ColladaSerializer::ColladaExporter::ColladaScene::closeParent()
 	current_node = NULL;
 }
 
+void ColladaSerializer::ColladaExporter::ColladaScene::applyDeferredOffset(double (&matrix_array)[4][4]) const {
+	// Nested nodes are placed relative to their parent, which is translated already
+	if (!parentNodes.empty() || !serializer->deferred_offset) {
+		return;
+	}
+	const std::array<double, 3>& offset = *serializer->deferred_offset;
+	for (int i = 0; i < 3; ++i) {
+		matrix_array[i][3] += offset[i];
+	}
+}
+
 void ColladaSerializer::ColladaExporter::ColladaScene::write() {
 	if (scene_opened) {
 		closeVisualScene();
@@ -349,7 +362,11 @@ void ColladaSerializer::ColladaExporter::ColladaMaterials::add(const IfcGeom::Ma
 
 		collada_id(material_name);
 
-		effects.write(material, material_name);
+		// When streaming the geometries library is open, the effects are written
+		// together with the materials.
+		if (!serializer->streaming) {
+			effects.write(material, material_name);
+		}
 		materials.push_back(material);
 		material_uris.push_back(material_name);
 	}
@@ -366,6 +383,11 @@ bool ColladaSerializer::ColladaExporter::ColladaMaterials::contains(const IfcGeo
 }
 
 void ColladaSerializer::ColladaExporter::ColladaMaterials::write() {
+	if (serializer->streaming) {
+		for (size_t i = 0; i < materials.size(); ++i) {
+			effects.write(materials[i], material_uris[i]);
+		}
+	}
 	effects.close();
     BOOST_FOREACH(const IfcGeom::Material& material, materials) {
         std::string material_name = getMaterialUri(material);
@@ -408,8 +430,19 @@ void ColladaSerializer::ColladaExporter::write(const IfcGeom::TriangulationEleme
 		material_references.push_back(material_name);
 	}
 
-	DeferredObject deferred(name, representation_id, o->type(), o->transformation(), mesh.verts(), mesh.normals(),
-		mesh.faces(), mesh.edges(), mesh.material_ids(), mesh.materials(), material_references, mesh.uvs());
+	if (serializer->streaming) {
+		if (geometries_written.insert(representation_id).second) {
+			geometries.write(representation_id, o->type(), mesh.verts(), mesh.normals(), mesh.faces(), mesh.edges(),
+				mesh.material_ids(), mesh.materials(), mesh.uvs(), material_references);
+		}
+	}
+
+	// When streaming only the scene node is kept, without the mesh.
+	DeferredObject deferred = serializer->streaming
+		? DeferredObject(name, representation_id, o->type(), o->transformation(), {}, {},
+			{}, {}, {}, {}, material_references, {})
+		: DeferredObject(name, representation_id, o->type(), o->transformation(), mesh.verts(), mesh.normals(),
+			mesh.faces(), mesh.edges(), mesh.material_ids(), mesh.materials(), material_references, mesh.uvs());
 
 	if (serializer->settings().get(SerializerSettings::USE_ELEMENT_HIERARCHY)) {
 		deferred.parents() = o->parents();
@@ -464,11 +497,13 @@ std::string ColladaSerializer::object_id(const IfcGeom::Element* o) /*override*/
 
 void ColladaSerializer::ColladaExporter::endDocument() {
 	// In fact due the XML based nature of Collada and its dependency on library nodes,
-	// only at this point all objects are written to the stream.
+	// only at this point all objects are written to the stream. Unless streaming, in
+	// which case the geometries have been written already and only the scene remains.
+	if (serializer->streaming) {
+		geometries.close();
+	}
 	materials.write();
 	bool use_hierarchy = serializer->settings().get(SerializerSettings::USE_ELEMENT_HIERARCHY);
-	
-	std::set<std::string> geometries_written;
 
 	//if the setting USE_ELEMENT_HIERARCHY is in use, we sort the deferreds objects by their parents.
 	
@@ -476,15 +511,17 @@ void ColladaSerializer::ColladaExporter::endDocument() {
 		std::sort(deferreds.begin(), deferreds.end());
 	}
 	
-	for (std::vector<DeferredObject>::const_iterator it = deferreds.begin(); it != deferreds.end(); ++it) {
-		if (geometries_written.find(it->representation_id) != geometries_written.end()) {
-			continue;
+	if (!serializer->streaming) {
+		for (std::vector<DeferredObject>::const_iterator it = deferreds.begin(); it != deferreds.end(); ++it) {
+			if (geometries_written.find(it->representation_id) != geometries_written.end()) {
+				continue;
+			}
+			geometries_written.insert(it->representation_id);
+			geometries.write(it->representation_id, it->type, it->vertices, it->normals, it->faces, it->edges,
+				it->material_ids, it->materials, it->uvs, it->material_references);
 		}
-		geometries_written.insert(it->representation_id);
-		geometries.write(it->representation_id, it->type, it->vertices, it->normals, it->faces, it->edges,
-            it->material_ids, it->materials, it->uvs, it->material_references);
+		geometries.close();
 	}
-	geometries.close();
 
 	for (std::vector<DeferredObject>::const_iterator it = deferreds.begin(); it != deferreds.end(); ++it){
 		const std::string object_name = it->unique_id;
@@ -48,6 +48,9 @@
 
 #include <boost/numeric/ublas/matrix.hpp>
 #include <boost/numeric/ublas/io.hpp>
+#include <boost/optional.hpp>
+
+#include <set>
 
 
 class SERIALIZERS_API ColladaSerializer : public WriteOnlyGeometrySerializer
@@ -90,6 +93,8 @@ private:
 			bool scene_opened;
 			std::stack<COLLADASW::Node*> parentNodes;
 			std::stack<IfcGeom::Transformation> matrixStack;
+			// Translates the matrix of a node at the root of the scene by the deferred offset, if any
+			void applyDeferredOffset(double (&matrix_array)[4][4]) const;
 		public:
 			ColladaScene(const std::string& scene_id, COLLADASW::StreamWriter& stream, ColladaSerializer *_serializer)
 				: COLLADASW::LibraryVisualScenes(&stream)
@@ -210,6 +215,7 @@ private:
         ColladaGeometries geometries;
         ColladaSerializer *serializer;
 		std::vector<DeferredObject> deferreds;
+		std::set<std::string> geometries_written;
 		virtual ~ColladaExporter() {}
 		void startDocument(const std::string& unit_name, float unit_magnitude);
 		void write(const IfcGeom::TriangulationElement* o);
@@ -218,10 +224,13 @@ private:
 	ColladaExporter exporter;
 	std::string unit_name;
 	float unit_magnitude;
+	boost::optional<std::array<double, 3>> deferred_offset;
+	bool streaming;
 public:
     ColladaSerializer(const std::string& dae_filename, const SerializerSettings& settings)
         : WriteOnlyGeometrySerializer(settings)
 		, exporter("IfcOpenShell", dae_filename, this, settings.precision >= 15)
+		, streaming(false)
     {
         exporter.serializer = this;
         exporter.materials.serializer = this;
@@ -239,6 +248,13 @@ public:
 		unit_magnitude = magnitude;
 	}
 	void setFile(IfcParse::IfcFile*) {}
+	// Vertices in world coordinates are not affected by the node matrices
+	bool supportsDeferredOffset() const { return !settings().get(SerializerSettings::USE_WORLD_COORDS); }
+	void setDeferredOffset(const std::array<double, 3>& offset) { deferred_offset = offset; }
+	/// Writes the geometry of elements as they arrive instead of in finalize(), only
+	/// the scene nodes are kept in memory. The effects and materials are then written
+	/// after the geometries. To be called before writeHeader().
+	void setStreaming(bool b) { streaming = b; }
 
     std::string object_id(const IfcGeom::Element* o) /*override*/;
 
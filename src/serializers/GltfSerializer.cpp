@@ -20,9 +20,12 @@
 #ifdef WITH_GLTF
 
 #include "GltfSerializer.h"
+#include "mesh_optimizer.h"
 
 #include "../ifcparse/utils.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iterator>
 
 static const uint32_t GLTF = 0x46546C67U;
@@ -44,39 +47,76 @@ static const uint32_t PRIM_TRIANGLES = 4;
 static const uint32_t PRIM_TRIANGLE_STRIP = 5;
 static const uint32_t PRIM_TRIANGLE_FAN = 6;
 
+static const uint32_t TARGET_ARRAY_BUFFER = 34962;
+static const uint32_t TARGET_ELEMENT_ARRAY_BUFFER = 34963;
+
+GltfSerializer::temp_stream::temp_stream(const std::string& fn)
+	: filename(fn)
+	, stream(IfcUtil::path::from_utf8(fn).c_str(), std::ios_base::binary)
+	, count(0)
+	, length(0)
+	, view(-1)
+{}
+
+GltfSerializer::temp_stream::~temp_stream() {
+	stream.close();
+	IfcUtil::path::delete_file(filename);
+}
+
+void GltfSerializer::temp_stream::append(const json& j) {
+	// One value per line, dump() escapes newlines in strings, see copy_nodes_with_offset()
+	if (count++) {
+		stream << ",\n";
+	}
+	stream << j.dump();
+}
+
+size_t GltfSerializer::temp_stream::output_length() const {
+	if (vertex_encoder) {
+		return vertex_encoder->length();
+	} else if (index_encoder) {
+		return index_encoder->length();
+	} else {
+		return length;
+	}
+}
+
 GltfSerializer::GltfSerializer(const std::string& filename, const SerializerSettings& settings)
 	: WriteOnlyGeometrySerializer(settings)
 	, filename_(filename)
-	, tmp_filename1_(filename + ".indices.tmp")
-	, tmp_filename2_(filename + ".vertices.tmp")
 	, fstream_(IfcUtil::path::from_utf8(filename).c_str(), std::ios_base::binary)
-	, tmp_fstream1_(IfcUtil::path::from_utf8(tmp_filename1_).c_str(), std::ios_base::binary)
-	, tmp_fstream2_(IfcUtil::path::from_utf8(tmp_filename2_).c_str(), std::ios_base::binary)
-	{}
-
-GltfSerializer::~GltfSerializer() {
-	tmp_fstream1_.close();
-	tmp_fstream2_.close();
-	IfcUtil::path::delete_file(tmp_filename1_);
-	IfcUtil::path::delete_file(tmp_filename2_);
+	, quantize_(settings.get(SerializerSettings::GLTF_QUANTIZE))
+	, compress_(settings.get(SerializerSettings::GLTF_MESHOPT_COMPRESSION))
+	, accessors_(filename + ".accessors.tmp")
+	, meshes_(filename + ".meshes.tmp")
+	, nodes_(filename + ".nodes.tmp")
+	, indices_(filename + ".indices.tmp")
+	, positions_(filename + ".positions.tmp")
+	, normals_(filename + ".normals.tmp")
+	, materials_array_(json::array())
+	, num_views_(0)
+	, has_lods_(false)
+{
+	if (compress_) {
+		// Attributes are padded to multiples of four bytes, as required by the codec
+		positions_.vertex_encoder.reset(new mesh_optimizer::vertex_encoder(positions_.stream, quantize_ ? 8 : 12));
+		normals_.vertex_encoder.reset(new mesh_optimizer::vertex_encoder(normals_.stream, quantize_ ? 4 : 12));
+		indices_.index_encoder.reset(new mesh_optimizer::index_encoder(indices_.stream));
+	}
 }
 
+GltfSerializer::~GltfSerializer() {}
+
 bool GltfSerializer::ready() {
-	return fstream_.is_open() && tmp_fstream1_.is_open() && tmp_fstream2_.is_open();
+	for (auto* ts : { &accessors_, &meshes_, &nodes_, &indices_, &positions_, &normals_ }) {
+		if (!ts->stream.is_open()) {
+			return false;
+		}
+	}
+	return fstream_.is_open();
 }
 
-void GltfSerializer::writeHeader() {
-	json_["asset"]["generator"] = "IfcOpenShell IfcConvert " IFCOPENSHELL_VERSION;
-	json_["asset"]["version"] = "2.0";
-	json_["scene"] = 0;
-
-	node_array_ = json::array();
-	json_["accessors"] = json::array();
-	json_["scenes"] = json::array();
-	json_["nodes"] = json::array();
-	json_["meshes"] = json::array();
-	json_["materials"] = json::array();
-}
+void GltfSerializer::writeHeader() {}
 
 int GltfSerializer::writeMaterial(const IfcGeom::Material& style) {
 	auto it = materials_.find(style.name());
@@ -84,7 +124,7 @@ int GltfSerializer::writeMaterial(const IfcGeom::Material& style) {
 		return it->second;
 	}
 	
-	int idx = json_["materials"].size();
+	int idx = materials_array_.size();
 	materials_[style.name()] = idx;
 
 	std::array<double, 4> base;
@@ -98,10 +138,10 @@ int GltfSerializer::writeMaterial(const IfcGeom::Material& style) {
 		base[3] = 1. - style.transparency();
 	}
 
-	json_["materials"].push_back({ {"pbrMetallicRoughness", {{"baseColorFactor", base}, {"metallicFactor", 0}}} });
+	materials_array_.push_back({ {"pbrMetallicRoughness", {{"baseColorFactor", base}, {"metallicFactor", 0}}} });
 	
 	if (style.hasTransparency() && style.transparency() > 1.e-9) {
-		json_["materials"].back()["alphaMode"] = "BLEND";
+		materials_array_.back()["alphaMode"] = "BLEND";
 	}
 
 	return idx;
@@ -117,157 +157,313 @@ const char* const stride_name<3U>::value = "VEC3";
 template <typename T>
 struct component_type { static const uint32_t value; };
 template <>
-const uint32_t component_type<int>::value = CT_UNSIGNED_INT;
+const uint32_t component_type<int8_t>::value = CT_BYTE;
+template <>
+const uint32_t component_type<int16_t>::value = CT_SHORT;
+template <>
+const uint32_t component_type<uint16_t>::value = CT_UNSIGNED_SHORT;
+template <>
+const uint32_t component_type<uint32_t>::value = CT_UNSIGNED_INT;
 template <>
 const uint32_t component_type<float>::value = CT_FLOAT;
 
-template <size_t N, typename It>
-size_t write_accessor(json& j, std::ofstream& ofs, It begin, It end) {
-	auto num = std::distance(begin, end) / N;
+// Vertex attributes are aligned to four bytes, for example a VEC3 of shorts is
+// followed by a padding component.
+template <size_t N, typename T>
+struct padded_components { static const size_t value = (N == 1 || (N * sizeof(T)) % 4 == 0) ? N : 4; };
 
-	json accessor = json::object();
+template <size_t N, typename T>
+int GltfSerializer::writeAccessor(temp_stream& ts, const std::vector<T>& data, bool normalized, bool min_max) {
+	static const size_t P = padded_components<N, T>::value;
+	const size_t num = data.size() / P;
+
+	if (ts.view == -1) {
+		ts.view = num_views_++;
+	}
 
-	accessor["bufferView"] = N == 1 ? 0 : 1;
-	accessor["byteOffset"] = (size_t)ofs.tellp();
-	accessor["componentType"] = component_type<typename It::value_type>::value;
+	json accessor = json::object();
+	accessor["bufferView"] = ts.view;
+	accessor["byteOffset"] = ts.length;
+	accessor["componentType"] = component_type<T>::value;
 	accessor["count"] = num;
+	accessor["type"] = stride_name<N>::value;
+	if (normalized) {
+		accessor["normalized"] = true;
+	}
 
-	std::array<typename It::value_type, N> min, max;
-	min.fill(std::numeric_limits<typename It::value_type>::max());
-	max.fill(std::numeric_limits<typename It::value_type>::lowest());
-	for (auto it = begin; it != end; it += N) {
-		for (size_t i = 0; i < N; ++i) {
-			const float& v = *(it + i);
-			if (v < min[i]) {
-				min[i] = v;
-			}
-			if (v > max[i]) {
-				max[i] = v;
+	if (min_max) {
+		std::array<T, N> min, max;
+		min.fill(std::numeric_limits<T>::max());
+		max.fill(std::numeric_limits<T>::lowest());
+		for (auto it = data.begin(); it != data.end(); it += P) {
+			for (size_t i = 0; i < N; ++i) {
+				const T& v = *(it + i);
+				if (v < min[i]) {
+					min[i] = v;
+				}
+				if (v > max[i]) {
+					max[i] = v;
+				}
 			}
 		}
+		accessor["min"] = min;
+		accessor["max"] = max;
 	}
-	accessor["min"] = min;
-	accessor["max"] = max;
-	accessor["type"] = stride_name<N>::value;
 
-	ofs.write((const char*)&*begin, sizeof(typename It::value_type) * num * N);
+	const size_t num_bytes = data.size() * sizeof(T);
+	if (ts.vertex_encoder) {
+		ts.vertex_encoder->write((const unsigned char*) data.data(), num);
+	} else if (ts.index_encoder) {
+		ts.index_encoder->write((const unsigned int*) data.data(), num);
+	} else {
+		ts.stream.write((const char*) data.data(), num_bytes);
+	}
+	ts.length += num_bytes;
+	ts.count += num;
 
-	j["accessors"].push_back(accessor);
+	if (!ts.vertex_encoder && !ts.index_encoder) {
+		// Keep subsequent accessors aligned, only applies to 16-bit indices
+		for (; ts.length % 4; ++ts.length) {
+			ts.stream.put('\0');
+		}
+	}
 
-	return j["accessors"].size() - 1;
+	accessors_.append(accessor);
+	return (int) accessors_.count - 1;
 }
 
-void GltfSerializer::write(const IfcGeom::TriangulationElement* o) {
-	if (o->geometry().material_ids().empty()) {
-		return;
+template <typename T>
+T quantize_normal(double v) {
+	const double max = std::numeric_limits<T>::max();
+	return (T) std::lround(std::min(std::max(v, -1.), 1.) * max);
+}
+
+GltfSerializer::mesh_info GltfSerializer::writeMesh(const IfcGeom::Representation::Triangulation& geom) {
+	mesh_info info;
+	info.index = (int) meshes_.count;
+	info.scale = 1.;
+	info.offset.fill(0.);
+
+	const std::vector<double>& verts = geom.verts();
+	const std::vector<double>& normals = geom.normals();
+
+	if (quantize_ && !verts.empty()) {
+		// Positions are stored as 16-bit integers relative to the center of the
+		// bounding box. A uniform scale is used so that normals are unaffected
+		// by the dequantization transform that is applied on the nodes.
+		std::array<double, 3> lower, upper;
+		lower.fill(+std::numeric_limits<double>::infinity());
+		upper.fill(-std::numeric_limits<double>::infinity());
+		for (size_t i = 0; i < verts.size(); i += 3) {
+			for (size_t j = 0; j < 3; ++j) {
+				lower[j] = std::min(lower[j], verts[i + j]);
+				upper[j] = std::max(upper[j], verts[i + j]);
+			}
+		}
+		double extent = 0.;
+		for (size_t j = 0; j < 3; ++j) {
+			info.offset[j] = (lower[j] + upper[j]) / 2.;
+			extent = std::max(extent, upper[j] - lower[j]);
+		}
+		if (extent > 0.) {
+			info.scale = extent / (2 * std::numeric_limits<int16_t>::max());
+		}
 	}
 
-	node_array_.push_back(json_["nodes"].size());
+	auto mid1 = geom.material_ids().begin();
+	auto mid0 = mid1;
 
-	const std::vector<double>& m = o->transformation().matrix().data();
-	// nb: note that this contains the Y-UP transform as well.
-	const std::array<double, 16> matrix_flat = {
-		m[0], m[ 2], -m[ 1], 0,
-		m[3], m[ 5], -m[ 4], 0,
-		m[6], m[ 8], -m[ 7], 0,
-		m[9], m[11], -m[10], 1
-	};
-	static const std::array<double, 16> identity_matrix = {1,0,0,0,0,1,0,0,0,0,1,0,0,0,0,1};
-	
-	json node;
-	if (matrix_flat != identity_matrix) {
-		// glTF validator complains about identity matrices
-		node["matrix"] = matrix_flat;
-	}
-	node["name"] = object_id(o);
-	
-	int current_mesh_index;
+	std::vector<int>::const_iterator fid0;
+	int stride;
+	int primitive_type;
 
-	// See if this mesh has already been processed
-	auto it = meshes_.find(o->geometry().id());
-	if (it == meshes_.end()) {
+	if (!geom.faces().empty()) {
+		stride = 3;
+		fid0 = geom.faces().begin();
+		primitive_type = PRIM_TRIANGLES;
+	} else {
+		stride = 2;
+		fid0 = geom.edges().begin();
+		primitive_type = PRIM_LINES;
+	}
 
-		auto mid1 = o->geometry().material_ids().begin();
-		auto mid0 = mid1;
+	json mesh;
+	mesh["name"] = geom.id();
+
+	while (true) {
+		// In glTF we need to decompose a mesh into several primitives
+		// with a constant material. In the triangulations coming from
+		// IfcOpenShell the materials are encoded in an additional set
+		// of indices. Therefore we loop over the material indices to
+		// find equal ranges of materials. Triangle indices then need
+		// to be updated to reference the vertices only for the current
+		// material.
+		mid1++;
+
+		if ((mid1 == geom.material_ids().end()) || (*mid1 != *mid0)) {
+			auto n = std::distance(mid0, mid1);
+			auto fid1 = fid0 + n * stride;
+
+			auto idx_range = std::minmax_element(fid0, fid1);
+			const int idx_begin = *idx_range.first;
+			const int idx_end = *idx_range.second + 1;
+
+			std::vector<int> idx_transformed;
+			idx_transformed.reserve((n * stride));
+			std::transform(fid0, fid1, std::back_inserter(idx_transformed), [idx_begin](int i) {
+				return i - idx_begin;
+			});
+
+			// Reorder triangles for the post-transform cache of the GPU and then
+			// number vertices in the order they are referenced. This also improves
+			// the delta encoding of both indices and vertices.
+			if (primitive_type == PRIM_TRIANGLES) {
+				mesh_optimizer::optimize_vertex_cache(idx_transformed, idx_end - idx_begin);
+			}
+			size_t num_vertices;
+			const std::vector<int> remap = mesh_optimizer::optimize_vertex_fetch(idx_transformed, idx_end - idx_begin, num_vertices);
 
-		std::vector<int>::const_iterator fid0;
-		int stride;
-		int primitive_type;
+			json primitive = json::object();
 
-		if (!o->geometry().faces().empty()) {
-			stride = 3;
-			fid0 = o->geometry().faces().begin();
-			primitive_type = PRIM_TRIANGLES;
-		} else {
-			stride = 2;
-			fid0 = o->geometry().edges().begin();
-			primitive_type = PRIM_LINES;
-		}
+			if (num_vertices <= std::numeric_limits<uint16_t>::max() && !compress_) {
+				primitive["indices"] = writeAccessor<1U>(indices_, std::vector<uint16_t>(idx_transformed.begin(), idx_transformed.end()));
+			} else {
+				primitive["indices"] = writeAccessor<1U>(indices_, std::vector<uint32_t>(idx_transformed.begin(), idx_transformed.end()));
+			}
 
-		json mesh;
-		mesh["name"] = o->geometry().id();
-		
-		while (true) {
-			// In glTF we need to decompose a mesh into several primitives
-			// with a constant material. In the triangulations coming from
-			// IfcOpenShell the materials are encoded in an additional set
-			// of indices. Therefore we loop over the material indices to
-			// find equal ranges of materials. Triangle indices then need
-			// to be updated to reference the vertices only for the current
-			// material.
-			mid1++;
-
-			if ((mid1 == o->geometry().material_ids().end()) || (*mid1 != *mid0)) {
-				auto n = std::distance(mid0, mid1);
-				auto fid1 = fid0 + n * stride;
-
-				auto idx_range = std::minmax_element(fid0, fid1);
-				const auto& idx_begin = *idx_range.first;
-				const auto& idx_end = *idx_range.second + 1;
-
-				std::vector<int> idx_transformed;
-				idx_transformed.reserve((n * stride));
-				std::transform(fid0, fid1, std::back_inserter(idx_transformed), [idx_begin](int i) {
-					return i - idx_begin;
-				});
-
-				json primitive = json::object();
-				
-				primitive["indices"] = write_accessor<1U>(json_, tmp_fstream1_, idx_transformed.begin(), idx_transformed.end());
-
-				auto vbegin = o->geometry().verts().begin();
-				std::vector<float> vf(vbegin + idx_begin * 3, vbegin + idx_end * 3);
-				primitive["attributes"]["POSITION"] = write_accessor<3U>(json_, tmp_fstream2_, vf.begin(), vf.end());
-
-				if (o->geometry().normals().size()) {
-					auto nbegin = o->geometry().normals().begin();
-					std::vector<float> nf(nbegin + idx_begin * 3, nbegin + idx_end * 3);
-					primitive["attributes"]["NORMAL"] = write_accessor<3U>(json_, tmp_fstream2_, nf.begin(), nf.end());
+			if (quantize_) {
+				std::vector<int16_t> vq(num_vertices * 4, 0);
+				for (int i = idx_begin; i < idx_end; ++i) {
+					const int j = remap[i - idx_begin];
+					if (j == -1) continue;
+					for (int k = 0; k < 3; ++k) {
+						vq[j * 4 + k] = (int16_t) std::lround((verts[i * 3 + k] - info.offset[k]) / info.scale);
+					}
 				}
-				
-				primitive["material"] = writeMaterial(o->geometry().materials()[*mid0]);
-				primitive["mode"] = primitive_type;
-				
-				mesh["primitives"].push_back(primitive);
-
-				if (mid1 == o->geometry().material_ids().end()) {
-					break;
+				primitive["attributes"]["POSITION"] = writeAccessor<3U>(positions_, vq, false, true);
+			} else {
+				std::vector<float> vf(num_vertices * 3);
+				for (int i = idx_begin; i < idx_end; ++i) {
+					const int j = remap[i - idx_begin];
+					if (j == -1) continue;
+					std::copy(verts.begin() + i * 3, verts.begin() + i * 3 + 3, vf.begin() + j * 3);
+				}
+				primitive["attributes"]["POSITION"] = writeAccessor<3U>(positions_, vf, false, true);
+			}
+
+			if (normals.size()) {
+				if (quantize_) {
+					std::vector<int8_t> nq(num_vertices * 4, 0);
+					for (int i = idx_begin; i < idx_end; ++i) {
+						const int j = remap[i - idx_begin];
+						if (j == -1) continue;
+						for (int k = 0; k < 3; ++k) {
+							nq[j * 4 + k] = quantize_normal<int8_t>(normals[i * 3 + k]);
+						}
+					}
+					primitive["attributes"]["NORMAL"] = writeAccessor<3U>(normals_, nq, true);
+				} else {
+					std::vector<float> nf(num_vertices * 3);
+					for (int i = idx_begin; i < idx_end; ++i) {
+						const int j = remap[i - idx_begin];
+						if (j == -1) continue;
+						std::copy(normals.begin() + i * 3, normals.begin() + i * 3 + 3, nf.begin() + j * 3);
+					}
+					primitive["attributes"]["NORMAL"] = writeAccessor<3U>(normals_, nf);
 				}
+			}
+
+			primitive["material"] = writeMaterial(geom.materials()[*mid0]);
+			primitive["mode"] = primitive_type;
+
+			mesh["primitives"].push_back(primitive);
 
-				mid0 = mid1;
-				fid0 = fid1;
+			if (mid1 == geom.material_ids().end()) {
+				break;
 			}
+
+			mid0 = mid1;
+			fid0 = fid1;
 		}
+	}
 
-		json_["meshes"].push_back(mesh);
+	meshes_.append(mesh);
 
-		meshes_[o->geometry().id()] = current_mesh_index = json_["meshes"].size() - 1;
-	} else {
-		current_mesh_index = it->second;
+	return info;
+}
+
+void GltfSerializer::write(const IfcGeom::TriangulationElement* o) {
+	if (o->geometry().material_ids().empty()) {
+		return;
+	}
+
+	// See if these meshes have already been processed
+	auto mesh = [this](const IfcGeom::Representation::Triangulation& geom) -> const mesh_info& {
+		auto it = mesh_infos_.find(geom.id());
+		if (it == mesh_infos_.end()) {
+			it = mesh_infos_.insert({ geom.id(), writeMesh(geom) }).first;
+		}
+		return it->second;
+	};
+
+	const std::vector<double>& m = o->transformation().matrix().data();
+
+	auto node_for = [&m, this](const mesh_info& info) {
+		// nb: note that this contains the Y-UP transform as well.
+		std::array<double, 16> matrix_flat = {
+			m[0], m[ 2], -m[ 1], 0,
+			m[3], m[ 5], -m[ 4], 0,
+			m[6], m[ 8], -m[ 7], 0,
+			m[9], m[11], -m[10], 1
+		};
+
+		if (quantize_) {
+			// Append the dequantization of positions to the (column-major) node matrix
+			for (int i = 0; i < 3; ++i) {
+				matrix_flat[12 + i] += matrix_flat[0 + i] * info.offset[0] + matrix_flat[4 + i] * info.offset[1] + matrix_flat[8 + i] * info.offset[2];
+			}
+			for (int i = 0; i < 12; ++i) {
+				matrix_flat[i] *= info.scale;
+			}
+		}
+
+		static const std::array<double, 16> identity_matrix = {1,0,0,0,0,1,0,0,0,0,1,0,0,0,0,1};
+
+		json node;
+		if (matrix_flat != identity_matrix) {
+			// glTF validator complains about identity matrices
+			node["matrix"] = matrix_flat;
+		}
+		node["mesh"] = info.index;
+		return node;
+	};
+
+	json node = node_for(mesh(o->geometry()));
+	node["name"] = object_id(o);
+
+	// Coarser levels of detail are written as separate nodes that are not part of
+	// the scene, but referenced from the node of the full detail mesh (MSFT_lod).
+	std::vector<json> lod_nodes;
+	for (auto& lod : o->geometry().lods()) {
+		if (!lod->material_ids().empty()) {
+			lod_nodes.push_back(node_for(mesh(*lod)));
+			lod_nodes.back()["name"] = object_id(o) + "-lod" + std::to_string(lod_nodes.size());
+		}
+	}
+	if (!lod_nodes.empty()) {
+		has_lods_ = true;
+		json ids = json::array();
+		for (size_t i = 1; i <= lod_nodes.size(); ++i) {
+			ids.push_back(nodes_.count + i);
+		}
+		node["extensions"]["MSFT_lod"]["ids"] = ids;
 	}
 
-	node["mesh"] = current_mesh_index;
-	json_["nodes"].push_back(node);
+	scene_nodes_.push_back(nodes_.count);
+	nodes_.append(node);
+	for (auto& n : lod_nodes) {
+		nodes_.append(n);
+	}
 }
 
 template <uint32_t>
@@ -304,48 +500,188 @@ void write_block(std::ostream& fs, It begin, It end) {
 	write_padding<iden>(fs, N);
 }
 
+namespace {
+	void copy_file(std::ostream& os, const std::string& fn) {
+		std::ifstream ifs(IfcUtil::path::from_utf8(fn).c_str(), std::ios::binary);
+		os << ifs.rdbuf();
+	}
+
+	// Copies the nodes written by temp_stream::append() with their matrices translated
+	// by offset. The translation is composed in double precision, so that the matrices
+	// in the output do not contain the large coordinates of a georeferenced model.
+	void copy_nodes_with_offset(std::ostream& os, const std::string& fn, const std::array<double, 3>& offset) {
+		static const std::array<double, 16> identity_matrix = {1,0,0,0,0,1,0,0,0,0,1,0,0,0,0,1};
+		// nb: the Y-UP transform as in the node matrices
+		const std::array<double, 3> translation = { offset[0], offset[2], -offset[1] };
+
+		std::ifstream ifs(IfcUtil::path::from_utf8(fn).c_str(), std::ios::binary);
+		std::string line;
+		bool first = true;
+		while (std::getline(ifs, line)) {
+			if (!line.empty() && line.back() == ',') {
+				line.pop_back();
+			}
+			json node = json::parse(line);
+
+			std::array<double, 16> matrix_flat = identity_matrix;
+			if (node.count("matrix")) {
+				for (size_t i = 0; i < 16; ++i) {
+					matrix_flat[i] = node["matrix"][i].get<double>();
+				}
+			}
+			for (size_t i = 0; i < 3; ++i) {
+				matrix_flat[12 + i] += translation[i];
+			}
+			if (matrix_flat != identity_matrix) {
+				node["matrix"] = matrix_flat;
+			} else {
+				node.erase("matrix");
+			}
+
+			if (!first) {
+				os.put(',');
+			}
+			first = false;
+			os << node.dump();
+		}
+	}
+}
+
 void GltfSerializer::finalize() {
-	tmp_fstream1_.close();
-	tmp_fstream2_.close();
+	for (auto* ts : { &accessors_, &meshes_, &nodes_, &indices_, &positions_, &normals_ }) {
+		if (ts->vertex_encoder) {
+			ts->vertex_encoder->finalize();
+		}
+		if (ts->index_encoder) {
+			ts->index_encoder->finalize();
+		}
+		ts->stream.close();
+	}
 
-	std::vector<char> binary_contents;
-	// nb: uint32_t is the max buffer size in glTF
-	uint32_t indices_length, binary_length;
-	{
-		std::ifstream ifs(IfcUtil::path::from_utf8(tmp_filename1_).c_str(), std::ios::binary);
-		ifs.ignore(std::numeric_limits<std::streamsize>::max());
-		indices_length = ifs.gcount();
+	std::vector<temp_stream*> views;
+	for (auto* ts : { &indices_, &positions_, &normals_ }) {
+		if (ts->view != -1) {
+			views.push_back(ts);
+		}
 	}
-	{
-		std::ifstream ifs(IfcUtil::path::from_utf8(tmp_filename2_).c_str(), std::ios::binary);
-		ifs.ignore(std::numeric_limits<std::streamsize>::max());
-		binary_length = indices_length + ifs.gcount();
+	std::sort(views.begin(), views.end(), [](temp_stream* a, temp_stream* b) {
+		return a->view < b->view;
+	});
+
+	// The remainder of the JSON document is small and assembled in memory. The
+	// accessors, meshes and nodes are copied from the temporary files.
+	json doc;
+	doc["asset"]["generator"] = "IfcOpenShell IfcConvert " IFCOPENSHELL_VERSION;
+	doc["asset"]["version"] = "2.0";
+	doc["scene"] = 0;
+	if (!materials_array_.empty()) {
+		doc["materials"] = materials_array_;
 	}
 
-	json scene_0;
-	scene_0["nodes"] = node_array_;
-	json_["scenes"].push_back(scene_0);
-	json_["bufferViews"].push_back({ {"buffer", 0}, { "byteLength", indices_length } });
-	json_["bufferViews"].push_back({ {"buffer", 0}, {"byteStride", 12}, { "byteOffset", indices_length },  { "byteLength", binary_length - indices_length } });
-	json_["buffers"].push_back({ {"byteLength", binary_length} });
+	std::vector<std::string> extensions;
+	if (quantize_ && !views.empty()) {
+		extensions.push_back("KHR_mesh_quantization");
+	}
+	if (compress_ && !views.empty()) {
+		extensions.push_back("EXT_meshopt_compression");
+	}
+	if (!extensions.empty()) {
+		doc["extensionsUsed"] = extensions;
+		doc["extensionsRequired"] = extensions;
+	}
+	if (has_lods_) {
+		// Viewers without support for MSFT_lod display the full detail meshes
+		doc["extensionsUsed"].push_back("MSFT_lod");
+	}
 
-	std::string json_contents = json_.dump();
-	uint32_t json_length = (uint32_t) json_contents.size();
+	// nb: uint32_t is the max buffer size in glTF
+	uint32_t binary_length = 0, uncompressed_length = 0;
+	for (auto* ts : views) {
+		json view = {
+			{ "buffer", compress_ ? 1 : 0 },
+			{ "byteOffset", compress_ ? uncompressed_length : binary_length },
+			{ "byteLength", ts->length }
+		};
+		if (ts == &indices_) {
+			view["target"] = TARGET_ELEMENT_ARRAY_BUFFER;
+		} else {
+			view["target"] = TARGET_ARRAY_BUFFER;
+			view["byteStride"] = ts->length / ts->count;
+		}
+		if (compress_) {
+			// Decoders write the uncompressed data into the fallback buffer,
+			// which has no contents of its own.
+			view["extensions"]["EXT_meshopt_compression"] = {
+				{ "buffer", 0 },
+				{ "byteOffset", binary_length },
+				{ "byteLength", ts->output_length() },
+				{ "byteStride", ts->length / ts->count },
+				{ "count", ts->count },
+				{ "mode", ts == &indices_ ? "INDICES" : "ATTRIBUTES" }
+			};
+		}
+		doc["bufferViews"].push_back(view);
+		binary_length += ts->output_length() + padding_for(ts->output_length());
+		uncompressed_length += ts->length + padding_for(ts->length);
+	}
+	if (binary_length) {
+		doc["buffers"].push_back({ { "byteLength", binary_length } });
+		if (compress_) {
+			doc["buffers"].push_back({ { "byteLength", uncompressed_length }, { "extensions", { { "EXT_meshopt_compression", { { "fallback", true } } } } } });
+		}
+	}
 
-	uint32_t header[] = { GLTF, 2U, 12 + 8 + json_length + padding_for(json_length) + 8 + binary_length + padding_for(binary_length) };
+	// Reserve space for the GLB header and the header of the JSON chunk, which
+	// are written after the length of the JSON contents is known.
+	uint32_t header[] = { GLTF, 2U, 0, 0, JSON };
 	fstream_.write((const char*)header, sizeof(header));
 
-	write_block<JSON>(fstream_, json_contents.begin(), json_contents.end());
-	write_header<BIN>(fstream_, binary_length);
-	{
-		std::ifstream ifs(IfcUtil::path::from_utf8(tmp_filename1_).c_str(), std::ios::binary);
-		fstream_ << ifs.rdbuf();
+	const std::streampos json_begin = fstream_.tellp();
+	fstream_.put('{');
+	for (auto& p : std::initializer_list<std::pair<const char*, temp_stream*>>{ { "accessors", &accessors_ }, { "meshes", &meshes_ }, { "nodes", &nodes_ } }) {
+		if (p.second->count) {
+			fstream_ << "\"" << p.first << "\":[";
+			if (p.second == &nodes_ && deferred_offset_) {
+				copy_nodes_with_offset(fstream_, nodes_.filename, *deferred_offset_);
+			} else {
+				copy_file(fstream_, p.second->filename);
+			}
+			fstream_ << "],";
+		}
+	}
+	fstream_ << "\"scenes\":[{";
+	if (!scene_nodes_.empty()) {
+		fstream_ << "\"nodes\":[";
+		for (size_t i = 0; i < scene_nodes_.size(); ++i) {
+			if (i) {
+				fstream_.put(',');
+			}
+			fstream_ << scene_nodes_[i];
+		}
+		fstream_ << "]";
 	}
-	{
-		std::ifstream ifs(IfcUtil::path::from_utf8(tmp_filename2_).c_str(), std::ios::binary);
-		fstream_ << ifs.rdbuf();
+	fstream_ << "}],";
+	const std::string json_remainder = doc.dump();
+	fstream_.write(json_remainder.data() + 1, json_remainder.size() - 1);
+	const uint32_t json_length = (uint32_t) (fstream_.tellp() - json_begin);
+	write_padding<JSON>(fstream_, json_length);
+
+	uint32_t total_length = 12 + 8 + json_length + padding_for(json_length);
+
+	if (binary_length) {
+		write_header<BIN>(fstream_, binary_length);
+		for (auto* ts : views) {
+			copy_file(fstream_, ts->filename);
+			write_padding<BIN>(fstream_, (uint32_t) ts->output_length());
+		}
+		total_length += 8 + binary_length;
 	}
-	write_padding<BIN>(fstream_, binary_length);
+
+	header[2] = total_length;
+	header[3] = json_length + padding_for(json_length);
+	fstream_.seekp(0);
+	fstream_.write((const char*)header, sizeof(header));
+	fstream_.close();
 }
 
 #endif
@@ -26,18 +26,71 @@
 #include "../ifcgeom_schema_agnostic/GeometrySerializer.h"
 
 #include <nlohmann/json.hpp>
+#include <boost/optional.hpp>
 using json = nlohmann::json;
 
+#include <array>
+#include <fstream>
 #include <map>
+#include <memory>
+#include <vector>
+
+namespace mesh_optimizer {
+	class vertex_encoder;
+	class index_encoder;
+}
 
 class SERIALIZERS_API GltfSerializer : public WriteOnlyGeometrySerializer {
 private:
-	std::string filename_, tmp_filename1_, tmp_filename2_;
-	std::ofstream fstream_, tmp_fstream1_, tmp_fstream2_;
-	std::map<std::string, int> materials_, meshes_;
-	json json_, node_array_;
+	// Temporary file with a section of the output that is assembled in finalize().
+	// JSON arrays and binary buffer views are streamed to disk so that memory use
+	// does not grow with the size of the model.
+	class temp_stream {
+	public:
+		std::string filename;
+		std::ofstream stream;
+		/// Number of elements written, array entries or vertex attributes.
+		size_t count;
+		/// Number of uncompressed bytes written.
+		size_t length;
+		/// Index of the bufferView, assigned upon first use.
+		int view;
+		std::unique_ptr<mesh_optimizer::vertex_encoder> vertex_encoder;
+		std::unique_ptr<mesh_optimizer::index_encoder> index_encoder;
+
+		temp_stream(const std::string& filename);
+		~temp_stream();
+		/// Appends a value to the JSON array section.
+		void append(const json& j);
+		/// Number of bytes in the output, which differs from length when compressed.
+		size_t output_length() const;
+	};
+
+	struct mesh_info {
+		int index;
+		// Dequantization transform of positions: p = offset + scale * q
+		double scale;
+		std::array<double, 3> offset;
+	};
+
+	std::string filename_;
+	std::ofstream fstream_;
+	bool quantize_, compress_;
+	temp_stream accessors_, meshes_, nodes_, indices_, positions_, normals_;
+	std::map<std::string, int> materials_;
+	std::map<std::string, mesh_info> mesh_infos_;
+	json materials_array_;
+	int num_views_;
+	// Translation that is applied to the node matrices in finalize(), if any
+	boost::optional<std::array<double, 3>> deferred_offset_;
+	// Nodes of the full detail meshes, the nodes of other levels of detail are not in the scene
+	std::vector<size_t> scene_nodes_;
+	bool has_lods_;
 
 	int writeMaterial(const IfcGeom::Material& style);
+	mesh_info writeMesh(const IfcGeom::Representation::Triangulation& geom);
+	template <size_t N, typename T>
+	int writeAccessor(temp_stream& ts, const std::vector<T>& data, bool normalized = false, bool min_max = false);
 public:
 	GltfSerializer(const std::string& filename, const SerializerSettings& settings);
 	virtual ~GltfSerializer();
@@ -49,6 +102,9 @@ public:
 	bool isTesselated() const { return true; }
 	void setUnitNameAndMagnitude(const std::string& /*name*/, float /*magnitude*/) {}
 	void setFile(IfcParse::IfcFile*) {}
+	// Vertices in world coordinates are not affected by the node matrices
+	bool supportsDeferredOffset() const { return !settings().get(SerializerSettings::USE_WORLD_COORDS); }
+	void setDeferredOffset(const std::array<double, 3>& offset) { deferred_offset_ = offset; }
 };
 
 #endif
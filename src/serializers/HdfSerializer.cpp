@@ -24,11 +24,14 @@
 #include "../ifcgeom_schema_agnostic/IfcGeomRenderStyles.h"
 
 #include "../ifcparse/utils.h"
+#include "../ifcparse/IfcLogger.h"
 
 #include <BRepTools_ShapeSet.hxx>
 #include <BinTools_ShapeSet.hxx>
+#include <Standard_Failure.hxx>
 #include <boost/lexical_cast.hpp>
 
+#include <cstring>
 #include <iomanip>
 #include <numeric>
 #include <functional>
@@ -97,6 +100,160 @@ HdfSerializer::HdfSerializer(const std::string& hdf_filename, const SerializerSe
 	compound.insertMember("matrix", HOFFSET(brep_element, matrix), double4x4);
 	compound.insertMember("shape_serialization", HOFFSET(brep_element, shape_serialization), shape_type);
 	compound.insertMember("surface_style_id", HOFFSET(brep_element, surface_style), style_compound);
+
+	if (!read_only) {
+		writer_ = std::thread(&HdfSerializer::writer_loop, this);
+	}
+}
+
+HdfSerializer::~HdfSerializer() {
+	if (writer_.joinable()) {
+		{
+			std::lock_guard<std::mutex> lk(queue_mutex_);
+			stop_writer_ = true;
+		}
+		queue_cv_.notify_all();
+		writer_.join();
+	}
+}
+
+void HdfSerializer::flush() {
+	if (!writer_.joinable()) {
+		return;
+	}
+	std::unique_lock<std::mutex> lk(queue_mutex_);
+	queue_empty_cv_.wait(lk, [this]() { return write_queue_.empty() && write_batch_.empty(); });
+}
+
+void HdfSerializer::enqueue(write_task&& task) {
+	if (!writer_.joinable()) {
+		// Opened read-only
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lk(queue_mutex_);
+		write_queue_.push_back(std::move(task));
+	}
+	queue_cv_.notify_one();
+}
+
+void HdfSerializer::enqueue(const std::string& key, const IfcGeom::BRepElement* o) {
+	// The element is owned by the caller and typically deleted before the write is
+	// performed, a shallow copy shares the (immutable) geometry.
+	write_task task;
+	task.key = key;
+	task.is_brep = true;
+	task.element.reset(new IfcGeom::BRepElement(
+		o->id(), o->parent_id(), o->name(), o->type(), o->guid(), o->context(),
+		o->transformation().data(), o->geometry_pointer(), o->product()));
+	enqueue(std::move(task));
+}
+
+void HdfSerializer::enqueue(const std::string& key, const IfcGeom::TriangulationElement* o) {
+	write_task task;
+	task.key = key;
+	task.is_brep = false;
+	task.element.reset(new IfcGeom::TriangulationElement(*o, o->geometry_pointer()));
+	enqueue(std::move(task));
+}
+
+void HdfSerializer::write_task_(const write_task& task) {
+	const std::string& group_name = task.key.empty() ? task.element->guid() : task.key;
+	try {
+		std::lock_guard<std::mutex> lk(h5_mutex_);
+		if (!task.key.empty() && H5Lexists(file.getId(), task.key.c_str(), H5P_DEFAULT)) {
+			// Content addressed entries are never overwritten, identical keys imply identical geometry
+			if (task.is_brep) {
+				return;
+			}
+			auto element_group = file.openGroup(task.key);
+			if (H5Lexists(element_group.getId(), task.key.c_str(), H5P_DEFAULT)) {
+				auto representation_group = element_group.openGroup(task.key);
+				if (H5Lexists(representation_group.getId(), GROUP_NAME_MESH.c_str(), H5P_DEFAULT)) {
+					return;
+				}
+			}
+		}
+		auto element_group = writeElementGroup(task.element.get(), group_name);
+		if (task.is_brep) {
+			writeBRep(element_group, static_cast<IfcGeom::BRepElement*>(task.element.get()));
+		} else {
+			writeTriangulation(element_group, static_cast<IfcGeom::TriangulationElement*>(task.element.get()));
+		}
+	} catch (const H5::Exception& e) {
+		Logger::Error("Failed to write " + group_name + " to cache: " + e.getDetailMsg());
+	} catch (const std::exception& e) {
+		Logger::Error("Failed to write " + group_name + " to cache: " + e.what());
+	} catch (const Standard_Failure& e) {
+		if (e.GetMessageString() && strlen(e.GetMessageString())) {
+			Logger::Error("Failed to write " + group_name + " to cache: " + e.GetMessageString());
+		} else {
+			Logger::Error("Failed to write " + group_name + " to cache");
+		}
+	} catch (...) {
+		Logger::Error("Failed to write " + group_name + " to cache");
+	}
+}
+
+void HdfSerializer::writer_loop() {
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lk(queue_mutex_);
+			queue_empty_cv_.notify_all();
+			queue_cv_.wait(lk, [this]() { return stop_writer_ || !write_queue_.empty(); });
+			if (write_queue_.empty()) {
+				// stop_writer_ is set and all writes have been committed
+				return;
+			}
+			write_batch_.swap(write_queue_);
+		}
+
+		for (;;) {
+			// The front task stays in the batch while being written, so that it
+			// can be found by read_pending(). Only this thread removes tasks.
+			const write_task* task;
+			{
+				std::lock_guard<std::mutex> lk(queue_mutex_);
+				if (write_batch_.empty()) {
+					break;
+				}
+				task = &write_batch_.front();
+			}
+			while (readers_waiting_ > 0) {
+				std::this_thread::yield();
+			}
+			write_task_(*task);
+			std::lock_guard<std::mutex> lk(queue_mutex_);
+			write_batch_.pop_front();
+		}
+	}
+}
+
+IfcGeom::Element* HdfSerializer::read_pending(const std::string& guid, const std::string& representation_id, read_type rt) {
+	std::lock_guard<std::mutex> lk(queue_mutex_);
+	// The most recently queued task is the one that would end up in the file
+	for (auto* queue : { &write_queue_, &write_batch_ }) {
+		for (auto it = queue->rbegin(); it != queue->rend(); ++it) {
+			const write_task& task = *it;
+			if (task.is_brep != (rt == READ_BREP) || (task.key.empty() ? task.element->guid() : task.key) != guid) {
+				continue;
+			}
+			if (task.is_brep) {
+				auto o = static_cast<const IfcGeom::BRepElement*>(task.element.get());
+				if (o->geometry().id() == representation_id) {
+					return new IfcGeom::BRepElement(
+						o->id(), o->parent_id(), o->name(), o->type(), o->guid(), o->context(),
+						o->transformation().data(), o->geometry_pointer(), o->product());
+				}
+			} else {
+				auto o = static_cast<const IfcGeom::TriangulationElement*>(task.element.get());
+				if (o->geometry().id() == representation_id) {
+					return new IfcGeom::TriangulationElement(*o, o->geometry_pointer());
+				}
+			}
+		}
+	}
+	return nullptr;
 }
 
 bool HdfSerializer::ready() {
@@ -260,12 +417,22 @@ void HdfSerializer::read_surface_style(surface_style_serialization& s, std::shar
 }
 
 void HdfSerializer::remove(const std::string& guid) {
+	flush();
+	std::lock_guard<std::mutex> lk(h5_mutex_);
 	if (H5Lexists(file.getId(), guid.c_str(), H5P_DEFAULT)) {
 		file.unlink(guid);
 	}
 }
 
 IfcGeom::Element* HdfSerializer::read(IfcParse::IfcFile& f, const std::string& guid, const std::string& representation_id_str, read_type rt) {
+	if (auto pending = read_pending(guid, representation_id_str, rt)) {
+		return pending;
+	}
+
+	++readers_waiting_;
+	std::lock_guard<std::mutex> lk(h5_mutex_);
+	--readers_waiting_;
+
 	if (!H5Lexists(file.getId(), guid.c_str(), H5P_DEFAULT)) {
 		return nullptr;
 	}
@@ -281,6 +448,7 @@ IfcGeom::Element* HdfSerializer::read(IfcParse::IfcFile& f, const std::string& g
 	std::string name = read_scalar_attribute<std::string>(element_group, "name");
 	std::string context = read_scalar_attribute<std::string>(element_group, "context");
 	std::string unique_id = read_scalar_attribute<std::string>(element_group, "unique_id");
+	std::string stored_guid = read_scalar_attribute<std::string>(element_group, "guid");
 
 	gp_Trsf trsf;
 	auto placeds = element_group.openDataSet(DATASET_NAME_PLACEMENT);
@@ -296,7 +464,13 @@ IfcGeom::Element* HdfSerializer::read(IfcParse::IfcFile& f, const std::string& g
 	std::string geom_id = read_scalar_attribute<std::string>(representation_group, "geom_id");
 
 	IfcGeom::ElementSettings element_settings(settings_, f.getUnit("LENGTHUNIT").second, type);
-	auto inst = f.instance_by_id(id)->as<IfcUtil::IfcBaseEntity>();
+
+	// Content addressed entries may have been written for a product in a different
+	// revision of the model, the caller substitutes the element attributes.
+	IfcUtil::IfcBaseEntity* inst = nullptr;
+	try {
+		inst = f.instance_by_id(id)->as<IfcUtil::IfcBaseEntity>();
+	} catch (IfcParse::IfcException&) {}
 
 	boost::shared_ptr<IfcGeom::Representation::BRep> brep_geometry;
 	boost::shared_ptr<IfcGeom::Representation::Triangulation> triangulation_geometry;
@@ -319,11 +493,13 @@ IfcGeom::Element* HdfSerializer::read(IfcParse::IfcFile& f, const std::string& g
 		static const auto ignored_settings =
 			// Settings that do not affect storage of brep data
 			IfcGeom::IteratorSettings::DISABLE_TRIANGULATION | IfcGeom::IteratorSettings::USE_BREP_DATA |
+			IfcGeom::IteratorSettings::CACHE_BY_CONTENT | IfcGeom::IteratorSettings::BUDGET_FALLBACK |
 			// Settings that affect which representation is considered, but cache does not need to be complete
 			IfcGeom::IteratorSettings::INCLUDE_CURVES | IfcGeom::IteratorSettings::EXCLUDE_SOLIDS_AND_SURFACES |
 			// Only affects triangulation
 			IfcGeom::IteratorSettings::WELD_VERTICES | IfcGeom::IteratorSettings::NO_NORMALS |
 			IfcGeom::IteratorSettings::GENERATE_UVS | IfcGeom::IteratorSettings::EDGE_ARROWS |
+			IfcGeom::IteratorSettings::RELATIVE_DEFLECTION | IfcGeom::IteratorSettings::TRIANGULATE_PLANAR_FACES |
 			// Is applied in the serializer
 			IfcGeom::IteratorSettings::ELEMENT_HIERARCHY;
 		
@@ -478,7 +654,7 @@ IfcGeom::Element* HdfSerializer::read(IfcParse::IfcFile& f, const std::string& g
 	}
 
 	if (rt == READ_BREP) {
-		return new IfcGeom::BRepElement(id, parent_id, name, type, guid, context, trsf, brep_geometry, inst);
+		return new IfcGeom::BRepElement(id, parent_id, name, type, stored_guid, context, trsf, brep_geometry, inst);
 	} else {
 		return new IfcGeom::TriangulationElement(
 			IfcGeom::Element(
@@ -487,7 +663,7 @@ IfcGeom::Element* HdfSerializer::read(IfcParse::IfcFile& f, const std::string& g
 				parent_id,
 				name,
 				type,
-				guid,
+				stored_guid,
 				context,
 				trsf,
 				inst
@@ -513,11 +689,17 @@ namespace {
 }
 
 H5::Group HdfSerializer::write(const IfcGeom::Element* o) {
+	flush();
+	std::lock_guard<std::mutex> lk(h5_mutex_);
+	return writeElementGroup(o, o->guid());
+}
+
+H5::Group HdfSerializer::writeElementGroup(const IfcGeom::Element* o, const std::string& group_name) {
 	try {
-		return file.openGroup(o->guid());
+		return file.openGroup(group_name);
 	} catch (H5::Exception&) {}
 
-	H5::Group element_group = file.createGroup(o->guid());
+	H5::Group element_group = file.createGroup(group_name);
 
 	typedef std::string const & (IfcGeom::Element::*string_member_fun)(void) const;
 	typedef int (IfcGeom::Element::*int_member_fun)(void) const;
@@ -612,9 +794,15 @@ void HdfSerializer::write_style(surface_style_serialization& data, const IfcGeom
 
 
 void HdfSerializer::write(const IfcGeom::BRepElement* o) {
-	static auto nan = std::numeric_limits<double>::quiet_NaN();
+	enqueue("", o);
+}
 
-	auto element_group = write((const IfcGeom::Element*)o);
+void HdfSerializer::write_by_key(const std::string& key, const IfcGeom::BRepElement* o) {
+	enqueue(key, o);
+}
+
+void HdfSerializer::writeBRep(H5::Group& element_group, const IfcGeom::BRepElement* o) {
+	static auto nan = std::numeric_limits<double>::quiet_NaN();
 
 	auto it = group_cache_.find(o->geometry().id());
 	if (it != group_cache_.end()) {
@@ -674,21 +862,53 @@ void HdfSerializer::write(const IfcGeom::BRepElement* o) {
 
 namespace {
 
+	// Datasets up to this size are stored in the object header of the dataset
+	const size_t COMPACT_DATASET_MAX_BYTES = 4096;
+	// Larger datasets are chunked and compressed
+	const hsize_t CHUNK_ROWS = 4096;
+	const int DEFLATE_LEVEL = 4;
+
 	template <typename T>
 	void write_dataset(const H5::Group& group, const std::string& name, const std::vector<T>& ts, size_t stride) {
 		hsize_t d[2]{ ts.size() / stride, stride };
-		H5::DataSpace dataspace(stride == 1 ? 1 : 2, d);
+		const int rank = stride == 1 ? 1 : 2;
+		H5::DataSpace dataspace(rank, d);
 		auto dt = h5_datatype_for_cpp<T>();
 
-		auto ds = group.createDataSet(name, dt, dataspace);
+		H5::DSetCreatPropList plist;
+		const size_t num_bytes = ts.size() * sizeof(T);
+		if (num_bytes == 0) {
+			// Default contiguous layout, nothing is allocated
+		} else if (num_bytes <= COMPACT_DATASET_MAX_BYTES) {
+			// Avoids a separate allocation in the file for the many small meshes
+			plist.setLayout(H5D_COMPACT);
+		} else {
+			hsize_t chunk[2]{ (std::min)(d[0], CHUNK_ROWS), stride };
+			plist.setChunk(rank, chunk);
+			// Byte shuffling groups the similar exponent bytes of coordinates
+			// and the high bytes of indices, which greatly improves compression
+			plist.setShuffle();
+			static const bool deflate_available = H5Zfilter_avail(H5Z_FILTER_DEFLATE) > 0;
+			if (deflate_available) {
+				plist.setDeflate(DEFLATE_LEVEL);
+			}
+		}
+
+		auto ds = group.createDataSet(name, dt, dataspace, plist);
 		ds.write(ts.data(), dt);
 	}
 
 }
 
 void HdfSerializer::write(const IfcGeom::TriangulationElement* o) {
-	auto element_group = write((const IfcGeom::Element*)o);
+	enqueue("", o);
+}
+
+void HdfSerializer::write_by_key(const std::string& key, const IfcGeom::TriangulationElement* o) {
+	enqueue(key, o);
+}
 
+void HdfSerializer::writeTriangulation(H5::Group& element_group, const IfcGeom::TriangulationElement* o) {
 	const auto& mesh = o->geometry();
 	H5::Group representation_group = createRepresentationGroup(element_group, o->geometry().id());
 	H5::Group meshGroup = representation_group.createGroup(GROUP_NAME_MESH);
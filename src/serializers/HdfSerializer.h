@@ -23,8 +23,14 @@
 #ifdef WITH_HDF5
 
 #include <set>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <memory>
 #include <string>
+#include <thread>
 #include <fstream>
+#include <condition_variable>
 
 #include "H5Cpp.h"
 
@@ -83,28 +89,70 @@ private:
 
 private:
 
+	// The HDF5 library is not reentrant, all calls into it, as well as the
+	// caches below, are guarded by this mutex.
+	std::mutex h5_mutex_;
+	// Number of calls to read() waiting for the HDF5 mutex. The writer does not
+	// start writing the next element while reads are waiting, so that a cache
+	// hit waits for at most a single element write.
+	std::atomic<int> readers_waiting_{0};
+
+	// Writes are performed in batches on a dedicated thread so that conversion
+	// threads only wait for the HDF5 library when reading from the cache. The
+	// HDF5 mutex is taken per element, so that reads are interleaved with the
+	// writes of a batch. Elements that are not yet committed to file are read
+	// from the queued tasks. No writer is started when opened read-only.
+	struct write_task {
+		// Empty when stored under the element GlobalId
+		std::string key;
+		std::unique_ptr<IfcGeom::Element> element;
+		bool is_brep;
+	};
+
+	// Tasks not yet picked up by the writer and the batch being written
+	std::deque<write_task> write_queue_, write_batch_;
+	std::mutex queue_mutex_;
+	std::condition_variable queue_cv_, queue_empty_cv_;
+	bool stop_writer_ = false;
+	std::thread writer_;
+
+	void enqueue(write_task&& task);
+	void enqueue(const std::string& key, const IfcGeom::BRepElement* o);
+	void enqueue(const std::string& key, const IfcGeom::TriangulationElement* o);
+	void write_task_(const write_task& task);
+	void writer_loop();
+	IfcGeom::Element* read_pending(const std::string& guid, const std::string& representation_id, read_type rt);
+
 	std::map<std::string, boost::shared_ptr<IfcGeom::Representation::BRep>> brep_cache_;
 	std::map<std::string, boost::shared_ptr<IfcGeom::Representation::Triangulation>> triangulation_cache_;
 	std::map<std::string, std::string> group_cache_;
 
 	H5::Group createRepresentationGroup(const H5::Group& element_group, const std::string& gid);
+	H5::Group writeElementGroup(const IfcGeom::Element* o, const std::string& group_name);
+	void writeBRep(H5::Group& element_group, const IfcGeom::BRepElement* o);
+	void writeTriangulation(H5::Group& element_group, const IfcGeom::TriangulationElement* o);
 	void read_surface_style(surface_style_serialization& sss, std::shared_ptr<IfcGeom::SurfaceStyle>& style_ptr);
 	void write_style(surface_style_serialization& data, const IfcGeom::SurfaceStyle& s);
 
 public:
 	HdfSerializer(const std::string& hdf_filename, const SerializerSettings& settings, bool read_only=false);
-	virtual ~HdfSerializer() {}
+	virtual ~HdfSerializer();
 	bool ready();
 	void writeHeader();
 
 	H5::Group write(const IfcGeom::Element* o);
 	void write(const IfcGeom::BRepElement* o);
 	void write(const IfcGeom::TriangulationElement* o);
+	void write_by_key(const std::string& key, const IfcGeom::BRepElement* o);
+	void write_by_key(const std::string& key, const IfcGeom::TriangulationElement* o);
 	void remove(const std::string& guid);
 
 	IfcGeom::Element* read(IfcParse::IfcFile& f, const std::string& guid, const std::string&, read_type rt = READ_BREP);
 	
-	void finalize() {}
+	/// Blocks until all queued writes have been committed to file
+	void flush();
+
+	void finalize() { flush(); }
 	bool isTesselated() const { return false; }
 	void setUnitNameAndMagnitude(const std::string& /*name*/, float /*magnitude*/) {}
 	void setFile(IfcParse::IfcFile*) {}
@@ -27,6 +27,10 @@
 #include <limits>
 #include <algorithm>
 #include <numeric>
+#include <atomic>
+#include <thread>
+#include <exception>
+#include <memory>
 
 #include <gp_Pln.hxx>
 #include <gp_Trsf.hxx>
@@ -75,9 +79,14 @@
 
 #include <HLRBRep_PolyHLRToShape.hxx>
 
+#include <BRepMesh_IncrementalMesh.hxx>
+#include <BRepBuilderAPI_Copy.hxx>
+#include <Poly_Triangulation.hxx>
+
 #include <Extrema_ExtPElS.hxx>
 
 #include "../ifcparse/IfcGlobalId.h"
+#include "../ifcgeom_schema_agnostic/mesh_utils.h"
 
 #include <boost/format.hpp>
 #include <boost/tokenizer.hpp>
@@ -352,6 +361,87 @@ void SvgSerializer::write(path_object& p, const TopoDS_Shape& comp_or_wire, boos
 	p.second.push_back(path);
 }
 
+namespace {
+	// Merges the triangulations of the faces, which do not share nodes, into a
+	// single mesh so that it can be sliced into closed polylines.
+	bool triangulation_to_mesh(const TopoDS_Shape& shape, IfcGeom::util::mesh::triangle_mesh& m) {
+		IfcGeom::util::mesh::vertex_welder welder(m.vertices, Precision::Confusion());
+
+		TopExp_Explorer exp(shape, TopAbs_FACE);
+		for (; exp.More(); exp.Next()) {
+			const TopoDS_Face& face = TopoDS::Face(exp.Current());
+			TopLoc_Location loc;
+			Handle(Poly_Triangulation) tri = BRep_Tool::Triangulation(face, loc);
+			if (tri.IsNull()) {
+				return false;
+			}
+
+			std::vector<int> indices;
+			indices.reserve(tri->NbNodes());
+			for (int i = 1; i <= tri->NbNodes(); ++i) {
+				const gp_XYZ p = tri->Node(i).Transformed(loc).XYZ();
+				indices.push_back(welder.add(IfcGeom::util::mesh::point3{ p.X(), p.Y(), p.Z() }));
+			}
+
+			const Poly_Array1OfTriangle& triangles = tri->Triangles();
+			for (int i = 1; i <= triangles.Length(); ++i) {
+				int n1, n2, n3;
+				triangles(i).Get(n1, n2, n3);
+				std::array<int, 3> t = { indices[n1 - 1], indices[n2 - 1], indices[n3 - 1] };
+				if (t[0] != t[1] && t[1] != t[2] && t[0] != t[2]) {
+					m.triangles.push_back(t);
+				}
+			}
+		}
+
+		return !m.triangles.empty();
+	}
+}
+
+bool SvgSerializer::write_mesh_section(path_object& p, const TopoDS_Shape& shape, const gp_Pln& pln, const gp_Trsf& trsf) {
+	IfcGeom::util::mesh::triangle_mesh m;
+	if (!triangulation_to_mesh(shape, m)) {
+		return false;
+	}
+
+	const gp_Pnt& o = pln.Location();
+	const gp_Dir& n = pln.Axis().Direction();
+	auto polylines = IfcGeom::util::mesh::slice(m, { o.X(), o.Y(), o.Z() }, { n.X(), n.Y(), n.Z() });
+	if (polylines.empty()) {
+		return true;
+	}
+
+	util::string_buffer path;
+	bool first_polyline = true;
+
+	for (auto& polyline : polylines) {
+		bool first = true;
+		for (auto& q : polyline) {
+			gp_Pnt pnt(q[0], q[1], q[2]);
+			pnt.Transform(trsf);
+
+			if (first) {
+				path.add(first_polyline ? "            <path d=\"" : " ");
+				path.add("M");
+			} else {
+				path.add(" L");
+			}
+			addXCoordinate(path.add(pnt.X()));
+			path.add(",");
+			addYCoordinate(path.add(pnt.Y()));
+
+			growBoundingBox(pnt.X(), pnt.Y());
+
+			first = false;
+		}
+		first_polyline = false;
+	}
+
+	path.add("\"/>\n");
+	p.second.push_back(path);
+	return true;
+}
+
 SvgSerializer::path_object& SvgSerializer::start_path(const gp_Pln& pln, IfcUtil::IfcBaseEntity* storey, const std::string& id) {
 	auto key = std::make_pair(std::make_pair(storey, ""), path_object());
 	SvgSerializer::path_object& p = paths.insert(key)->second;
@@ -691,6 +781,13 @@ void SvgSerializer::write(const IfcGeom::BRepElement* brep_obj) {
 		return;
 	}
 
+	if (mesh_section_) {
+		// The triangulation is stored on a copy as the geometry can be shared
+		// with other elements.
+		compound_local = BRepBuilderAPI_Copy(compound_local).Shape();
+		BRepMesh_IncrementalMesh(compound_local, settings().deflection_tolerance(), false, settings().angular_tolerance());
+	}
+
 	auto p = storey_elevation_from_element(brep_obj);
 	IfcUtil::IfcBaseEntity* storey = p ? p->first : nullptr;
 	double elev = p ? p->second : std::numeric_limits<double>::quiet_NaN();
@@ -781,12 +878,16 @@ void SvgSerializer::write(const geometry_data& data) {
 
 	// SVG has a coordinate system with the origin in the *upper*-left corner
 	// therefore we mirror the shape along the XZ-plane.	
+	// The mirrored shape is only used on floor plans.
 	gp_Trsf trsf_mirror;
 	trsf_mirror.SetMirror(gp_Ax2(gp::Origin(), gp::DY()));
-	BRepBuilderAPI_Transform make_transform_mirror(compound_unmirrored, trsf_mirror, true);
-	make_transform_mirror.Build();
-	// (When determinant < 0, copy is implied and the input is not mutated.)
-	auto compound = make_transform_mirror.Shape();
+	BRepBuilderAPI_Transform make_transform_mirror(trsf_mirror);
+	TopoDS_Shape compound;
+	if (is_floor_plan_) {
+		make_transform_mirror.Perform(compound_unmirrored, true);
+		// (When determinant < 0, copy is implied and the input is not mutated.)
+		compound = make_transform_mirror.Shape();
+	}
 
 	TopoDS_Wire annotation;
 
@@ -1177,6 +1278,8 @@ void SvgSerializer::write(const geometry_data& data) {
 		}
 
 		TopoDS_Iterator it(compound_to_use);
+		// The untransformed components, in the same order, for slicing their triangulation
+		TopoDS_Iterator local_it(data.compound_local);
 		auto dash_it = data.dash_arrays.begin();
 
 		TopoDS_Face largest_closed_wire_face;
@@ -1184,7 +1287,7 @@ void SvgSerializer::write(const geometry_data& data) {
 		path_object* po = nullptr;
 
 		// Iterate over components of compound to have better chance of matching section edges to closed wires
-		for (; it.More(); it.Next(), ++dash_it) {
+		for (; it.More(); it.Next(), local_it.Next(), ++dash_it) {
 
 			const TopoDS_Shape& subshape = it.Value();
 
@@ -1387,6 +1490,29 @@ void SvgSerializer::write(const geometry_data& data) {
 				}
 			}
 
+			// Wires are needed for the space labels and storey height annotations
+			const bool requires_wires = data.product->declaration().is("IfcBuildingStorey") ||
+				((print_space_names_ || print_space_areas_) && data.product->declaration().is("IfcSpace"));
+
+			if (mesh_section_ && !requires_wires) {
+				// The plane is brought into element coordinates and the transformations
+				// that are applied to the section result below are applied to the points.
+				gp_Trsf to_plane = data.trsf;
+				if (is_floor_plan_) {
+					to_plane.PreMultiply(trsf_mirror);
+				}
+				gp_Trsf to_drawing = to_plane;
+				if (variant.which() == 2) {
+					gp_Trsf trsf;
+					trsf.SetTransformation(gp::XOY(), pln.Position());
+					to_drawing.PreMultiply(trsf);
+					to_drawing.PreMultiply(trsf_mirror);
+				}
+				if (write_mesh_section(*po, local_it.Value(), pln.Transformed(to_plane.Inverted()), to_drawing)) {
+					continue;
+				}
+			}
+
 			TopoDS_Shape result = BRepAlgoAPI_Section(subshape, pln);
 
 			if (variant.which() == 2) {
@@ -1775,56 +1901,102 @@ namespace {
 			return occt_join(hlr_shapes.OutLineVCompound(), hlr_shapes.VCompound());
 		}
 	};
+
+	// Calls fn(i) for i in [0, n) on at most num_threads threads. Exceptions are
+	// rethrown after all threads have finished, the one of the lowest i first.
+	template <typename Fn>
+	void parallel_for(size_t n, int num_threads, Fn fn) {
+		if (num_threads <= 1 || n <= 1) {
+			for (size_t i = 0; i < n; ++i) {
+				fn(i);
+			}
+			return;
+		}
+
+		std::vector<std::exception_ptr> errors(n);
+		std::atomic<size_t> next(0);
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < (std::min)(n, (size_t) num_threads); ++t) {
+			threads.emplace_back([&]() {
+				size_t i;
+				while ((i = next++) < n) {
+					try {
+						fn(i);
+					} catch (...) {
+						errors[i] = std::current_exception();
+					}
+				}
+			});
+		}
+		for (auto& t : threads) {
+			t.join();
+		}
+		for (auto& e : errors) {
+			if (e) {
+				std::rethrow_exception(e);
+			}
+		}
+	}
 }
 
-void SvgSerializer::draw_hlr(const gp_Pln& pln, const drawing_key& drawing_name) {
+TopoDS_Shape SvgSerializer::project_hlr(const gp_Pln& pln, const drawing_key& drawing_name, hlr_t& algo) {
 	gp_Trsf trsf;
 	trsf.SetTransformation(pln.Position());
 	HLRAlgo_Projector projector(trsf, false, 1.);
 
 	hlr_calc vis(projector);
-	TopoDS_Shape hlr_compound_unmirrored = boost::apply_visitor(vis, drawing_name.first ? this->storey_hlr[drawing_name.first] : hlr);
+	TopoDS_Shape hlr_compound_unmirrored = boost::apply_visitor(vis, algo);
 
-	if (!hlr_compound_unmirrored.IsNull()) {
-		// Compound 3D curves for mirroring to work
-		ShapeFix_Edge sfe;
-		TopExp_Explorer exp(hlr_compound_unmirrored, TopAbs_EDGE);
-		for (; exp.More(); exp.Next()) {
-			sfe.FixAddCurve3d(TopoDS::Edge(exp.Current()));
-		}
+	if (hlr_compound_unmirrored.IsNull()) {
+		return hlr_compound_unmirrored;
+	}
 
-		// Mirror to match SVG coord system.
-		// @todo this is very wasteful. We better do the Y-mirror in the SVG writing and
-		// not on the TopoDS_Shape input.
+	// Compound 3D curves for mirroring to work
+	ShapeFix_Edge sfe;
+	TopExp_Explorer exp(hlr_compound_unmirrored, TopAbs_EDGE);
+	for (; exp.More(); exp.Next()) {
+		sfe.FixAddCurve3d(TopoDS::Edge(exp.Current()));
+	}
 
-		TopoDS_Shape hlr_compound;
-		if (drawing_name.first == nullptr) {
-			gp_Trsf trsf_mirror;
-			trsf_mirror.SetMirror(gp_Ax2(gp::Origin(), gp::DY()));
-			BRepBuilderAPI_Transform make_transform_mirror(hlr_compound_unmirrored, trsf_mirror, true);
-			make_transform_mirror.Build();
-			hlr_compound = make_transform_mirror.Shape();
-		} else {
-			// In case of building storey-based floor plan the mirroring has already
-			// been taken into account before projection.
-			hlr_compound = hlr_compound_unmirrored;
-		}		
+	// Mirror to match SVG coord system.
+	// @todo this is very wasteful. We better do the Y-mirror in the SVG writing and
+	// not on the TopoDS_Shape input.
 
-		exp.Init(hlr_compound, TopAbs_EDGE);
-		BRep_Builder B;
-		path_object* po;
-		if (drawing_name.first) {
-			po = &start_path(pln, drawing_name.first, "class=\"projection\"");
-		} else {
-			po = &start_path(pln, drawing_name.second, "class=\"projection\"");
-		}
-		for (; exp.More(); exp.Next()) {
-			TopoDS_Wire w;
-			B.MakeWire(w);
-			B.Add(w, exp.Current());
-			write(*po, w);
-		}
+	if (drawing_name.first == nullptr) {
+		gp_Trsf trsf_mirror;
+		trsf_mirror.SetMirror(gp_Ax2(gp::Origin(), gp::DY()));
+		BRepBuilderAPI_Transform make_transform_mirror(hlr_compound_unmirrored, trsf_mirror, true);
+		make_transform_mirror.Build();
+		return make_transform_mirror.Shape();
+	} else {
+		// In case of building storey-based floor plan the mirroring has already
+		// been taken into account before projection.
+		return hlr_compound_unmirrored;
+	}
+}
+
+void SvgSerializer::draw_hlr(const gp_Pln& pln, const drawing_key& drawing_name) {
+	draw_hlr(pln, drawing_name, project_hlr(pln, drawing_name, drawing_name.first ? this->storey_hlr[drawing_name.first] : hlr));
+}
+
+void SvgSerializer::draw_hlr(const gp_Pln& pln, const drawing_key& drawing_name, const TopoDS_Shape& hlr_compound) {
+	if (hlr_compound.IsNull()) {
+		return;
+	}
 
+	TopExp_Explorer exp(hlr_compound, TopAbs_EDGE);
+	BRep_Builder B;
+	path_object* po;
+	if (drawing_name.first) {
+		po = &start_path(pln, drawing_name.first, "class=\"projection\"");
+	} else {
+		po = &start_path(pln, drawing_name.second, "class=\"projection\"");
+	}
+	for (; exp.More(); exp.Next()) {
+		TopoDS_Wire w;
+		B.MakeWire(w);
+		B.Add(w, exp.Current());
+		write(*po, w);
 	}
 }
 
@@ -1971,6 +2143,102 @@ void SvgSerializer::addTextAnnotations(const drawing_key& k) {
 	}
 }
 
+drawing_key SvgSerializer::draw_section(const section_data& sd, const std::list<geometry_data>& elements) {
+	bool use_hlr = true;
+	const gp_Pln* pln = nullptr;
+	std::string drawing_name;
+	if (sd.which() == 2) {
+		const auto& section = boost::get<vertical_section>(sd);
+		use_hlr = section.with_projection;
+		drawing_name = section.name;
+		pln = &section.plane;
+	}
+
+	if (use_hlr) {
+		if (use_hlr_poly_) {
+			hlr = new HLRBRep_PolyAlgo;
+		} else {
+			hlr = new HLRBRep_Algo;
+		}
+	}
+
+	section_data_ = std::vector<section_data>{ sd };
+	for (auto& e : elements) {
+		write(e);
+	}
+
+	if (use_hlr) {
+		const auto& section = boost::get<vertical_section>(sd);
+		const auto& ax = section.plane.Position();
+		
+		draw_hlr(ax, { nullptr, drawing_name });
+	}
+
+	addTextAnnotations({ nullptr, drawing_name });
+
+	if (file && storey_height_display_ != SH_NONE && pln && std::abs(pln->Position().Direction().Z()) < 1.e-5) {
+		auto storeys = file->instances_by_type("IfcBuildingStorey");
+		if (storeys) {
+			const double lu = file->getUnit("LENGTHUNIT").second;
+			for (auto& s : *storeys) {
+				auto storey = (IfcUtil::IfcBaseEntity*) s;
+				auto a = storey->get("Elevation");
+				if (!a->isNull()) {
+					double elev = *a;
+					elev *= lu;
+					auto svg_name = nameElement(storey);
+
+					gp_Pln elev_pln(gp_Ax3(gp_Pnt(0, 0, elev), gp::DZ(), gp::DX()));
+					//, pln->Position().XDirection()));
+					// auto ref_y = pln->Position().YDirection().XYZ().Dot(pln->Position().Location().XYZ());
+
+					double x0, y0, z0, x1, y1, z1;
+					bnd_.Get(x0, y0, z0, x1, y1, z1);
+
+					// @todo this is a hack in order to get the auto elevations (which are 0.1 offset from
+					// the global bounding box) to include the storey height symbols.
+					x0 -= 0.2;
+					y0 -= 0.2;
+					z0 -= 0.2;
+
+					x1 += 0.2;
+					y1 += 0.2;
+					z1 += 0.2;
+
+					const double shll = storey_height_line_length_.get_value_or(2.);
+
+					BRepBuilderAPI_MakeFace mf(elev_pln, x0 - shll, x1 + shll, y0 - shll, y1 + shll);
+					gp_Trsf trsf;
+					TopoDS_Compound C;
+					BRep_Builder B;
+					B.MakeCompound(C);
+					B.Add(C, mf.Face());
+					std::string name;
+					auto a2 = storey->get("Name");
+					if (!a2->isNull()) {
+						name = (std::string) *a2;
+					}
+					write(geometry_data{
+						C,{boost::none},trsf,storey,storey,elev,name,nameElement(storey)
+					});
+				}
+			}
+		}
+	}
+
+	auto m3 = resize();
+
+	auto k = std::make_pair(nullptr, drawing_name);
+	drawing_metadata[k].matrix_3 = m3;
+
+	resetScale();
+
+	// @todo does this probably call Nullify()
+	hlr = boost::blank();
+
+	return k;
+}
+
 void SvgSerializer::finalize() {
 	doWriteHeader();
 
@@ -1978,8 +2246,24 @@ void SvgSerializer::finalize() {
 		addTextAnnotations(p.first);
 	}
 
-	for (auto& p : storey_hlr) {
-		draw_hlr(drawing_metadata[{p.first, ""}].pln_3d, { p.first, "" });
+	{
+		// The storeys are projected concurrently, each has its own HLR algorithm,
+		// the projections are written in the order of the storeys.
+		std::vector<std::pair<drawing_key, gp_Pln>> storey_drawings;
+		std::vector<hlr_t*> storey_algos;
+		for (auto& p : storey_hlr) {
+			storey_drawings.push_back({ { p.first, "" }, drawing_metadata[{p.first, ""}].pln_3d });
+			storey_algos.push_back(&p.second);
+		}
+
+		std::vector<TopoDS_Shape> projections(storey_drawings.size());
+		parallel_for(storey_drawings.size(), num_threads_, [&](size_t i) {
+			projections[i] = project_hlr(storey_drawings[i].second, storey_drawings[i].first, *storey_algos[i]);
+		});
+
+		for (size_t i = 0; i < storey_drawings.size(); ++i) {
+			draw_hlr(storey_drawings[i].second, storey_drawings[i].first, projections[i]);
+		}
 	}
 
 	auto m = resize();
@@ -2050,99 +2334,45 @@ void SvgSerializer::finalize() {
 		// Draw door arcs only on floor plans.
 		is_floor_plan_ = false;
 
-		for (auto& sd : *deferred_section_data_) {
-			bool use_hlr = true;
-			const gp_Pln* pln = nullptr;
-			std::string drawing_name;
-			if (sd.which() == 2) {
-				const auto& section = boost::get<vertical_section>(sd);
-				use_hlr = section.with_projection;
-				drawing_name = section.name;
-				pln = &section.plane;
-			}
-
-			if (use_hlr) {
-				if (use_hlr_poly_) {
-					hlr = new HLRBRep_PolyAlgo;
-				} else {
-					hlr = new HLRBRep_Algo;
-				}
-			}
-
-			section_data_ = std::vector<section_data>{ sd };
-			for (auto& e : element_buffer_) {
-				write(e);
-			}
+		// Every drawing is generated by its own copy of this serializer, with its own
+		// HLR algorithm and paths, so that the drawings can be generated concurrently.
+		// The buffered elements and the paths written so far are moved out of the way
+		// while copying and the resulting paths are merged in the order of the drawings.
+		std::list<geometry_data> elements;
+		elements.swap(element_buffer_);
+		std::multimap<drawing_key, path_object, storey_sorter> written_paths;
+		written_paths.swap(paths);
+		float_item_list written_xcoords, written_ycoords, written_radii;
+		written_xcoords.swap(xcoords);
+		written_ycoords.swap(ycoords);
+		written_radii.swap(radii);
+
+		std::vector<std::unique_ptr<SvgSerializer>> drawings;
+		for (size_t i = 0; i < deferred_section_data_->size(); ++i) {
+			drawings.emplace_back(new SvgSerializer(*this));
+			drawings.back()->xcoords_begin = drawings.back()->ycoords_begin = drawings.back()->radii_begin = 0;
+		}
 
-			if (use_hlr) {
-				const auto& section = boost::get<vertical_section>(sd);
-				const auto& ax = section.plane.Position();
-				
-				draw_hlr(ax, { nullptr, drawing_name });
-			}
+		paths.swap(written_paths);
+		xcoords.swap(written_xcoords);
+		ycoords.swap(written_ycoords);
+		radii.swap(written_radii);
 
-			addTextAnnotations({ nullptr, drawing_name });
+		std::vector<drawing_key> keys(drawings.size());
+		parallel_for(drawings.size(), num_threads_, [&](size_t i) {
+			keys[i] = drawings[i]->draw_section((*deferred_section_data_)[i], elements);
+		});
 
-			if (file && storey_height_display_ != SH_NONE && pln && std::abs(pln->Position().Direction().Z()) < 1.e-5) {
-				auto storeys = file->instances_by_type("IfcBuildingStorey");
-				if (storeys) {
-					const double lu = file->getUnit("LENGTHUNIT").second;
-					for (auto& s : *storeys) {
-						auto storey = (IfcUtil::IfcBaseEntity*) s;
-						auto a = storey->get("Elevation");
-						if (!a->isNull()) {
-							double elev = *a;
-							elev *= lu;
-							auto svg_name = nameElement(storey);
-
-							gp_Pln elev_pln(gp_Ax3(gp_Pnt(0, 0, elev), gp::DZ(), gp::DX()));
-							//, pln->Position().XDirection()));
-							// auto ref_y = pln->Position().YDirection().XYZ().Dot(pln->Position().Location().XYZ());
-
-							double x0, y0, z0, x1, y1, z1;
-							bnd_.Get(x0, y0, z0, x1, y1, z1);
-
-							// @todo this is a hack in order to get the auto elevations (which are 0.1 offset from
-							// the global bounding box) to include the storey height symbols.
-							x0 -= 0.2;
-							y0 -= 0.2;
-							z0 -= 0.2;
-
-							x1 += 0.2;
-							y1 += 0.2;
-							z1 += 0.2;
-
-							const double shll = storey_height_line_length_.get_value_or(2.);
-
-							BRepBuilderAPI_MakeFace mf(elev_pln, x0 - shll, x1 + shll, y0 - shll, y1 + shll);
-							gp_Trsf trsf;
-							TopoDS_Compound C;
-							BRep_Builder B;
-							B.MakeCompound(C);
-							B.Add(C, mf.Face());
-							std::string name;
-							auto a2 = storey->get("Name");
-							if (!a2->isNull()) {
-								name = (std::string) *a2;
-							}
-							write(geometry_data{
-								C,{boost::none},trsf,storey,storey,elev,name,nameElement(storey)
-							});
-						}
-					}
-				}
+		for (size_t i = 0; i < drawings.size(); ++i) {
+			auto& d = *drawings[i];
+			for (auto& p : d.paths) {
+				drawing_metadata[p.first] = d.drawing_metadata[p.first];
+				paths.insert(std::move(p));
 			}
-
-			auto m3 = resize();
-
-			auto k = std::make_pair(nullptr, drawing_name);
-			drawing_metadata[k].matrix_3 = m3;
-
-			resetScale();
-
-			// @todo does this probably call Nullify()
-			hlr = boost::blank();
+			drawing_metadata[keys[i]] = d.drawing_metadata[keys[i]];
 		}
+
+		element_buffer_.swap(elements);
 	}
 
 	std::multimap<drawing_key, path_object, storey_sorter>::const_iterator it;
@@ -165,8 +165,10 @@ protected:
 	bool use_namespace_, use_hlr_poly_, always_project_, polygonal_;
 	bool emit_building_storeys_;
 	bool no_css_;
+	bool mesh_section_;
 
 	int profile_threshold_;
+	int num_threads_;
 
 	IfcParse::IfcFile* file;
 	IfcUtil::IfcBaseEntity* storey_;
@@ -189,7 +191,16 @@ protected:
 	// @todo maybe better to rely on a screen-space bounding box
 	Bnd_Box bnd_;
 
+	static TopoDS_Shape project_hlr(const gp_Pln& pln, const drawing_key& drawing_name, hlr_t& algo);
 	void draw_hlr(const gp_Pln& pln, const drawing_key& drawing_name);
+	void draw_hlr(const gp_Pln& pln, const drawing_key& drawing_name, const TopoDS_Shape& hlr_compound);
+
+	// Writes the section of the triangulation of shape by pln, transformed by trsf,
+	// returns false when shape is not triangulated.
+	bool write_mesh_section(path_object& p, const TopoDS_Shape& shape, const gp_Pln& pln, const gp_Trsf& trsf);
+
+	// Generates a deferred section or elevation from the buffered elements, returns its key
+	drawing_key draw_section(const section_data& sd, const std::list<geometry_data>& elements);
 
 	subtract_before_project subtraction_settings_;
 
@@ -215,7 +226,9 @@ public:
 		, polygonal_(false)
 		, emit_building_storeys_(true)
 		, no_css_(false)
+		, mesh_section_(false)
 		, profile_threshold_(-1)
+		, num_threads_(1)
 		, file(0)
 		, storey_(0)
 		, xcoords_begin(0)
@@ -302,6 +315,11 @@ public:
 		no_css_ = b;
 	}
 
+	// Cuts elements by slicing their triangulation instead of an exact section.
+	void setMeshSection(bool b) {
+		mesh_section_ = b;
+	}
+
 	void setScale(double s) { scale_ = s; }
 	void setDrawingCenter(double x, double y) {
 		center_x_ = x; center_y_ = y;
@@ -338,6 +356,12 @@ public:
 		return profile_threshold_;
 	}
 
+	// Number of threads used in finalize() to generate the storey projections
+	// and the deferred sections and elevations concurrently.
+	void setNumThreads(int n) {
+		num_threads_ = n;
+	}
+
 protected:
 	std::string writeMetadata(const drawing_meta& m);
 };
@@ -23,6 +23,7 @@
 #include "../ifcgeom_schema_agnostic/IfcGeomRenderStyles.h"
 
 #include "../ifcparse/utils.h"
+#include "../serializers/util.h"
 
 #include <boost/lexical_cast.hpp>
 #include <iomanip>
@@ -87,22 +88,38 @@ void WaveFrontOBJSerializer::writeMaterial(const IfcGeom::Material& style)
 
 void WaveFrontOBJSerializer::write(const IfcGeom::TriangulationElement* o)
 {
-    obj_stream.stream << "g " << object_id(o) << "\n";
-	obj_stream.stream << "s 1" << "\n";
+	encoded_chunk chunk;
+	reserve(o, chunk);
+	encode(o, chunk);
+	append(o, chunk);
+}
+
+void WaveFrontOBJSerializer::reserve(const IfcGeom::TriangulationElement* o, encoded_chunk& chunk)
+{
+	// Vertex indices in OBJ are global, so the offset is assigned in the order of the elements
+	chunk.offset = vcount_total;
+	vcount_total += (unsigned int) o->geometry().verts().size() / 3;
+}
+
+void WaveFrontOBJSerializer::encode(const IfcGeom::TriangulationElement* o, encoded_chunk& chunk)
+{
+	util::text_buffer os(settings().precision);
+
+    os << "g " << object_id(o) << "\n";
+	os << "s 1" << "\n";
 	const bool isyup = settings().get(SerializerSettings::USE_Y_UP);
 
     const IfcGeom::Representation::Triangulation& mesh = o->geometry();
 
-	const int vcount = (int)mesh.verts().size() / 3;
     for ( std::vector<double>::const_iterator it = mesh.verts().begin(); it != mesh.verts().end(); ) {
         const double x = *(it++);
         const double y = *(it++);
         const double z = *(it++);
 		
 		if (isyup) {
-			obj_stream.stream << "v " << x << " " << z << " " << -y << "\n";
+			os << "v " << x << " " << z << " " << -y << "\n";
 		} else {
-			obj_stream.stream << "v " << x << " " << y << " " << z << "\n";
+			os << "v " << x << " " << y << " " << z << "\n";
 		}
 	}
 
@@ -110,15 +127,17 @@ void WaveFrontOBJSerializer::write(const IfcGeom::TriangulationElement* o)
         const double x = *(it++);
         const double y = *(it++);
         const double z = *(it++);
-		obj_stream.stream << "vn " << x << " " << y << " " << z << "\n";
+		os << "vn " << x << " " << y << " " << z << "\n";
 	}
 
     for (std::vector<double>::const_iterator it = mesh.uvs().begin(); it != mesh.uvs().end();) {
         const double u = *it++;
         const double v = *it++;
-        obj_stream.stream << "vt " << u << " " << v << "\n";
+        os << "vt " << u << " " << v << "\n";
     }
 
+	const int vertex_offset = (int) chunk.offset;
+
 	int previous_material_id = -2;
 	std::vector<int>::const_iterator material_it = mesh.material_ids().begin();
 
@@ -132,28 +151,24 @@ void WaveFrontOBJSerializer::write(const IfcGeom::TriangulationElement* o)
             std::string material_name = (settings().get(SerializerSettings::USE_MATERIAL_NAMES)
                 ? material.original_name() : material.name());
             IfcUtil::sanitate_material_name(material_name);
-			obj_stream.stream << "usemtl " << material_name << "\n";
-			if (materials.find(material_name) == materials.end()) {
-				writeMaterial(material);
-				materials.insert(material_name);
-			}
+			os << "usemtl " << material_name << "\n";
 			previous_material_id = material_id;
 		}
 
-		const int v1 = *(it++)+vcount_total;
-		const int v2 = *(it++)+vcount_total;
-		const int v3 = *(it++)+vcount_total;
+		const int v1 = *(it++) + vertex_offset;
+		const int v2 = *(it++) + vertex_offset;
+		const int v3 = *(it++) + vertex_offset;
 
 		if (has_normals && has_uvs) {
-			obj_stream.stream << "f " << v1 << "/" << v1 << "/" << v1 << " "
+			os << "f " << v1 << "/" << v1 << "/" << v1 << " "
 				<< v2 << "/" << v2 << "/" << v2 << " "
 				<< v3 << "/" << v3 << "/" << v3 << "\n";
 		} else if (has_normals) {
-			obj_stream.stream << "f " << v1 << "//" << v1 << " "
+			os << "f " << v1 << "//" << v1 << " "
 				<< v2 << "//" << v2 << " "
 				<< v3 << "//" << v3 << "\n";
 		} else {
-			obj_stream.stream << "f " << v1 << " " << v2 << " " << v3 << "\n";
+			os << "f " << v1 << " " << v2 << " " << v3 << "\n";
 		}
 
 	}
@@ -176,19 +191,39 @@ void WaveFrontOBJSerializer::write(const IfcGeom::TriangulationElement* o)
             std::string material_name = (settings().get(SerializerSettings::USE_MATERIAL_NAMES)
                 ? material.original_name() : material.name());
             IfcUtil::sanitate_material_name(material_name);
-			obj_stream.stream << "usemtl " << material_name << "\n";
-			if (materials.find(material_name) == materials.end()) {
-				writeMaterial(material);
-				materials.insert(material_name);
-			}
+			os << "usemtl " << material_name << "\n";
 			previous_material_id = material_id;
 		}
 
-		const int v1 = i1 + vcount_total;
-		const int v2 = i2 + vcount_total;
+		const int v1 = i1 + vertex_offset;
+		const int v2 = i2 + vertex_offset;
 
-		obj_stream.stream << "l " << v1 << " " << v2 << "\n";
+		os << "l " << v1 << " " << v2 << "\n";
 	}
 
-	vcount_total += vcount;
+	chunk.data = os.take();
+}
+
+void WaveFrontOBJSerializer::append(const IfcGeom::TriangulationElement* o, const encoded_chunk& chunk)
+{
+	obj_stream.stream << chunk.data;
+
+	// The material library is written in the order in which materials are first used,
+	// every face and free edge has an entry in material_ids().
+	const IfcGeom::Representation::Triangulation& mesh = o->geometry();
+	int previous_material_id = -2;
+	for (std::vector<int>::const_iterator it = mesh.material_ids().begin(); it != mesh.material_ids().end(); ++it) {
+		if (*it == previous_material_id) {
+			continue;
+		}
+		previous_material_id = *it;
+		const IfcGeom::Material& material = mesh.materials()[*it];
+		std::string material_name = (settings().get(SerializerSettings::USE_MATERIAL_NAMES)
+			? material.original_name() : material.name());
+		IfcUtil::sanitate_material_name(material_name);
+		if (materials.find(material_name) == materials.end()) {
+			writeMaterial(material);
+			materials.insert(material_name);
+		}
+	}
 }
@@ -46,6 +46,10 @@ public:
 	bool isTesselated() const { return true; }
 	void setUnitNameAndMagnitude(const std::string& /*name*/, float /*magnitude*/) {}
 	void setFile(IfcParse::IfcFile*) {}
+	bool supportsEncoding() const { return true; }
+	void reserve(const IfcGeom::TriangulationElement* o, encoded_chunk& chunk);
+	void encode(const IfcGeom::TriangulationElement* o, encoded_chunk& chunk);
+	void append(const IfcGeom::TriangulationElement* o, const encoded_chunk& chunk);
 };
 
 #endif
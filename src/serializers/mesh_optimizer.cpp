@@ -0,0 +1,359 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	// Vertex cache model of the Forsyth algorithm, see
+	// https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+	const size_t cache_size = 32;
+	const unsigned max_valence = 32;
+
+	struct score_table {
+		float cache[cache_size];
+		float valence[max_valence + 1];
+
+		score_table() {
+			for (size_t i = 0; i < cache_size; ++i) {
+				// The three most recent vertices are used by the last triangle, a
+				// fixed score prevents favouring triangles sharing an edge with it.
+				cache[i] = i < 3 ? 0.75f : std::pow(1.f - float(i - 3) / float(cache_size - 3), 1.5f);
+			}
+			valence[0] = 0.f;
+			for (unsigned i = 1; i <= max_valence; ++i) {
+				// Boost vertices with few remaining triangles to get rid of them quickly.
+				valence[i] = 2.f / std::sqrt(float(i));
+			}
+		}
+
+		float score(int cache_position, unsigned remaining) const {
+			if (remaining == 0) {
+				return -1.f;
+			}
+			return (cache_position >= 0 ? cache[cache_position] : 0.f) + valence[std::min(remaining, max_valence)];
+		}
+	};
+
+	// Vertex codec constants of EXT_meshopt_compression.
+	const unsigned char vertex_header = 0xa0;
+	const unsigned char index_header = 0xd1;
+	const size_t byte_group_size = 16;
+	const size_t max_block_vertices = 256;
+	const size_t max_block_bytes = 8192;
+	const size_t min_tail_size = 32;
+
+	unsigned char zigzag8(unsigned char v) {
+		return static_cast<unsigned char>(((signed char) v >> 7) ^ (v << 1));
+	}
+
+	size_t measure_group(const unsigned char* data, int bits) {
+		if (bits == 0) {
+			return std::all_of(data, data + byte_group_size, [](unsigned char c) { return c == 0; }) ? 0 : size_t(-1);
+		}
+		if (bits == 8) {
+			return byte_group_size;
+		}
+		// Values that do not fit are marked with a sentinel and stored as a full byte after the group.
+		const unsigned char sentinel = (unsigned char) ((1 << bits) - 1);
+		return byte_group_size * bits / 8 + std::count_if(data, data + byte_group_size, [sentinel](unsigned char c) { return c >= sentinel; });
+	}
+
+	void encode_group(const unsigned char* data, int bits, std::vector<unsigned char>& out) {
+		if (bits == 0) {
+			return;
+		}
+		if (bits == 8) {
+			out.insert(out.end(), data, data + byte_group_size);
+			return;
+		}
+		const unsigned char sentinel = (unsigned char) ((1 << bits) - 1);
+		const size_t per_byte = 8 / bits;
+		for (size_t i = 0; i < byte_group_size; i += per_byte) {
+			unsigned char byte = 0;
+			for (size_t k = 0; k < per_byte; ++k) {
+				byte = (unsigned char) (byte << bits);
+				byte |= std::min(data[i + k], sentinel);
+			}
+			out.push_back(byte);
+		}
+		for (size_t i = 0; i < byte_group_size; ++i) {
+			if (data[i] >= sentinel) {
+				out.push_back(data[i]);
+			}
+		}
+	}
+
+	void encode_bytes(const unsigned char* data, size_t size, std::vector<unsigned char>& out) {
+		static const int bits_for_log2[] = { 0, 2, 4, 8 };
+
+		const size_t group_count = size / byte_group_size;
+		const size_t header_offset = out.size();
+		out.resize(out.size() + (group_count + 3) / 4, 0);
+
+		for (size_t g = 0; g < group_count; ++g) {
+			const unsigned char* group = data + g * byte_group_size;
+			int best = 3;
+			size_t best_size = byte_group_size;
+			for (int i = 0; i < 3; ++i) {
+				size_t s = measure_group(group, bits_for_log2[i]);
+				if (s < best_size) {
+					best = i;
+					best_size = s;
+				}
+			}
+			out[header_offset + g / 4] |= (unsigned char) (best << ((g % 4) * 2));
+			encode_group(group, bits_for_log2[best], out);
+		}
+	}
+}
+
+void mesh_optimizer::optimize_vertex_cache(std::vector<int>& indices, size_t vertex_count) {
+	static const score_table table;
+
+	const size_t triangle_count = indices.size() / 3;
+	if (triangle_count < 2) {
+		return;
+	}
+
+	// Per vertex the list of triangles not yet emitted, remaining[v] is the valid
+	// length of the list at offsets[v].
+	std::vector<unsigned> remaining(vertex_count, 0), offsets(vertex_count + 1, 0), adjacency(triangle_count * 3);
+	for (size_t i = 0; i < triangle_count * 3; ++i) {
+		remaining[indices[i]]++;
+	}
+	for (size_t v = 0; v < vertex_count; ++v) {
+		offsets[v + 1] = offsets[v] + remaining[v];
+	}
+	{
+		std::vector<unsigned> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < triangle_count * 3; ++i) {
+			adjacency[fill[indices[i]]++] = (unsigned) (i / 3);
+		}
+	}
+
+	std::vector<int> cache_position(vertex_count, -1);
+	std::vector<float> vertex_score(vertex_count), triangle_score(triangle_count, 0.f);
+	for (size_t v = 0; v < vertex_count; ++v) {
+		vertex_score[v] = table.score(-1, remaining[v]);
+	}
+	for (size_t i = 0; i < triangle_count * 3; ++i) {
+		triangle_score[i / 3] += vertex_score[indices[i]];
+	}
+
+	std::vector<char> emitted(triangle_count, 0);
+	std::vector<int> result, cache, new_cache;
+	result.reserve(triangle_count * 3);
+	cache.reserve(cache_size + 3);
+	new_cache.reserve(cache_size + 3);
+
+	long best = std::distance(triangle_score.begin(), std::max_element(triangle_score.begin(), triangle_score.end()));
+	size_t input_cursor = 0;
+
+	while (result.size() < triangle_count * 3) {
+		if (best < 0) {
+			// None of the cached vertices has remaining triangles, continue
+			// with the next triangle in input order.
+			while (emitted[input_cursor]) {
+				++input_cursor;
+			}
+			best = (long) input_cursor;
+		}
+
+		emitted[best] = 1;
+		const int* tri = &indices[best * 3];
+		new_cache.clear();
+		for (int k = 0; k < 3; ++k) {
+			const int v = tri[k];
+			result.push_back(v);
+			if (std::find(new_cache.begin(), new_cache.end(), v) == new_cache.end()) {
+				new_cache.push_back(v);
+			}
+			unsigned* begin = &adjacency[offsets[v]];
+			unsigned* end = begin + remaining[v];
+			std::iter_swap(std::find(begin, end, (unsigned) best), end - 1);
+			remaining[v]--;
+		}
+		const size_t emitted_vertices = new_cache.size();
+		for (int v : cache) {
+			if (std::find(new_cache.begin(), new_cache.begin() + emitted_vertices, v) == new_cache.begin() + emitted_vertices) {
+				new_cache.push_back(v);
+			}
+		}
+
+		// Update scores of the vertices that moved in, within or out of the cache
+		// and propagate the differences to their remaining triangles.
+		best = -1;
+		float best_score = -1.f;
+		for (size_t i = 0; i < new_cache.size(); ++i) {
+			const int v = new_cache[i];
+			cache_position[v] = i < cache_size ? (int) i : -1;
+			const float s = table.score(cache_position[v], remaining[v]);
+			const float delta = s - vertex_score[v];
+			vertex_score[v] = s;
+			const unsigned* adj = &adjacency[offsets[v]];
+			for (unsigned j = 0; j < remaining[v]; ++j) {
+				const unsigned t = adj[j];
+				triangle_score[t] += delta;
+				if (i < cache_size && triangle_score[t] > best_score) {
+					best = t;
+					best_score = triangle_score[t];
+				}
+			}
+		}
+		if (new_cache.size() > cache_size) {
+			new_cache.resize(cache_size);
+		}
+		cache.swap(new_cache);
+	}
+
+	indices.swap(result);
+}
+
+std::vector<int> mesh_optimizer::optimize_vertex_fetch(std::vector<int>& indices, size_t vertex_count, size_t& unique_vertex_count) {
+	std::vector<int> remap(vertex_count, -1);
+	int next = 0;
+	for (auto& i : indices) {
+		if (remap[i] == -1) {
+			remap[i] = next++;
+		}
+		i = remap[i];
+	}
+	unique_vertex_count = (size_t) next;
+	return remap;
+}
+
+mesh_optimizer::vertex_encoder::vertex_encoder(std::ostream& stream, size_t vertex_size)
+	: stream_(stream)
+	, vertex_size_(vertex_size)
+	, block_size_(std::min((max_block_bytes / vertex_size) & ~(byte_group_size - 1), max_block_vertices))
+	, count_(0)
+	, length_(0)
+{
+	pending_.reserve(block_size_ * vertex_size_);
+}
+
+void mesh_optimizer::vertex_encoder::write(const unsigned char* data, size_t vertex_count) {
+	if (vertex_count == 0) {
+		return;
+	}
+	if (count_ == 0) {
+		stream_.put((char) vertex_header);
+		length_ += 1;
+		// The first vertex is the baseline for the deltas of the first block,
+		// it is stored at the end of the stream.
+		first_vertex_.assign(data, data + vertex_size_);
+		last_vertex_ = first_vertex_;
+	}
+	count_ += vertex_count;
+
+	const unsigned char* end = data + vertex_count * vertex_size_;
+	while (data != end) {
+		const size_t n = std::min((size_t) (end - data), block_size_ * vertex_size_ - pending_.size());
+		pending_.insert(pending_.end(), data, data + n);
+		data += n;
+		if (pending_.size() == block_size_ * vertex_size_) {
+			encode_block_(pending_.data(), block_size_);
+			pending_.clear();
+		}
+	}
+}
+
+void mesh_optimizer::vertex_encoder::finalize() {
+	if (count_ == 0) {
+		return;
+	}
+	if (!pending_.empty()) {
+		encode_block_(pending_.data(), pending_.size() / vertex_size_);
+		pending_.clear();
+	}
+	// The tail is padded so that decoders can read ahead safely.
+	const size_t tail_size = std::max(min_tail_size, vertex_size_);
+	for (size_t i = vertex_size_; i < tail_size; ++i) {
+		stream_.put('\0');
+	}
+	stream_.write((const char*) first_vertex_.data(), vertex_size_);
+	length_ += tail_size;
+}
+
+void mesh_optimizer::vertex_encoder::encode_block_(const unsigned char* data, size_t vertex_count) {
+	const size_t aligned = (vertex_count + byte_group_size - 1) & ~(byte_group_size - 1);
+	std::vector<unsigned char> deltas(aligned, 0);
+	block_.clear();
+
+	for (size_t k = 0; k < vertex_size_; ++k) {
+		unsigned char p = last_vertex_[k];
+		for (size_t i = 0; i < vertex_count; ++i) {
+			const unsigned char v = data[i * vertex_size_ + k];
+			deltas[i] = zigzag8((unsigned char) (v - p));
+			p = v;
+		}
+		encode_bytes(deltas.data(), aligned, block_);
+	}
+
+	last_vertex_.assign(data + (vertex_count - 1) * vertex_size_, data + vertex_count * vertex_size_);
+	stream_.write((const char*) block_.data(), block_.size());
+	length_ += block_.size();
+}
+
+mesh_optimizer::index_encoder::index_encoder(std::ostream& stream)
+	: stream_(stream)
+	, count_(0)
+	, length_(0)
+	, current_(0)
+{
+	last_[0] = last_[1] = 0;
+}
+
+void mesh_optimizer::index_encoder::write(const unsigned int* data, size_t index_count) {
+	if (index_count && count_ == 0) {
+		stream_.put((char) index_header);
+		length_ += 1;
+	}
+	count_ += index_count;
+
+	for (size_t i = 0; i < index_count; ++i) {
+		const unsigned int index = data[i];
+		// Switch to the other baseline when the delta does not fit in a single byte.
+		const int cd = (int) (index - last_[current_]);
+		current_ ^= (unsigned) ((cd < 0 ? -cd : cd) >= 30);
+
+		const unsigned int d = index - last_[current_];
+		unsigned int v = (((d << 1) ^ (unsigned int) ((int) d >> 31)) << 1) | current_;
+		do {
+			stream_.put((char) ((v & 127) | (v > 127 ? 128 : 0)));
+			length_ += 1;
+			v >>= 7;
+		} while (v);
+
+		last_[current_] = index;
+	}
+}
+
+void mesh_optimizer::index_encoder::finalize() {
+	if (count_ == 0) {
+		return;
+	}
+	for (int i = 0; i < 4; ++i) {
+		stream_.put('\0');
+	}
+	length_ += 4;
+}
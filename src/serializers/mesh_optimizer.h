@@ -0,0 +1,78 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+// Index reordering and buffer compression for the glTF serializer. The encoders
+// produce the bitstreams of the EXT_meshopt_compression glTF extension so that
+// the output can be decoded by the meshoptimizer decoders available in browsers.
+
+namespace mesh_optimizer {
+
+	/// Reorders triangles for post-transform vertex cache efficiency using Tom
+	/// Forsyth's linear-speed algorithm. Indices are modified in place.
+	void optimize_vertex_cache(std::vector<int>& indices, size_t vertex_count);
+
+	/// Renumbers vertices in order of first reference in indices, so that vertex
+	/// fetches are sequential, and drops unreferenced vertices. Returns for every
+	/// original vertex its new index, or -1 when unreferenced.
+	std::vector<int> optimize_vertex_fetch(std::vector<int>& indices, size_t vertex_count, size_t& unique_vertex_count);
+
+	/// Streaming encoder for the ATTRIBUTES mode of EXT_meshopt_compression. Vertices
+	/// are delta encoded byte-wise in blocks, only a single block is buffered.
+	class vertex_encoder {
+	public:
+		/// vertex_size needs to be a multiple of 4 and at most 256.
+		vertex_encoder(std::ostream& stream, size_t vertex_size);
+		void write(const unsigned char* data, size_t vertex_count);
+		void finalize();
+		/// Number of vertices written.
+		size_t count() const { return count_; }
+		/// Number of bytes of encoded output.
+		size_t length() const { return length_; }
+	private:
+		std::ostream& stream_;
+		size_t vertex_size_, block_size_, count_, length_;
+		std::vector<unsigned char> pending_, last_vertex_, first_vertex_, block_;
+		void encode_block_(const unsigned char* data, size_t vertex_count);
+	};
+
+	/// Streaming encoder for the INDICES mode of EXT_meshopt_compression. Indices are
+	/// stored as zigzag varint deltas relative to one of two baselines.
+	class index_encoder {
+	public:
+		index_encoder(std::ostream& stream);
+		void write(const unsigned int* data, size_t index_count);
+		void finalize();
+		size_t count() const { return count_; }
+		size_t length() const { return length_; }
+	private:
+		std::ostream& stream_;
+		size_t count_, length_;
+		unsigned int last_[2], current_;
+	};
+
+}
+
+#endif
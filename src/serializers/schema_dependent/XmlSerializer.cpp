@@ -29,6 +29,7 @@
 #include "../../ifcparse/IfcSIPrefix.h"
 #include "../../ifcgeom/IfcGeom.h"
 #include "../../ifcparse/utils.h"
+#include "../../serializers/util.h"
 
 using boost::property_tree::ptree;
 
@@ -55,6 +56,103 @@ namespace {
 // TODO: Make this a member of XmlSerializer?
 std::map<std::string, std::string> MAKE_TYPE_NAME(argument_name_map);
 
+// Writes XML elements directly to a stream, formatted identically to
+// boost::property_tree::write_xml() with tab indentation, so that the document
+// does not need to be built in memory as a whole. The start tag of an element
+// is written once a child is started or the element is ended, until then its
+// attributes can be added or overwritten.
+class xml_writer {
+	std::ostream& stream_;
+	std::vector<std::string> elements_;
+	std::vector<std::pair<std::string, std::string> > attributes_;
+	bool pending_;
+
+	void write_start_tag(bool empty) {
+		stream_ << std::string(elements_.size() - 1, '\t') << '<' << elements_.back();
+		for (auto& attr : attributes_) {
+			stream_ << ' ' << attr.first << "=\"" << boost::property_tree::xml_parser::encode_char_entities(attr.second) << '"';
+		}
+		stream_ << (empty ? "/>\n" : ">\n");
+		attributes_.clear();
+		pending_ = false;
+	}
+
+public:
+	explicit xml_writer(std::ostream& stream)
+		: stream_(stream)
+		, pending_(false)
+	{
+		stream_ << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+	}
+
+	void start(const std::string& name) {
+		if (pending_) {
+			write_start_tag(false);
+		}
+		elements_.push_back(name);
+		pending_ = true;
+	}
+
+	// Sets an attribute on the element that was started last, before any child is started.
+	void attribute(const std::string& name, const std::string& value) {
+		auto it = std::find_if(attributes_.begin(), attributes_.end(), [&name](const std::pair<std::string, std::string>& attr) {
+			return attr.first == name;
+		});
+		if (it == attributes_.end()) {
+			attributes_.emplace_back(name, value);
+		} else {
+			it->second = value;
+		}
+	}
+
+	void end() {
+		if (pending_) {
+			write_start_tag(true);
+		} else {
+			stream_ << std::string(elements_.size() - 1, '\t') << "</" << elements_.back() << ">\n";
+		}
+		elements_.pop_back();
+	}
+
+	// Writes a small property tree as a child of the current element.
+	template <typename Settings>
+	void write(const std::string& name, const ptree& tree, const Settings& settings) {
+		if (pending_) {
+			write_start_tag(false);
+		}
+		boost::property_tree::xml_parser::write_xml_element(stream_, name, tree, (int) elements_.size(), settings);
+	}
+};
+
+// The XML attribute name and the qualified name used for special cases in
+// format_attribute(), by attribute index, computed once per entity type.
+struct attribute_format {
+	std::string name;
+	std::string qualified_name;
+};
+
+std::map<const IfcParse::entity*, std::vector<attribute_format> > MAKE_TYPE_NAME(attribute_formats);
+
+const std::vector<attribute_format>& get_attribute_formats(const IfcParse::entity& decl) {
+	auto it = MAKE_TYPE_NAME(attribute_formats).find(&decl);
+	if (it != MAKE_TYPE_NAME(attribute_formats).end()) {
+		return it->second;
+	}
+	std::vector<attribute_format>& formats = MAKE_TYPE_NAME(attribute_formats)[&decl];
+	const size_t n = decl.attribute_count();
+	formats.reserve(n);
+	for (size_t i = 0; i < n; ++i) {
+		std::string argument_name = decl.attribute_by_index(i)->name();
+		std::map<std::string, std::string>::const_iterator argument_name_it;
+		argument_name_it = MAKE_TYPE_NAME(argument_name_map).find(argument_name);
+		if (argument_name_it != MAKE_TYPE_NAME(argument_name_map).end()) {
+			argument_name = argument_name_it->second;
+		}
+		formats.push_back({ argument_name, decl.name() + "." + argument_name });
+	}
+	return formats;
+}
+
 // Format an IFC attribute and maybe returns as string. Only literal scalar 
 // values are converted. Things like entity instances and lists are omitted.
 boost::optional<std::string> format_attribute(const Argument* argument, IfcUtil::ArgumentType argument_type, const std::string& argument_name) {
@@ -74,9 +172,9 @@ boost::optional<std::string> format_attribute(const Argument* argument, IfcUtil:
 				deg += angle[3] / (1000000. * 3600.);
 				prec = 14;
 			}
-			std::stringstream stream;
-			stream << std::setprecision(prec) << deg;
-			value = stream.str();
+			util::text_buffer buffer(prec);
+			buffer << deg;
+			value = buffer.take();
 		}
 		return value;
 	}
@@ -88,9 +186,9 @@ boost::optional<std::string> format_attribute(const Argument* argument, IfcUtil:
 			break; }
 		case IfcUtil::Argument_DOUBLE: {
 			const double d = *argument;
-			std::stringstream stream;
-			stream << std::setprecision (std::numeric_limits< double >::max_digits10) << d;
-			value = stream.str();
+			util::text_buffer buffer(std::numeric_limits< double >::max_digits10);
+			buffer << d;
+			value = buffer.take();
 			break; }
 		case IfcUtil::Argument_STRING:
 		case IfcUtil::Argument_ENUMERATION: {
@@ -98,9 +196,9 @@ boost::optional<std::string> format_attribute(const Argument* argument, IfcUtil:
 			break; }
 		case IfcUtil::Argument_INT: {
 			const int v = *argument;
-			std::stringstream stream;
-			stream << v;
-			value = stream.str();
+			util::text_buffer buffer;
+			buffer << v;
+			value = buffer.take();
 			break; }
 		case IfcUtil::Argument_ENTITY_INSTANCE: {
 			IfcUtil::IfcBaseClass* e = *argument;
@@ -130,15 +228,15 @@ boost::optional<std::string> format_attribute(const Argument* argument, IfcUtil:
 				IfcGeom::MAKE_TYPE_NAME(Kernel) kernel;
 				
 				if (kernel.convert(placement, trsf)) {
-					std::stringstream stream;
+					util::text_buffer buffer(std::numeric_limits< double >::max_digits10);
 					for (int i = 1; i < 5; ++i) {
 						for (int j = 1; j < 4; ++j) {
 							const double trsf_value = trsf.Value(j, i);
-							stream << std::setprecision (std::numeric_limits< double >::max_digits10) << trsf_value << " ";
+							buffer << trsf_value << " ";
 						}
-						stream << ((i == 4) ? "1" : "0 ");
+						buffer << ((i == 4) ? "1" : "0 ");
 					}
-					value = stream.str();
+					value = buffer.take();
 				}				
 			}
 			break; }
@@ -148,31 +246,27 @@ boost::optional<std::string> format_attribute(const Argument* argument, IfcUtil:
 	return value;
 }
 
-// Appends to a node with possibly existing attributes
-ptree* format_entity_instance(IfcUtil::IfcBaseEntity* instance, ptree& child, ptree& tree, bool as_link = false) {
-	const unsigned n = instance->declaration().attribute_count();
+// Writes the attributes of an entity instance as xml attributes of the element
+// that was started last. As a link, only the id is written, as an xlink:href.
+void format_attributes(IfcUtil::IfcBaseEntity* instance, xml_writer& writer, bool as_link = false) {
+	const std::vector<attribute_format>& formats = get_attribute_formats(instance->declaration());
+	const unsigned n = (unsigned) formats.size();
 	for (unsigned i = 0; i < n; ++i) {
+		const attribute_format& format = formats[i];
+		if (as_link && format.name != "id") continue;
+
+		const Argument* argument;
 		try {
-		    instance->data().getArgument(i);
+			argument = instance->data().getArgument(i);
 		} catch (const std::exception&) {
-		    Logger::Error("Expected " + boost::lexical_cast<std::string>(n) + " attributes for:", instance);
-		    break;
-		}		
-		const Argument* argument = instance->data().getArgument(i);
-		if (argument->isNull()) continue;
-
-		std::string argument_name = instance->declaration().attribute_by_index(i)->name();
-		std::map<std::string, std::string>::const_iterator argument_name_it;
-		argument_name_it = MAKE_TYPE_NAME(argument_name_map).find(argument_name);
-		if (argument_name_it != MAKE_TYPE_NAME(argument_name_map).end()) {
-			argument_name = argument_name_it->second;
+			Logger::Error("Expected " + boost::lexical_cast<std::string>(n) + " attributes for:", instance);
+			break;
 		}
-		const IfcUtil::ArgumentType argument_type = instance->data().getArgument(i)->type();
+		if (argument->isNull()) continue;
 
-		const std::string qualified_name = instance->declaration().name() + "." + argument_name;
 		boost::optional<std::string> value;
 		try {
-			value = format_attribute(argument, argument_type, qualified_name);
+			value = format_attribute(argument, argument->type(), format.qualified_name);
 		} catch (const std::exception& e) {
 			Logger::Error(e);
 		} catch (const Standard_ConstructionError& e) {
@@ -181,24 +275,25 @@ ptree* format_entity_instance(IfcUtil::IfcBaseEntity* instance, ptree& child, pt
 
 		if (value) {
 			if (as_link) {
-				if (argument_name == "id") {
-					child.put("<xmlattr>.xlink:href", std::string("#") + *value);
-				}
+				writer.attribute("xlink:href", std::string("#") + *value);
 			} else {
-				std::stringstream stream;
-				stream << "<xmlattr>." << argument_name;
-				child.put(stream.str(), *value);
+				writer.attribute(format.name, *value);
 			}
 		}
 	}
-	return &tree.add_child(instance->declaration().name(), child);
 }
 
-// Formats an entity instances as a ptree node, and insert into the DOM. Recurses
-// over the entity attributes and writes them as xml attributes of the node.
-ptree* format_entity_instance(IfcUtil::IfcBaseEntity* instance, ptree& tree, bool as_link = false) {
-    ptree child;
-    return format_entity_instance(instance, child, tree, as_link);
+// Starts an element for an entity instance and writes its attributes. The
+// element is left open for children to be added.
+void start_entity_instance(IfcUtil::IfcBaseEntity* instance, xml_writer& writer, bool as_link = false) {
+	writer.start(instance->declaration().name());
+	format_attributes(instance, writer, as_link);
+}
+
+// Formats an entity instance as an element without children.
+void format_entity_instance(IfcUtil::IfcBaseEntity* instance, xml_writer& writer, bool as_link = false) {
+	start_entity_instance(instance, writer, as_link);
+	writer.end();
 }
 
 std::string qualify_unrooted_instance(IfcUtil::IfcBaseInterface* inst) {
@@ -207,12 +302,22 @@ std::string qualify_unrooted_instance(IfcUtil::IfcBaseInterface* inst) {
 
 // A function to be called recursively. Template specialization is used 
 // to descend into decomposition, containment and property relationships.
+// Returns whether an element was started, which is left open for children
+// to be added.
 template <typename A>
-ptree* descend(A* instance, ptree& tree, IfcUtil::IfcBaseClass* parent=nullptr) {
+bool start_descend(A* instance, xml_writer& writer, IfcUtil::IfcBaseClass* parent=nullptr) {
 	if (instance->declaration().is(IfcSchema::IfcObjectDefinition::Class())) {
-		return descend(instance->template as<IfcSchema::IfcObjectDefinition>(), tree, parent);
+		return start_descend(instance->template as<IfcSchema::IfcObjectDefinition>(), writer, parent);
 	} else {
-		return format_entity_instance(instance, tree);
+		start_entity_instance(instance, writer);
+		return true;
+	}
+}
+
+template <typename A>
+void descend(A* instance, xml_writer& writer, IfcUtil::IfcBaseClass* parent=nullptr) {
+	if (start_descend(instance, writer, parent)) {
+		writer.end();
 	}
 }
 
@@ -236,16 +341,16 @@ typename V::list::ptr get_related(T* t, F f, G g) {
 // Descends into the tree by recursing into IfcRelContainedInSpatialStructure,
 // IfcRelDecomposes, IfcRelDefinesByType, IfcRelDefinesByProperties relations.
 template <>
-ptree* descend(IfcSchema::IfcObjectDefinition* product, ptree& tree, IfcUtil::IfcBaseClass* parent) {
+bool start_descend(IfcSchema::IfcObjectDefinition* product, xml_writer& writer, IfcUtil::IfcBaseClass* parent) {
 	if (product->declaration().is(IfcSchema::IfcElement::Class())) {
 		auto voids = product->as<IfcSchema::IfcElement>()->FillsVoids();
 		if (voids && voids->size() == 1 && (*voids->begin())->RelatingOpeningElement() != parent) {
 			// Fills are placed under their corresponding opening, return early to avoid duplication.
-			return nullptr;
+			return false;
 		}
 	}
 
-	ptree& child = *format_entity_instance(product, tree);
+	start_entity_instance(product, writer);
 
 	if (product->declaration().is(IfcSchema::IfcOpeningElement::Class())) {
 		IfcSchema::IfcOpeningElement* opening = product->as<IfcSchema::IfcOpeningElement>();
@@ -253,7 +358,7 @@ ptree* descend(IfcSchema::IfcObjectDefinition* product, ptree& tree, IfcUtil::If
 			opening, &IfcSchema::IfcOpeningElement::HasFillings, &IfcSchema::IfcRelFillsElement::RelatedBuildingElement);
 
 		for (IfcSchema::IfcElement::list::it it = fills->begin(); it != fills->end(); ++it) {
-			descend(*it, child, product);
+			descend(*it, writer, product);
 		}
 	}
 	
@@ -265,7 +370,7 @@ ptree* descend(IfcSchema::IfcObjectDefinition* product, ptree& tree, IfcUtil::If
 			(structure, &IfcSchema::IfcSpatialStructureElement::ContainsElements, &IfcSchema::IfcRelContainedInSpatialStructure::RelatedElements);
 	
 		for (IfcSchema::IfcObjectDefinition::list::it it = elements->begin(); it != elements->end(); ++it) {
-			descend(*it, child, product);
+			descend(*it, writer, product);
 		}
 	}
 
@@ -275,7 +380,7 @@ ptree* descend(IfcSchema::IfcObjectDefinition* product, ptree& tree, IfcUtil::If
             element, &IfcSchema::IfcElement::HasOpenings, &IfcSchema::IfcRelVoidsElement::RelatedOpeningElement);
 
         for (IfcSchema::IfcOpeningElement::list::it it = openings->begin(); it != openings->end(); ++it) {
-            descend(*it, child, product);
+            descend(*it, writer, product);
         }
     }
 
@@ -295,7 +400,7 @@ ptree* descend(IfcSchema::IfcObjectDefinition* product, ptree& tree, IfcUtil::If
 
 	for (IfcSchema::IfcObjectDefinition::list::it it = structures->begin(); it != structures->end(); ++it) {
 		IfcSchema::IfcObjectDefinition* ob = *it;
-		descend(ob, child, product);
+		descend(ob, writer, product);
 	}
 
 	if (product->declaration().is(IfcSchema::IfcObject::Class())) {
@@ -308,9 +413,9 @@ ptree* descend(IfcSchema::IfcObjectDefinition* product, ptree& tree, IfcUtil::If
 		for (IfcSchema::IfcPropertySetDefinition::list::it it = property_sets->begin(); it != property_sets->end(); ++it) {
 			IfcSchema::IfcPropertySetDefinition* pset = *it;
 			if (pset->declaration().is(IfcSchema::IfcPropertySet::Class())) {
-				format_entity_instance(pset, child, true);
+				format_entity_instance(pset, writer, true);
 			} else if (pset->declaration().is(IfcSchema::IfcElementQuantity::Class())) {
-				format_entity_instance(pset, child, true);
+				format_entity_instance(pset, writer, true);
 			}
 		}
 
@@ -326,7 +431,7 @@ ptree* descend(IfcSchema::IfcObjectDefinition* product, ptree& tree, IfcUtil::If
 
 		for (IfcSchema::IfcTypeObject::list::it it = types->begin(); it != types->end(); ++it) {
 			IfcSchema::IfcTypeObject* type = *it;
-			format_entity_instance(type, child, true);
+			format_entity_instance(type, writer, true);
 		}
 	}
 
@@ -335,40 +440,43 @@ ptree* descend(IfcSchema::IfcObjectDefinition* product, ptree& tree, IfcUtil::If
         for (std::map<std::string, IfcUtil::IfcBaseEntity*>::const_iterator it = layers.begin(); it != layers.end(); ++it) {
             // IfcPresentationLayerAssignments don't have GUIDs (only optional Identifier) so use name as the ID.
             // Note that the IfcPresentationLayerAssignment passed here doesn't really matter as as_link is true
-            // for the format_entity_instance() call.
-            ptree node;
-            node.put("<xmlattr>.xlink:href", "#" + it->first);
-            format_entity_instance(it->second, node, child, true);
+            // for the format_attributes() call.
+            writer.start(it->second->declaration().name());
+            writer.attribute("xlink:href", "#" + it->first);
+            format_attributes(it->second, writer, true);
+            writer.end();
         }
 		
 		IfcSchema::IfcRelAssociates::list::ptr associations = product->HasAssociations();
 		for (IfcSchema::IfcRelAssociates::list::it it = associations->begin(); it != associations->end(); ++it) {
 			if ((*it)->as<IfcSchema::IfcRelAssociatesMaterial>()) {
 				IfcSchema::IfcMaterialSelect* mat = (*it)->as<IfcSchema::IfcRelAssociatesMaterial>()->RelatingMaterial();
-				ptree node;
-				node.put("<xmlattr>.xlink:href", "#" + qualify_unrooted_instance(mat));
-				format_entity_instance(mat->as<IfcUtil::IfcBaseEntity>(), node, child, true);
+				IfcUtil::IfcBaseEntity* mat_entity = mat->as<IfcUtil::IfcBaseEntity>();
+				writer.start(mat_entity->declaration().name());
+				writer.attribute("xlink:href", "#" + qualify_unrooted_instance(mat));
+				format_attributes(mat_entity, writer, true);
+				writer.end();
 			}
 		}
     }
 
-	return &child;
+	return true;
 }
 
-// Format IfcProperty instances and insert into the DOM. IfcComplexProperties are flattened out.
-void format_properties(IfcSchema::IfcProperty::list::ptr properties, ptree& node) {
+// Format IfcProperty instances and write them as elements. IfcComplexProperties are flattened out.
+void format_properties(IfcSchema::IfcProperty::list::ptr properties, xml_writer& writer) {
 	for (IfcSchema::IfcProperty::list::it it = properties->begin(); it != properties->end(); ++it) {
 		IfcSchema::IfcProperty* p = *it;
 		if (p->declaration().is(IfcSchema::IfcComplexProperty::Class())) {
 			IfcSchema::IfcComplexProperty* complex = p->as<IfcSchema::IfcComplexProperty>();
-			format_properties(complex->HasProperties(), node);
+			format_properties(complex->HasProperties(), writer);
 		} else {
-			format_entity_instance(p, node);
+			format_entity_instance(p, writer);
 		}
 	}
 }
 
-void writeGroupToNode(IfcSchema::IfcGroup* group, ptree& node, std::set<std::string>notRootGroups) {
+void writeGroupToNode(IfcSchema::IfcGroup* group, xml_writer& writer, std::set<std::string>notRootGroups) {
 	// @todo tfk: instead of a set<string> shouldn't we just have a set<IfcGroup>, the current approach
 	// might not work with non-unique or NIL group names.
 
@@ -381,7 +489,9 @@ void writeGroupToNode(IfcSchema::IfcGroup* group, ptree& node, std::set<std::str
         return;
     }
     // Write one group to root
-    ptree* node2 = descend(group, node);
+    if (!start_descend(group, writer)) {
+        return;
+    }
     auto father = group->IsGroupedBy();
     for (auto iter = father->begin(); iter != father->end(); iter++)
     {
@@ -390,142 +500,142 @@ void writeGroupToNode(IfcSchema::IfcGroup* group, ptree& node, std::set<std::str
         for (auto objit = objs->begin(); objit != objs->end(); objit++) {
             auto entity = *objit;
             if (entity->declaration().is(IfcSchema::IfcGroup::Class()) && entity->Name()) {
-                writeGroupToNode(entity->as<IfcSchema::IfcGroup>(), *node2, notRootGroups);
+                writeGroupToNode(entity->as<IfcSchema::IfcGroup>(), writer, notRootGroups);
                 notRootGroups.emplace(*entity->Name());
             }
             else {
                 // Write child to father group
-                descend(entity, *node2);
+                descend(entity, writer);
             }
         }
     }
+    writer.end();
 }
 
-// Format IfcElementQuantity instances and insert into the DOM.
-void format_quantities(IfcSchema::IfcPhysicalQuantity::list::ptr quantities, ptree& node) {
+// Format IfcElementQuantity instances and write them as elements.
+void format_quantities(IfcSchema::IfcPhysicalQuantity::list::ptr quantities, xml_writer& writer) {
 	for (IfcSchema::IfcPhysicalQuantity::list::it it = quantities->begin(); it != quantities->end(); ++it) {
 		IfcSchema::IfcPhysicalQuantity* p = *it;
-		ptree* node2 = format_entity_instance(p, node);
-		if (node2 && p->declaration().is(IfcSchema::IfcPhysicalComplexQuantity::Class())) {
+		start_entity_instance(p, writer);
+		if (p->declaration().is(IfcSchema::IfcPhysicalComplexQuantity::Class())) {
 			IfcSchema::IfcPhysicalComplexQuantity* complex = p->as<IfcSchema::IfcPhysicalComplexQuantity>();
-			format_quantities(complex->HasQuantities(), *node2);
+			format_quantities(complex->HasQuantities(), writer);
 		}
+		writer.end();
 	}
 }
 
-// Format IfcTask instances and insert into the DOM.
-void format_tasks(IfcSchema::IfcTask* task, ptree& node) {
-	ptree* ntask = format_entity_instance(task, node);
+// Writes an element with only a reference to the id of an object.
+void format_reference(const std::string& name, IfcSchema::IfcRoot* object, xml_writer& writer) {
+	writer.start(name);
+	writer.attribute("id", object->GlobalId());
+	writer.end();
+}
+
+// Format IfcTask instances and write them as elements.
+void format_tasks(IfcSchema::IfcTask* task, xml_writer& writer) {
+	start_entity_instance(task, writer);
 
-	if (ntask) {
 #ifdef SCHEMA_IfcTask_HAS_TaskTime
-		IfcSchema::IfcTaskTime* task_time = task->TaskTime();
-		if (task_time)
-		{
-			format_entity_instance(task_time, *ntask);
-		}
+	IfcSchema::IfcTaskTime* task_time = task->TaskTime();
+	if (task_time)
+	{
+		format_entity_instance(task_time, writer);
+	}
 #endif
 
 #ifdef SCHEMA_IfcProcess_HAS_IsSuccessorFrom
-		IfcSchema::IfcRelSequence::list::ptr successor_from = task->IsSuccessorFrom();
-		for (IfcSchema::IfcRelSequence::list::it it = successor_from->begin(); it != successor_from->end(); ++it)
-		{
-			IfcSchema::IfcProcess* relating_process = (*it)->RelatingProcess();
-			ptree nobject;
-			nobject.put("<xmlattr>.id", relating_process->GlobalId());
-			ntask->add_child("IsSuccessorFrom", nobject);
-		}
+	IfcSchema::IfcRelSequence::list::ptr successor_from = task->IsSuccessorFrom();
+	for (IfcSchema::IfcRelSequence::list::it it = successor_from->begin(); it != successor_from->end(); ++it)
+	{
+		IfcSchema::IfcProcess* relating_process = (*it)->RelatingProcess();
+		format_reference("IsSuccessorFrom", relating_process, writer);
+	}
 #endif
 
 #ifdef SCHEMA_IfcProcess_HAS_IsPredecessorTo
-		IfcSchema::IfcRelSequence::list::ptr predecessor_to = task->IsPredecessorTo();
-		for (IfcSchema::IfcRelSequence::list::it it = predecessor_to->begin(); it != predecessor_to->end(); ++it)
-		{
-			IfcSchema::IfcProcess* relating_process = (*it)->RelatedProcess();
-			ptree nobject;
-			nobject.put("<xmlattr>.id", relating_process->GlobalId());
-			ntask->add_child("IsPredecessorTo", nobject);
-		}
+	IfcSchema::IfcRelSequence::list::ptr predecessor_to = task->IsPredecessorTo();
+	for (IfcSchema::IfcRelSequence::list::it it = predecessor_to->begin(); it != predecessor_to->end(); ++it)
+	{
+		IfcSchema::IfcProcess* relating_process = (*it)->RelatedProcess();
+		format_reference("IsPredecessorTo", relating_process, writer);
+	}
 #endif
 
-		IfcSchema::IfcPropertySetDefinition::list::ptr property_sets = get_related
-			<IfcSchema::IfcObject, IfcSchema::IfcRelDefinesByProperties, IfcSchema::IfcPropertySetDefinition>
-			(task, &IfcSchema::IfcObject::IsDefinedBy, &IfcSchema::IfcRelDefinesByProperties::RelatingPropertyDefinition);
+	IfcSchema::IfcPropertySetDefinition::list::ptr property_sets = get_related
+		<IfcSchema::IfcObject, IfcSchema::IfcRelDefinesByProperties, IfcSchema::IfcPropertySetDefinition>
+		(task, &IfcSchema::IfcObject::IsDefinedBy, &IfcSchema::IfcRelDefinesByProperties::RelatingPropertyDefinition);
 
-		for (IfcSchema::IfcPropertySetDefinition::list::it it = property_sets->begin(); it != property_sets->end(); ++it) {
-			IfcSchema::IfcPropertySetDefinition* pset = *it;
-			if (pset->declaration().is(IfcSchema::IfcPropertySet::Class())) {
-				format_entity_instance(pset, *ntask, true);
-			}
-			else if (pset->declaration().is(IfcSchema::IfcElementQuantity::Class())) {
-				format_entity_instance(pset, *ntask, true);
-			}
+	for (IfcSchema::IfcPropertySetDefinition::list::it it = property_sets->begin(); it != property_sets->end(); ++it) {
+		IfcSchema::IfcPropertySetDefinition* pset = *it;
+		if (pset->declaration().is(IfcSchema::IfcPropertySet::Class())) {
+			format_entity_instance(pset, writer, true);
+		}
+		else if (pset->declaration().is(IfcSchema::IfcElementQuantity::Class())) {
+			format_entity_instance(pset, writer, true);
 		}
+	}
 
 #ifdef SCHEMA_IfcProcess_HAS_OperatesOn
-		IfcSchema::IfcRelAssignsToProcess::list::ptr operates = task->OperatesOn();
-		if (operates->size() > 0)
+	IfcSchema::IfcRelAssignsToProcess::list::ptr operates = task->OperatesOn();
+	for (IfcSchema::IfcRelAssignsToProcess::list::it i = operates->begin(); i != operates->end(); ++i)
+	{
+		IfcSchema::IfcRelAssignsToProcess* operation = (*i);
+		IfcSchema::IfcObjectDefinition::list::ptr objects = operation->RelatedObjects();
+		for (IfcSchema::IfcObjectDefinition::list::it it2 = objects->begin(); it2 != objects->end(); ++it2)
 		{
-			for (IfcSchema::IfcRelAssignsToProcess::list::it i = operates->begin(); i != operates->end(); ++i)
+			IfcSchema::IfcObjectDefinition* object = *it2;
+			if (object->declaration().is(IfcSchema::IfcProduct::Class()))
 			{
-				IfcSchema::IfcRelAssignsToProcess* operation = (*i);
-				IfcSchema::IfcObjectDefinition::list::ptr objects = operation->RelatedObjects();
-				for (IfcSchema::IfcObjectDefinition::list::it it2 = objects->begin(); it2 != objects->end(); ++it2)
-				{
-					IfcSchema::IfcObjectDefinition* object = *it2;
-					ptree nobject;
-					nobject.put("<xmlattr>.id", object->GlobalId());
-					if (object->declaration().is(IfcSchema::IfcProduct::Class()))
-					{
-						ntask->add_child("Input", nobject);
-					}
-					else if (object->declaration().is(IfcSchema::IfcResource::Class()))
-					{
-						ntask->add_child("Resource", nobject);
-					}
-					else if (object->declaration().is(IfcSchema::IfcControl::Class()))
-					{
-						ntask->add_child("Control", nobject);
-					}
-					else
-					{
-						nobject.put("<xmlattr>.Type", object->declaration().name());
-						ntask->add_child("OperatesOn", nobject);
-					}
-				}
+				format_reference("Input", object, writer);
+			}
+			else if (object->declaration().is(IfcSchema::IfcResource::Class()))
+			{
+				format_reference("Resource", object, writer);
+			}
+			else if (object->declaration().is(IfcSchema::IfcControl::Class()))
+			{
+				format_reference("Control", object, writer);
+			}
+			else
+			{
+				writer.start("OperatesOn");
+				writer.attribute("id", object->GlobalId());
+				writer.attribute("Type", object->declaration().name());
+				writer.end();
 			}
 		}
+	}
 #endif
 
-		IfcSchema::IfcRelAssigns::list::ptr assignments = task->HasAssignments();
-		for (IfcSchema::IfcRelAssigns::list::it i = assignments->begin(); i != assignments->end(); ++i)
-		{
-			IfcSchema::IfcRelAssigns* assignment = *i;
-			if (assignment->declaration().is(IfcSchema::IfcRelAssignsToProduct::Class())) {
-				IfcSchema::IfcRelAssignsToProduct* assign_to_product = assignment->as<IfcSchema::IfcRelAssignsToProduct>();
-				IfcSchema::IfcProduct* product = assign_to_product->RelatingProduct()->as<IfcSchema::IfcProduct>();
-				ptree nobject;
-				nobject.put("<xmlattr>.id", product->GlobalId());
-				ntask->add_child("Output", nobject);
-			}
+	IfcSchema::IfcRelAssigns::list::ptr assignments = task->HasAssignments();
+	for (IfcSchema::IfcRelAssigns::list::it i = assignments->begin(); i != assignments->end(); ++i)
+	{
+		IfcSchema::IfcRelAssigns* assignment = *i;
+		if (assignment->declaration().is(IfcSchema::IfcRelAssignsToProduct::Class())) {
+			IfcSchema::IfcRelAssignsToProduct* assign_to_product = assignment->as<IfcSchema::IfcRelAssignsToProduct>();
+			IfcSchema::IfcProduct* product = assign_to_product->RelatingProduct()->as<IfcSchema::IfcProduct>();
+			format_reference("Output", product, writer);
 		}
+	}
 
 #ifdef SCHEMA_IfcObjectDefinition_HAS_IsNestedBy
-		IfcSchema::IfcRelNests::list::ptr nested_by = task->IsNestedBy();
-		for (IfcSchema::IfcRelNests::list::it it = nested_by->begin(); it != nested_by->end(); ++it)
+	IfcSchema::IfcRelNests::list::ptr nested_by = task->IsNestedBy();
+	for (IfcSchema::IfcRelNests::list::it it = nested_by->begin(); it != nested_by->end(); ++it)
+	{
+		IfcSchema::IfcObjectDefinition::list::ptr related_objects = (*it)->RelatedObjects();
+		for (IfcSchema::IfcObjectDefinition::list::it it2 = related_objects->begin(); it2 != related_objects->end(); ++it2)
 		{
-			IfcSchema::IfcObjectDefinition::list::ptr related_objects = (*it)->RelatedObjects();
-			for (IfcSchema::IfcObjectDefinition::list::it it2 = related_objects->begin(); it2 != related_objects->end(); ++it2)
-			{
-				if (!(*it2)->declaration().is(IfcSchema::IfcTask::Class())) {
-					continue;
-				}
-				IfcSchema::IfcTask* task2 = (*it2)->as<IfcSchema::IfcTask>();
-				format_tasks(task2, *ntask);
+			if (!(*it2)->declaration().is(IfcSchema::IfcTask::Class())) {
+				continue;
 			}
+			IfcSchema::IfcTask* task2 = (*it2)->as<IfcSchema::IfcTask>();
+			format_tasks(task2, writer);
 		}
-#endif
 	}
+#endif
+
+	writer.end();
 }
 
 } // ~unnamed namespace
@@ -540,7 +650,8 @@ void MAKE_TYPE_NAME(XmlSerializer)::finalize() {
 	}
 	IfcSchema::IfcProject* project = *projects->begin();
 
-	ptree root, header, units, decomposition, properties, quantities, types, layers, materials, work, calendars, connections, groups;
+	// The header is small and therefore still composed as a property tree.
+	ptree header;
 
 	// Write the SPF header as XML nodes.
 	BOOST_FOREACH(const std::string& s, file->header().file_description().description()) {
@@ -604,233 +715,254 @@ void MAKE_TYPE_NAME(XmlSerializer)::finalize() {
         Logger::Message(Logger::LOG_ERROR, ss.str());
     }
 
-	// Descend into the decomposition structure of the IFC file.
-	descend(project, decomposition);
+#if BOOST_VERSION >= 105600
+	boost::property_tree::xml_writer_settings<ptree::key_type> settings = boost::property_tree::xml_writer_make_settings<ptree::key_type>('\t', 1);
+#else
+	boost::property_tree::xml_writer_settings<char> settings('\t', 1);
+#endif
+	
+	// The document is written to the file while the model is traversed, in
+	// document order, so that its size is not limited by memory.
+	std::ofstream f(IfcUtil::path::from_utf8(xml_filename).c_str());
+	xml_writer writer(f);
 
-	// Write all property sets and values as XML nodes.
-	IfcSchema::IfcPropertySet::list::ptr psets = file->instances_by_type<IfcSchema::IfcPropertySet>();
-	for (IfcSchema::IfcPropertySet::list::it it = psets->begin(); it != psets->end(); ++it) {
-		IfcSchema::IfcPropertySet* pset = *it;
-		ptree* node = format_entity_instance(pset, properties);
-		if (node) {
-			format_properties(pset->HasProperties(), *node);
+	writer.start("ifc");
+	writer.attribute("xmlns:xlink", "http://www.w3.org/1999/xlink");
+
+	writer.write("header", header, settings);
+
+	// Write all assigned units as XML nodes.
+	writer.start("units");
+	aggregate_of_instance::ptr unit_assignments = project->UnitsInContext()->Units();
+	for (aggregate_of_instance::it it = unit_assignments->begin(); it != unit_assignments->end(); ++it) {
+		if ((*it)->declaration().is(IfcSchema::IfcNamedUnit::Class())) {
+			IfcSchema::IfcNamedUnit* named_unit = (*it)->as<IfcSchema::IfcNamedUnit>();
+			start_entity_instance(named_unit, writer);
+			util::text_buffer buffer(std::numeric_limits< double >::max_digits10);
+			buffer << IfcParse::get_SI_equivalent<IfcSchema>(named_unit);
+			writer.attribute("SI_equivalent", buffer.take());
+			writer.end();
+		} else if ((*it)->declaration().is(IfcSchema::IfcMonetaryUnit::Class())) {
+			format_entity_instance((*it)->as<IfcSchema::IfcMonetaryUnit>(), writer);
 		}
 	}
+	writer.end();
 
-	// Write all group sets and values as XML nodes.
-	IfcSchema::IfcGroup::list::ptr gsets = file->instances_by_type<IfcSchema::IfcGroup>();
-	std::set<std::string> notRootGroups; //selfname, fathername
-	for (IfcSchema::IfcGroup::list::it it = gsets->begin(); it != gsets->end(); ++it) {
-		writeGroupToNode(*it, groups, notRootGroups);
+	writer.start("connections");
+	IfcSchema::IfcRelConnectsElements::list::ptr pconnections = file->instances_by_type<IfcSchema::IfcRelConnectsElements>();
+	for (IfcSchema::IfcRelConnectsElements::list::it it = pconnections->begin(); it != pconnections->end(); ++it) {
+		IfcSchema::IfcRelConnectsElements* connection = *it;
+
+		start_entity_instance(connection, writer);
+
+		writer.start("RelatedElement");
+		format_entity_instance(connection->RelatedElement(), writer, true);
+		writer.end();
+
+		writer.start("RelatingElement");
+		format_entity_instance(connection->RelatingElement(), writer, true);
+		writer.end();
+
+		writer.end();
 	}
-	for (auto it = groups.begin(); it != groups.end();) {
-		if (notRootGroups.find(it->second.get<std::string>("<xmlattr>.Name")) != notRootGroups.end()) {
-			it = groups.erase(it);
-		} else {
-			it++;
-		}
+	writer.end();
+
+	// Write all property sets and values as XML nodes.
+	writer.start("properties");
+	IfcSchema::IfcPropertySet::list::ptr psets = file->instances_by_type<IfcSchema::IfcPropertySet>();
+	for (IfcSchema::IfcPropertySet::list::it it = psets->begin(); it != psets->end(); ++it) {
+		IfcSchema::IfcPropertySet* pset = *it;
+		start_entity_instance(pset, writer);
+		format_properties(pset->HasProperties(), writer);
+		writer.end();
 	}
+	writer.end();
 
 	// Write all quantities and values as XML nodes.
+	writer.start("quantities");
 	IfcSchema::IfcElementQuantity::list::ptr qtosets = file->instances_by_type<IfcSchema::IfcElementQuantity>();
 	for (IfcSchema::IfcElementQuantity::list::it it = qtosets->begin(); it != qtosets->end(); ++it) {
 		IfcSchema::IfcElementQuantity* qto = *it;
-		ptree* node = format_entity_instance(qto, quantities);
-		if (node) {
-			format_quantities(qto->Quantities(), *node);
-		}
+		start_entity_instance(qto, writer);
+		format_quantities(qto->Quantities(), writer);
+		writer.end();
 	}
+	writer.end();
+
+	writer.start("work");
 
 	// Write all work schedules and values as XML nodes.
-	ptree pwork_schedules;
+	writer.start("schedules");
 	IfcSchema::IfcWorkSchedule::list::ptr pschedules = file->instances_by_type<IfcSchema::IfcWorkSchedule>();
 	for (IfcSchema::IfcWorkSchedule::list::it it = pschedules->begin(); it != pschedules->end(); ++it) {
 		IfcSchema::IfcWorkSchedule* schedule = *it;
-		ptree* nschedule = format_entity_instance(schedule, pwork_schedules);
+		start_entity_instance(schedule, writer);
 		
-		if(nschedule) {
-			IfcSchema::IfcRelAssignsToControl::list::ptr controls = schedule->Controls();
-			for(IfcSchema::IfcRelAssignsToControl::list::it it2 = controls->begin(); it2 != controls->end(); ++it2) {
-				IfcSchema::IfcRelAssignsToControl* control = *it2;
+		IfcSchema::IfcRelAssignsToControl::list::ptr controls = schedule->Controls();
+		for(IfcSchema::IfcRelAssignsToControl::list::it it2 = controls->begin(); it2 != controls->end(); ++it2) {
+			IfcSchema::IfcRelAssignsToControl* control = *it2;
+			
+			IfcSchema::IfcObjectDefinition::list::ptr objects = control->RelatedObjects();
+			for(IfcSchema::IfcObjectDefinition::list::it it3 = objects->begin(); it3 != objects->end(); ++it3) {
+				IfcSchema::IfcObjectDefinition* object = *it3;
 				
-				IfcSchema::IfcObjectDefinition::list::ptr objects = control->RelatedObjects();
-				for(IfcSchema::IfcObjectDefinition::list::it it3 = objects->begin(); it3 != objects->end(); ++it3) {
-					IfcSchema::IfcObjectDefinition* object = *it3;
-					
-					if (object && object->declaration().is(IfcSchema::IfcTask::Class())) {
-						IfcSchema::IfcTask* task = object->as<IfcSchema::IfcTask>();
-						format_tasks(task, *nschedule);
-					}
+				if (object && object->declaration().is(IfcSchema::IfcTask::Class())) {
+					IfcSchema::IfcTask* task = object->as<IfcSchema::IfcTask>();
+					format_tasks(task, writer);
 				}
 			}
 		}
+
+		writer.end();
 	}
-	work.add_child("schedules", pwork_schedules);
+	writer.end();
 
 	// Write all work plans and values as XML nodes.
-	ptree pwork_plans;
+	writer.start("plans");
 	IfcSchema::IfcWorkPlan::list::ptr pplans = file->instances_by_type<IfcSchema::IfcWorkPlan>();
 	for (IfcSchema::IfcWorkPlan::list::it it = pplans->begin(); it != pplans->end(); ++it) {
 		IfcSchema::IfcWorkPlan* plan = *it;
-		ptree* nschedule = format_entity_instance(plan, pwork_plans);
+		start_entity_instance(plan, writer);
 
-		if (nschedule) {
 #ifdef SCHEMA_IfcObjectDefinition_HAS_IsDecomposedBy
-			auto decomposed_by = plan->IsDecomposedBy();
-			for (auto it2 = decomposed_by->begin(); it2 != decomposed_by->end(); ++it2)
+		auto decomposed_by = plan->IsDecomposedBy();
+		for (auto it2 = decomposed_by->begin(); it2 != decomposed_by->end(); ++it2)
+		{
+			IfcSchema::IfcObjectDefinition::list::ptr related_objects = (*it2)->RelatedObjects();
+			for (IfcSchema::IfcObjectDefinition::list::it it3 = related_objects->begin(); it3 != related_objects->end(); ++it3)
 			{
-				IfcSchema::IfcObjectDefinition::list::ptr related_objects = (*it2)->RelatedObjects();
-				for (IfcSchema::IfcObjectDefinition::list::it it3 = related_objects->begin(); it3 != related_objects->end(); ++it3)
-				{
-					IfcSchema::IfcObjectDefinition* work_schedule = *it3;
-					ptree pwork_schedule;
-					pwork_schedule.put("<xmlattr>.id", work_schedule->GlobalId());
-					nschedule->add_child("IfcWorkSchedule", pwork_schedule);
-				}
+				format_reference("IfcWorkSchedule", *it3, writer);
 			}
-#endif
 		}
+#endif
+
+		writer.end();
 	}
-	work.add_child("plans", pwork_plans);
+	writer.end();
+
+	writer.end();
 	
 	// Write all work calendars and values as XML nodes.
+	writer.start("calendars");
 #ifdef SCHEMA_HAS_IfcWorkCalendar
 	IfcSchema::IfcWorkCalendar::list::ptr pcalendars = file->instances_by_type<IfcSchema::IfcWorkCalendar>();
 	for (IfcSchema::IfcWorkCalendar::list::it it = pcalendars->begin(); it != pcalendars->end(); ++it) {
 		IfcSchema::IfcWorkCalendar* calendar = *it;
-		ptree* ncalendar = format_entity_instance(calendar, calendars);
+		start_entity_instance(calendar, writer);
 		
-		if (ncalendar) {
-			IfcSchema::IfcWorkTime::list::ptr working_times = calendar->WorkingTimes().value_or(nullptr);
-			if (working_times != nullptr) {
-				for (IfcSchema::IfcWorkTime::list::it it2 = working_times->begin(); it2 != working_times->end(); ++it2)
-				{
-					IfcSchema::IfcWorkTime* working_time = *it2;
-					format_entity_instance(working_time, *ncalendar);
-				}
+		IfcSchema::IfcWorkTime::list::ptr working_times = calendar->WorkingTimes().value_or(nullptr);
+		if (working_times != nullptr) {
+			for (IfcSchema::IfcWorkTime::list::it it2 = working_times->begin(); it2 != working_times->end(); ++it2)
+			{
+				IfcSchema::IfcWorkTime* working_time = *it2;
+				format_entity_instance(working_time, writer);
 			}
 		}
-	}
-#endif
-	
-	IfcSchema::IfcRelConnectsElements::list::ptr pconnections = file->instances_by_type<IfcSchema::IfcRelConnectsElements>();
-	for (IfcSchema::IfcRelConnectsElements::list::it it = pconnections->begin(); it != pconnections->end(); ++it) {
-		IfcSchema::IfcRelConnectsElements* connection = *it;
-
-		ptree* nconnection = format_entity_instance(connection, connections);
 
-		ptree nrelatedElement;
-		ptree nrelatingElement;
-
-		format_entity_instance(connection->RelatedElement(), nrelatedElement, true);
-		format_entity_instance(connection->RelatingElement(), nrelatingElement, true);
-		
-		nconnection->add_child("RelatedElement",  nrelatedElement);
-		nconnection->add_child("RelatingElement", nrelatingElement);
+		writer.end();
 	}
+#endif
+	writer.end();
 
 	// Write all type objects as XML nodes.
+	writer.start("types");
 	IfcSchema::IfcTypeObject::list::ptr type_objects = file->instances_by_type<IfcSchema::IfcTypeObject>();
 	for (IfcSchema::IfcTypeObject::list::it it = type_objects->begin(); it != type_objects->end(); ++it) {
 		IfcSchema::IfcTypeObject* type_object = *it;
-		ptree* node = descend(type_object, types);
+		if (!start_descend(type_object, writer)) {
+			continue;
+		}
 		
-		if (node && type_object->HasPropertySets()) {
+		if (type_object->HasPropertySets()) {
 			IfcSchema::IfcPropertySetDefinition::list::ptr property_sets = *type_object->HasPropertySets();
 			for (IfcSchema::IfcPropertySetDefinition::list::it jt = property_sets->begin(); jt != property_sets->end(); ++jt) {
 				IfcSchema::IfcPropertySetDefinition* pset = *jt;
 				if (pset->declaration().is(IfcSchema::IfcPropertySet::Class())) {
-					format_entity_instance(pset, *node, true);
+					format_entity_instance(pset, writer, true);
 				}
 			}
 		}
-	}
 
-	// Write all assigned units as XML nodes.
-	aggregate_of_instance::ptr unit_assignments = project->UnitsInContext()->Units();
-	for (aggregate_of_instance::it it = unit_assignments->begin(); it != unit_assignments->end(); ++it) {
-		if ((*it)->declaration().is(IfcSchema::IfcNamedUnit::Class())) {
-			IfcSchema::IfcNamedUnit* named_unit = (*it)->as<IfcSchema::IfcNamedUnit>();
-			ptree* node = format_entity_instance(named_unit, units);
-			if (node) {
-				node->put("<xmlattr>.SI_equivalent", IfcParse::get_SI_equivalent<IfcSchema>(named_unit));
-			}
-		} else if ((*it)->declaration().is(IfcSchema::IfcMonetaryUnit::Class())) {
-			format_entity_instance((*it)->as<IfcSchema::IfcMonetaryUnit>(), units);
-		}
+		writer.end();
 	}
+	writer.end();
 
     // Layer assignments. IfcPresentationLayerAssignments don't have GUIDs (only optional Identifier)
     // so use names as the IDs and only insert those with unique names. In case of possible duplicate names/IDs
     // the first IfcPresentationLayerAssignment occurrence takes precedence.
+    writer.start("layers");
     std::set<std::string> layer_names;
 	IfcSchema::IfcPresentationLayerAssignment::list::ptr layer_assignments = file->instances_by_type<IfcSchema::IfcPresentationLayerAssignment>();
     for (IfcSchema::IfcPresentationLayerAssignment::list::it it = layer_assignments->begin(); it != layer_assignments->end(); ++it) {
         const std::string& name = (*it)->Name();
         if (layer_names.find(name) == layer_names.end()) {
             layer_names.insert(name);
-            ptree node;
-            node.put("<xmlattr>.id", name);
-            format_entity_instance(*it, node, layers);
+            writer.start((*it)->declaration().name());
+            writer.attribute("id", name);
+            format_attributes(*it, writer);
+            writer.end();
         }
     }
+    writer.end();
 
+	// Write all group sets and values as XML nodes. Groups that are part of
+	// another group are written both nested in that group and at the root, as
+	// writeGroupToNode() only tracks the nested groups within a single subtree.
+	writer.start("groups");
+	IfcSchema::IfcGroup::list::ptr gsets = file->instances_by_type<IfcSchema::IfcGroup>();
+	std::set<std::string> notRootGroups; //selfname, fathername
+	for (IfcSchema::IfcGroup::list::it it = gsets->begin(); it != gsets->end(); ++it) {
+		writeGroupToNode(*it, writer, notRootGroups);
+	}
+	writer.end();
+
+	writer.start("materials");
 	IfcSchema::IfcRelAssociatesMaterial::list::ptr materal_associations = file->instances_by_type<IfcSchema::IfcRelAssociatesMaterial>();
 	std::set<IfcSchema::IfcMaterialSelect*> emitted_materials;
 	for (IfcSchema::IfcRelAssociatesMaterial::list::it it = materal_associations->begin(); it != materal_associations->end(); ++it) {
 		IfcSchema::IfcMaterialSelect* mat = (**it).RelatingMaterial();
 		if (emitted_materials.find(mat) == emitted_materials.end()) {
 			emitted_materials.insert(mat);
-			ptree node;
-			node.put("<xmlattr>.id", qualify_unrooted_instance(mat));
-			if (mat->as<IfcSchema::IfcMaterialLayerSetUsage>() || mat->as<IfcSchema::IfcMaterialLayerSet>()) {				
-				IfcSchema::IfcMaterialLayerSet* layerset = mat->as<IfcSchema::IfcMaterialLayerSet>();
+			IfcUtil::IfcBaseEntity* mat_entity = mat->as<IfcUtil::IfcBaseEntity>();
+			writer.start(mat_entity->declaration().name());
+			writer.attribute("id", qualify_unrooted_instance(mat));
+			IfcSchema::IfcMaterialLayerSet* layerset = nullptr;
+			if (mat->as<IfcSchema::IfcMaterialLayerSetUsage>() || mat->as<IfcSchema::IfcMaterialLayerSet>()) {
+				layerset = mat->as<IfcSchema::IfcMaterialLayerSet>();
 				if (!layerset) {
 					layerset = mat->as<IfcSchema::IfcMaterialLayerSetUsage>()->ForLayerSet();
-				}				
+				}
 				if (layerset->LayerSetName()) {
-					node.put("<xmlattr>.LayerSetName", *layerset->LayerSetName());
+					writer.attribute("LayerSetName", *layerset->LayerSetName());
 				}
+			}
+			// The attributes of the material itself are to be set before its children are started.
+			format_attributes(mat_entity, writer);
+			if (layerset) {
 				IfcSchema::IfcMaterialLayer::list::ptr ls = layerset->MaterialLayers();
 				for (IfcSchema::IfcMaterialLayer::list::it jt = ls->begin(); jt != ls->end(); ++jt) {
-					ptree subnode;
+					writer.start((*jt)->declaration().name());
 					if ((*jt)->Material()) {
-						subnode.put("<xmlattr>.Name", (*jt)->Material()->Name());
+						writer.attribute("Name", (*jt)->Material()->Name());
 					}
-					format_entity_instance(*jt, subnode, node);
+					format_attributes(*jt, writer);
+					writer.end();
 				}
 			} else if (mat->as<IfcSchema::IfcMaterialList>()) {
 				IfcSchema::IfcMaterial::list::ptr mats = mat->as<IfcSchema::IfcMaterialList>()->Materials();
 				for (IfcSchema::IfcMaterial::list::it jt = mats->begin(); jt != mats->end(); ++jt) {
-					ptree subnode;
-					format_entity_instance(*jt, subnode, node);
+					format_entity_instance(*jt, writer);
 				}
 			}
-			format_entity_instance(mat->as<IfcUtil::IfcBaseEntity>(), node, materials);
+			writer.end();
 		}
 	}
+	writer.end();
 
-	root.add_child("ifc.header",        header);
-	root.add_child("ifc.units",         units);
-	root.add_child("ifc.connections",   connections);
-	root.add_child("ifc.properties",    properties);
-	root.add_child("ifc.quantities",    quantities);
-	root.add_child("ifc.work",			work);
-	root.add_child("ifc.calendars",		calendars);
-	root.add_child("ifc.types",         types);
-	root.add_child("ifc.layers",        layers);
-    root.add_child("ifc.groups",        groups);
-	root.add_child("ifc.materials",     materials);
-	root.add_child("ifc.decomposition", decomposition);
-
-	root.put("ifc.<xmlattr>.xmlns:xlink", "http://www.w3.org/1999/xlink");
+	// Descend into the decomposition structure of the IFC file.
+	writer.start("decomposition");
+	descend(project, writer);
+	writer.end();
 
-#if BOOST_VERSION >= 105600
-	boost::property_tree::xml_writer_settings<ptree::key_type> settings = boost::property_tree::xml_writer_make_settings<ptree::key_type>('\t', 1);
-#else
-	boost::property_tree::xml_writer_settings<char> settings('\t', 1);
-#endif
-	
-	std::ofstream f(IfcUtil::path::from_utf8(xml_filename).c_str());
-	boost::property_tree::write_xml(f, root, settings);
+	writer.end();
 }
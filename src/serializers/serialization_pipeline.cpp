@@ -0,0 +1,152 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#include "serialization_pipeline.h"
+
+#include <stdexcept>
+
+serialization_pipeline::serialization_pipeline(GeometrySerializer& serializer, int num_threads, size_t max_pending)
+	: serializer_(serializer)
+	, max_pending_(max_pending)
+	, front_(0)
+	, next_(0)
+	, finished_(false)
+{
+	if (num_threads < 1) {
+		num_threads = 1;
+	}
+	for (int i = 0; i < num_threads; ++i) {
+		encoders_.emplace_back(&serialization_pipeline::encode_, this);
+	}
+	writer_ = std::thread(&serialization_pipeline::write_, this);
+}
+
+serialization_pipeline::~serialization_pipeline() {
+	{
+		std::lock_guard<std::mutex> lk(mutex_);
+		finished_ = true;
+		// Nothing more will be appended when the pipeline is destroyed without finish()
+		if (!error_) {
+			error_ = std::make_exception_ptr(std::runtime_error("Serialization pipeline aborted"));
+		}
+	}
+	work_available_.notify_all();
+	chunk_encoded_.notify_all();
+	slot_available_.notify_all();
+	for (auto& t : encoders_) {
+		if (t.joinable()) {
+			t.join();
+		}
+	}
+	if (writer_.joinable()) {
+		writer_.join();
+	}
+}
+
+void serialization_pipeline::push(const IfcGeom::TriangulationElement* o) {
+	std::unique_lock<std::mutex> lk(mutex_);
+	slot_available_.wait(lk, [this]() { return error_ || slots_.size() < max_pending_; });
+	if (error_) {
+		std::rethrow_exception(error_);
+	}
+	slots_.push_back(slot{ o, encoded_chunk(), false });
+	// Called under the lock, so that positions are assigned in the order of the elements
+	serializer_.reserve(o, slots_.back().chunk);
+	lk.unlock();
+	work_available_.notify_one();
+}
+
+void serialization_pipeline::finish() {
+	{
+		std::lock_guard<std::mutex> lk(mutex_);
+		finished_ = true;
+	}
+	work_available_.notify_all();
+	chunk_encoded_.notify_all();
+	for (auto& t : encoders_) {
+		t.join();
+	}
+	writer_.join();
+	if (error_) {
+		std::rethrow_exception(error_);
+	}
+}
+
+void serialization_pipeline::fail_(std::exception_ptr e) {
+	{
+		std::lock_guard<std::mutex> lk(mutex_);
+		if (!error_) {
+			error_ = e;
+		}
+	}
+	work_available_.notify_all();
+	chunk_encoded_.notify_all();
+	slot_available_.notify_all();
+}
+
+void serialization_pipeline::encode_() {
+	while (true) {
+		slot* s;
+		{
+			std::unique_lock<std::mutex> lk(mutex_);
+			work_available_.wait(lk, [this]() { return error_ || finished_ || next_ < front_ + slots_.size(); });
+			if (error_ || next_ == front_ + slots_.size()) {
+				return;
+			}
+			s = &slots_[next_++ - front_];
+		}
+		try {
+			serializer_.encode(s->element, s->chunk);
+		} catch (...) {
+			fail_(std::current_exception());
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			s->encoded = true;
+		}
+		chunk_encoded_.notify_all();
+	}
+}
+
+void serialization_pipeline::write_() {
+	while (true) {
+		slot* s;
+		{
+			std::unique_lock<std::mutex> lk(mutex_);
+			chunk_encoded_.wait(lk, [this]() { return error_ || (!slots_.empty() && slots_.front().encoded) || (finished_ && slots_.empty()); });
+			if (error_ || slots_.empty()) {
+				return;
+			}
+			s = &slots_.front();
+		}
+		try {
+			serializer_.append(s->element, s->chunk);
+		} catch (...) {
+			fail_(std::current_exception());
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			slots_.pop_front();
+			++front_;
+		}
+		slot_available_.notify_one();
+	}
+}
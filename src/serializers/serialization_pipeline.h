@@ -0,0 +1,78 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#ifndef SERIALIZATION_PIPELINE_H
+#define SERIALIZATION_PIPELINE_H
+
+#include "../serializers/serializers_api.h"
+#include "../ifcgeom_schema_agnostic/GeometrySerializer.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Formats elements on a pool of threads using GeometrySerializer::encode() and
+/// appends the encoded chunks to the output on a single writer thread, in the
+/// order in which the elements were pushed. The serializer needs to support
+/// encoding. Elements need to stay alive until they are appended, which is the
+/// case for the elements returned by a multithreaded IfcGeom::Iterator.
+class SERIALIZERS_API serialization_pipeline {
+public:
+	/// At most max_pending elements are buffered, push() blocks when this limit is reached.
+	serialization_pipeline(GeometrySerializer& serializer, int num_threads, size_t max_pending = 256);
+	~serialization_pipeline();
+
+	/// Assigns the element its position in the output and queues it for encoding.
+	/// Rethrows exceptions from encoding or appending earlier elements.
+	void push(const IfcGeom::TriangulationElement* o);
+
+	/// Waits until all elements are appended and stops the threads.
+	void finish();
+
+private:
+	struct slot {
+		const IfcGeom::TriangulationElement* element;
+		encoded_chunk chunk;
+		bool encoded;
+	};
+
+	GeometrySerializer& serializer_;
+	size_t max_pending_;
+
+	std::mutex mutex_;
+	std::condition_variable work_available_, chunk_encoded_, slot_available_;
+	// References to slots remain valid while elements are added and removed at the ends
+	std::deque<slot> slots_;
+	// Sequence numbers of the first slot and the next slot to be encoded
+	size_t front_, next_;
+	bool finished_;
+	std::exception_ptr error_;
+
+	std::vector<std::thread> encoders_;
+	std::thread writer_;
+
+	void encode_();
+	void write_();
+	void fail_(std::exception_ptr);
+};
+
+#endif
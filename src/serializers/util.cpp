@@ -19,6 +19,10 @@
 
 #include <set>
 #include <iostream>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cctype>
 
 #include "../serializers/util.h"
 
@@ -41,3 +45,82 @@ std::string string_buffer::str() const {
 	}
 	return ss.str();
 }
+
+namespace {
+	void append_unsigned(std::string& buffer, uint64_t v) {
+		char digits[24];
+		char* end = digits + sizeof(digits);
+		char* begin = end;
+		do {
+			*--begin = (char) ('0' + v % 10);
+			v /= 10;
+		} while (v);
+		buffer.append(begin, end);
+	}
+}
+
+text_buffer& text_buffer::operator<<(double d) {
+	// Precision as interpreted by printf's %g conversion, which is how streams
+	// format floating point numbers in the default floatfield.
+	const int precision = precision_ < 0 ? 6 : precision_ == 0 ? 1 : precision_;
+
+	// Integral values with at most as many digits as the precision are printed
+	// by %g without decimals or exponent. These are common (e.g. 0 and 1 in
+	// normals) and formatted as integers, i.e. exactly, without printf.
+	static const double powers_of_ten[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+	const double limit = powers_of_ten[precision < 15 ? precision : 15];
+	if (std::floor(d) == d && std::fabs(d) < limit) {
+		if (std::signbit(d)) {
+			buffer_ += '-';
+		}
+		append_unsigned(buffer_, (uint64_t) std::fabs(d));
+		return *this;
+	}
+
+	const size_t offset = buffer_.size();
+	size_t available = 32;
+	for (;;) {
+		buffer_.resize(offset + available);
+		const int n = snprintf(&buffer_[offset], available, "%.*g", precision, d);
+		if (n < 0) {
+			buffer_.resize(offset);
+			break;
+		}
+		if ((size_t) n < available) {
+			buffer_.resize(offset + n);
+			break;
+		}
+		available = (size_t) n + 1;
+	}
+
+	// printf formats the decimal point according to LC_NUMERIC, whereas streams
+	// use the classic locale unless imbued otherwise. The decimal point, which
+	// can be a multibyte sequence, is what follows the leading digits.
+	size_t i = offset;
+	if (i < buffer_.size() && buffer_[i] == '-') {
+		++i;
+	}
+	const size_t digits = i;
+	while (i < buffer_.size() && std::isdigit((unsigned char) buffer_[i])) {
+		++i;
+	}
+	if (i > digits && i < buffer_.size() && buffer_[i] != '.' && buffer_[i] != 'e') {
+		size_t j = i + 1;
+		while (j < buffer_.size() && !std::isdigit((unsigned char) buffer_[j])) {
+			++j;
+		}
+		buffer_[i] = '.';
+		buffer_.erase(i + 1, j - i - 1);
+	}
+	return *this;
+}
+
+text_buffer& text_buffer::operator<<(int i) {
+	if (i < 0) {
+		buffer_ += '-';
+		append_unsigned(buffer_, (uint64_t) -(int64_t) i);
+	} else {
+		append_unsigned(buffer_, (uint64_t) i);
+	}
+	return *this;
+}
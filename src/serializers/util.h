@@ -20,7 +20,9 @@
 #ifndef IFCCONVERT_UTIL_H
 #define IFCCONVERT_UTIL_H
 
+#include <ostream>
 #include <sstream>
+#include <string>
 #include <vector>
 
 #include <boost/shared_ptr.hpp>
@@ -62,6 +64,38 @@ namespace util {
 		boost::shared_ptr<float_item> add(const double& d);
 		std::string str() const;
 	};
+
+	/// Character buffer for text output that formats floating point numbers
+	/// identically to a std::ostream with std::setprecision(precision), but
+	/// without the overhead of iostreams. The buffer is meant to be reused and
+	/// flushed to the output stream once per element.
+	class text_buffer {
+		std::string buffer_;
+		int precision_;
+	public:
+		/// A negative precision results in the default precision of streams, 6.
+		explicit text_buffer(int precision = 6) : precision_(precision) {}
+
+		text_buffer& operator<<(double d);
+		text_buffer& operator<<(int i);
+		text_buffer& operator<<(char c) { buffer_ += c; return *this; }
+		text_buffer& operator<<(const char* s) { buffer_ += s; return *this; }
+		text_buffer& operator<<(const std::string& s) { buffer_ += s; return *this; }
+
+		int precision() const { return precision_; }
+		void precision(int p) { precision_ = p; }
+
+		const char* data() const { return buffer_.data(); }
+		size_t size() const { return buffer_.size(); }
+		bool empty() const { return buffer_.empty(); }
+		const std::string& str() const { return buffer_; }
+		/// Clears the contents and retains the allocated memory.
+		void clear() { buffer_.clear(); }
+		/// Moves the contents out of the buffer.
+		std::string take() { std::string s; s.swap(buffer_); return s; }
+		/// Writes the contents to the stream and clears the buffer.
+		void flush(std::ostream& os) { os.write(buffer_.data(), buffer_.size()); buffer_.clear(); }
+	};
 }
 
 #endif